@@ -0,0 +1,340 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <ctime>
+#include <algorithm>
+#include <string>
+
+#include "mos6502.h"
+#include "Bus.h"
+#include "Mapper.h"
+#include "BlockCache.h"
+#include "Jit.h"
+#include "ExecStats.h"
+#include "Pacer.h"
+
+//
+// Headless throughput benchmark: loads a ROM image, runs the CPU for a fixed cycle budget
+// or until a stop condition is met and reports emulation speed as JSON
+//
+
+class BenchBus final : public BusT<BenchBus>
+{
+public:
+	void TickHandler() override
+	{
+		// no devices attached - measure the bare CPU + bus stepping
+	}
+};
+
+struct BenchOptions
+{
+	const char* rom = nullptr;
+	uint16_t load = 0xC000;     // ROM load address
+	bool start_set = false;     // start at 'start' instead of the reset vector
+	uint16_t start = 0;
+	uint64_t cycles = 100000000;// cycle budget
+	bool until_set = false;     // stop as soon as PC reaches 'until'
+	uint16_t until = 0;
+	bool trap = true;           // stop on a trap loop (instruction jumping to itself)
+	Core core = Core::Cycle;
+	MapperConfig mapper;        // banked image instead of a flat load
+	bool jit_verify = false;    // cross-check recompiled code against the interpreter
+	const char* trace = nullptr;// bus trace file (cycle cores)
+	const char* stats = nullptr;// execution statistics: json, table (MOS6502_STATS builds)
+	double clock = 0;           // pace to this clock (Pacer.h) instead of running flat out
+};
+
+static void usage()
+{
+	std::cerr <<
+		"usage: benchCPU <rom> [options]\n"
+		"  --load ADDR      load address of the image (hex, default C000)\n"
+		"  --start ADDR     start execution at ADDR instead of the reset vector (hex)\n"
+		"  --cycles N       cycle budget (default 100000000)\n"
+		"  --until-pc ADDR  stop when PC reaches ADDR (hex)\n"
+		"  --no-trap        don't stop on trap loops\n"
+		"  --core NAME      CPU core: cycle (default), mc, instr, block, jit\n"
+		"  --jit-verify     cross-check the jit core against the interpreter\n"
+		"  --trace FILE     record the bus pins of every cycle (cycle, mc cores)\n"
+		"  --stats FORMAT   execution statistics to stderr: json, table (needs a MOS6502_STATS build)\n"
+		"  --clock HZ       run paced to a clock: 1mhz, ntsc, pal or Hz (reports how late batches started)\n"
+		"  --mapper NAME    banked image: rom, romfixed (the image holds the banks, --load is ignored),\n"
+		"                   ram (RAM banks, the image is loaded at --load)\n"
+		"  --window PAGE    first page of the bank window (hex, default 80)\n"
+		"  --window-pages N bank window size in pages (hex, default 40)\n"
+		"  --control ADDR   bank select register (hex, default 7000, outside the window)\n";
+}
+
+static bool parseArgs(int argc, char** argv, BenchOptions& opt)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string a = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (a == "--load" && has_value)
+			opt.load = (uint16_t)std::strtoul(argv[++i], nullptr, 16);
+		else if (a == "--start" && has_value)
+		{
+			opt.start = (uint16_t)std::strtoul(argv[++i], nullptr, 16);
+			opt.start_set = true;
+		}
+		else if (a == "--cycles" && has_value)
+			opt.cycles = std::strtoull(argv[++i], nullptr, 10);
+		else if (a == "--until-pc" && has_value)
+		{
+			opt.until = (uint16_t)std::strtoul(argv[++i], nullptr, 16);
+			opt.until_set = true;
+		}
+		else if (a == "--no-trap")
+			opt.trap = false;
+		else if (a == "--core" && has_value)
+		{
+			std::string c = argv[++i];
+			if (c == "cycle")
+				opt.core = Core::Cycle;
+			else if (c == "mc")
+				opt.core = Core::Microcode;
+			else if (c == "instr")
+				opt.core = Core::Instruction;
+			else if (c == "block")
+				opt.core = Core::Block;
+			else if (c == "jit")
+				opt.core = Core::Jit;
+			else
+				return false;
+		}
+		else if (a == "--jit-verify")
+			opt.jit_verify = true;
+		else if (a == "--trace" && has_value)
+			opt.trace = argv[++i];
+		else if (a == "--stats" && has_value)
+		{
+			opt.stats = argv[++i];
+			if (std::strcmp(opt.stats, "json") && std::strcmp(opt.stats, "table"))
+				return false;
+		}
+		else if (a == "--clock" && has_value)
+		{
+			if (!Pacer::ParseClock(argv[++i], opt.clock))
+				return false;
+		}
+		else if (a == "--mapper" && has_value)
+		{
+			std::string m = argv[++i];
+			if (m == "rom")
+				opt.mapper.type = MapperType::RomWindow;
+			else if (m == "romfixed")
+				opt.mapper.type = MapperType::RomWindowFixedLast;
+			else if (m == "ram")
+				opt.mapper.type = MapperType::RamWindow;
+			else
+				return false;
+		}
+		else if (a == "--window" && has_value)
+			opt.mapper.window = (uint8_t)std::strtoul(argv[++i], nullptr, 16);
+		else if (a == "--window-pages" && has_value)
+			opt.mapper.pages = (uint8_t)std::strtoul(argv[++i], nullptr, 16);
+		else if (a == "--control" && has_value)
+			opt.mapper.control = (uint16_t)std::strtoul(argv[++i], nullptr, 16);
+		else if (a[0] != '-' && !opt.rom)
+			opt.rom = argv[i];
+		else
+			return false;
+	}
+	return opt.rom != nullptr;
+}
+
+static const char* coreName(Core core)
+{
+	switch (core)
+	{
+	case Core::Microcode: return "mc";
+	case Core::Instruction: return "instr";
+	case Core::Block: return "block";
+	case Core::Jit: return "jit";
+	default: return "cycle";
+	}
+}
+
+static std::string jsonString(const char* s)
+{
+	std::string r = "\"";
+	for (; *s; s++)
+	{
+		if (*s == '"' || *s == '\\')
+			r += '\\';
+		r += *s;
+	}
+	return r + "\"";
+}
+
+static BenchBus bus;
+
+int main(int argc, char** argv)
+{
+	BenchOptions opt;
+	if (!parseArgs(argc, argv, opt))
+	{
+		usage();
+		return 1;
+	}
+
+	std::string error;
+	if (opt.mapper.type != MapperType::None && !Mapper::Check(opt.mapper, error))
+	{
+		std::cerr << "--mapper: " << error << std::endl;
+		return 1;
+	}
+	bool banked_rom = opt.mapper.type == MapperType::RomWindow || opt.mapper.type == MapperType::RomWindowFixedLast;
+	if (opt.mapper.type == MapperType::RamWindow)
+		bus.SetMapper(opt.mapper);
+
+	if (banked_rom ? !bus.ReadFromFile(opt.rom, opt.mapper) : !bus.ReadFromFile(opt.rom, opt.load))
+	{
+		std::cerr << "can't read " << opt.rom << std::endl;
+		return 1;
+	}
+
+	bus.core = opt.core;
+	if (opt.core == Core::Jit)
+		bus.GetJit().SetVerify(opt.jit_verify);
+
+	// run the reset sequence outside of the measured loop
+	bus.pins = bus.CPU.reset();
+	while (bus.pins.RES)
+		bus.CPU_Step();
+	if (opt.start_set)
+		bus.pins = bus.CPU.forceJumpTo(opt.start);
+
+	TraceWriter trace;
+	if (opt.trace)
+	{
+		if (!trace.Open(opt.trace))
+		{
+			std::cerr << trace.Error() << std::endl;
+			return 1;
+		}
+		bus.SetTrace(&trace);
+	}
+
+	ExecStats stats;
+	if (opt.stats)
+	{
+		if (!ExecStats::Enabled)
+		{
+			std::cerr << "--stats needs a build with MOS6502_STATS defined" << std::endl;
+			return 1;
+		}
+		bus.CPU.setStats(&stats);
+	}
+
+	const char* stop = "cycles";
+	uint64_t instructions = 0;
+	uint64_t ticks_start = bus.CPU.readTicksTotal();
+	uint16_t last_pc = bus.CPU.readPC();
+
+	auto t0 = std::chrono::steady_clock::now();
+
+	// checked at every instruction boundary (every block for the block/jit cores), PC points to the next instruction
+	bool blocks = opt.core == Core::Block || opt.core == Core::Jit;
+	uint64_t last_instructions = 0;
+	uint64_t last_ticks = ticks_start;
+	auto check_stop = [&](BenchBus& b)
+	{
+		// RDY held: the core came back without running anything, no instruction and no trap
+		uint64_t ticks = b.CPU.readTicksTotal();
+		if (ticks == last_ticks)
+			return false;
+		last_ticks = ticks;
+		uint16_t pc = b.CPU.readPC();
+		instructions = blocks ? b.GetBlockCache().instructions : instructions + 1;
+		if (opt.until_set && pc == opt.until)
+		{
+			stop = "pc";
+			return true;
+		}
+		// a loop of several instructions in one block comes back to the same PC too
+		if (opt.trap && pc == last_pc && instructions - last_instructions == 1)
+		{
+			stop = "trap";
+			return true;
+		}
+		last_pc = pc;
+		last_instructions = instructions;
+		return false;
+	};
+
+	Pacer pacer(PaceMode::Paced, opt.clock ? opt.clock : Pacer::Clock1MHz);
+	std::clock_t cpu0 = std::clock();
+	if (opt.clock)
+	{
+		// batches of 1 ms, sleeping in between
+		for (uint64_t done = 0; done < opt.cycles && !std::strcmp(stop, "cycles");)
+		{
+			uint64_t n = bus.RunUntil(check_stop, std::min(pacer.Next(), opt.cycles - done));
+			pacer.Done(n);
+			done += n;
+		}
+	}
+	else
+		bus.RunUntil(check_stop, opt.cycles);
+
+	if (blocks)
+		instructions = bus.GetBlockCache().instructions;
+
+	// the pending chunks are part of the cost
+	bus.SetTrace(nullptr);
+	if (opt.trace && !trace.Close())
+	{
+		std::cerr << trace.Error() << std::endl;
+		return 1;
+	}
+
+	auto t1 = std::chrono::steady_clock::now();
+
+	if (opt.stats)
+	{
+		// detaching counts the last instruction of the cycle cores
+		bus.CPU.setStats(nullptr);
+		std::cerr << (std::strcmp(opt.stats, "json") ? stats.Table() : stats.Json());
+	}
+
+	uint64_t cycles = bus.CPU.readTicksTotal() - ticks_start;
+	double seconds = std::chrono::duration<double>(t1 - t0).count();
+	double cps = seconds > 0 ? cycles / seconds : 0.0;
+	double ips = seconds > 0 ? instructions / seconds : 0.0;
+
+	std::printf("{\n");
+	std::printf("  \"rom\": %s,\n", jsonString(opt.rom).c_str());
+	std::printf("  \"core\": \"%s\",\n", coreName(opt.core));
+	std::printf("  \"stop\": \"%s\",\n", stop);
+	std::printf("  \"pc\": %u,\n", (unsigned)bus.CPU.readPC());
+	std::printf("  \"cycles\": %llu,\n", (unsigned long long)cycles);
+	std::printf("  \"instructions\": %llu,\n", (unsigned long long)instructions);
+	std::printf("  \"seconds\": %.6f,\n", seconds);
+	std::printf("  \"cycles_per_sec\": %.0f,\n", cps);
+	std::printf("  \"instructions_per_sec\": %.0f,\n", ips);
+	if (opt.trace)
+		std::printf("  \"trace_cycles\": %llu,\n", (unsigned long long)trace.Cycles());
+	if (opt.core == Core::Jit)
+	{
+		const Jit::Stats& js = bus.GetJit().GetStats();
+		std::printf("  \"jit_blocks\": %llu,\n", (unsigned long long)js.compiled);
+		std::printf("  \"jit_mismatches\": %llu,\n", (unsigned long long)js.mismatches);
+	}
+	if (opt.clock)
+	{
+		std::printf("  \"clock\": %.0f,\n", opt.clock);
+		std::printf("  \"max_late_ms\": %.3f,\n", pacer.MaxLate() * 1000);
+		std::printf("  \"cpu_seconds\": %.6f,\n", (double)(std::clock() - cpu0) / CLOCKS_PER_SEC);
+	}
+	std::printf("  \"mhz\": %.3f\n", cps / 1e6);
+	std::printf("}\n");
+
+	return 0;
+}
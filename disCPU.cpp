@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "mos6502.h"
+#include "Bus.h"
+#include "Loader.h"
+#include "Disassembly.h"
+#include "Profiler.h"
+
+//
+// Listing of an image (Disassembly.h): follows the flow from the vectors by default, data bytes come out
+// as .byte lines; --linear for the plain sweep
+//
+
+class DisBus final : public BusT<DisBus>
+{
+public:
+	void TickHandler() override {}
+};
+
+struct DisOptions
+{
+	const char* rom = nullptr;
+	ImageFormat format = ImageFormat::Auto;
+	uint16_t load = 0xC000;     // Raw images
+	std::vector<uint16_t> seeds;
+	unsigned threads = 0;       // one per core
+	bool linear = false;
+	const char* symbols = nullptr;
+};
+
+static void usage()
+{
+	std::cerr <<
+		"usage: disCPU <rom> [options]\n"
+		"  --format NAME    image format: auto (default), raw, prg, hex, srec\n"
+		"  --load ADDR      load address of raw images (hex, default C000)\n"
+		"  --seed ADDR      code entry point besides the vectors (hex, repeatable)\n"
+		"  --threads N      threads following the flow (default one per core)\n"
+		"  --linear         sweep the image linearly instead of following the flow\n"
+		"  --symbols FILE   labels: VICE label file (ld65 -Ln), 'name = $ADDR' or 'ADDR name' lines\n";
+}
+
+static bool parseArgs(int argc, char** argv, DisOptions& opt)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string a = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (a == "--format" && has_value)
+		{
+			std::string f = argv[++i];
+			if (f == "auto")
+				opt.format = ImageFormat::Auto;
+			else if (f == "raw")
+				opt.format = ImageFormat::Raw;
+			else if (f == "prg")
+				opt.format = ImageFormat::Prg;
+			else if (f == "hex")
+				opt.format = ImageFormat::IntelHex;
+			else if (f == "srec")
+				opt.format = ImageFormat::SRecord;
+			else
+				return false;
+		}
+		else if (a == "--load" && has_value)
+			opt.load = (uint16_t)std::strtoul(argv[++i], nullptr, 16);
+		else if (a == "--seed" && has_value)
+			opt.seeds.push_back((uint16_t)std::strtoul(argv[++i], nullptr, 16));
+		else if (a == "--threads" && has_value)
+			opt.threads = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+		else if (a == "--linear")
+			opt.linear = true;
+		else if (a == "--symbols" && has_value)
+			opt.symbols = argv[++i];
+		else if (a[0] != '-' && !opt.rom)
+			opt.rom = argv[i];
+		else
+			return false;
+	}
+	return opt.rom != nullptr;
+}
+
+static DisBus bus;
+
+int main(int argc, char** argv)
+{
+	DisOptions opt;
+	if (!parseArgs(argc, argv, opt))
+	{
+		usage();
+		return 1;
+	}
+
+	Image image;
+	if (!image.Open(opt.rom, opt.format, opt.load))
+	{
+		std::cerr << image.Error() << "\n";
+		return 1;
+	}
+	Symbols symbols;
+	if (opt.symbols && !symbols.Load(opt.symbols))
+	{
+		std::cerr << symbols.Error() << "\n";
+		return 1;
+	}
+	bus.Load(image);
+	if (image.HasStart())
+		opt.seeds.push_back(image.Start());
+
+	Disassembly code(bus);
+	auto t0 = std::chrono::steady_clock::now();
+	if (opt.linear)
+	{
+		// one sweep over everything the image covers
+		uint32_t first = 0xFFFF, last = 0;
+		for (const ImageSegment& s : image.Segments())
+		{
+			first = std::min<uint32_t>(first, s.addr);
+			last = std::max<uint32_t>(last, s.addr + s.size - 1);
+		}
+		if (first <= last)
+			code.Build((uint16_t)first, (uint16_t)last);
+	}
+	else
+		code.Trace(opt.seeds, opt.threads);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+	unsigned instructions = 0, code_bytes = 0, data_bytes = 0;
+	for (const ImageSegment& s : image.Segments())
+	{
+		uint32_t end = s.addr + s.size;
+		for (uint32_t a = s.addr; a < end;)
+		{
+			uint16_t addr = (uint16_t)a;
+			if (symbols.Has(addr))
+				std::printf("%s:\n", symbols.Name(addr).c_str());
+			if (code.IsInstruction(addr))
+			{
+				instructions++;
+				code_bytes += code.Length(addr);
+				std::printf("%s\n", code.Text(addr).c_str());
+				a += code.Length(addr);
+				continue;
+			}
+			// runs of data, 8 bytes a line, broken at labels and instructions
+			std::string line = code.Text(addr);
+			if (line.empty())
+				line = Disassembly::Line(bus, addr);
+			uint32_t n = 1;
+			if (code.IsData(addr))
+			{
+				for (; n < 8 && a + n < end && code.IsData((uint16_t)(a + n)) && !symbols.Has((uint16_t)(a + n)); n++)
+				{
+					char b[8];
+					std::snprintf(b, sizeof(b), ", $%02X", code.Opcode((uint16_t)(a + n)));
+					line += b;
+				}
+				data_bytes += n;
+			}
+			std::printf("%s\n", line.c_str());
+			a += n;
+		}
+	}
+	std::fprintf(stderr, "%u instructions, %u code bytes, %u data bytes, %.3f ms\n", instructions, code_bytes,
+		data_bytes, ms);
+	return 0;
+}
@@ -0,0 +1,207 @@
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "Fleet.h"
+
+//
+// Runs a batch of independent ROM jobs on the fleet runner and reports per job results as JSON
+//
+
+struct FleetOptions
+{
+	std::vector<std::string> roms;
+	const char* list = nullptr; // file with one ROM path per line
+	unsigned repeat = 1;        // run every ROM that many times
+	ImageFormat format = ImageFormat::Auto;
+	FleetJob job;               // settings shared by all jobs
+	Fleet::Options fleet;
+};
+
+static void usage()
+{
+	std::cerr <<
+		"usage: fleetCPU [options] <rom>...\n"
+		"  --jobs FILE      read ROM paths from FILE, one per line\n"
+		"  --repeat N       run every ROM N times (default 1)\n"
+		"  --threads N      worker threads (default: one per hardware thread)\n"
+		"  --pin            pin worker threads to CPUs\n"
+		"  --load ADDR      load address of raw images (hex, default C000)\n"
+		"  --format NAME    image format: auto (default), raw, prg, hex, srec\n"
+		"  --rom            map the images read-only instead of copying them\n"
+		"  --start ADDR     start execution at ADDR instead of the reset vector (hex)\n"
+		"  --cycles N       cycle budget per job (default 100000000)\n"
+		"  --until-pc ADDR  stop when PC reaches ADDR (hex)\n"
+		"  --no-trap        don't stop on trap loops\n"
+		"  --core NAME      CPU core: cycle, mc, instr, block (default), jit\n";
+}
+
+static bool parseArgs(int argc, char** argv, FleetOptions& opt)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string a = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (a == "--jobs" && has_value)
+			opt.list = argv[++i];
+		else if (a == "--repeat" && has_value)
+			opt.repeat = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+		else if (a == "--threads" && has_value)
+			opt.fleet.threads = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+		else if (a == "--pin")
+			opt.fleet.pin_threads = true;
+		else if (a == "--load" && has_value)
+			opt.job.load = (uint16_t)std::strtoul(argv[++i], nullptr, 16);
+		else if (a == "--format" && has_value)
+		{
+			std::string f = argv[++i];
+			if (f == "auto")
+				opt.format = ImageFormat::Auto;
+			else if (f == "raw")
+				opt.format = ImageFormat::Raw;
+			else if (f == "prg")
+				opt.format = ImageFormat::Prg;
+			else if (f == "hex")
+				opt.format = ImageFormat::IntelHex;
+			else if (f == "srec")
+				opt.format = ImageFormat::SRecord;
+			else
+				return false;
+		}
+		else if (a == "--rom")
+			opt.job.readonly = true;
+		else if (a == "--start" && has_value)
+		{
+			opt.job.start = (uint16_t)std::strtoul(argv[++i], nullptr, 16);
+			opt.job.start_set = true;
+		}
+		else if (a == "--cycles" && has_value)
+			opt.job.cycles = std::strtoull(argv[++i], nullptr, 10);
+		else if (a == "--until-pc" && has_value)
+		{
+			opt.job.until = (uint16_t)std::strtoul(argv[++i], nullptr, 16);
+			opt.job.until_set = true;
+		}
+		else if (a == "--no-trap")
+			opt.job.trap = false;
+		else if (a == "--core" && has_value)
+		{
+			std::string c = argv[++i];
+			if (c == "cycle")
+				opt.job.core = Core::Cycle;
+			else if (c == "mc")
+				opt.job.core = Core::Microcode;
+			else if (c == "instr")
+				opt.job.core = Core::Instruction;
+			else if (c == "block")
+				opt.job.core = Core::Block;
+			else if (c == "jit")
+				opt.job.core = Core::Jit;
+			else
+				return false;
+		}
+		else if (a[0] != '-')
+			opt.roms.push_back(argv[i]);
+		else
+			return false;
+	}
+
+	if (opt.list)
+	{
+		std::ifstream f(opt.list);
+		if (!f.is_open())
+			return false;
+		std::string line;
+		while (std::getline(f, line))
+		{
+			while (!line.empty() && (line.back() == '\r' || line.back() == ' '))
+				line.pop_back();
+			if (!line.empty() && line[0] != '#')
+				opt.roms.push_back(line);
+		}
+	}
+	return !opt.roms.empty() && opt.repeat > 0;
+}
+
+static std::string jsonString(const std::string& s)
+{
+	std::string r = "\"";
+	for (char c : s)
+	{
+		if (c == '"' || c == '\\')
+			r += '\\';
+		r += c;
+	}
+	return r + "\"";
+}
+
+int main(int argc, char** argv)
+{
+	FleetOptions opt;
+	if (!parseArgs(argc, argv, opt))
+	{
+		usage();
+		return 1;
+	}
+
+	// every image is opened once and shared by its jobs
+	std::vector<FleetJob> jobs;
+	for (const std::string& rom : opt.roms)
+	{
+		FleetJob job = opt.job;
+		job.rom = rom;
+		std::shared_ptr<Image> image = std::make_shared<Image>();
+		if (!image->Open(rom.c_str(), opt.format, opt.job.load))
+		{
+			std::cerr << image->Error() << "\n";
+			return 1;
+		}
+		job.file = image;
+		for (unsigned r = 0; r < opt.repeat; r++)
+			jobs.push_back(job);
+	}
+
+	Fleet fleet(opt.fleet);
+	auto t0 = std::chrono::steady_clock::now();
+	std::vector<FleetResult> results = fleet.Run(jobs);
+	auto t1 = std::chrono::steady_clock::now();
+	double seconds = std::chrono::duration<double>(t1 - t0).count();
+
+	uint64_t cycles = 0;
+	int failed = 0;
+	std::printf("{\n  \"jobs\": [\n");
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const FleetResult& r = results[i];
+		cycles += r.cycles;
+		failed += r.stop[0] == 'e';
+		std::printf("    { \"rom\": %s, \"stop\": \"%s\", \"pc\": %u, \"a\": %u, \"x\": %u, \"y\": %u, \"sp\": %u, \"p\": %u, "
+			"\"cycles\": %llu, \"instructions\": %llu, \"seconds\": %.6f, \"worker\": %u }%s\n",
+			jsonString(jobs[i].rom).c_str(), r.stop, (unsigned)r.pc,
+			(unsigned)r.regs.A, (unsigned)r.regs.X, (unsigned)r.regs.Y, (unsigned)r.regs.SP, (unsigned)r.flags,
+			(unsigned long long)r.cycles, (unsigned long long)r.instructions, r.seconds, r.worker,
+			i + 1 < results.size() ? "," : "");
+	}
+	std::printf("  ],\n  \"workers\": [\n");
+	for (unsigned w = 0; w < fleet.Threads(); w++)
+	{
+		const Fleet::WorkerStats& s = fleet.Stats()[w];
+		std::printf("    { \"jobs\": %llu, \"steals\": %llu, \"cycles\": %llu, \"busy_seconds\": %.6f }%s\n",
+			(unsigned long long)s.jobs, (unsigned long long)s.steals, (unsigned long long)s.cycles, s.busy_seconds,
+			w + 1 < fleet.Threads() ? "," : "");
+	}
+	std::printf("  ],\n");
+	std::printf("  \"threads\": %u,\n", fleet.Threads());
+	std::printf("  \"seconds\": %.6f,\n", seconds);
+	std::printf("  \"mhz\": %.3f\n", seconds > 0 ? cycles / seconds / 1e6 : 0.0);
+	std::printf("}\n");
+
+	return failed ? 2 : 0;
+}
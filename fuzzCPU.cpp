@@ -0,0 +1,258 @@
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iterator>
+#include <memory>
+
+#include "Fuzzer.h"
+
+//
+// Fuzzes a ROM routine through its input register and reports coverage and crashes as JSON
+//
+
+struct FuzzOptions
+{
+	const char* rom = nullptr;
+	uint16_t load = 0xC000;     // load address
+	bool readonly = false;      // image pages read-only
+	bool start_set = false;     // start at 'start' instead of the reset vector
+	uint16_t start = 0;
+	uint64_t cases = 100000;    // per thread
+	unsigned threads = 1;
+	std::vector<std::string> seeds;
+	FuzzConfig config;
+};
+
+static void usage()
+{
+	std::cerr <<
+		"usage: fuzzCPU [options] <rom>\n"
+		"  --load ADDR      load address of the image (hex, default C000)\n"
+		"  --rom            image pages are read-only\n"
+		"  --start ADDR     start execution at ADDR instead of the reset vector (hex)\n"
+		"  --input ADDR     input register (hex, default F004)\n"
+		"  --prefix TEXT    input fed before the snapshot (\\r, \\n, \\xHH escapes)\n"
+		"  --cases N        cases per thread (default 100000)\n"
+		"  --cycles N       cycle budget per case (default 1000000)\n"
+		"  --max-len N      longest input (default 256)\n"
+		"  --brk-ok ADDR    BRK at ADDR isn't a crash (hex, repeatable)\n"
+		"  --dict FILE      tokens for the mutator, one per line\n"
+		"  --seed-input F   file with a starting input (repeatable)\n"
+		"  --seed N         random seed (default 1)\n"
+		"  --threads N      independent fuzzers with seeds N, N+1, ... (default 1)\n";
+}
+
+static std::vector<uint8_t> unescape(const std::string& s)
+{
+	std::vector<uint8_t> r;
+	for (size_t i = 0; i < s.size(); i++)
+	{
+		if (s[i] != '\\' || i + 1 == s.size())
+		{
+			r.push_back((uint8_t)s[i]);
+			continue;
+		}
+		char c = s[++i];
+		if (c == 'r')
+			r.push_back('\r');
+		else if (c == 'n')
+			r.push_back('\n');
+		else if (c == 'x' && i + 2 < s.size())
+		{
+			r.push_back((uint8_t)std::strtoul(s.substr(i + 1, 2).c_str(), nullptr, 16));
+			i += 2;
+		}
+		else
+			r.push_back((uint8_t)c);
+	}
+	return r;
+}
+
+static bool readFile(const std::string& name, std::vector<uint8_t>& data)
+{
+	std::ifstream f(name, std::ios::binary);
+	if (!f.is_open())
+		return false;
+	data.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+	return true;
+}
+
+static bool parseArgs(int argc, char** argv, FuzzOptions& opt)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string a = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (a == "--load" && has_value)
+			opt.load = (uint16_t)std::strtoul(argv[++i], nullptr, 16);
+		else if (a == "--rom")
+			opt.readonly = true;
+		else if (a == "--start" && has_value)
+		{
+			opt.start = (uint16_t)std::strtoul(argv[++i], nullptr, 16);
+			opt.start_set = true;
+		}
+		else if (a == "--input" && has_value)
+			opt.config.input = (uint16_t)std::strtoul(argv[++i], nullptr, 16);
+		else if (a == "--prefix" && has_value)
+			opt.config.prefix = unescape(argv[++i]);
+		else if (a == "--cases" && has_value)
+			opt.cases = std::strtoull(argv[++i], nullptr, 10);
+		else if (a == "--cycles" && has_value)
+			opt.config.cycles = std::strtoull(argv[++i], nullptr, 10);
+		else if (a == "--max-len" && has_value)
+			opt.config.max_len = (size_t)std::strtoul(argv[++i], nullptr, 10);
+		else if (a == "--brk-ok" && has_value)
+			opt.config.brk_ok.push_back((uint16_t)std::strtoul(argv[++i], nullptr, 16));
+		else if (a == "--dict" && has_value)
+		{
+			std::ifstream f(argv[++i]);
+			if (!f.is_open())
+				return false;
+			std::string line;
+			while (std::getline(f, line))
+			{
+				while (!line.empty() && line.back() == '\r')
+					line.pop_back();
+				if (!line.empty())
+				{
+					std::vector<uint8_t> token = unescape(line);
+					opt.config.dictionary.push_back(std::string(token.begin(), token.end()));
+				}
+			}
+		}
+		else if (a == "--seed-input" && has_value)
+			opt.seeds.push_back(argv[++i]);
+		else if (a == "--seed" && has_value)
+			opt.config.seed = std::strtoull(argv[++i], nullptr, 10);
+		else if (a == "--threads" && has_value)
+			opt.threads = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+		else if (a[0] != '-' && !opt.rom)
+			opt.rom = argv[i];
+		else
+			return false;
+	}
+	return opt.rom && opt.threads > 0;
+}
+
+static std::string jsonHex(const std::vector<uint8_t>& data)
+{
+	static const char digits[] = "0123456789abcdef";
+	std::string r = "\"";
+	for (uint8_t b : data)
+	{
+		r += digits[b >> 4];
+		r += digits[b & 15];
+	}
+	return r + "\"";
+}
+
+int main(int argc, char** argv)
+{
+	FuzzOptions opt;
+	if (!parseArgs(argc, argv, opt))
+	{
+		usage();
+		return 1;
+	}
+
+	std::vector<uint8_t> image;
+	if (!readFile(opt.rom, image))
+	{
+		std::cerr << "can't read " << opt.rom << "\n";
+		return 1;
+	}
+	std::vector<std::vector<uint8_t>> seeds;
+	for (const std::string& name : opt.seeds)
+	{
+		std::vector<uint8_t> seed;
+		if (!readFile(name, seed))
+		{
+			std::cerr << "can't read " << name << "\n";
+			return 1;
+		}
+		seeds.push_back(seed);
+	}
+
+	// one fuzzer per thread, each with its own machine and corpus
+	std::vector<std::unique_ptr<Fuzzer>> fuzzers;
+	for (unsigned t = 0; t < opt.threads; t++)
+	{
+		FuzzConfig config = opt.config;
+		config.seed += t;
+		fuzzers.emplace_back(new Fuzzer(config));
+		Fuzzer& f = *fuzzers.back();
+		f.Load(image, opt.load, opt.readonly);
+		if (!(opt.start_set ? f.Start(opt.start) : f.Start()))
+		{
+			std::cerr << "the input register wasn't read within the start cycles\n";
+			return 1;
+		}
+		for (const std::vector<uint8_t>& seed : seeds)
+			f.AddSeed(seed);
+	}
+
+	auto t0 = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	for (auto& f : fuzzers)
+	{
+		Fuzzer* p = f.get();
+		threads.emplace_back([p, &opt] { p->Run(opt.cases); });
+	}
+	for (std::thread& t : threads)
+		t.join();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+	// crashes merged by reason and address
+	std::vector<FuzzCrash> crashes;
+	FuzzStats total;
+	for (auto& f : fuzzers)
+	{
+		const FuzzStats& s = f->Stats();
+		total.cases += s.cases;
+		total.cycles += s.cycles;
+		total.hangs += s.hangs;
+		total.crashes += s.crashes;
+		total.edges = std::max(total.edges, s.edges);
+		for (const FuzzCrash& c : f->Crashes())
+		{
+			bool known = false;
+			for (const FuzzCrash& k : crashes)
+				known |= k.pc == c.pc && k.reason == c.reason;
+			if (!known)
+				crashes.push_back(c);
+		}
+	}
+
+	std::printf("{\n  \"crashes\": [\n");
+	for (size_t i = 0; i < crashes.size(); i++)
+	{
+		const FuzzCrash& c = crashes[i];
+		std::printf("    { \"reason\": \"%s\", \"pc\": %u, \"input\": %s }%s\n",
+			c.reason.c_str(), (unsigned)c.pc, jsonHex(c.input).c_str(), i + 1 < crashes.size() ? "," : "");
+	}
+	std::printf("  ],\n  \"fuzzers\": [\n");
+	for (size_t i = 0; i < fuzzers.size(); i++)
+	{
+		const FuzzStats& s = fuzzers[i]->Stats();
+		std::printf("    { \"cases\": %llu, \"corpus\": %zu, \"edges\": %u, \"hangs\": %llu, \"crashes\": %llu, \"seconds\": %.6f }%s\n",
+			(unsigned long long)s.cases, fuzzers[i]->Corpus().size(), s.edges, (unsigned long long)s.hangs,
+			(unsigned long long)s.crashes, s.seconds, i + 1 < fuzzers.size() ? "," : "");
+	}
+	std::printf("  ],\n");
+	std::printf("  \"cases\": %llu,\n", (unsigned long long)total.cases);
+	std::printf("  \"cases_per_second\": %.1f,\n", seconds > 0 ? total.cases / seconds : 0.0);
+	std::printf("  \"mhz\": %.3f,\n", seconds > 0 ? total.cycles / seconds / 1e6 : 0.0);
+	std::printf("  \"seconds\": %.6f\n", seconds);
+	std::printf("}\n");
+
+	return crashes.empty() ? 0 : 2;
+}
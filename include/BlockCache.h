@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include "mos6502.h"
+
+class Bus;
+
+//
+// Pre-decoded basic blocks for mos6502::step_block()
+//
+// A block is a straight run of instructions decoded once (see mos6502::DecodedOp), ending on
+// flow control or an I flag change (mos6502::EndsBlock). Blocks are looked up by start address.
+// Pages holding cached code are taken off the bus fast write path, so a write that changes
+// a cached instruction byte invalidates every block on that page. Remapping a page does the same.
+//
+class BlockCache
+{
+	friend class Jit;
+public:
+	static const unsigned MaxOps = 32;
+
+	struct Block
+	{
+		uint16_t start;
+		uint16_t end;       // address after the last instruction
+		uint8_t count;
+		bool alive;
+		uint32_t hits;          // runs, for the recompiler to pick hot blocks
+		const void* native;     // recompiled code (Jit.h), nullptr if none
+		mos6502::DecodedOp ops[MaxOps];
+	};
+
+	// instructions run by step_block(), including the ones left for step()
+	uint64_t instructions = 0;
+
+public:
+	BlockCache(Bus& _bus);
+
+	// block starting at addr, decoded on a miss; nullptr if the address can't be cached (device page)
+	Block* Get(uint16_t addr)
+	{
+		int32_t id = index[addr];
+		return id >= 0 ? &blocks[id] : Build(addr);
+	}
+
+	// the bus wrote to a page with cached code
+	void Written(uint16_t addr);
+	// drop all blocks touching the page
+	void InvalidatePage(uint8_t page);
+	void Clear();
+	// forget all recompiled code (the recompiler dropped its code buffer)
+	void DropNative();
+
+	// changes every time blocks get invalidated
+	uint32_t Generation() const { return generation; }
+
+	size_t BlockCount() const { return blocks.size() - free_ids.size(); }
+
+private:
+	Bus& bus;
+	std::vector<Block> blocks;
+	std::vector<int32_t> free_ids;
+	std::unique_ptr<int32_t[]> index;       // start address -> block id, -1 if none
+	std::vector<int32_t> page_blocks[256];  // blocks touching the page
+	uint64_t code_bytes[256][4];            // instruction bytes of cached blocks, one bit per byte
+	uint32_t generation = 0;
+
+	Block* Build(uint16_t addr);
+	void Kill(int32_t id, uint8_t page);
+	void SetCodePage(uint8_t page, bool code);
+};
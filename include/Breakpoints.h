@@ -0,0 +1,147 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Bus;
+
+//
+// Execute, read and write breakpoints over the 64K space
+//
+// One bitmap per kind, a bit per address. The batched run loops (BusT::RunUntil) check the execute bitmap on
+// every instruction boundary, but only while something is armed: the loop is picked once per call, the
+// unarmed one has no checks at all. Read/write watches take the pages they are on off the fast path of the
+// page table (like devices), so other pages don't pay either; they see every CPU access of the address,
+// fetches and the dummy reads of the cycle cores included. The block cores run instruction by instruction
+// while armed.
+//
+// A breakpoint can have a condition, compiled to bytecode when it's set and run only when the bit is hit:
+//   A==$20 && X>3      [$00FF]!=0      DATA>=$80 || ADDR==$F004      (PC & $FF00) == $E000 && !C
+// Values are A X Y SP P PC, flags N V D I Z C, DATA and ADDR (the byte and address of the access, the PC
+// for execute breakpoints), numbers ($hex, 0xhex, %binary, decimal), [expr] for the byte in memory, with
+// the C operators (! ~ - * / % + - << >> < <= > >= == != & ^ | && ||) and parentheses.
+//
+// Execute breakpoints stop before the instruction runs, watches after the instruction doing the access.
+// RunUntil() returns then, Take() tells which one it was. Running on goes past the breakpoint.
+//
+
+// compiled condition
+class Condition
+{
+public:
+	// false with Error() set when the text doesn't parse
+	bool Compile(const std::string& text);
+	const std::string& Error() const { return error; }
+	bool Empty() const { return code.empty(); }
+
+	// empty conditions are true; memory goes through Bus::Peek(), evaluating unshares no pages
+	int32_t Eval(Bus& bus, uint16_t addr, uint8_t data) const;
+
+private:
+	enum Op : int32_t
+	{
+		Push, RegA, RegX, RegY, RegSP, RegP, RegPC, Flag, Addr, Data, Mem,
+		Not, Neg, Compl, Mul, Div, Mod, Add, Sub, Shl, Shr, Lt, Le, Gt, Ge, Eq, Ne, And, Xor, Or, LAnd, LOr,
+	};
+	static const int MaxDepth = 32;
+
+	std::vector<int32_t> code;      // ops, Push and Flag followed by their value
+	std::string error;
+
+	struct Parser;
+};
+
+enum BreakKind : uint8_t
+{
+	BreakExec = 1,
+	BreakRead = 2,
+	BreakWrite = 4,
+};
+
+struct BreakHit
+{
+	int id;
+	BreakKind kind;
+	uint16_t addr;      // accessed, the PC for BreakExec
+	uint8_t data;       // read or written
+	uint16_t pc;        // of the instruction
+};
+
+class Breakpoints
+{
+public:
+	// attaches to the bus
+	explicit Breakpoints(Bus& b);
+	~Breakpoints();
+
+	// kinds is a BreakKind mask, the range first..last inclusive; returns the id, -1 with Error() set when
+	// the condition doesn't compile
+	int Add(uint8_t kinds, uint16_t first, uint16_t last, const std::string& condition = "");
+	bool Remove(int id);
+	void Clear();
+	const std::string& Error() const { return error; }
+
+	// anything set, the run loops check only then
+	bool Armed() const { return !list.empty(); }
+	// the breakpoint RunUntil() stopped for, once
+	bool Take(BreakHit& hit);
+	uint64_t Hits(int id) const;
+
+	// run loop, on an instruction boundary: stop here
+	bool Boundary(uint16_t pc)
+	{
+		at = pc;
+		if (pending)
+			return true;
+		if (!((exec[pc >> 3] >> (pc & 7)) & 1))
+			return false;
+		return Check(BreakExec, pc, 0, pc);
+	}
+	// Bus::ReadSlow/WriteSlow on watched pages
+	void Access(BreakKind kind, uint16_t addr, uint8_t data)
+	{
+		const uint8_t* bits = kind == BreakRead ? read : write;
+		if (((bits[addr >> 3] >> (addr & 7)) & 1) && !pending)
+			Check(kind, addr, data, at);
+	}
+	// run loop, once per call: a hit left from manual stepping doesn't stop the next run
+	void Resume(uint16_t pc)
+	{
+		pending = false;
+		at = pc;
+	}
+	bool Watched(uint8_t page, BreakKind kind) const { return (kind == BreakRead ? read_pages : write_pages)[page]; }
+
+private:
+	Breakpoints(const Breakpoints&) = delete;
+	Breakpoints& operator=(const Breakpoints&) = delete;
+
+	struct Breakpoint
+	{
+		int id;
+		uint8_t kinds;
+		uint16_t first, last;
+		Condition condition;
+		uint64_t hits = 0;
+	};
+
+	Bus& bus;
+	std::vector<Breakpoint> list;
+	int next_id = 1;
+	std::string error;
+
+	uint8_t exec[0x2000] = {};
+	uint8_t read[0x2000] = {};
+	uint8_t write[0x2000] = {};
+	bool read_pages[256] = {};
+	bool write_pages[256] = {};
+
+	bool pending = false;
+	BreakHit hit = {};
+	uint16_t at = 0;    // PC of the instruction running, from the last boundary
+
+	// the bit is set: runs the conditions of the breakpoints there, true if one holds (and becomes the hit)
+	bool Check(BreakKind kind, uint16_t addr, uint8_t data, uint16_t pc);
+	// bitmaps and watched pages from the list
+	void Rebuild();
+};
@@ -5,28 +5,196 @@
 #include <array>
 #include <functional>
 #include <atomic>
+#include <limits>
+#include <memory>
+#include <vector>
 #include "mos6502.h"
+#include "State.h"
+#include "Trace.h"
+#include "Breakpoints.h"
 
-typedef std::array<uint8_t, 64 * 1024> AllMemory;
+
+// CPU core used to step the bus
+enum class Core : uint8_t
+{
+	Cycle,      // mos6502::tick() - reference core, easy to follow
+	Microcode,  // mos6502::tick_mc() - same pins every cycle, unfolded into one switch
+	Instruction,// mos6502::step() - whole instructions with direct memory access, no pins activity
+	Block,      // mos6502::step_block() - as Instruction, but runs pre-decoded basic blocks (BlockCache.h)
+	Jit,        // Block with hot blocks recompiled to x86-64 code (Jit.h), interpreted elsewhere
+};
+
+// memory mapped device, attached to one or more pages of the address space with Bus::MapDevice()
+class Device
+{
+public:
+	virtual ~Device() {}
+
+	// data comes in with the byte from the backing memory of the page, a device only changes it for its own registers
+	virtual void Read(uint16_t addr, uint8_t& data) = 0;
+	// data is stored to the backing memory afterwards (unless the page is read-only)
+	virtual void Write(uint16_t addr, uint8_t& data) = 0;
+};
+
+class Mapper;
+struct MapperConfig;
+class BlockCache;
+class Jit;
+class Rewind;
+class Image;
+class MappedFile;
+class Disassembly;
 
 class Bus
 {
 	friend class Debugger;
+	friend class Mapper;
+	friend class BlockCache;
+	friend class Jit;
+	friend class Rewind;
+	friend class Breakpoints;
 protected:
-	AllMemory RAM = { 0 };
+	static const uint32_t NoSlot = 0xFFFFFFFF;
+	static const uint32_t RamSlots = 256;   // storage pages of the bus RAM, slots 0-255 (State.h)
+
+	// one 256 byte page of the address space
+	struct Page
+	{
+		uint8_t* mem = nullptr;     // backing storage, never null
+		Device* device = nullptr;   // device handling the page, nullptr for plain memory
+		bool readonly = false;      // writes are dropped (ROM)
+		bool code = false;          // holds cached blocks, writes are checked by BlockCache
+		bool clean = false;         // not written since the checkpoint, the first write marks the slot dirty
+		bool shared = false;        // fork: still in the image of the parent, the first write copies it (Fork())
+		uint32_t slot = NoSlot;     // storage page for SaveState (see State.h), NoSlot for ROM and foreign memory
+	};
+	Page pages[256];
+
+	// fast path pointers, nullptr when the access needs Page handling (device, read-only, clean, shared, journaled,
+	// watched)
+	uint8_t* page_read[256];
+	uint8_t* page_write[256];
+
+	void UpdatePage(uint8_t page);
+	static unsigned JitStep(Jit& j);
+	uint8_t ReadSlow(uint16_t addr);
+	void WriteSlow(uint16_t addr, uint8_t data);
+
+	// dirty page tracking for state deltas, off until the first SaveState/LoadState
+	bool tracking = false;
+	uint64_t checkpoint = 0;            // id of the state saved/loaded last
+	uint64_t states = 0;                // states saved, for the ids
+	std::vector<uint8_t> slot_dirty;    // per slot
+	std::vector<uint32_t> dirty_slots;  // slots written since the checkpoint
+
+	uint32_t Slots() const;
+	uint8_t* SlotMem(uint32_t slot);
+	// a byte into a slot behind the page table (rewind undo), unshared and marked dirty like a bus write
+	void WriteSlot(uint32_t slot, uint8_t offset, uint8_t data);
+	void SetSlots(uint8_t first, unsigned count, uint32_t slot);
+	void MarkDirty(uint8_t page);
+	void Checkpoint(uint64_t id);
+	void StopTracking();
+
+	// rewind recording: every write goes through WriteSlow to the journal
+	Rewind* rewind = nullptr;
+	void SetRewind(Rewind* r);
+
+	// RAM in 256 slots of 256 bytes, copy-on-write: a slot stays in shared_image (zeros on a new bus, the parent
+	// memory on a fork, shared by all forks taken at the same ticks) until the first write copies it to a page
+	// of its own, so neither a new bus nor a fork pays for the 64K up front
+	std::shared_ptr<const std::vector<uint8_t>> shared_image;   // 64K
+	std::array<bool, RamSlots> slot_shared;                     // slot still in shared_image
+	std::unique_ptr<uint8_t[]> ram_pages[RamSlots];             // own pages, allocated on the first write
+	std::shared_ptr<const std::vector<uint8_t>> fork_image;     // parent: image of the last Fork()
+	uint64_t fork_ticks = 0;                                    // parent: ticks_total of fork_image
+
+	uint8_t* RamSlot(uint32_t slot) const
+	{
+		return slot_shared[slot] ? const_cast<uint8_t*>(&(*shared_image)[slot * 256]) : ram_pages[slot].get();
+	}
+	void MapPage(uint8_t page, uint8_t* mem, uint32_t slot, bool readonly);
+	void ForkFrom(Bus& parent);
+	void Unshare(uint32_t slot);
+	const uint8_t* SlotData(uint32_t slot) const;
+
+	// bus trace of the cycle cores (Trace.h), nullptr when off
+	TraceWriter* trace = nullptr;
+
+	// debugger disassembly index (Disassembly.h), told about every write while attached
+	Disassembly* disasm = nullptr;
+
+	// breakpoints (Breakpoints.h), checked by RunUntil() while armed
+	Breakpoints* breaks = nullptr;
+
+	// files MapRom() mapped pages from, kept open while the page table may point into them
+	std::vector<std::shared_ptr<MappedFile>> rom_files;
+	// bytes into the backing memory through the page table
+	void Copy(uint16_t addr, const uint8_t* data, uint32_t size);
+
+	// blocks go first: the mapper unmaps its pages (and invalidates blocks) when destroyed
+	std::unique_ptr<BlockCache> blocks;
+	std::unique_ptr<Jit> jit;
+	std::unique_ptr<Mapper> mapper;
 
 public:
 	Pins pins = {};
 	mos6502 CPU;
+	Core core = Core::Cycle;
 	std::atomic<uint16_t> opaddr;
 
 public:
-	Bus() { }
-	~Bus() {}
+	Bus();
+	~Bus();
 
+	// the CPU is 64 byte aligned, plain new doesn't promise that before C++17
+	static void* operator new(size_t size);
+	static void* operator new(size_t, void* p) { return p; }
+	static void operator delete(void* p);
+
+	// called on every cycle by the cycle based cores, devices go to MapDevice()
 	virtual void TickHandler() = 0;
 
+	// raw image at the offset, false if it can't be read or doesn't fit
 	bool ReadFromFile(const char* filename, uint16_t offset);
+	// banked ROM/RAM image (see Mapper.h), replaces the current mapper and drops the rewind history; false and
+	// no change if the config doesn't pass Mapper::Check()
+	bool ReadFromFile(const char* filename, const MapperConfig& config);
+	bool SetMapper(const MapperConfig& config, std::vector<uint8_t> image = {});
+	Mapper* GetMapper() { return mapper.get(); }
+	// image file (Loader.h) into memory through the page table (the start address isn't applied), unlike bus[]
+	// the pages count as written for state deltas
+	void Load(const Image& image);
+	// image as ROM: whole pages of Raw/PRG images are mapped straight from the file, the rest is copied,
+	// every page the image touches gets write protected. The mapped pages are shared by every bus mapping
+	// the same Image, so bus[] mustn't write to them.
+	void MapRom(const Image& image);
+	// pre-decoded code for Core::Block, created on first use
+	BlockCache& GetBlockCache();
+	// recompiler for Core::Jit, created on first use
+	Jit& GetJit();
+	// drop pre-decoded code, needed after changing code behind the bus back (bus[], RAM)
+	void FlushCode();
+	// back to the memory of a new machine without allocating it again: zeroed RAM on every page, no mapper, ROM
+	// files, cached code, states, fork image or rewind history. Devices stay attached, the CPU is left to reset().
+	void Clear();
+
+	// machine state (State.h): CPU mid-instruction, pins, mapper bank and memory, out is replaced.
+	// Every saved or loaded state is a checkpoint: a Delta holds only the memory pages written since then
+	// (the first state is always Full), and only loads on top of that checkpoint (load Full, then the deltas
+	// in order). Loading the checkpoint's own Full state again only copies back the pages written since (cheap
+	// snapshot restore). Writes through bus[] and RAM aren't tracked, devices and the memory map aren't saved.
+	void SaveState(std::vector<uint8_t>& out, StateKind kind = StateKind::Full);
+	bool LoadState(const uint8_t* data, size_t size);
+
+	// record the pins of every cycle of the cycle cores into an open trace, nullptr stops (detach before
+	// closing the trace)
+	void SetTrace(TraceWriter* t) { trace = t; }
+	// report writes, remaps and loaded states to the disassembly index (Disassembly::Build() attaches it),
+	// nullptr detaches; every write takes the slow path while attached
+	void SetDisassembly(Disassembly* d);
+	// breakpoints for RunUntil() (the Breakpoints constructor attaches them), nullptr detaches
+	void SetBreakpoints(Breakpoints* b);
 
 	void AddTickHandler(std::function<void(void)> callback)
 	{
@@ -36,6 +204,180 @@ public:
 	void CPU_Step();
 	void CPU_Step_Op();
 
-	// access bus address space (now just RAM) via bus[]
+	// memory access through the page table, as seen by the CPU
+	uint8_t Read(uint16_t addr)
+	{
+		if (uint8_t* p = page_read[addr >> 8])
+			return p[addr & 0xFF];
+		return ReadSlow(addr);
+	}
+	void Write(uint16_t addr, uint8_t data)
+	{
+		if (uint8_t* p = page_write[addr >> 8])
+			p[addr & 0xFF] = data;
+		else
+			WriteSlow(addr, data);
+	}
+
+	// map 'count' pages starting at 'first' to the storage (256 bytes per page)
+	void MapMemory(uint8_t first, unsigned count, uint8_t* mem, bool readonly = false);
+	// map 'count' pages starting at 'first' to the bus RAM from slot 'slot' on (the RAM of page 'slot' on a new
+	// bus, other pages for mirrors)
+	void MapRam(uint8_t first, unsigned count, uint32_t slot, bool readonly = false);
+	// write protect (or unprotect) pages, device registers are still writable
+	void SetReadOnly(uint8_t first, unsigned count, bool readonly = true);
+	// attach the device to pages, nullptr detaches
+	void MapDevice(uint8_t first, unsigned count, Device* device);
+
+	// device attached to a page, nullptr for none
+	Device* PageDevice(uint8_t page) const { return pages[page].device; }
+	// backing memory of a page, for copying out (Publisher.h); devices aren't read, write through bus[]
+	const uint8_t* PageMemory(uint8_t page) const { return pages[page].mem; }
+	// a byte of the backing memory, for looking at: unlike bus[] it leaves a fork's shared pages shared
+	uint8_t Peek(uint16_t addr) const { return pages[addr >> 8].mem[addr & 0xFF]; }
+
+	// access bus address space via bus[], goes to the backing memory and bypasses devices, write protection
+	// and the block cache
 	uint8_t& operator[](uint16_t addr);
-};
\ No newline at end of file
+};
+
+//
+// Batched run loops with the bus handler resolved at compile time (CRTP):
+//   class MyBus : public BusT<MyBus> { void TickHandler() override { ... } };
+// TickHandler() is called qualified, so it is inlined into the loop instead of going through the vtable.
+// opaddr is published once per batch, not on every SYNC.
+//
+template<class Derived>
+class BusT : public Bus
+{
+	// one bus cycle, same as Bus::CPU_Step() minus the virtual call
+	template<bool MC, bool Traced>
+	void Cycle()
+	{
+		if (pins.RW)
+			pins.DATA = Read(pins.ADDR);
+		if (Traced)
+			trace->Record(CPU.readTicksTotal(), pins);
+
+		pins = MC ? CPU.tick_mc(pins) : CPU.tick(pins);
+
+		static_cast<Derived*>(this)->Derived::TickHandler();
+
+		if (!pins.RW)
+			Write(pins.ADDR, pins.DATA);
+	}
+
+	template<bool MC, bool Traced, class Pred>
+	uint64_t RunCycles(Pred& pred, uint64_t cycles)
+	{
+		Derived& self = *static_cast<Derived*>(this);
+		uint64_t n = 0;
+		while (n < cycles)
+		{
+			// microcode core: whole instructions while the budget has room for the longest one (7 cycles)
+			if (MC && !Traced && pins.SYNC && cycles - n >= 7)
+			{
+				n += CPU.step_mc(*this);
+				if (pins.SYNC && pred(self))
+					break;
+				continue;
+			}
+			Cycle<MC, Traced>();
+			n++;
+			if (pins.SYNC && pred(self))
+				break;
+		}
+		return n;
+	}
+
+	template<class Pred>
+	uint64_t RunCore(Pred& pred, uint64_t cycles, Core c)
+	{
+		uint64_t n = 0;
+		switch (c)
+		{
+		case Core::Microcode:
+			n = trace ? RunCycles<true, true>(pred, cycles) : RunCycles<true, false>(pred, cycles);
+			break;
+		case Core::Block:
+		{
+			BlockCache& cache = GetBlockCache();
+			while (n < cycles)
+			{
+				unsigned t = CPU.step_block(*this, cache);
+				n += t ? t : 1;
+				if (pred(*static_cast<Derived*>(this)))
+					break;
+			}
+			break;
+		}
+		case Core::Jit:
+		{
+			Jit& j = GetJit();
+			while (n < cycles)
+			{
+				unsigned t = JitStep(j);
+				n += t ? t : 1;
+				if (pred(*static_cast<Derived*>(this)))
+					break;
+			}
+			break;
+		}
+		case Core::Instruction:
+			while (n < cycles)
+			{
+				// RDY held - no ticks done, count it as one cycle so the budget still runs out
+				unsigned t = CPU.step(*this);
+				n += t ? t : 1;
+				if (pred(*static_cast<Derived*>(this)))
+					break;
+			}
+			break;
+		default:
+			n = trace ? RunCycles<false, true>(pred, cycles) : RunCycles<false, false>(pred, cycles);
+			break;
+		}
+		return n;
+	}
+
+public:
+	// Copy of the machine for search-style runs: CPU, pins, core and mapper bank are copied, memory is shared
+	// copy-on-write in 256 byte pages. Forks taken at the same ticks_total share one image of the memory (so
+	// bus[] changes in between aren't seen), a fork only pays for the pages it writes (and the bus itself, no
+	// 64K: its RAM starts out in the shared image the same way a new bus starts out in zeros). Derived is default
+	// constructed: its devices come from its constructor (their state isn't copied), the memory map from the parent.
+	// The fork has no block cache, rewind or state tracking of its own yet, and runs on any thread.
+	std::unique_ptr<Derived> Fork()
+	{
+		std::unique_ptr<Derived> fork(new Derived());
+		fork->ForkFrom(*this);
+		return fork;
+	}
+
+	// run for the given number of bus cycles, returns the number of cycles done
+	// (the instruction level core may overshoot the budget by up to one instruction)
+	uint64_t Run(uint64_t cycles)
+	{
+		return RunUntil([](Derived&) { return false; }, cycles);
+	}
+
+	// run until pred(bus) returns true at an instruction boundary or the cycle budget is spent
+	// (Core::Block checks it after every block), or until an armed breakpoint is hit
+	template<class Pred>
+	uint64_t RunUntil(Pred pred, uint64_t cycles = std::numeric_limits<uint64_t>::max())
+	{
+		uint64_t n;
+		if (breaks && breaks->Armed())
+		{
+			// every instruction boundary is looked at, so the block cores go one instruction at a time
+			Breakpoints& b = *breaks;
+			b.Resume(CPU.readPC());
+			auto checked = [&](Derived& self) { return b.Boundary(self.CPU.readPC()) || pred(self); };
+			n = RunCore(checked, cycles, core == Core::Block || core == Core::Jit ? Core::Instruction : core);
+		}
+		else
+			n = RunCore(pred, cycles, core);
+		opaddr = CPU.readPC();
+		return n;
+	}
+};
@@ -0,0 +1,128 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "mos6502.h"
+
+class Bus;
+
+//
+// Disassembly index of the 64K address space, for the debugger views
+//
+// Build() sweeps the range linearly (every instruction starts right after the one before) and keeps 2 bytes per
+// address: the opcode, and its addressing mode and length where an instruction starts. Text is only formatted
+// for the lines asked for, with the operand bytes as they are in memory then.
+//
+// Once built the index is attached to the bus, which reports writes, remaps and restored states by page (from
+// the CPU thread, so every write takes the slow path while attached). Update() looks at the reported pages
+// only and re-decodes from the instructions whose opcode byte changed, until the sweep gets back in step with
+// the old one. Operand writes don't change the index.
+//
+// Trace() follows the flow instead, so data between routines doesn't throw the listing out of step: code is
+// what can be reached from the NMI, reset and IRQ vectors and the given seeds through JSR, JMP and both ways of
+// the branches, every other byte is a data line. A path ends at RTS, RTI, JMP, BRK and at undefined opcodes;
+// JMP (ind) isn't followed, its targets turn up as seeds once they have run (Seed() with the PC). Paths are
+// followed on a snapshot of memory, by several threads if asked to. Where reachable instructions overlap (BIT
+// abs skipping a 2 byte instruction) the lower one is listed. Writes to code bytes that change the flow (opcodes,
+// the hidden overlapped ones and the undefined ones paths ended on included, jump and branch targets) trace it
+// all again on Update().
+//
+class Disassembly
+{
+public:
+	explicit Disassembly(Bus& b) : bus(b) {}
+	~Disassembly();
+
+	// linear sweep from first to last, instructions starting past $FFFC are left out; attaches to the bus
+	void Build(uint16_t first, uint16_t last);
+	// flow following over the whole space from the vectors and seeds, threads 0 is one per core; attaches
+	void Trace(const std::vector<uint16_t>& seeds = {}, unsigned threads = 1);
+	// code found running (a PC that isn't an instruction of the index), traced from there and kept as a seed
+	void Seed(uint16_t addr);
+	// re-decode what changed on the pages the bus reported since the last call
+	void Update();
+
+	bool IsInstruction(uint16_t addr) const { return entries && (entries[addr].info & Start); }
+	uint8_t Opcode(uint16_t addr) const { return entries ? entries[addr].opcode : 0; }
+	uint8_t Length(uint16_t addr) const { return entries ? (entries[addr].info >> 4) & 3 : 0; }
+	mos6502::Mode Mode(uint16_t addr) const { return (mos6502::Mode)(entries ? entries[addr].info & 0xF : 0); }
+	// a byte no traced path reaches, only after Trace()
+	bool IsData(uint16_t addr) const { return entries && (entries[addr].info & Data); }
+
+	// the line (instruction or data byte) after/before the one at addr, false at the ends of the range
+	bool Next(uint16_t& addr) const;
+	bool Prev(uint16_t& addr) const;
+
+	// "$C000: LDA #$01 {IMM}" for an instruction of the index, "$C000: .byte $01" for data
+	std::string Text(uint16_t addr) const;
+	// with the bytes from a copy of the 64K (Publisher.h snapshot) instead of the bus
+	std::string Text(uint16_t addr, const uint8_t* memory) const;
+	// the same for whatever is in memory at addr
+	static std::string Line(const Bus& bus, uint16_t addr);
+	static std::string Line(const uint8_t* memory, uint16_t addr);
+	// "$C000: .byte $01"
+	static std::string DataLine(const uint8_t* memory, uint16_t addr);
+
+	// heap taken by the index
+	size_t Bytes() const { return (entries ? 0x10000 * sizeof(Entry) : 0) + (reached ? 0x10000 : 0) + mem.capacity(); }
+
+	// reported by the bus
+	void Written(uint16_t addr)
+	{
+		changed[addr >> 8].store(true, std::memory_order_relaxed);
+		any_changed.store(true, std::memory_order_release);
+	}
+	void Changed();
+
+private:
+	Disassembly(const Disassembly&) = delete;
+	Disassembly& operator=(const Disassembly&) = delete;
+
+	static const uint8_t Start = 0x80;
+	static const uint8_t Data = 0x40;
+
+	struct Entry
+	{
+		uint8_t opcode;
+		uint8_t info;   // bit 7 instruction start, bit 6 data, bits 4-5 length, bits 0-3 mos6502::Mode
+	};
+
+	Bus& bus;
+	std::unique_ptr<Entry[]> entries;
+	uint32_t first = 0;
+	uint32_t last = 0;      // last address an instruction may start at
+	bool attached = false;
+	std::atomic<bool> changed[256] = {};
+	std::atomic<bool> any_changed = { false };
+
+	bool flow = false;                                  // Trace()d
+	unsigned threads = 1;
+	std::vector<uint16_t> seeds;                        // given and found running, the vectors are read each time
+	std::vector<uint8_t> mem;                           // what the paths are followed on
+	bool stale[256] = {};                               // pages of mem written since (Update() saw them)
+	std::unique_ptr<std::atomic<uint8_t>[]> reached;    // where the paths got to: Reached, DeadEnd or 0
+	static const uint8_t Reached = 1;                   // an instruction start
+	static const uint8_t DeadEnd = 2;                   // an undefined opcode or one running past $FFFF
+
+	static std::string Format(uint16_t addr, uint8_t opcode, uint8_t lo, uint8_t hi);
+
+	// clears the index for first..last and attaches
+	void Reset(uint16_t from, uint16_t to);
+
+	// decode from addr on, up to the end of the range, or up to the first old instruction that is still the same
+	void Sweep(uint32_t addr, bool resync);
+	// copy of the memory into mem: all of it, or the stale pages
+	void Snapshot(bool all);
+	// all paths again from the vectors and seeds
+	void Retrace();
+	// follows the paths from the work list, marking their instructions as reached
+	void Follow(std::vector<uint16_t> work, unsigned threads);
+	// one path from addr, up to where it ends or joins one taken before; targets go to the work list
+	void Path(uint16_t addr, std::vector<uint16_t>& targets);
+	// reached instructions and data lines into the index, the lower of two overlapping instructions wins
+	void Classify();
+	// the byte at addr is an opcode or a jump/branch target of the traced code
+	bool Steers(uint16_t addr) const;
+};
@@ -0,0 +1,87 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+//
+// Execution statistics: what a workload actually runs, per opcode
+//
+// Collected by the CPU only when it's built with MOS6502_STATS defined (the whole build, it changes the
+// mos6502 layout), attached with mos6502::setStats(). Without it the hooks are empty and the CPU is the
+// same as before, setStats() does nothing and Enabled is false.
+//
+// Every finished instruction is counted with the ticks it took, and the ticks tell the rest: abs,X abs,Y
+// and (zp),Y instructions one tick over their minimum paid the page crossing penalty, branches over 2
+// ticks were taken (4: to another page). Interrupt sequences are counted apart from BRK. SP is sampled
+// after every instruction, the lowest one gives the maximum stack depth (below $01FF).
+//
+// All cores count the same; the jit core runs blocks through the interpreter while a collector is attached.
+// An instruction the cycle cores are in the middle of is counted once they finish it.
+//
+
+struct ExecStats
+{
+#ifdef MOS6502_STATS
+	static constexpr bool Enabled = true;
+#else
+	static constexpr bool Enabled = false;
+#endif
+
+	struct Op
+	{
+		uint64_t count;
+		uint64_t cycles;
+		uint64_t taken;     // branches
+		uint64_t crossed;   // page crossing penalties, taken branches to another page
+	};
+
+	Op ops[256];
+	uint64_t irq;
+	uint64_t nmi;
+	uint64_t interrupt_cycles;
+	uint8_t min_sp;
+
+	ExecStats();
+	void Clear();
+	// adds the counts of another collector (one per machine/thread, then merged)
+	void Merge(const ExecStats& s);
+
+	uint64_t Instructions() const;
+	uint64_t Cycles() const;
+	unsigned MaxStackDepth() const { return 0xFF - min_sp; }
+
+	// totals, branch and page crossing summary and the executed opcodes (most cycles first)
+	std::string Json() const;
+	// the same as text columns
+	std::string Table() const;
+
+	// called by the CPU
+	void Instruction(uint8_t opcode, unsigned ticks, uint8_t sp)
+	{
+		Op& o = ops[opcode];
+		o.count++;
+		o.cycles += ticks;
+		if (ticks > base[opcode])
+		{
+			if (branch[opcode])
+			{
+				o.taken++;
+				o.crossed += ticks > 3;
+			}
+			else
+				o.crossed++;
+		}
+		if (sp < min_sp)
+			min_sp = sp;
+	}
+	void Interrupt(bool is_nmi, unsigned ticks, uint8_t sp)
+	{
+		(is_nmi ? nmi : irq)++;
+		interrupt_cycles += ticks;
+		if (sp < min_sp)
+			min_sp = sp;
+	}
+
+private:
+	uint8_t base[256];      // fewest ticks the opcode takes
+	bool branch[256];
+};
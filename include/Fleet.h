@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include "Bus.h"
+#include "Loader.h"
+
+//
+// Fleet runner: runs many independent machines (Bus + mos6502) headless on a work-stealing thread pool.
+// Every worker owns one machine, allocated by the worker thread itself (so with pinned threads its memory
+// ends up on the worker's NUMA node, first touch) and cleared between jobs (Bus::Clear()). Jobs are dealt round-robin
+// to the workers' queues, a worker out of jobs steals from the others.
+//
+
+struct FleetJob
+{
+	std::string rom;                            // image file, or...
+	std::shared_ptr<const std::vector<uint8_t>> image;  // ...image already in memory (shared between jobs)
+	std::shared_ptr<const Image> file;          // ...or image file opened once (Loader.h), takes precedence
+	bool readonly = false;                      // map the image file as ROM instead of copying it
+	uint16_t load = 0xC000;                     // load address of rom/image
+	bool start_set = false;                     // start at 'start' instead of the reset vector
+	uint16_t start = 0;
+	uint64_t cycles = 100000000;                // cycle budget
+	bool until_set = false;                     // stop as soon as PC reaches 'until'
+	uint16_t until = 0;
+	bool trap = true;                           // stop on a trap loop (instruction jumping to itself)
+	Core core = Core::Block;
+};
+
+struct FleetResult
+{
+	const char* stop = "error";                 // "cycles", "pc", "trap" or "error" (image not loaded)
+	uint16_t pc = 0;
+	Registers6502 regs = {};
+	uint8_t flags = 0;
+	uint64_t cycles = 0;
+	uint64_t instructions = 0;
+	double seconds = 0;
+	unsigned worker = 0;
+};
+
+class Fleet
+{
+public:
+	struct Options
+	{
+		unsigned threads = 0;       // 0 - one per hardware thread
+		bool pin_threads = false;   // pin worker i to CPU i (Linux, Windows)
+	};
+
+	struct WorkerStats
+	{
+		uint64_t jobs = 0;
+		uint64_t steals = 0;
+		uint64_t cycles = 0;
+		double busy_seconds = 0;
+	};
+
+	Fleet(const Options& _options);
+	~Fleet();
+
+	// runs all jobs and waits for them, results come in the job order
+	std::vector<FleetResult> Run(const std::vector<FleetJob>& jobs);
+
+	unsigned Threads() const { return threads; }
+	const std::vector<WorkerStats>& Stats() const { return stats; }
+
+private:
+	struct Worker;
+
+	Options options;
+	unsigned threads;
+	std::vector<WorkerStats> stats;
+	std::vector<std::unique_ptr<Worker>> workers;
+
+	void WorkerMain(unsigned id, const std::vector<FleetJob>& jobs, std::vector<FleetResult>& results);
+	bool Pop(unsigned id, size_t& job);
+	bool Steal(unsigned id, size_t& job);
+};
@@ -0,0 +1,98 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "Bus.h"
+
+//
+// Coverage-guided fuzzer for 6502 routines reading their input from a register (like EhBASIC's $F004)
+//
+// The machine runs up to the first read of the input register after the prefix is used up and is saved
+// there (Bus::SaveState); every case goes back to that snapshot (only the pages the previous case wrote get
+// copied) and feeds its bytes through the input register. A case ends when the program asks for more input
+// than there is, or on the cycle budget (a hang). Coverage is a 64K bitmap of control flow edges (branch
+// outcomes, JSR/RTS/JMP/RTI/BRK targets) with AFL style hit count buckets, inputs reaching new edges or buckets
+// join the corpus. Crashes: BRK outside the expected places, an undefined opcode, stack overflow/underflow
+// (SP wrapping around). Cases run on the instruction core, checked after every instruction.
+//
+// One Fuzzer is one machine on one thread, run more of them with different seeds for more cores.
+//
+
+struct FuzzConfig
+{
+	uint16_t input = 0xF004;            // input register: reads pop the next byte, 0 once it's used up
+	std::vector<uint8_t> prefix;        // fed before the snapshot (get past start-up prompts)
+	uint64_t start_cycles = 100000000;  // budget for reaching the snapshot point
+	uint64_t cycles = 1000000;          // budget per case
+	size_t max_len = 256;               // longest input made by mutation
+	std::vector<uint16_t> brk_ok;       // addresses a BRK is expected at
+	std::vector<std::string> dictionary;// tokens spliced into inputs (keywords, ...)
+	uint64_t seed = 1;
+};
+
+struct FuzzCrash
+{
+	std::string reason;                 // "brk", "bad opcode", "stack overflow", "stack underflow"
+	uint16_t pc = 0;                    // address of the instruction
+	std::vector<uint8_t> input;
+};
+
+struct FuzzStats
+{
+	uint64_t cases = 0;
+	uint64_t cycles = 0;
+	uint64_t hangs = 0;
+	uint64_t crashes = 0;               // all crashing cases, Crashes() has one per reason and address
+	unsigned edges = 0;                 // bitmap entries seen
+	double seconds = 0;
+};
+
+class Fuzzer
+{
+public:
+	Fuzzer(const FuzzConfig& _config);
+	~Fuzzer();
+
+	// image at the load address, read-only pages (ROM) stay read-only for the program
+	void Load(const std::vector<uint8_t>& image, uint16_t at, bool readonly = false);
+	// from reset (or start), up to the snapshot point: false when the input register wasn't read in time
+	bool Start();
+	bool Start(uint16_t start);
+
+	// corpus entries to begin with, the empty input is used without any; each one is run once and one that
+	// crashes goes to Crashes() instead
+	void AddSeed(const std::vector<uint8_t>& input);
+	// mutate and run cases
+	void Run(uint64_t cases);
+	// one case from the snapshot, nullptr when it didn't crash (pc is set on a crash)
+	const char* Exec(const std::vector<uint8_t>& input, uint16_t* pc = nullptr);
+
+	const std::vector<std::vector<uint8_t>>& Corpus() const { return corpus; }
+	const std::vector<FuzzCrash>& Crashes() const { return crashes; }
+	const FuzzStats& Stats() const { return stats; }
+
+private:
+	struct Machine;
+
+	FuzzConfig config;
+	std::unique_ptr<Machine> m;
+	std::vector<uint8_t> snapshot;
+	std::mt19937_64 rng;
+
+	std::vector<std::vector<uint8_t>> corpus;
+	std::vector<FuzzCrash> crashes;
+	FuzzStats stats;
+	size_t next = 0;                    // corpus entry mutated next
+
+	std::vector<uint8_t> trace;         // hit counts of the current case
+	std::vector<uint16_t> touched;      // trace entries to clear
+	std::vector<uint8_t> seen;          // bucket bits seen so far, per entry
+	bool flow[256];                     // opcodes giving edges
+
+	const char* Case(const std::vector<uint8_t>& input, uint16_t& pc, bool& hang);
+	void Crash(const char* reason, uint16_t pc, const std::vector<uint8_t>& input);
+	bool NewCoverage();
+	std::vector<uint8_t> Mutate(const std::vector<uint8_t>& in);
+};
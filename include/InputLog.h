@@ -0,0 +1,150 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <vector>
+#include "Bus.h"
+#include "BlockCache.h"
+
+//
+// Deterministic input record/replay
+//
+// Everything coming from outside the machine is logged with the ticks_total it was applied at: pin changes
+// (IRQ, NMI, RDY, reset) and data bytes handed to devices (keyboard, serial, ...) on numbered channels.
+// The log starts with the full machine state (Bus::SaveState), so a replay doesn't depend on how the
+// machine was set up. Stream format, little endian:
+//
+//   header   "65IN", u16 version, u8 core, u8 0, u32 state size, state
+//   events   varint ticks since the previous event, u8 tag, [u8 value for data]
+//            tag 0x10 | pin << 1 | level - pin change, 0x20 | channel - data byte, 0x00 - end
+//
+// Replay applies the events on the same ticks: InputReplayer::Run() splits the cycle budget at the event
+// ticks, so the run loop itself runs unchanged between events. Cycle exact with the cycle cores; the
+// instruction level cores reach the same ticks as long as the events were recorded on instruction
+// boundaries with the same core, as the recording side of a batched run loop does. The block cores can't
+// stop inside a block, so they close in on an event or the end of the budget one instruction at a time.
+//
+
+enum class InputPin : uint8_t
+{
+	IRQ,
+	NMI,
+	RDY,
+	RES,    // level 1 is a reset (CPU.reset()), 0 is ignored
+};
+
+struct InputEvent
+{
+	uint64_t ticks;
+	bool data;          // data byte for a device instead of a pin change
+	uint8_t id;         // InputPin or data channel
+	uint8_t value;      // pin level or data byte
+};
+
+class InputRecorder
+{
+	std::ostream& out;
+	uint64_t last_ticks = 0;
+
+	void Event(uint64_t ticks, uint8_t tag);
+
+public:
+	// writes the header with the current state of the bus
+	InputRecorder(std::ostream& _out, Bus& bus);
+	~InputRecorder();
+
+	void Pin(uint64_t ticks, InputPin pin, bool level);
+	// channels are 0-15, false (nothing recorded) for one above
+	bool Data(uint64_t ticks, uint8_t channel, uint8_t value);
+	// end marker, nothing can be recorded after it
+	void Close();
+
+private:
+	bool closed = false;
+};
+
+class InputReplayer
+{
+	std::istream& in;
+	InputEvent next = {};
+	bool done = true;
+	Core core = Core::Cycle;
+
+	void Read();
+
+public:
+	InputReplayer(std::istream& _in) : in(_in) {}
+
+	// reads the header and loads the recorded start state into the bus (the bus needs the same memory map)
+	bool Start(Bus& bus);
+
+	Core RecordedCore() const { return core; }
+	bool Done() const { return done; }
+	// ticks of the next event, max when there are none left
+	uint64_t Next() const { return done ? std::numeric_limits<uint64_t>::max() : next.ticks; }
+
+	// applies the events due by now: pins go to bus.pins, data bytes to data(channel, value)
+	template<class B, class Data>
+	void Apply(B& bus, Data data)
+	{
+		while (!done && next.ticks <= bus.CPU.readTicksTotal())
+		{
+			if (next.data)
+				data(next.id, next.value);
+			else
+			{
+				switch ((InputPin)next.id)
+				{
+				case InputPin::IRQ: bus.pins.IRQ = next.value != 0; break;
+				case InputPin::NMI: bus.pins.NMI = next.value != 0; break;
+				case InputPin::RDY: bus.pins.RDY = next.value != 0; break;
+				case InputPin::RES:
+					if (next.value)
+						bus.pins = bus.CPU.reset();
+					break;
+				}
+			}
+			Read();
+		}
+	}
+
+	// BusT::Run() for the given cycles with the events applied on their ticks, returns the cycles done
+	template<class B, class Data>
+	uint64_t Run(B& bus, uint64_t cycles, Data data)
+	{
+		uint64_t n = 0;
+		while (n < cycles)
+		{
+			Apply(bus, data);
+			uint64_t now = bus.CPU.readTicksTotal();
+			uint64_t chunk = std::min(cycles - n, Next() - now);
+			if (bus.core != Core::Block && bus.core != Core::Jit)
+			{
+				n += bus.Run(chunk);
+				continue;
+			}
+
+			// a block can't be longer than MaxOps instructions of 7 ticks, the rest goes one instruction
+			// at a time so neither the event nor the end of the budget is run over
+			const uint64_t tail = BlockCache::MaxOps * 8;
+			if (chunk > tail)
+				n += bus.Run(chunk - tail);
+			const uint64_t end = now + chunk;
+			while (bus.CPU.readTicksTotal() < end)
+			{
+				uint64_t t = bus.CPU.readTicksTotal();
+				bus.CPU_Step_Op();
+				// RDY held, no ticks go by
+				if (bus.CPU.readTicksTotal() == t)
+				{
+					n++;
+					break;
+				}
+				n += bus.CPU.readTicksTotal() - t;
+			}
+		}
+		Apply(bus, data);
+		return n;
+	}
+};
@@ -0,0 +1,91 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "mos6502.h"
+#include "BlockCache.h"
+
+class Bus;
+
+//
+// x86-64 recompiler for the block cache (Core::Jit)
+//
+// Blocks that ran often enough through mos6502::step_block() are translated to native code working
+// on the mos6502 registers in place. Register, flag and immediate instructions, zero page/absolute
+// loads and stores, branches and JMP are emitted inline; everything else calls back into the
+// interpreter (mos6502::Exec) for that one instruction, so the semantics stay those of op_table.
+// Memory goes through the bus page table: pages without a direct pointer (devices, ROM, pages holding
+// cached code) take the Bus slow path, and a block stops as soon as it invalidates cached code.
+//
+// With verify set every inlined instruction is run again through the interpreter on a copy of the
+// CPU and the results are compared; mismatches are counted, reported once and the interpreter wins.
+//
+// Only built for x86-64 System V (Linux, macOS, BSD), elsewhere nothing gets compiled and
+// the blocks are interpreted.
+//
+class Jit
+{
+public:
+	// block runs before it gets compiled
+	static const uint32_t HotRuns = 16;
+
+	struct Stats
+	{
+		uint64_t compiled = 0;      // blocks translated
+		uint64_t native_ops = 0;    // instructions emitted inline (at compile time)
+		uint64_t helper_ops = 0;    // instructions left to the interpreter (at compile time)
+		uint64_t flushes = 0;       // code buffer overflows
+		uint64_t mismatches = 0;    // verify failures
+	};
+
+	Jit(Bus& _bus, BlockCache& _cache);
+	~Jit();
+
+	// the same as mos6502::step_block(), but runs compiled code for hot blocks
+	unsigned Step();
+
+	// cross-check compiled code against the interpreter, drops the code compiled so far
+	void SetVerify(bool v);
+	bool Verify() const { return verify; }
+
+	// false when the host can't run the generated code (blocks are interpreted then)
+	static bool Supported();
+
+	const Stats& GetStats() const { return stats; }
+
+private:
+	typedef unsigned (*NativeBlock)(mos6502* cpu, Bus* bus, unsigned* ops);
+
+	Bus& bus;
+	BlockCache& cache;
+	bool verify = false;
+	Stats stats;
+
+	uint8_t* code = nullptr;    // executable buffer
+	size_t code_size = 0;
+	size_t code_used = 0;
+
+	// verify mode: CPU state before the instruction being checked (as plain bytes, mos6502 is trivially copyable)
+	uint8_t snapshot[sizeof(mos6502)];
+	unsigned snapshot_cycles = 0;
+
+	bool Compile(BlockCache::Block& block);
+	void Flush();
+	// the host won't change the protection of the code buffer: drop it, the blocks are interpreted from now on
+	void Release();
+
+	// called from the generated code
+	static unsigned HelperExec(mos6502* cpu, Bus* bus, uint64_t op);
+	static unsigned HelperRead(Bus* bus, uint32_t addr);
+	static void HelperWrite(Bus* bus, uint32_t addr, uint32_t data);
+	static void HelperSnapshot(Jit* jit, mos6502* cpu, unsigned cycles);
+	static int HelperCheck(Jit* jit, Bus* bus, uint64_t op, unsigned cycles, uint32_t addr);
+
+	static uint64_t Pack(const mos6502::DecodedOp& op)
+	{
+		return op.operand | ((uint64_t)op.opcode << 16) | ((uint64_t)op.len << 24) | ((uint64_t)op.cycles << 32);
+	}
+	static mos6502::DecodedOp Unpack(uint64_t v)
+	{
+		return { (uint16_t)v, (uint8_t)(v >> 16), (uint8_t)(v >> 24), (uint8_t)(v >> 32) };
+	}
+};
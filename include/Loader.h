@@ -0,0 +1,105 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+//
+// Image files for the bus (Bus::Load(), Bus::MapRom())
+//
+// Files are memory mapped (copy-on-write, so ROM pages can be mapped onto the bus as they are) and parsed
+// into segments that are checked to fit the 64K address space. Raw and PRG segments point straight into
+// the mapping, Intel HEX and S-record data is decoded once into the image.
+//
+//   Raw        the whole file at the load address
+//   Prg        Commodore PRG: 2 byte little endian load address, then the data
+//   IntelHex   ':' records, data/EOF/extended segment and linear address/start address
+//   SRecord    Motorola S0-S9, S1/S2/S3 data with 16/24/32 bit addresses, S7/S8/S9 start address
+//
+// Auto picks the format from the extension (.prg, .hex/.ihx, .s19/.s28/.s37/.srec/.mot), then from the
+// first bytes of text formats, and takes the file as Raw otherwise.
+//
+
+enum class ImageFormat : uint8_t
+{
+	Auto,
+	Raw,
+	Prg,
+	IntelHex,
+	SRecord,
+};
+
+// read-only file contents, mapped where the platform has it (read into memory elsewhere)
+class MappedFile
+{
+public:
+	static std::shared_ptr<MappedFile> Open(const char* path, std::string& error);
+	~MappedFile();
+
+	const uint8_t* Data() const { return data; }
+	size_t Size() const { return size; }
+
+private:
+	friend class Bus;
+	friend class Image;
+
+	MappedFile() {}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	uint8_t* data = nullptr;    // private mapping, writes stay in this process
+	size_t size = 0;
+	bool mapped = false;
+	std::vector<uint8_t> copy;  // no mapping (empty file, or the platform has none)
+#ifdef _WIN32
+	void* map = nullptr;
+#endif
+};
+
+struct ImageSegment
+{
+	uint16_t addr;
+	uint32_t size;              // addr + size is at most $10000
+	const uint8_t* data;
+	bool mapped;                // data points into the file mapping (Raw, Prg)
+};
+
+class Image
+{
+public:
+	Image() {}
+	Image(Image&&) = default;
+	Image& operator=(Image&&) = default;
+
+	// load is the address of Raw images, the other formats carry their own
+	bool Open(const char* path, ImageFormat format = ImageFormat::Auto, uint16_t load = 0);
+	// image from memory, Raw/Prg segments point into data (it has to outlive the image)
+	bool Parse(const uint8_t* data, size_t size, ImageFormat format, uint16_t load = 0);
+
+	ImageFormat Format() const { return format; }
+	const std::vector<ImageSegment>& Segments() const { return segments; }
+	// entry point from the file (HEX start address records, S7/S8/S9)
+	bool HasStart() const { return has_start; }
+	uint16_t Start() const { return start; }
+	// why Open()/Parse() failed
+	const std::string& Error() const { return error; }
+
+private:
+	friend class Bus;
+
+	Image(const Image&) = delete;
+	Image& operator=(const Image&) = delete;
+
+	std::shared_ptr<MappedFile> file;
+	std::vector<uint8_t> decoded;   // HEX/S-record data, segments point into it
+	std::vector<ImageSegment> segments;
+	ImageFormat format = ImageFormat::Raw;
+	bool has_start = false;
+	uint16_t start = 0;
+	std::string error;
+
+	bool Fail(const std::string& what);
+	bool AddSegment(uint32_t addr, const uint8_t* data, size_t size, bool mapped);
+	bool ParseHex(const uint8_t* text, size_t size);
+	bool ParseSRecord(const uint8_t* text, size_t size);
+};
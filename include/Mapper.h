@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Bus.h"
+
+//
+// Bank switching: a window of pages on the bus shows one bank of a bigger ROM/RAM.
+// Writing the bank number to the control register switches the window.
+// Only the page table gets repointed, so a switch costs the same regardless of the window size.
+// The control register is write only and keeps the memory under it; a device already on its page still gets
+// the other addresses of the page, and gets the page back when the mapper goes.
+//
+
+enum class MapperType : uint8_t
+{
+	None,               // no banking, plain 64K
+	RomWindow,          // switchable ROM bank in the window
+	RamWindow,          // switchable RAM bank in the window
+	RomWindowFixedLast, // switchable ROM bank in the window, last bank fixed in the same size window right after it
+};
+
+struct MapperConfig
+{
+	MapperType type = MapperType::None;
+	uint8_t window = 0x80;      // first page of the switchable window
+	uint8_t pages = 0x40;       // window size in pages
+	uint16_t control = 0x7000;  // bank select register (write only), outside the window
+	uint16_t ram_banks = 4;     // RamWindow: number of RAM banks
+};
+
+class Mapper : public Device
+{
+	Bus& bus;
+	MapperConfig config;
+	std::vector<uint8_t> mem;   // all banks, back to back
+	unsigned banks = 0;
+	unsigned bank = 0;
+	Device* previous = nullptr; // device on the control page before the mapper
+
+public:
+	// the config fits: window (both for RomWindowFixedLast) inside the 64K, at least a page and a RAM bank,
+	// control register outside the window; why not in error otherwise
+	static bool Check(const MapperConfig& config, std::string& error);
+
+	// config passed Check(); image: ROM banks back to back (padded with $FF up to the whole bank, an empty
+	// one is a bank of $FF), ignored for RamWindow
+	Mapper(Bus& _bus, const MapperConfig& _config, std::vector<uint8_t> image);
+	// copy of another mapper (banks and selected bank) on a forked bus
+	Mapper(Bus& _bus, const Mapper& other);
+	~Mapper();
+
+	void Read(uint16_t addr, uint8_t& data) override
+	{
+		if (previous)
+			previous->Read(addr, data);
+	}
+	void Write(uint16_t addr, uint8_t& data) override
+	{
+		if (addr == config.control)
+		{
+			Select(data);
+			data = bus.PageMemory(addr >> 8)[addr & 0xFF];
+		}
+		else if (previous)
+			previous->Write(addr, data);
+	}
+
+	// map the bank into the window (bank number wraps around the number of banks)
+	void Select(unsigned n);
+
+	unsigned Bank() const { return bank; }
+	unsigned Banks() const { return banks; }
+	const MapperConfig& Config() const { return config; }
+
+	// RamWindow bank memory in 256 byte pages (for SaveState), none for ROM
+	unsigned RamPages() const { return config.type == MapperType::RamWindow ? (unsigned)(mem.size() / 256) : 0; }
+	uint8_t* RamPage(unsigned n) { return &mem[n * 256]; }
+
+private:
+	void Attach(unsigned n);
+};
@@ -0,0 +1,74 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+//
+// Run loop scheduler of a CPU thread: how many cycles to run next, and when
+//
+//   Unthrottled   batches back to back, as fast as the core goes
+//   Paced         batches of about 1 ms of machine time, each one started when the monotonic clock says it is
+//                 due (cycles run so far / clock), sleeping in between; a batch is late by the oversleep only.
+//                 After falling behind by more than 50 ms (breakpoint, slow host) the schedule starts over
+//                 from now instead of racing to catch up.
+//   Paused        blocked on a condition variable, for stepping and a stopped machine
+//
+// The UI thread changes the mode and calls Wake() when it has something for the CPU thread (a step, reset,
+// quit); Next() returns 0 then, whatever the mode, so the requests get handled right away.
+//
+enum class PaceMode : uint8_t
+{
+	Unthrottled,
+	Paced,
+	Paused,
+};
+
+class Pacer
+{
+public:
+	static constexpr double Clock1MHz = 1000000.0;
+	static constexpr double ClockNTSC = 1789773.0;  // NES/Famicom CPU, NTSC
+	static constexpr double ClockPAL = 1662607.0;   // NES CPU, PAL
+
+	// "1mhz", "ntsc", "pal" or a number of Hz
+	static bool ParseClock(const std::string& s, double& hz);
+
+	explicit Pacer(PaceMode mode = PaceMode::Unthrottled, double hz = Clock1MHz);
+
+	// any thread; hz 0 keeps the clock, the pacing schedule starts over
+	void SetMode(PaceMode mode, double hz = 0);
+	PaceMode Mode() const;
+	double Clock() const;
+	// any thread: the next (or the waiting) Next() returns 0
+	void Wake();
+
+	// CPU thread: budget of the next batch, after sleeping until it's due (Paced) or while Paused;
+	// 0 when woken by Wake()
+	uint64_t Next();
+	// CPU thread: cycles the batch took (RunUntil() stops early or runs over a little)
+	void Done(uint64_t cycles);
+
+	// paced: most a batch started after it was due since the mode was set, in seconds
+	double MaxLate() const;
+
+	// unthrottled batch, paced batches are 1 ms of the clock
+	uint64_t batch_cycles = 10000;
+
+private:
+	typedef std::chrono::steady_clock Time;
+
+	Pacer(const Pacer&) = delete;
+	Pacer& operator=(const Pacer&) = delete;
+
+	mutable std::mutex lock;
+	std::condition_variable wake;
+	PaceMode mode;
+	double hz;
+	bool woken = false;
+	uint64_t generation = 0;        // SetMode() calls, a sleeping Next() starts over on a change
+	Time::time_point origin;        // of the schedule
+	uint64_t cycles = 0;            // run since origin
+	Time::duration late = Time::duration::zero();
+};
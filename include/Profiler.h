@@ -0,0 +1,95 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Bus;
+
+//
+// Cycle profiler: every cycle goes to the instruction that took it, and to the routine it ran in
+//
+// Profiler::Instruction() is called on every instruction boundary (a RunUntil() predicate of the cycle and
+// instruction cores; the block cores only stop between blocks). The ticks since the last call go to the
+// instruction at the PC of the last call. The routine is the top of a shadow call stack: JSR, BRK and
+// interrupt entries push the new PC, a frame is gone once SP gets back to where it was before the call
+// (RTS, RTI, but also PLA PLA + JMP and TXS), so routines that don't return the usual way don't pile up.
+// Interrupt entries are told from BRK by the pushed return address, their 7 ticks go to the handler.
+//
+// The call tree keeps a node per call path, with the ticks spent in it (exclusive) and the calls made to it;
+// inclusive ticks are summed up from the children, counted once per path for recursive routines.
+//
+
+// labels for addresses: VICE label files (al C:C000 .name, as ld65 -Ln writes them), "name = $C000" and
+// "C000 name" lines, ; and # comments
+class Symbols
+{
+public:
+	bool Load(const char* path);
+	const std::string& Error() const { return error; }
+	void Add(uint16_t addr, const std::string& name) { labels[addr] = name; }
+	bool Empty() const { return labels.empty(); }
+	bool Has(uint16_t addr) const { return labels.count(addr) != 0; }
+
+	// the label, the nearest one below with +offset (up to 255 bytes), or $XXXX
+	std::string Name(uint16_t addr) const;
+
+private:
+	std::map<uint16_t, std::string> labels;
+	std::string error;
+};
+
+class Profiler
+{
+public:
+	explicit Profiler(Bus& b) : bus(b), pc_cycles(0x10000), pc_count(0x10000) {}
+
+	// the bus is on an instruction boundary, returns false to use it as a RunUntil() predicate as it is
+	bool Instruction();
+	void Clear();
+
+	uint64_t Cycles() const { return cycles; }
+	uint64_t Instructions() const { return instructions; }
+
+	// routines by exclusive ticks with inclusive ticks and calls, then the hottest instructions (disassembled)
+	std::string Flat(const Symbols& symbols, size_t lines = 30) const;
+	// one line per call path: "outer;inner;routine ticks", the input of flamegraph.pl
+	std::string Folded(const Symbols& symbols) const;
+
+private:
+	struct Node
+	{
+		uint16_t routine;
+		uint32_t parent;
+		uint64_t self = 0;
+		uint64_t calls = 0;
+	};
+	struct Frame
+	{
+		uint32_t node;
+		uint8_t sp;     // before the call, the frame is gone when SP gets back to it
+	};
+
+	static const size_t MaxFrames = 1024;
+
+	Bus& bus;
+	bool started = false;
+	uint64_t last_ticks = 0;
+	uint16_t last_pc = 0;
+	uint8_t last_sp = 0;
+	uint8_t last_op = 0;
+
+	uint64_t cycles = 0;
+	uint64_t instructions = 0;
+	uint64_t interrupts = 0;
+	std::vector<uint64_t> pc_cycles;
+	std::vector<uint64_t> pc_count;
+	std::vector<Node> nodes;                            // parents come before their children
+	std::unordered_map<uint64_t, uint32_t> children;    // parent << 16 | routine -> node
+	std::vector<Frame> frames;
+
+	void Call(uint16_t routine, uint8_t sp);
+	std::vector<uint64_t> Inclusive() const;
+	std::string Path(uint32_t node, const Symbols& symbols) const;
+};
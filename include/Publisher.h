@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include "mos6502.h"
+
+class Bus;
+class Disassembly;
+
+//
+// Machine state handed from the CPU thread to a UI thread without locks (triple buffer)
+//
+// The CPU thread fills the buffer nobody else has, between batches, and swaps it with the middle one; the
+// UI swaps the middle one with its own when there is a newer one. Neither side ever waits for the other,
+// and a buffer is only read once it's complete, so registers, cycle count and memory always go together.
+//
+// Only the memory pages that changed are copied: the buffer being filled is compared with the bus page by
+// page (the bus write tracking belongs to the state checkpoints, and comparing also catches bus[], loaded
+// states and rewinds). Publish() skips the work while the UI hasn't taken the last snapshot, so it costs
+// a compare of the 64K once per UI frame, not per batch.
+//
+// Given a disassembly index, Publish() also brings it up to date with the code written and run (Update(),
+// Seed() with the PC) and lists the lines around the PC into the snapshot. The index is only ever touched
+// by the CPU thread then, the UI formats the lines from the snapshot memory.
+//
+struct MachineView
+{
+	uint64_t serial;        // snapshots published before this one
+	uint64_t ticks;
+	uint16_t pc;            // of the instruction the CPU is at (Bus::opaddr)
+	Registers6502 regs;
+	Flags6502 flags;
+	Pins pins;
+	uint8_t memory[0x10000];    // backing memory of the pages, device registers aren't read
+
+	// listing around the PC: CodeBefore lines before it at most, then the PC line, then the lines after it
+	static const int CodeBefore = 13;
+	static const int CodeLines = CodeBefore * 2 + 1;
+	struct CodeLine
+	{
+		uint16_t addr;
+		bool data;          // a data byte, an instruction otherwise
+	};
+	CodeLine code[CodeLines];
+	uint8_t code_lines;     // filled, 0 without a disassembly or when the PC isn't on an instruction of it
+	uint8_t code_pc;        // index of the PC line
+};
+
+class Publisher
+{
+public:
+	// code: the debugger disassembly index to keep up and list from, nullptr for none
+	explicit Publisher(Bus& b, Disassembly* code = nullptr);
+
+	// CPU thread, between batches: false if the last snapshot hasn't been taken yet and force isn't set
+	bool Publish(bool force = false);
+
+	// UI thread: the newest snapshot, unchanged until the next call
+	const MachineView& Latest();
+
+private:
+	Publisher(const Publisher&) = delete;
+	Publisher& operator=(const Publisher&) = delete;
+
+	static const uint8_t Fresh = 4;     // in middle: published, not taken yet
+
+	Bus& bus;
+	Disassembly* code;
+	std::unique_ptr<MachineView[]> views;
+	uint8_t back = 0;                   // CPU thread
+	uint8_t front = 1;                  // UI thread
+	std::atomic<uint8_t> middle = { 2 };
+	uint64_t serial = 0;
+
+	void List(MachineView& v);
+};
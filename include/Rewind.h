@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <vector>
+#include "Bus.h"
+
+//
+// Rewind ring for reverse stepping
+//
+// History is kept in segments: a full keyframe (Bus::SaveState) followed by a journal with one record
+// per Mark() call (every instruction, or every block with the block cores). A record holds the old bytes
+// of the memory writes done since the previous mark and the bytes of the CPU/pins/bank state that changed
+// (a reverse delta, usually a dozen bytes), so stepping back one instruction costs next to nothing.
+// Going back by cycles loads the keyframe before the target and replays forward on the cycle core.
+// When the history outgrows max_bytes the oldest segments are dropped.
+//
+// While attached every bus write takes the slow path (Bus::WriteSlow), devices only get their backing memory
+// restored, and replaying assumes the same inputs (interrupt lines, device reads) as the first run.
+// Keyframes are Bus states, so they restart the SaveState delta chain. A new mapper (Bus::SetMapper(),
+// Bus::Clear()) drops the history.
+//
+struct RewindConfig
+{
+	uint64_t keyframe_cycles = 100000;  // cycles between keyframes
+	size_t max_bytes = 32 << 20;        // keyframes + journals
+};
+
+class Rewind
+{
+public:
+	Rewind(Bus& _bus, const RewindConfig& _config = RewindConfig());
+	~Rewind();
+
+	// record an instruction boundary, call it after every instruction (a RunUntil() predicate does)
+	void Mark();
+
+	// back to the previous mark (one instruction, or block), false when the history is used up
+	bool StepBack();
+	// back by the number of cycles, the CPU may end up mid-instruction (continue on a cycle core then)
+	bool BackCycles(uint64_t cycles);
+	// back to the n-th keyframe (the start of the current segment counts as the first one)
+	bool JumpBack(unsigned n = 1);
+	// drop the history, the current state becomes the first keyframe
+	void Clear();
+
+	uint64_t OldestCycle() const { return segments.front().ticks; }
+	size_t Bytes() const { return closed_bytes + segments.back().journal.size(); }
+	size_t Keyframes() const { return segments.size(); }
+
+private:
+	friend class Bus;
+
+	struct Segment
+	{
+		uint64_t ticks = 0;             // ticks_total at the keyframe
+		std::vector<uint8_t> keyframe;
+		std::vector<uint8_t> journal;   // records: writes, state delta, trailer (see Rewind.cpp)
+		size_t records = 0;
+	};
+
+	Bus& bus;
+	RewindConfig config;
+	std::deque<Segment> segments;
+	size_t closed_bytes = 0;            // all but the journal of the last segment
+
+	// CPU, pins and mapper bank at the last mark, the base of the next reverse delta
+	std::vector<uint8_t> last, current;
+	uint64_t last_ticks = 0;
+	size_t open = 0;                    // journal size at the last mark, writes after it are pending
+	unsigned mask_bytes = 0;
+
+	std::vector<uint8_t> mask;          // delta mask of Mark(), mask_bytes
+
+	// called from Bus::WriteSlow before the byte gets stored; by slot, not by pointer: undo writes the slot
+	// wherever it is mapped by then (bank switched out, state loaded)
+	void Journal(uint16_t addr, uint32_t slot, uint8_t old)
+	{
+		std::vector<uint8_t>& j = segments.back().journal;
+		size_t n = j.size();
+		j.resize(n + WriteSize);
+		std::memcpy(&j[n], &slot, 4);
+		j[n + 4] = (uint8_t)addr;
+		j[n + 5] = (uint8_t)(addr >> 8);
+		j[n + 6] = old;
+	}
+	static const size_t WriteSize = 7;  // slot, address, old byte
+
+	void Capture(std::vector<uint8_t>& image);
+	void Restore(const std::vector<uint8_t>& image);
+	void UndoWrites(Segment& s, size_t from, size_t to);
+	void NewSegment();
+	void ToKeyframe();
+};
@@ -0,0 +1,99 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "mos6502.h"
+
+//
+// Machine state format (Bus::SaveState/LoadState), little endian, every field written explicitly:
+//
+//   header   "65ST", u16 version, u8 kind (full/delta), u8 0, u64 id, u64 base id (delta only, 0 for full)
+//   cpu      registers, flags, internal tick state and pins of mos6502, u64 ticks_total
+//   bus      pins
+//   mapper   u8 type, u8 window, u8 pages, u16 control, u32 banks, u32 bank
+//   memory   u32 count, then count times { u32 slot, 256 bytes }
+//
+// Memory goes by storage page ("slot"), not by bus page: slots 0-255 are the bus RAM, the ones after it
+// the RAM banks of a RamWindow mapper. A full state has all of them, a delta only the slots written since
+// the checkpoint it was taken against (the previous SaveState/LoadState, its id is the base id).
+//
+
+enum class StateKind : uint8_t
+{
+	Full,
+	Delta,
+};
+
+class StateWriter
+{
+	std::vector<uint8_t>& out;
+
+public:
+	StateWriter(std::vector<uint8_t>& _out) : out(_out) {}
+
+	void u8(uint8_t v) { out.push_back(v); }
+	void u16(uint16_t v) { u8((uint8_t)v); u8((uint8_t)(v >> 8)); }
+	void u32(uint32_t v) { u16((uint16_t)v); u16((uint16_t)(v >> 16)); }
+	void u64(uint64_t v) { u32((uint32_t)v); u32((uint32_t)(v >> 32)); }
+	void bytes(const uint8_t* p, size_t n) { out.insert(out.end(), p, p + n); }
+	void pins(const Pins& p)
+	{
+		u8((uint8_t)(p.IRQ | (p.NMI << 1) | (p.RDY << 2) | (p.RES << 3) | (p.RW << 4) | (p.SYNC << 5)));
+		u8(p.PORT);
+		u8(p.DATA);
+		u16(p.ADDR);
+	}
+};
+
+// reads past the end return zeroes and clear ok
+class StateReader
+{
+	const uint8_t* p;
+	const uint8_t* end;
+
+public:
+	bool ok = true;
+
+	StateReader(const uint8_t* data, size_t size) : p(data), end(data + size) {}
+
+	uint8_t u8()
+	{
+		if (p == end)
+		{
+			ok = false;
+			return 0;
+		}
+		return *p++;
+	}
+	uint16_t u16() { uint16_t v = u8(); return (uint16_t)(v | (u8() << 8)); }
+	uint32_t u32() { uint32_t v = u16(); return v | ((uint32_t)u16() << 16); }
+	uint64_t u64() { uint64_t v = u32(); return v | ((uint64_t)u32() << 32); }
+	// n bytes in place, nullptr if there aren't that many left
+	const uint8_t* take(size_t n)
+	{
+		if ((size_t)(end - p) < n)
+		{
+			ok = false;
+			return nullptr;
+		}
+		const uint8_t* r = p;
+		p += n;
+		return r;
+	}
+	Pins pins()
+	{
+		Pins p;
+		uint8_t b = u8();
+		p.IRQ = b & 1;
+		p.NMI = (b >> 1) & 1;
+		p.RDY = (b >> 2) & 1;
+		p.RES = (b >> 3) & 1;
+		p.RW = (b >> 4) & 1;
+		p.SYNC = (b >> 5) & 1;
+		p.PORT = u8();
+		p.DATA = u8();
+		p.ADDR = u16();
+		return p;
+	}
+	bool done() const { return p == end; }
+};
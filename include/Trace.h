@@ -0,0 +1,172 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mos6502.h"
+
+//
+// Binary bus trace: the pins of every cycle (ADDR, DATA, RW, SYNC, IRQ, NMI, RDY, RES), for offline analysis
+//
+// The run loop only stores a 4 byte record per cycle into the current chunk buffer; full chunks go to a
+// background thread that encodes and writes them. Pins are sampled once the cycle is complete (the read
+// DATA is on the bus), numbered by ticks_total; cycles the CPU is held in (RDY, reset) don't advance it
+// and repeat the number of the cycle they hold up. Only the cycle cores (Core::Cycle, Core::Microcode and
+// Bus::CPU_Step()) have bus cycles, the instruction level cores don't record anything.
+//
+// File format, little endian:
+//
+//   header   "65TR", u16 version, u16 0, u32 cycles per chunk
+//   chunks   u64 first cycle, u32 cycles, u32 ticks (last cycle - first + 1), u32 bytes, u64 hash, encoded cycles
+//   index    count times { u64 first cycle, u32 cycles, u32 ticks, u32 bytes, u64 hash, u64 file offset }
+//   footer   u64 index offset, u32 count, "65TI"
+//
+// Cycles are consecutive within a chunk, a jump of ticks_total (LoadState, rewind) starts a new one.
+// Every chunk decodes on its own, so the index makes the file seekable by cycle; a file without the footer
+// (recording cut short) is still read by walking the chunks. The hash is of the encoded cycles: chunks
+// with the same first cycle, length and hash hold the same cycles, CompareTraces() skips them unread.
+// Encoded cycle: one control byte
+//
+//   bit 0 RW, bit 1 SYNC, bit 2 lines changed: a byte with IRQ/NMI/RDY/RES in bits 0-3 and "held" (same
+//         ticks_total as the cycle before) in bit 4 follows
+//   bits 3-7 ADDR: 0-27 delta -8..19, 28 int8 delta follows, 29 u16 ADDR follows
+//
+// then the DATA byte. ADDR is a delta to the previous cycle, or to the previous SYNC cycle on SYNC cycles
+// (the PC of the last opcode fetch), so most cycles take 2 bytes.
+//
+
+class MappedFile;
+
+struct TraceCycle
+{
+	uint64_t cycle;     // ticks_total
+	bool held;          // the CPU didn't advance, same cycle as the one before
+	Pins pins;          // PORT isn't recorded
+};
+
+struct TraceChunk
+{
+	uint64_t first;     // cycle of the first record
+	uint32_t cycles;    // records
+	uint32_t ticks;     // cycle numbers covered, less than cycles when the CPU was held
+	uint32_t bytes;     // encoded size
+	uint64_t hash;      // of the encoded cycles
+	uint64_t offset;    // of the chunk header in the file
+};
+
+class TraceWriter
+{
+public:
+	TraceWriter() {}
+	~TraceWriter();
+
+	// creates the file and starts the writer thread, chunk_cycles records per chunk
+	bool Open(const char* path, uint32_t chunk_cycles = 1 << 16);
+	// pending chunks, the index and the footer, false if anything couldn't be written
+	bool Close();
+	const std::string& Error() const { return error; }
+	uint64_t Cycles() const { return cycles; }
+
+	// one bus cycle, called by the cycle cores of an attached Bus (Bus::SetTrace())
+	void Record(uint64_t ticks, const Pins& p)
+	{
+		uint32_t held = 0;
+		if (ticks != next_ticks || fill == end)
+			held = Jump(ticks);
+		*fill++ = p.ADDR | p.DATA << 16 | (uint32_t)(p.IRQ | p.NMI << 1 | p.RDY << 2 | p.RES << 3 | p.RW << 4 | p.SYNC << 5) << 24 | held;
+		next_ticks = ticks + 1;
+	}
+
+private:
+	TraceWriter(const TraceWriter&) = delete;
+	TraceWriter& operator=(const TraceWriter&) = delete;
+
+	struct Buffer
+	{
+		uint64_t first = 0;
+		std::vector<uint32_t> records;  // ADDR | DATA << 16 | pin bits << 24, bit 30 held
+		size_t count = 0;
+		uint64_t last = 0;              // cycle of the last record
+	};
+
+	uint32_t* fill = nullptr;
+	uint32_t* end = nullptr;
+	uint64_t next_ticks = 0;
+	uint64_t cycles = 0;                // in submitted chunks
+	std::unique_ptr<Buffer> current;
+
+	// chunks waiting for the writer thread, the number of buffers is bounded (the run loop waits for it)
+	std::mutex lock;
+	std::condition_variable ready, done;
+	std::deque<std::unique_ptr<Buffer>> queue, spare;
+	unsigned buffers = 0;
+	bool closing = false;
+	std::thread writer;
+
+	std::ofstream file;
+	uint32_t chunk_cycles = 0;
+	uint64_t offset = 0;
+	std::vector<TraceChunk> index;
+	std::vector<uint8_t> encoded;
+	bool failed = false;
+	std::string error;
+
+	uint32_t Jump(uint64_t ticks);
+	void NewChunk(uint64_t ticks);
+	void Submit();
+	void WriterThread();
+	void Write(const Buffer& b);
+};
+
+class TraceReader
+{
+public:
+	bool Open(const char* path);
+	const std::string& Error() const { return error; }
+
+	const std::vector<TraceChunk>& Chunks() const { return chunks; }
+	uint64_t Cycles() const;
+
+	// the next Next() returns the cycle (the latest chunk holding it), false if the trace hasn't got it
+	bool Seek(uint64_t cycle);
+	// the next Next() returns the n-th record of the file
+	bool SeekRecord(uint64_t n);
+	// cycles in file order, false at the end (or on a damaged chunk, see Error())
+	bool Next(TraceCycle& c);
+	// decoded chunk, false if it's damaged
+	bool Decode(size_t chunk, std::vector<TraceCycle>& out);
+
+private:
+	std::shared_ptr<MappedFile> file;
+	std::vector<TraceChunk> chunks;
+	std::vector<TraceCycle> decoded;
+	size_t chunk = 0;                   // next chunk to decode
+	size_t pos = 0;                     // next cycle in decoded
+	std::string error;
+};
+
+enum class TraceDiff : uint8_t
+{
+	Same,
+	Differ,
+	Error,      // damaged chunk (the reader has the error)
+};
+
+struct TraceMismatch
+{
+	uint64_t record = 0;        // records before it, the same in both traces
+	uint64_t cycle = 0;         // of the first trace (of the second one if the first ended)
+	bool a_ended = false;       // the trace is a prefix of the other one
+	bool b_ended = false;
+	uint64_t chunks_skipped = 0;// chunk pairs matched by hash, without decoding
+};
+
+// Cycles of both traces in file order, pair by pair (cycle number, held, pins); chunk pairs with the same
+// first cycle, length and hash are skipped. Traces recorded with the same chunk size from the same start
+// line up chunk for chunk, anything else is compared cycle by cycle.
+TraceDiff CompareTraces(TraceReader& a, TraceReader& b, TraceMismatch& m);
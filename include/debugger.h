@@ -3,26 +3,33 @@
 #include <cstdint>
 #include <cstring>
 #include <string>
-#include <map>
 #include <array>
 #include "Bus.h"
 #include "mos6502.h"
+#include "Disassembly.h"
+#include "Breakpoints.h"
 
 class Debugger 
 {
 private:
 public:
 	Bus& bus;
-	std::map<uint16_t, std::string> mapAsm;
+	// filled by disassemble() or Trace(), kept up to date with code writes by Update()
+	Disassembly code;
+	// checked by RunUntil() only while one is set
+	Breakpoints breaks;
 public:
-	Debugger(Bus& _bus) : bus(_bus) { }
+	Debugger(Bus& _bus) : bus(_bus), code(_bus), breaks(_bus) { }
 	~Debugger() {}
 
 	Registers6502& getRegisters() { return bus.CPU.R; }
 	Flags6502& getFlags() { return bus.CPU.S; }
-	uint8_t Read(uint16_t addr) { return bus.RAM[addr]; }
-	void Write(uint16_t addr, uint8_t data) { bus.RAM[addr] = data; }
+	uint8_t Read(uint16_t addr) { return bus[addr]; }
+	void Write(uint16_t addr, uint8_t data) { bus[addr] = data; }
 
 	void disassemble(uint16_t nStart, uint16_t nStop);
-	size_t getRAMSize() { return bus.RAM.size(); }
+	// "x C000", "rw 0200-02FF DATA==0", "x E000-EFFF A==$20 && X>3": kinds (x r w), address or range (hex),
+	// condition; returns the id, -1 with error set
+	int setBreakpoint(const std::string& spec, std::string& error);
+	size_t getRAMSize() { return Bus::RamSlots * 256; }
 };
\ No newline at end of file
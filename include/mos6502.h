@@ -1,8 +1,19 @@
 #pragma once
 #include <cstdint>
+#include <type_traits>
+#ifdef MOS6502_STATS
+#include "ExecStats.h"
+#endif
+
+class Bus;
+class BlockCache;
+class StateWriter;
+class StateReader;
+struct ExecStats;
 
 // 
 // Virtual CPU pins - the only way CPU should talk to the outside world
+// (except the instruction level mode, which reads and writes memory via the Bus directly)
 //
 struct Pins
 {
@@ -33,29 +44,30 @@ class Flags6502
 {
     uint8_t _S; // flags byte
 
-    class Flag
+    bool get(FLAGS6502 m) const { return _S & static_cast<uint8_t>(m); }
+    void set(FLAGS6502 m, bool f)
     {
-        uint8_t& S;
-        const FLAGS6502 M;
-    public:
-        Flag(uint8_t& x, const FLAGS6502 mask) : S(x), M(mask)  {}
-        operator bool() const { return S & static_cast<uint8_t>(M); }
-        // not sure if S.C = true/false is better than S.C.Set() S.C.Clr()
-        void Clr() { S &= ~static_cast<uint8_t>(M); }
-        void Set() { S |= static_cast<uint8_t>(M); }
-        Flag& operator=(bool const& f) { f ? Set() : Clr(); return *this; }
-    };
+        _S = (_S & ~static_cast<uint8_t>(m)) | (f ? static_cast<uint8_t>(m) : 0);
+    }
 
 public:
-    // access individual flags in S register
-    Flag C = { _S, FLAGS6502::CF };
-    Flag Z = { _S, FLAGS6502::ZF };
-    Flag I = { _S, FLAGS6502::IF };
-    Flag D = { _S, FLAGS6502::DF };
-    Flag B = { _S, FLAGS6502::BF };
-    Flag X = { _S, FLAGS6502::XF };
-    Flag V = { _S, FLAGS6502::VF };
-    Flag N = { _S, FLAGS6502::NF };
+    // access individual flags in S register: S.C() to read, S.C(true) to write
+    bool C() const { return get(FLAGS6502::CF); }
+    bool Z() const { return get(FLAGS6502::ZF); }
+    bool I() const { return get(FLAGS6502::IF); }
+    bool D() const { return get(FLAGS6502::DF); }
+    bool B() const { return get(FLAGS6502::BF); }
+    bool X() const { return get(FLAGS6502::XF); }
+    bool V() const { return get(FLAGS6502::VF); }
+    bool N() const { return get(FLAGS6502::NF); }
+    void C(bool f) { set(FLAGS6502::CF, f); }
+    void Z(bool f) { set(FLAGS6502::ZF, f); }
+    void I(bool f) { set(FLAGS6502::IF, f); }
+    void D(bool f) { set(FLAGS6502::DF, f); }
+    void B(bool f) { set(FLAGS6502::BF, f); }
+    void X(bool f) { set(FLAGS6502::XF, f); }
+    void V(bool f) { set(FLAGS6502::VF, f); }
+    void N(bool f) { set(FLAGS6502::NF, f); }
     // register as is (for stack operations)
     Flags6502& operator=(uint8_t const& s) { _S = s; return *this; }
     operator uint8_t() const { return _S; }
@@ -72,10 +84,12 @@ struct Registers6502
     uint16_t PC; // program counter
 };
 
-class mos6502
+class alignas(64) mos6502
 {
     // Helper class with raw registers, states and private methods access for debugging/monitoring purposes
     friend class Debugger;
+    // native code of the recompiler works on the registers directly
+    friend class Jit;
 
 private:
     typedef void (mos6502::* OpFunc)();
@@ -87,278 +101,40 @@ private:
         OpFunc func;       // function method reference (LDA, ORA, CMP, CLI, etc...)
         uint8_t cycles;    // number of cycles required to execute the instruction
     };
-    //  CPU instructions jump table
-    const OpData op_table[256] { 
-        { "BRK", &mos6502::Addr_imp,      &mos6502::Op_BRK,         7 },  // 0x00 
-        { "ORA", &mos6502::Addr_ind_X,    &mos6502::Op_ORA,         6 },  // 0x01
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x02
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x03
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x04
-        { "ORA", &mos6502::Addr_zpg,      &mos6502::Op_ORA,         3 },  // 0x05
-        { "ASL", &mos6502::Addr_zpg,      &mos6502::Op_ASL,         5 },  // 0x06
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x07
-        { "PHP", &mos6502::Addr_imp,      &mos6502::Op_PHP,         3 },  // 0x08
-        { "ORA", &mos6502::Addr_imm,      &mos6502::Op_ORA,         2 },  // 0x09
-        { "ASL", &mos6502::Addr_imp,      &mos6502::Op_ASL_A,       2 },  // 0x0A
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x0B
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x0C
-        { "ORA", &mos6502::Addr_abs,      &mos6502::Op_ORA,         4 },  // 0x0D
-        { "ASL", &mos6502::Addr_abs,      &mos6502::Op_ASL,         6 },  // 0x0E
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x0F
-        { "BPL", &mos6502::Addr_rel,      &mos6502::Op_BPL,         4 },  // 0x10
-        { "ORA", &mos6502::Addr_ind_Y,    &mos6502::Op_ORA,         6 },  // 0x11
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x12
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x13
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x14
-        { "ORA", &mos6502::Addr_zpg_X,    &mos6502::Op_ORA,         4 },  // 0x15
-        { "ASL", &mos6502::Addr_zpg_X,    &mos6502::Op_ASL,         6 },  // 0x16
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x17
-        { "CLC", &mos6502::Addr_imp,      &mos6502::Op_CLC,         2 },  // 0x18
-        { "ORA", &mos6502::Addr_abs_Y,    &mos6502::Op_ORA,         5 },  // 0x19
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x1A
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x1B
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x1C
-        { "ORA", &mos6502::Addr_abs_X,    &mos6502::Op_ORA,         5 },  // 0x1D
-        { "ASL", &mos6502::Addr_abs_X,    &mos6502::Op_ASL,         7 },  // 0x1E
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x1F
-        { "JSR", &mos6502::Addr_jsr,      &mos6502::Op_JSR,         6 },  // 0x20
-        { "AND", &mos6502::Addr_ind_X,    &mos6502::Op_AND,         6 },  // 0x21
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x22
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x23
-        { "BIT", &mos6502::Addr_zpg,      &mos6502::Op_BIT,         3 },  // 0x24
-        { "AND", &mos6502::Addr_zpg,      &mos6502::Op_AND,         3 },  // 0x25
-        { "ROL", &mos6502::Addr_zpg,      &mos6502::Op_ROL,         5 },  // 0x26
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x27
-        { "PLP", &mos6502::Addr_imp,      &mos6502::Op_PLP,         4 },  // 0x28
-        { "AND", &mos6502::Addr_imm,      &mos6502::Op_AND,         2 },  // 0x29
-        { "ROL", &mos6502::Addr_imp,      &mos6502::Op_ROL_A,       2 },  // 0x2A
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x2B
-        { "BIT", &mos6502::Addr_abs,      &mos6502::Op_BIT,         4 },  // 0x2C
-        { "AND", &mos6502::Addr_abs,      &mos6502::Op_AND,         4 },  // 0x2D
-        { "ROL", &mos6502::Addr_abs,      &mos6502::Op_ROL,         6 },  // 0x2E
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x2F
-        { "BMI", &mos6502::Addr_rel,      &mos6502::Op_BMI,         4 },  // 0x30
-        { "AND", &mos6502::Addr_ind_Y,    &mos6502::Op_AND,         6 },  // 0x31
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x32
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x33
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x34
-        { "AND", &mos6502::Addr_zpg_X,    &mos6502::Op_AND,         7 },  // 0x35
-        { "ROL", &mos6502::Addr_zpg_X,    &mos6502::Op_ROL,         7 },  // 0x36
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x37
-        { "SEC", &mos6502::Addr_imp,      &mos6502::Op_SEC,         2 },  // 0x38
-        { "AND", &mos6502::Addr_abs_Y,    &mos6502::Op_AND,         5 },  // 0x39
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x3A
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x3B
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x3C
-        { "AND", &mos6502::Addr_abs_X,    &mos6502::Op_AND,         5 },  // 0x3D
-        { "ROL", &mos6502::Addr_abs_X,    &mos6502::Op_ROL,         7 },  // 0x3E
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x3F
-        { "RTI", &mos6502::Addr_imp,      &mos6502::Op_RTI,         6 },  // 0x40
-        { "EOR", &mos6502::Addr_ind_X,    &mos6502::Op_EOR,         6 },  // 0x41
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x42
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x43
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x44
-        { "EOR", &mos6502::Addr_zpg,      &mos6502::Op_EOR,         3 },  // 0x45
-        { "LSR", &mos6502::Addr_zpg,      &mos6502::Op_LSR,         5 },  // 0x46
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x47
-        { "PHA", &mos6502::Addr_imp,      &mos6502::Op_PHA,         3 },  // 0x48
-        { "EOR", &mos6502::Addr_imm,      &mos6502::Op_EOR,         2 },  // 0x49
-        { "LSR", &mos6502::Addr_imp,      &mos6502::Op_LSR_A,       2 },  // 0x4A
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x4B
-        { "JMP", &mos6502::Addr_abs,      &mos6502::Op_JMP,         3 },  // 0x4C
-        { "EOR", &mos6502::Addr_abs,      &mos6502::Op_EOR,         4 },  // 0x4D
-        { "LSR", &mos6502::Addr_abs,      &mos6502::Op_LSR,         6 },  // 0x4E
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x4F
-        { "BVC", &mos6502::Addr_rel,      &mos6502::Op_BVC,         4 },  // 0x50
-        { "EOR", &mos6502::Addr_ind_Y,    &mos6502::Op_EOR,         6 },  // 0x51
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x52
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x53
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x54
-        { "EOR", &mos6502::Addr_zpg_X,    &mos6502::Op_EOR,         4 },  // 0x55
-        { "LSR", &mos6502::Addr_zpg_X,    &mos6502::Op_LSR,         6 },  // 0x56
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x57
-        { "CLI", &mos6502::Addr_imp,      &mos6502::Op_CLI,         2 },  // 0x58
-        { "EOR", &mos6502::Addr_abs_Y,    &mos6502::Op_EOR,         5 },  // 0x59
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x5A
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x5B
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x5C
-        { "EOR", &mos6502::Addr_abs_X,    &mos6502::Op_EOR,         5 },  // 0x5D
-        { "LSR", &mos6502::Addr_abs_X,    &mos6502::Op_LSR,         7 },  // 0x5E
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x5F
-        { "RTS", &mos6502::Addr_imp,      &mos6502::Op_RTS,         6 },  // 0x60
-        { "ADC", &mos6502::Addr_ind_X,    &mos6502::Op_ADC,         6 },  // 0x61
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x62
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x63
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x64
-        { "ADC", &mos6502::Addr_zpg,      &mos6502::Op_ADC,         3 },  // 0x65
-        { "ROR", &mos6502::Addr_zpg,      &mos6502::Op_ROR,         5 },  // 0x66
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x67
-        { "PLA", &mos6502::Addr_imp,      &mos6502::Op_PLA,         4 },  // 0x68
-        { "ADC", &mos6502::Addr_imm,      &mos6502::Op_ADC,         2 },  // 0x69
-        { "ROR", &mos6502::Addr_imp,      &mos6502::Op_ROR_A,       2 },  // 0x6A
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x6B
-        { "JMP", &mos6502::Addr_ind,      &mos6502::Op_JMP,         5 },  // 0x6C
-        { "ADC", &mos6502::Addr_abs,      &mos6502::Op_ADC,         4 },  // 0x6D
-        { "ROR", &mos6502::Addr_abs,      &mos6502::Op_ROR,         6 },  // 0x6E
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x6F
-        { "BVS", &mos6502::Addr_rel,      &mos6502::Op_BVS,         4 },  // 0x70
-        { "ADC", &mos6502::Addr_ind_Y,    &mos6502::Op_ADC,         6 },  // 0x71
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x72
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x73
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x74
-        { "ADC", &mos6502::Addr_zpg_X,    &mos6502::Op_ADC,         4 },  // 0x75
-        { "ROR", &mos6502::Addr_zpg_X,    &mos6502::Op_ROR,         6 },  // 0x76
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x77
-        { "SEI", &mos6502::Addr_imp,      &mos6502::Op_SEI,         2 },  // 0x78
-        { "ADC", &mos6502::Addr_abs_Y,    &mos6502::Op_ADC,         5 },  // 0x79
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x7A
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x7B
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x7C
-        { "ADC", &mos6502::Addr_abs_X,    &mos6502::Op_ADC,         5 },  // 0x7D
-        { "ROR", &mos6502::Addr_abs_X,    &mos6502::Op_ROR,         7 },  // 0x7E
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x7F
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x80
-        { "STA", &mos6502::Addr_ind_X,    &mos6502::Op_STA,         6 },  // 0x81
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x82
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x83
-        { "STY", &mos6502::Addr_zpg,      &mos6502::Op_STY,         3 },  // 0x84
-        { "STA", &mos6502::Addr_zpg,      &mos6502::Op_STA,         3 },  // 0x85
-        { "STX", &mos6502::Addr_zpg,      &mos6502::Op_STX,         3 },  // 0x86
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x87
-        { "DEY", &mos6502::Addr_imp,      &mos6502::Op_DEY,         2 },  // 0x88
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x89
-        { "TXA", &mos6502::Addr_imp,      &mos6502::Op_TXA,         2 },  // 0x8A
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x8B
-        { "STY", &mos6502::Addr_abs,      &mos6502::Op_STY,         4 },  // 0x8C
-        { "STA", &mos6502::Addr_abs,      &mos6502::Op_STA,         4 },  // 0x8D
-        { "STX", &mos6502::Addr_abs,      &mos6502::Op_STX,         4 },  // 0x8E
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x8F
-        { "BCC", &mos6502::Addr_rel,      &mos6502::Op_BCC,         4 },  // 0x90
-        { "STA", &mos6502::Addr_ind_Y,    &mos6502::Op_STA,         6 },  // 0x91
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x92
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x93
-        { "STY", &mos6502::Addr_zpg_X,    &mos6502::Op_STY,         4 },  // 0x94
-        { "STA", &mos6502::Addr_zpg_X,    &mos6502::Op_STA,         4 },  // 0x95
-        { "STX", &mos6502::Addr_zpg_Y,    &mos6502::Op_STX,         4 },  // 0x96
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x97
-        { "TYA", &mos6502::Addr_imp,      &mos6502::Op_TYA,         2 },  // 0x98
-        { "STA", &mos6502::Addr_abs_Y,    &mos6502::Op_STA,         5 },  // 0x99
-        { "TXS", &mos6502::Addr_imp,      &mos6502::Op_TXS,         7 },  // 0x9A
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x9B
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x9C
-        { "STA", &mos6502::Addr_abs_X,    &mos6502::Op_STA,         5 },  // 0x9D
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x9E
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x9F
-        { "LDY", &mos6502::Addr_imm,      &mos6502::Op_LDY,         2 },  // 0xA0
-        { "LDA", &mos6502::Addr_ind_X,    &mos6502::Op_LDA,         6 },  // 0xA1
-        { "LDX", &mos6502::Addr_imm,      &mos6502::Op_LDX,         2 },  // 0xA2
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xA3
-        { "LDY", &mos6502::Addr_zpg,      &mos6502::Op_LDY,         3 },  // 0xA4
-        { "LDA", &mos6502::Addr_zpg,      &mos6502::Op_LDA,         3 },  // 0xA5
-        { "LDX", &mos6502::Addr_zpg,      &mos6502::Op_LDX,         3 },  // 0xA6
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xA7
-        { "TAY", &mos6502::Addr_imp,      &mos6502::Op_TAY,         2 },  // 0xA8
-        { "LDA", &mos6502::Addr_imm,      &mos6502::Op_LDA,         2 },  // 0xA9
-        { "TAX", &mos6502::Addr_imp,      &mos6502::Op_TAX,         2 },  // 0xAA
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xAB
-        { "LDY", &mos6502::Addr_abs,      &mos6502::Op_LDY,         4 },  // 0xAC
-        { "LDA", &mos6502::Addr_abs,      &mos6502::Op_LDA,         4 },  // 0xAD
-        { "LDX", &mos6502::Addr_abs,      &mos6502::Op_LDX,         4 },  // 0xAE
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xAF
-        { "BCS", &mos6502::Addr_rel,      &mos6502::Op_BCS,         4 },  // 0xB0
-        { "LDA", &mos6502::Addr_ind_Y,    &mos6502::Op_LDA,         6 },  // 0xB1
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xB2
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xB3
-        { "LDY", &mos6502::Addr_zpg_X,    &mos6502::Op_LDY,         4 },  // 0xB4
-        { "LDA", &mos6502::Addr_zpg_X,    &mos6502::Op_LDA,         4 },  // 0xB5
-        { "LDX", &mos6502::Addr_zpg_Y,    &mos6502::Op_LDX,         4 },  // 0xB6
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xB7
-        { "CLV", &mos6502::Addr_imp,      &mos6502::Op_CLV,         2 },  // 0xB8
-        { "LDA", &mos6502::Addr_abs_Y,    &mos6502::Op_LDA,         5 },  // 0xB9
-        { "TSX", &mos6502::Addr_imp,      &mos6502::Op_TSX,         2 },  // 0xBA
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xBB
-        { "LDY", &mos6502::Addr_abs_X,    &mos6502::Op_LDY,         5 },  // 0xBC
-        { "LDA", &mos6502::Addr_abs_X,    &mos6502::Op_LDA,         5 },  // 0xBD
-        { "LDX", &mos6502::Addr_abs_Y,    &mos6502::Op_LDX,         5 },  // 0xBE
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xBF
-        { "CPY", &mos6502::Addr_imm,      &mos6502::Op_CPY,         2 },  // 0xC0
-        { "CMP", &mos6502::Addr_ind_X,    &mos6502::Op_CMP,         6 },  // 0xC1
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xC2
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xC3
-        { "CPY", &mos6502::Addr_zpg,      &mos6502::Op_CPY,         3 },  // 0xC4
-        { "CMP", &mos6502::Addr_zpg,      &mos6502::Op_CMP,         3 },  // 0xC5
-        { "DEC", &mos6502::Addr_zpg,      &mos6502::Op_DEC,         5 },  // 0xC6
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xC7
-        { "INY", &mos6502::Addr_imp,      &mos6502::Op_INY,         2 },  // 0xC8
-        { "CMP", &mos6502::Addr_imm,      &mos6502::Op_CMP,         2 },  // 0xC9
-        { "DEX", &mos6502::Addr_imp,      &mos6502::Op_DEX,         2 },  // 0xCA
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xCB
-        { "CPY", &mos6502::Addr_abs,      &mos6502::Op_CPY,         4 },  // 0xCC
-        { "CMP", &mos6502::Addr_abs,      &mos6502::Op_CMP,         4 },  // 0xCD
-        { "DEC", &mos6502::Addr_abs,      &mos6502::Op_DEC,         6 },  // 0xCE
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xCF
-        { "BNE", &mos6502::Addr_rel,      &mos6502::Op_BNE,         4 },  // 0xD0
-        { "CMP", &mos6502::Addr_ind_Y,    &mos6502::Op_CMP,         6 },  // 0xD1
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xD2
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xD3
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xD4
-        { "CMP", &mos6502::Addr_zpg_X,    &mos6502::Op_CMP,         4 },  // 0xD5
-        { "DEC", &mos6502::Addr_zpg_X,    &mos6502::Op_DEC,         6 },  // 0xD6
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xD7
-        { "CLD", &mos6502::Addr_imp,      &mos6502::Op_CLD,         2 },  // 0xD8
-        { "CMP", &mos6502::Addr_abs_Y,    &mos6502::Op_CMP,         5 },  // 0xD9
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xDA
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xDB
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xDC
-        { "CMP", &mos6502::Addr_abs_X,    &mos6502::Op_CMP,         5 },  // 0xDD
-        { "DEC", &mos6502::Addr_abs_X,    &mos6502::Op_DEC,         7 },  // 0xDE
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xDF
-        { "CPX", &mos6502::Addr_imm,      &mos6502::Op_CPX,         2 },  // 0xE0
-        { "SBC", &mos6502::Addr_ind_X,    &mos6502::Op_SBC,         6 },  // 0xE1
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xE2
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xE3
-        { "CPX", &mos6502::Addr_zpg,      &mos6502::Op_CPX,         3 },  // 0xE4
-        { "SBC", &mos6502::Addr_zpg,      &mos6502::Op_SBC,         3 },  // 0xE5
-        { "INC", &mos6502::Addr_zpg,      &mos6502::Op_INC,         5 },  // 0xE6
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xE7
-        { "INX", &mos6502::Addr_imp,      &mos6502::Op_INX,         2 },  // 0xE8
-        { "SBC", &mos6502::Addr_imm,      &mos6502::Op_SBC,         2 },  // 0xE9
-        { "NOP", &mos6502::Addr_imp,      &mos6502::Op_NOP,         2 },  // 0xEA
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xEB
-        { "CPX", &mos6502::Addr_abs,      &mos6502::Op_CPX,         4 },  // 0xEC
-        { "SBC", &mos6502::Addr_abs,      &mos6502::Op_SBC,         4 },  // 0xED
-        { "INC", &mos6502::Addr_abs,      &mos6502::Op_INC,         6 },  // 0xEE
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xEF
-        { "BEQ", &mos6502::Addr_rel,      &mos6502::Op_BEQ,         4 },  // 0xF0
-        { "SBC", &mos6502::Addr_ind_Y,    &mos6502::Op_SBC,         6 },  // 0xF1
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xF2
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xF3
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xF4
-        { "SBC", &mos6502::Addr_zpg_X,    &mos6502::Op_SBC,         4 },  // 0xF5
-        { "INC", &mos6502::Addr_zpg_X,    &mos6502::Op_INC,         6 },  // 0xF6
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xF7
-        { "SED", &mos6502::Addr_imp,      &mos6502::Op_SED,         2 },  // 0xF8
-        { "SBC", &mos6502::Addr_abs_Y,    &mos6502::Op_SBC,         5 },  // 0xF9
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xFA
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xFB
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xFC
-        { "SBC", &mos6502::Addr_abs_X,    &mos6502::Op_SBC,         5 },  // 0xFD
-        { "INC", &mos6502::Addr_abs_X,    &mos6502::Op_INC,         7 },  // 0xFE
-        { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 }   // 0xFF
-    };
+    //  CPU instructions jump table, shared by all CPU instances (see mos6502.cpp)
+    static const OpData op_table[256];
+    // instruction lengths in bytes, from the op_table addressing modes
+    static const uint8_t op_length[256];
+
+    //// CPU state
+    // Everything the CPU needs on every tick is packed in the first bytes of the object,
+    // the whole CPU fits in one cache line and can be copied as plain bytes
 
     //// Registers
     Registers6502 R;
+    Flags6502 S;  // CPU flags (accessed R/W by bits and entire byte)
 
+    uint8_t Opcode; // current instruction byte
+    uint8_t ticks; // ticks to handle current instruction
+    uint8_t ticks_func; // ticks spent doing function part after addressing is done
     uint8_t AD;  // internal data register
+    bool addressing_done;  // set by Addr_xxx after all addressing ticks are completed to start Op_xxx calling
     uint16_t AR; // internal address register
 
-    uint8_t ticks; // ticks to handle current instruction
-    uint8_t ticks_func; // ticks spent doing function part after addressing is done
-    uint8_t Opcode; // current instruction byte
+    Pins _pins;
+
+    // interrupt signals to activate after finishing executing pending instruction
+    bool NMI_signal;
+    bool IRQ_signal;
+
     uint64_t ticks_total; // total number of ticks per emulation session
 
-    Flags6502 S;  // CPU flags (accessed R/W by bits and entire byte)
+#ifdef MOS6502_STATS
+    // execution statistics (ExecStats.h), past the first cache line
+    ExecStats* stats;
+    uint64_t stat_start;    // ticks_total at the opcode fetch of the instruction the cycle cores run
+    uint8_t stat_kind;      // of that instruction: StatNone, StatOp, StatIRQ, StatNMI
+#endif
 
     // 16-bit fixed system vectors, accessed by CPU
     static const uint16_t nmiVectorL = 0xFFFA;
@@ -370,11 +146,6 @@ private:
     // stack base address
     static const uint16_t stackBase = 0x100;
 
-    bool addressing_done;  // set by Addr_xxx after all addressing ticks are completed to start Op_xxx calling
-    // interrupt signals to activate after finishing executing pending instruction
-    bool NMI_signal;
-    bool IRQ_signal;
-
     // bad opcode 
     void Op_BAD() { NextOp(); }
     // reset operation - init PC from reset vector in 7 ticks
@@ -484,6 +255,51 @@ private:
         _pins.SYNC = true;
     }
 
+    // common start of tick() and tick_mc(): interrupts latching, RDY, reset & opcode fetch
+    // returns false if nothing else should be done during this tick
+    inline bool TickStart(const Pins& pins);
+
+    // execution statistics hooks, empty without MOS6502_STATS
+    enum : uint8_t { StatNone, StatOp, StatIRQ, StatNMI };
+    // cycle cores, opcode fetch: the instruction before is done, the next one (or an interrupt) starts
+    inline void StatFetch();
+    // instruction level: counts the instruction the cycle cores left on the boundary
+    inline void StatFlush();
+    inline void StatExec(uint8_t opcode, unsigned cycles);
+    inline void StatInterrupt(bool nmi, unsigned cycles);
+
+    // Microcode core (tick_mc): one function per (opcode, tick) pair, generated from op_table
+    template<uint8_t OP, uint8_t T> void Micro();
+    // step_mc(): tick T of the instruction with its bus cycle (n counts them), false when the instruction is done
+    // or tick_mc() has to go on with it
+    template<uint8_t OP, uint8_t T> bool MicroCycle(Bus& bus, unsigned& n);
+    template<uint8_t OP> unsigned MicroOp(Bus& bus);
+    // bus side of a step_mc() cycle: memory read & TickStart(), then the pins out, tick handler & write
+    inline bool CycleStart(Bus& bus);
+    inline void CycleEnd(Bus& bus);
+    // first and last tick Addr_xxx may finish on (they differ when a page crossing adds a tick)
+    static constexpr uint8_t AddrDoneFirst(OpFunc a)
+    {
+        return (a == &mos6502::Addr_zpg) ? 1 :
+            (a == &mos6502::Addr_zpg_X || a == &mos6502::Addr_zpg_Y || a == &mos6502::Addr_abs) ? 2 :
+            (a == &mos6502::Addr_abs_X || a == &mos6502::Addr_abs_Y) ? 2 :
+            (a == &mos6502::Addr_ind_Y) ? 3 :
+            (a == &mos6502::Addr_ind_X || a == &mos6502::Addr_ind) ? 4 : 0;
+    }
+    static constexpr uint8_t AddrDoneLast(OpFunc a)
+    {
+        return (a == &mos6502::Addr_abs_X || a == &mos6502::Addr_abs_Y) ? 3 :
+            (a == &mos6502::Addr_ind_Y) ? 4 : AddrDoneFirst(a);
+    }
+
+    // instruction length by addressing mode (BRK skips its padding byte by itself)
+    static constexpr uint8_t AddrLength(OpFunc a)
+    {
+        return (a == &mos6502::Addr_imp) ? 1 :
+            (a == &mos6502::Addr_abs || a == &mos6502::Addr_abs_X || a == &mos6502::Addr_abs_Y ||
+             a == &mos6502::Addr_ind || a == &mos6502::Addr_jsr) ? 3 : 2;
+    }
+
     inline void AND_A_Flags(uint8_t v);
     inline uint8_t ASL_Flags(uint8_t v);
     inline uint8_t LSR_Flags(uint8_t v);
@@ -492,21 +308,61 @@ private:
     inline void ADC_Flags(uint8_t v);
     inline void SBC_Flags(uint8_t v);
     inline void CMP_Flags(uint8_t r, uint8_t v);
-    // 
-    Pins _pins;
 
 public:
+    // instruction decoded once, with everything Exec() needs to run it without fetching from memory
+    struct DecodedOp
+    {
+        uint16_t operand;   // operand bytes, little endian
+        uint8_t opcode;
+        uint8_t len;        // instruction length in bytes
+        uint8_t cycles;     // base ticks from op_table, Exec() adjusts them for page crossing and branches
+    };
+    static DecodedOp Decode(uint8_t opcode, uint8_t lo, uint8_t hi)
+    {
+        return { (uint16_t)(lo | (hi << 8)), opcode, op_length[opcode], op_table[opcode].cycles };
+    }
+    static uint8_t Length(uint8_t opcode) { return op_length[opcode]; }
+    static const char* Mnemonic(uint8_t opcode) { return op_table[opcode].code; }
+    // fewest ticks the opcode takes: no page crossing, branch not taken
+    static uint8_t MinCycles(uint8_t opcode);
+    // abs,X abs,Y (zp),Y: a tick more when the indexing crosses a page
+    static bool PageCrossing(uint8_t opcode);
+    static bool Branch(uint8_t opcode) { return op_table[opcode].addr == &mos6502::Addr_rel; }
+    // addressing modes, as the disassembler shows them (JSR is ABS)
+    enum class Mode : uint8_t { IMP, IMM, ZP0, ZPX, ZPY, IZX, IZY, ABS, ABX, ABY, IND, REL };
+    static Mode AddrMode(uint8_t opcode);
+    // undefined opcode (runs as a 2 tick NOP)
+    static bool Bad(uint8_t opcode) { return op_table[opcode].func == &mos6502::Op_BAD; }
+    // instructions ending a basic block: flow control and I flag changes (IRQ gets sampled on the next one)
+    static bool EndsBlock(uint8_t opcode);
+
     mos6502();
-    ~mos6502();
 
     Pins reset();
 
     Pins tick(Pins pins);
+    // same as tick() pin for pin, but with all instructions unfolded into a single switch
+    Pins tick_mc(Pins pins);
+    // the microcode core a whole instruction at a time, on an instruction boundary (SYNC): does the bus cycles
+    // of the instruction itself, as the cycle loop would with tick_mc(), up to 7 of them; returns the number
+    // done. Stops early (SYNC not set then) on RDY or reset, tick_mc() goes on from there.
+    unsigned step_mc(Bus& bus);
+
+    // instruction level mode: execute a whole instruction (or interrupt sequence) at once,
+    // accessing memory directly via bus.Read()/bus.Write() instead of the pins
+    // returns the number of ticks taken, ticks_total is updated the same way tick() does it
+    unsigned step(Bus& bus);
+    // the same as step(), but runs a whole pre-decoded basic block from the cache,
+    // interrupts, RDY and reset go through step()
+    unsigned step_block(Bus& bus, BlockCache& cache);
 
     // some debugging and low level CPU control
     uint16_t readPC() { return R.PC; }
     uint8_t readSP() { return R.SP; }
     uint64_t readTicksTotal() { return ticks_total; }
+    Registers6502 readRegisters() { return R; }
+    uint8_t readFlags() { return S; }
     Pins forceJumpTo(uint16_t pc) { 
         _pins.ADDR = pc;
         R.PC = pc;
@@ -514,6 +370,195 @@ public:
         return _pins;
     }
     void Halt() { _pins.RDY = true; }
+    // execution statistics collector, nullptr to stop collecting (does nothing without MOS6502_STATS)
+    // a finished instruction still open in the cycle cores goes to the collector attached before
+    void setStats(ExecStats* s)
+    {
+#ifdef MOS6502_STATS
+        if (_pins.SYNC)
+            StatFlush();
+        stats = s;
+        stat_kind = StatNone;
+#else
+        (void)s;
+#endif
+    }
+
+    // the whole CPU state, mid-instruction included, field by field (see State.h); false and nothing
+    // loaded when the tick counters don't fit the opcode
+    void saveState(StateWriter& w) const;
+    bool loadState(StateReader& r);
 
+private:
+    // instruction level mode internals (mos6502_step.cpp)
+    unsigned Exec(Bus& bus, const DecodedOp& op);
+    // plain instruction boundary: no reset, RDY or interrupt to take, so a whole block can run
+    bool BlockReady(const Pins& pins) const
+    {
+        return pins.SYNC && !pins.RES && !(pins.RDY && pins.RW) && pins.ADDR == R.PC &&
+            !NMI_signal && !IRQ_signal && !(!_pins.NMI && pins.NMI) && !(pins.IRQ && !S.I());
+    }
+    void Interrupt(Bus& bus, uint16_t vector);
+    void StepDone(Bus& bus);
 };
 
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Execution statistics hooks
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+inline void mos6502::StatFetch()
+{
+#ifdef MOS6502_STATS
+    if (!stats)
+        return;
+    StatFlush();
+    stat_start = ticks_total;
+    stat_kind = NMI_signal ? StatNMI : IRQ_signal ? StatIRQ : StatOp;
+#endif
+}
+
+inline void mos6502::StatFlush()
+{
+#ifdef MOS6502_STATS
+    // nothing open, or ticks_total went back (state loaded) since it started
+    if (!stats || stat_kind == StatNone || ticks_total < stat_start)
+        return;
+    if (stat_kind == StatOp)
+        stats->Instruction(Opcode, (unsigned)(ticks_total - stat_start), R.SP);
+    else
+        stats->Interrupt(stat_kind == StatNMI, (unsigned)(ticks_total - stat_start), R.SP);
+    stat_kind = StatNone;
+#endif
+}
+
+inline void mos6502::StatExec(uint8_t opcode, unsigned cycles)
+{
+#ifdef MOS6502_STATS
+    if (stats)
+        stats->Instruction(opcode, cycles, R.SP);
+#else
+    (void)opcode; (void)cycles;
+#endif
+}
+
+inline void mos6502::StatInterrupt(bool nmi, unsigned cycles)
+{
+#ifdef MOS6502_STATS
+    if (stats)
+        stats->Interrupt(nmi, cycles, R.SP);
+#else
+    (void)nmi; (void)cycles;
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Flags helpers, shared by the cycle cores (mos6502.cpp) and the instruction level mode (mos6502_step.cpp)
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+inline void mos6502::UpdateNZ(uint8_t v)
+{
+    S.Z(!v);
+    S.N(v & 0x80);
+}
+
+inline void mos6502::AND_A_Flags(uint8_t v)
+{
+    uint8_t test = R.A & v;
+    S.Z(!test);
+    S.N(v & 0x80);
+    S.V(v & 0x40);
+}
+
+inline uint8_t mos6502::ASL_Flags(uint8_t v)
+{
+    uint8_t t;
+    S.C(v & 0x80);
+    t = (v << 1) & 0xFF;
+    UpdateNZ(t);
+    return t;
+}
+
+inline uint8_t mos6502::LSR_Flags(uint8_t v)
+{
+    uint8_t t = (v >> 1);
+    S.C(v & 0x01);
+    UpdateNZ(t);
+    return t;
+}
+
+inline uint8_t mos6502::ROL_Flags(uint8_t v)
+{
+    bool carry = S.C();
+    S.C(v & 0x80);
+    v <<= 1;
+    if (carry) v |= 1;
+    UpdateNZ(v);
+    return v;
+}
+
+inline uint8_t mos6502::ROR_Flags(uint8_t v)
+{
+    bool carry = S.C();
+    S.C(v & 0x01);
+    v >>= 1;
+    if (carry) v |= 0x80;
+    UpdateNZ(v);
+    return v;
+}
+
+inline void mos6502::ADC_Flags(uint8_t v)
+{
+    uint16_t sum = R.A + v + (S.C() ? 1 : 0);  // can feed bool as int directly, but...
+    S.Z(!(sum & 0xFF));
+
+    if (S.D()) {
+        if (((R.A & 0xF) + (v & 0xF) + (S.C() ? 1 : 0)) > 9) sum += 6;
+        S.N(sum & 0x80);
+        S.V(!((R.A ^ v) & 0x80) && ((R.A ^ sum) & 0x80));
+        if (sum > 0x99)
+        {
+            sum += 96;
+        }
+        S.C(sum> 0x99);
+    }
+    else 
+    {
+        S.N(sum & 0x80);
+        S.V(!((R.A ^ v) & 0x80) && ((R.A ^ sum) & 0x80));
+        S.C(sum > 0xFF);
+    }
+    R.A = sum & 0xFF;
+}
+
+inline void mos6502::SBC_Flags(uint8_t v)
+{
+    uint16_t dif = R.A - v - (S.C() ? 0 : 1);
+    S.N(dif & 0x80);
+    S.Z(!(dif & 0xFF));
+    S.V(((R.A ^ dif) & 0x80) && ((R.A ^ v) & 0x80));
+
+    if (S.D())
+    {
+        if (((R.A & 0x0F) - (S.C() ? 0 : 1)) < (v & 0x0F)) dif -= 6;
+        if (dif > 0x99)
+        {
+            dif -= 0x60;
+        }
+    }
+    S.C(dif < 0x100);
+    R.A = (dif & 0xFF);
+}
+
+inline void mos6502::CMP_Flags(uint8_t r, uint8_t v)
+{
+    uint16_t t = r - v;
+    S.C(r >= v);
+    S.Z(!t);
+    S.N(t & 0x80);
+}
+
+// many CPUs can be kept in arrays and saved/cloned with memcpy
+#ifndef MOS6502_STATS
+static_assert(sizeof(mos6502) == 64, "mos6502 state should fit in one cache line");
+#endif
+static_assert(std::is_trivially_copyable<mos6502>::value, "mos6502 should be trivially copyable");
\ No newline at end of file
@@ -3,10 +3,18 @@
 #include <cstdint>
 #include <thread>
 #include <atomic>
+#include <mutex>
+#include <deque>
+#include <fstream>
+#include <string>
 
 #include "mos6502.h"
 #include "Bus.h"
 #include "debugger.h"
+#include "Rewind.h"
+#include "InputLog.h"
+#include "Publisher.h"
+#include "Pacer.h"
 
 #define OLC_PGE_APPLICATION
 #include "olcPixelGameEngine/olcPixelGameEngine.h"
@@ -24,28 +32,59 @@ public:
 	}
 };
 
-class EhBasicBus : public Bus
+// EhBASIC serial I/O: output at $F001, input at $F004
+class EhBasicSerial : public Device
 {
+	// typed bytes, fed by the CPU thread between batches (so they can be recorded)
+	std::deque<uint8_t> input;
+
 public:
-	virtual void TickHandler()
+	void Push(uint8_t c)
+	{
+		input.push_back(c);
+	}
+
+	void Read(uint16_t addr, uint8_t& data) override
 	{
-		uint16_t a = pins.ADDR;
-		if (pins.RW) 
+		if (addr == 0xF004)
 		{
-			if (a == 0xF004)
+			data = 0;
+			if (!input.empty())
 			{
-				//if (_kbhit())
-				//	pins.DATA = _getch();
-				//else
-					pins.DATA = 0;
-				RAM[0xF004] = pins.DATA;
+				data = input.front();
+				input.pop_front();
 			}
 		}
-		else
-		{
-			if (a == 0xF001) 
-				std::cout << pins.DATA << std::flush;
-		}
+	}
+
+	void Write(uint16_t addr, uint8_t& data) override
+	{
+		if (addr == 0xF001) 
+			std::cout << data << std::flush;
+	}
+};
+
+class EhBasicBus final : public BusT<EhBasicBus>
+{
+	EhBasicSerial serial;
+
+public:
+	EhBasicBus()
+	{
+		// ROM at $C000-$FFFF, serial registers in the $F0 page
+		SetReadOnly(0xC0, 64);
+		MapDevice(0xF0, 1, &serial);
+	}
+
+	// serial input byte (input channel 0 of the input log)
+	void Input(uint8_t c)
+	{
+		serial.Push(c);
+	}
+
+	void TickHandler() override
+	{
+		// devices are on the page table
 	}
 };
 
@@ -54,16 +93,42 @@ class Demo6502 : public olc::PixelGameEngine
 public:
 	EhBasicBus nes;
 	Debugger deb = {nes};
+	// what the UI draws, published by cpu_task() between batches
+	Publisher publisher{nes, &deb.code};
 
 private:
-	bool cpu_init_done = false;
-	bool cpu_done = false;
-	
+	std::atomic<bool> cpu_done = { false };
+
 	std::unique_ptr<std::thread> thread_cpu;
-	bool step_mode = false;
-	bool step_one = false;
+	// runs, sleeps or waits cpu_task(); space and the debugger pause it, S runs again in run_mode
+	Pacer pacer;
+
+	// requests from the UI thread, applied by cpu_task() between batches (with a pacer.Wake())
+	std::atomic<bool> step_one = { false };
+	std::atomic<bool> reset_request = { false };
+	std::atomic<bool> irq_request = { false };
+	std::atomic<bool> nmi_request = { false };
+	std::atomic<unsigned> back_steps = { 0 };      // instructions to step back
+	std::atomic<unsigned> back_keyframes = { 0 };  // keyframes to jump back
+
+	// reverse stepping history, recorded on every instruction
+	std::unique_ptr<Rewind> rewind;
+
+	// console input, read by its own thread
+	std::mutex console_lock;
+	std::deque<uint8_t> console;
+	void console_task();
+
+	// external inputs are logged here with --record
+	std::ofstream record_file;
+	std::unique_ptr<InputRecorder> recorder;
 
 	void cpu_task();
+	void record_pin(InputPin pin, bool level)
+	{
+		if (recorder)
+			recorder->Pin(nes.CPU.readTicksTotal(), pin, level);
+	}
 
 	std::string hex(uint32_t n, uint8_t d)
 	{
@@ -73,7 +138,7 @@ private:
 		return s;
 	};
 
-	void DrawRam(int x, int y, uint16_t nAddr, int nRows, int nColumns)
+	void DrawRam(const MachineView& view, int x, int y, uint16_t nAddr, int nRows, int nColumns)
 	{
 		int nRamX = x, nRamY = y;
 		for (int row = 0; row < nRows; row++)
@@ -81,7 +146,7 @@ private:
 			std::string sOffset = "$" + hex(nAddr, 4) + ":";
 			for (int col = 0; col < nColumns; col++)
 			{
-				sOffset += " " + hex(nes[nAddr], 2);
+				sOffset += " " + hex(view.memory[nAddr], 2);
 				nAddr += 1;
 			}
 			DrawString(nRamX, nRamY, sOffset);
@@ -89,21 +154,21 @@ private:
 		}
 	}
 
-	void DrawCpu(int x, int y)
+	void DrawCpu(const MachineView& view, int x, int y)
 	{
-		Flags6502& F = deb.getFlags();
-		Registers6502& R = deb.getRegisters();
+		const Flags6502& F = view.flags;
+		const Registers6502& R = view.regs;
 
 		std::string status = "STATUS: ";
 		DrawString(x , y , "STATUS:", olc::WHITE);
-		DrawString(x  + 64, y, "N", F.N ? olc::GREEN : olc::RED);
-		DrawString(x  + 80, y , "V", F.V ? olc::GREEN : olc::RED);
-		DrawString(x  + 96, y , "-", F.X ? olc::GREEN : olc::RED);
-		DrawString(x  + 112, y , "B", F.B ? olc::GREEN : olc::RED);
-		DrawString(x  + 128, y , "D", F.D ? olc::GREEN : olc::RED);
-		DrawString(x  + 144, y , "I", F.I ? olc::GREEN : olc::RED);
-		DrawString(x  + 160, y , "Z", F.Z ? olc::GREEN : olc::RED);
-		DrawString(x  + 178, y , "C", F.C ? olc::GREEN : olc::RED);
+		DrawString(x  + 64, y, "N", F.N() ? olc::GREEN : olc::RED);
+		DrawString(x  + 80, y , "V", F.V() ? olc::GREEN : olc::RED);
+		DrawString(x  + 96, y , "-", F.X() ? olc::GREEN : olc::RED);
+		DrawString(x  + 112, y , "B", F.B() ? olc::GREEN : olc::RED);
+		DrawString(x  + 128, y , "D", F.D() ? olc::GREEN : olc::RED);
+		DrawString(x  + 144, y , "I", F.I() ? olc::GREEN : olc::RED);
+		DrawString(x  + 160, y , "Z", F.Z() ? olc::GREEN : olc::RED);
+		DrawString(x  + 178, y , "C", F.C() ? olc::GREEN : olc::RED);
 		DrawString(x , y + 10, "PC: $" + hex(R.PC, 4));
 		DrawString(x , y + 20, "A: $" +  hex(R.A, 2) + "  [" + std::to_string(R.A) + "]");
 		DrawString(x , y + 30, "X: $" +  hex(R.X, 2) + "  [" + std::to_string(R.X) + "]");
@@ -111,43 +176,32 @@ private:
 		DrawString(x , y + 50, "Stack P: $" + hex(R.SP, 4));
 	}
 
-	void DrawCode(int x, int y, int nLines)
+	void DrawCode(const MachineView& view, int x, int y, int nLines)
 	{
-		std::atomic<uint16_t>& PC = nes.opaddr;
-
-		auto it_a = deb.mapAsm.find(PC);
+		// the lines come with the snapshot (Publisher keeps deb.code up to date on the CPU thread), formatting only
 		int nLineY = (nLines >> 1) * 10 + y;
-		if (it_a != deb.mapAsm.end())
+		for (int i = 0; i < view.code_lines; i++)
 		{
-			DrawString(x, nLineY, (*it_a).second, olc::CYAN);
-			while (nLineY < (nLines * 10) + y)
-			{
-				nLineY += 10;
-				if (it_a != deb.mapAsm.end())
-				{
-					++it_a;
-					DrawString(x, nLineY, (*it_a).second);
-				}
-			}
-		}
-
-		it_a = deb.mapAsm.find(PC);
-		nLineY = (nLines >> 1) * 10 + y;
-		if (it_a != deb.mapAsm.end())
-		{
-			while (nLineY > y)
-			{
-				nLineY -= 10;
-				if (it_a != deb.mapAsm.end() && it_a != deb.mapAsm.begin())
-				{
-					--it_a;
-					DrawString(x, nLineY, (*it_a).second);
-				}
-			}
+			const MachineView::CodeLine& line = view.code[i];
+			int lineY = nLineY + (i - view.code_pc) * 10;
+			if (lineY < y || lineY > (nLines * 10) + y)
+				continue;
+			if (line.data)
+				DrawString(x, lineY, Disassembly::DataLine(view.memory, line.addr));
+			else
+				DrawString(x, lineY, Disassembly::Line(view.memory, line.addr), i == view.code_pc ? olc::CYAN : olc::WHITE);
 		}
 	}
 
 public:
+	// --record file name
+	std::string record_name;
+	// --break specs (Debugger::setBreakpoint())
+	std::vector<std::string> break_specs;
+	// --clock: paced to it instead of running flat out
+	PaceMode run_mode = PaceMode::Unthrottled;
+	double clock = Pacer::Clock1MHz;
+
 	Demo6502()
 	{
 		sAppName = "Demo6502";
@@ -157,22 +211,39 @@ public:
 	bool OnUserCreate() override
 	{
 		// Called once at the start, so create things here
-		thread_cpu = std::make_unique<std::thread>(&Demo6502::cpu_task, this);
-
 		nes.ReadFromFile("tests//ehbasic.bin", 0xC000);
 
-		deb.disassemble(0x0000, 0xFFFF);
+		// from the vectors, the data in between doesn't throw the listing out of step
+		deb.code.Trace({}, 0);
+		for (const std::string& spec : break_specs)
+		{
+			std::string error;
+			if (deb.setBreakpoint(spec, error) < 0)
+				std::cerr << error << std::endl;
+		}
 
 		nes.pins = nes.CPU.reset();
-		cpu_init_done = true;
-		
+		rewind = std::make_unique<Rewind>(nes);
+		if (!record_name.empty())
+		{
+			record_file.open(record_name, std::ios::binary);
+			if (record_file.is_open())
+				recorder = std::make_unique<InputRecorder>(record_file, nes);
+		}
+		std::thread(&Demo6502::console_task, this).detach();
+
+		// the CPU thread starts with everything set up, no waiting for it
+		pacer.SetMode(run_mode, clock);
+		thread_cpu = std::make_unique<std::thread>(&Demo6502::cpu_task, this);
 		return true;
 	}
 
 	bool OnUserDestroy() override
 	{
 		cpu_done = true;
+		pacer.Wake();
 		thread_cpu->join();
+		recorder.reset();
 		return true;
 	}
 
@@ -183,26 +254,53 @@ public:
 
 		if (GetKey(olc::Key::SPACE).bPressed)
 		{
-			step_mode = true;
+			pacer.SetMode(PaceMode::Paused);
 			step_one = true;
+			pacer.Wake();
 		}
 
 		if (GetKey(olc::Key::R).bPressed)
-			nes.pins = nes.CPU.reset();
+		{
+			reset_request = true;
+			pacer.Wake();
+		}
 
 		if (GetKey(olc::Key::I).bPressed)
-			nes.pins.IRQ = true;
+		{
+			irq_request = true;
+			pacer.Wake();
+		}
 
 		if (GetKey(olc::Key::N).bPressed)
-			nes.pins.NMI = true;
+		{
+			nmi_request = true;
+			pacer.Wake();
+		}
 
 		if (GetKey(olc::Key::S).bPressed)
-			step_mode = false;
+			pacer.SetMode(run_mode);
 
-		DrawRam(2, 2, 0x0000, 16, 16);
-		DrawRam(2, 182, nes.CPU.readPC() & 0xFF00, 16, 16);
-		DrawCpu(516, 2);
-		DrawCode(448, 72, 26);
+		// rewind: back one instruction, back one keyframe
+		if (GetKey(olc::Key::BACK).bPressed)
+		{
+			pacer.SetMode(PaceMode::Paused);
+			back_steps++;
+			pacer.Wake();
+		}
+
+		if (GetKey(olc::Key::PGUP).bPressed)
+		{
+			pacer.SetMode(PaceMode::Paused);
+			back_keyframes++;
+			pacer.Wake();
+		}
+
+		// one consistent snapshot per frame, the CPU thread doesn't wait for it
+		const MachineView& view = publisher.Latest();
+		DrawRam(view, 2, 2, 0x0000, 16, 16);
+		DrawRam(view, 2, 182, view.regs.PC & 0xFF00, 16, 16);
+		DrawCpu(view, 516, 2);
+		DrawCode(view, 448, 72, 26);
 
 		return true;
 	}
@@ -210,41 +308,152 @@ public:
 
 void Demo6502::cpu_task()
 {
-	for (;;)
+	while (!cpu_done)
 	{
-		if (!cpu_init_done) continue;
-		if (cpu_done) break;
-
-		if (step_mode)
+		if (reset_request.exchange(false))
+		{
+			record_pin(InputPin::RES, true);
+			nes.pins = nes.CPU.reset();
+		}
+		if (irq_request.exchange(false))
 		{
-			if (step_one)
+			record_pin(InputPin::IRQ, true);
+			nes.pins.IRQ = true;
+		}
+		if (nmi_request.exchange(false))
+		{
+			record_pin(InputPin::NMI, true);
+			nes.pins.NMI = true;
+		}
+		{
+			std::lock_guard<std::mutex> guard(console_lock);
+			for (uint8_t c : console)
 			{
-				nes.CPU_Step_Op();
-				step_one = false;
+				if (recorder)
+					recorder->Data(nes.CPU.readTicksTotal(), 0, c);
+				nes.Input(c);
 			}
+			console.clear();
 		}
-		else
-			nes.CPU_Step();
 
-		//uint16_t pc = nes.CPU.readPC();
-		//if (!(nes.CPU.readPC() ^ 0b1111111))
-		//	std::this_thread::sleep_for(std::chrono::microseconds(1));
- 
-		//if (!nes.pins.RES && nes.opaddr == 0x37A3)
-		//	nes.pins = nes.CPU.forceJumpTo(0x400);
+		// going back would make the input log useless, no rewinding while recording
+		unsigned steps = back_steps.exchange(0), keyframes = back_keyframes.exchange(0);
+		if (!recorder)
+		{
+			for (; steps; steps--)
+				rewind->StepBack();
+			if (keyframes)
+				rewind->JumpBack(keyframes);
+		}
 
-		if (nes.pins.SYNC)
+		// interrupt lines are held until the next instruction boundary
+		if (nes.pins.IRQ || nes.pins.NMI)
 		{
+			nes.CPU_Step_Op();
+			rewind->Mark();
+			if (nes.pins.IRQ)
+				record_pin(InputPin::IRQ, false);
+			if (nes.pins.NMI)
+				record_pin(InputPin::NMI, false);
 			nes.pins.IRQ = false;
 			nes.pins.NMI = false;
 		}
+
+		if (step_one.exchange(false))
+		{
+			nes.CPU_Step_Op();
+			rewind->Mark();
+		}
+
+		// for the next frame if the UI took the last one; always when paused, the thread waits next
+		publisher.Publish(pacer.Mode() == PaceMode::Paused);
+
+		// waits while paused, sleeps until the batch is due when paced, 0 when there are requests
+		uint64_t cycles = pacer.Next();
+		if (!cycles)
+			continue;
+		pacer.Done(nes.RunUntil([this](EhBasicBus&) { rewind->Mark(); return false; }, cycles));
+
+		// stopped at a breakpoint: single step from there
+		BreakHit hit;
+		if (deb.breaks.Take(hit))
+		{
+			static const char* kinds[] = { "", "exec", "read", "", "write" };
+			std::cerr << "break " << hit.id << " (" << kinds[hit.kind] << " $" << hex(hit.addr, 4) << ") at $"
+				<< hex(hit.pc, 4) << std::endl;
+			pacer.SetMode(PaceMode::Paused);
+		}
+	}
+}
+
+void Demo6502::console_task()
+{
+	// EhBASIC wants CR for the line end
+	for (int c; (c = std::cin.get()) != EOF; )
+	{
+		std::lock_guard<std::mutex> guard(console_lock);
+		console.push_back(c == '\n' ? '\r' : (uint8_t)c);
+	}
+}
+
+// mainTestCPU --replay FILE [--cycles N]: runs a recorded session headless, as fast as it goes
+static int replay(const char* name, uint64_t cycles)
+{
+	static EhBasicBus bus;
+
+	std::ifstream file(name, std::ios::binary);
+	InputReplayer replayer(file);
+	if (!file.is_open() || !replayer.Start(bus))
+	{
+		std::cerr << "can't replay " << name << std::endl;
+		return 1;
+	}
+	bus.core = replayer.RecordedCore();
+
+	auto input = [](uint8_t, uint8_t c) { bus.Input(c); };
+	if (cycles)
+		replayer.Run(bus, cycles, input);
+	else
+	{
+		// up to the last event
+		while (!replayer.Done())
+			replayer.Run(bus, replayer.Next() - bus.CPU.readTicksTotal(), input);
 	}
+
+	std::cout << std::dec << std::endl << "Total ticks: " << bus.CPU.readTicksTotal() << std::endl;
+	return 0;
 }
 
 static Demo6502 demo;
 
-int main()
+int main(int argc, char** argv)
 {
+	const char* replay_name = nullptr;
+	uint64_t replay_cycles = 0;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string a = argv[i];
+		if (a == "--record")
+			demo.record_name = argv[i + 1];
+		else if (a == "--break")
+			demo.break_specs.push_back(argv[i + 1]);
+		else if (a == "--clock")
+		{
+			if (!Pacer::ParseClock(argv[i + 1], demo.clock))
+			{
+				std::cerr << "--clock takes 1mhz, ntsc, pal or Hz" << std::endl;
+				return 1;
+			}
+			demo.run_mode = PaceMode::Paced;
+		}
+		else if (a == "--replay")
+			replay_name = argv[i + 1];
+		else if (a == "--cycles")
+			replay_cycles = std::strtoull(argv[i + 1], nullptr, 10);
+	}
+	if (replay_name)
+		return replay(replay_name, replay_cycles);
+
 	if (demo.Construct(780, 480, 2, 2))
 		demo.Start();
 
@@ -0,0 +1,172 @@
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#include "mos6502.h"
+#include "Bus.h"
+#include "Loader.h"
+#include "Profiler.h"
+
+//
+// Cycle profiler (Profiler.h): runs an image and prints the flat profile, writes the call paths for
+// flamegraph.pl
+//
+
+class ProfBus final : public BusT<ProfBus>
+{
+public:
+	void TickHandler() override {}
+};
+
+struct ProfOptions
+{
+	const char* rom = nullptr;
+	ImageFormat format = ImageFormat::Auto;
+	uint16_t load = 0xC000;     // Raw images
+	bool start_set = false;     // start at 'start' instead of the reset vector (or the image start address)
+	uint16_t start = 0;
+	uint64_t cycles = 100000000;// cycle budget
+	bool until_set = false;     // stop as soon as PC reaches 'until'
+	uint16_t until = 0;
+	Core core = Core::Cycle;
+	const char* symbols = nullptr;
+	const char* folded = nullptr;
+	size_t lines = 30;
+};
+
+static void usage()
+{
+	std::cerr <<
+		"usage: profCPU <rom> [options]\n"
+		"  --format NAME    image format: auto (default), raw, prg, hex, srec\n"
+		"  --load ADDR      load address of raw images (hex, default C000)\n"
+		"  --start ADDR     start execution at ADDR instead of the reset vector (hex)\n"
+		"  --cycles N       cycle budget (default 100000000)\n"
+		"  --until-pc ADDR  stop when PC reaches ADDR (hex)\n"
+		"  --core NAME      CPU core: cycle (default), mc, instr\n"
+		"  --symbols FILE   labels: VICE label file (ld65 -Ln), 'name = $ADDR' or 'ADDR name' lines\n"
+		"  --folded FILE    write the call paths with their cycles (flamegraph.pl input)\n"
+		"  --lines N        routines and instructions listed (default 30)\n";
+}
+
+static bool parseArgs(int argc, char** argv, ProfOptions& opt)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string a = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (a == "--format" && has_value)
+		{
+			std::string f = argv[++i];
+			if (f == "auto")
+				opt.format = ImageFormat::Auto;
+			else if (f == "raw")
+				opt.format = ImageFormat::Raw;
+			else if (f == "prg")
+				opt.format = ImageFormat::Prg;
+			else if (f == "hex")
+				opt.format = ImageFormat::IntelHex;
+			else if (f == "srec")
+				opt.format = ImageFormat::SRecord;
+			else
+				return false;
+		}
+		else if (a == "--load" && has_value)
+			opt.load = (uint16_t)std::strtoul(argv[++i], nullptr, 16);
+		else if (a == "--start" && has_value)
+		{
+			opt.start = (uint16_t)std::strtoul(argv[++i], nullptr, 16);
+			opt.start_set = true;
+		}
+		else if (a == "--cycles" && has_value)
+			opt.cycles = std::strtoull(argv[++i], nullptr, 10);
+		else if (a == "--until-pc" && has_value)
+		{
+			opt.until = (uint16_t)std::strtoul(argv[++i], nullptr, 16);
+			opt.until_set = true;
+		}
+		else if (a == "--core" && has_value)
+		{
+			// the block cores stop between blocks only, too coarse for per instruction cycles
+			std::string c = argv[++i];
+			if (c == "cycle")
+				opt.core = Core::Cycle;
+			else if (c == "mc")
+				opt.core = Core::Microcode;
+			else if (c == "instr")
+				opt.core = Core::Instruction;
+			else
+				return false;
+		}
+		else if (a == "--symbols" && has_value)
+			opt.symbols = argv[++i];
+		else if (a == "--folded" && has_value)
+			opt.folded = argv[++i];
+		else if (a == "--lines" && has_value)
+			opt.lines = (size_t)std::strtoull(argv[++i], nullptr, 10);
+		else if (a[0] != '-' && !opt.rom)
+			opt.rom = argv[i];
+		else
+			return false;
+	}
+	return opt.rom != nullptr;
+}
+
+static ProfBus bus;
+
+int main(int argc, char** argv)
+{
+	ProfOptions opt;
+	if (!parseArgs(argc, argv, opt))
+	{
+		usage();
+		return 1;
+	}
+
+	Image image;
+	if (!image.Open(opt.rom, opt.format, opt.load))
+	{
+		std::cerr << image.Error() << "\n";
+		return 1;
+	}
+	Symbols symbols;
+	if (opt.symbols && !symbols.Load(opt.symbols))
+	{
+		std::cerr << symbols.Error() << "\n";
+		return 1;
+	}
+	bus.Load(image);
+
+	bus.core = opt.core;
+	bus.pins = bus.CPU.reset();
+	while (bus.pins.RES)
+		bus.CPU_Step();
+	if (opt.start_set || image.HasStart())
+		bus.pins = bus.CPU.forceJumpTo(opt.start_set ? opt.start : image.Start());
+
+	Profiler profiler(bus);
+	profiler.Instruction();
+	bus.RunUntil([&](ProfBus& b)
+	{
+		profiler.Instruction();
+		return opt.until_set && b.CPU.readPC() == opt.until;
+	}, opt.cycles);
+
+	std::printf("%s", profiler.Flat(symbols, opt.lines).c_str());
+
+	if (opt.folded)
+	{
+		std::ofstream out(opt.folded);
+		out << profiler.Folded(symbols);
+		if (!out.good())
+		{
+			std::cerr << "can't write " << opt.folded << "\n";
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <cstring>
+#include "BlockCache.h"
+#include "Bus.h"
+
+BlockCache::BlockCache(Bus& _bus) : bus(_bus), index(new int32_t[0x10000])
+{
+	std::fill(index.get(), index.get() + 0x10000, -1);
+	std::memset(code_bytes, 0, sizeof(code_bytes));
+}
+
+BlockCache::Block* BlockCache::Build(uint16_t addr)
+{
+	auto cacheable = [this](uint32_t a) { return a <= 0xFFFF && !bus.pages[a >> 8].device; };
+	auto peek = [this](uint16_t a) { return bus.pages[a >> 8].mem[a & 0xFF]; };
+
+	if (!cacheable(addr))
+		return nullptr;
+
+	Block b;
+	b.start = addr;
+	b.count = 0;
+	b.alive = true;
+	b.hits = 0;
+	b.native = nullptr;
+
+	// decode up to the end of the block, an instruction running into a device page or past $FFFF ends it early
+	uint32_t a = addr;
+	while (b.count < MaxOps)
+	{
+		uint8_t opcode = peek(a);
+		uint8_t len = mos6502::Length(opcode);
+		if (!cacheable(a + len - 1))
+			break;
+		uint8_t lo = len > 1 ? peek(a + 1) : 0;
+		uint8_t hi = len > 2 ? peek(a + 2) : 0;
+		b.ops[b.count++] = mos6502::Decode(opcode, lo, hi);
+		a += len;
+		if (mos6502::EndsBlock(opcode))
+			break;
+	}
+	if (!b.count)
+		return nullptr;
+	b.end = (uint16_t)a;
+
+	int32_t id;
+	if (!free_ids.empty())
+	{
+		id = free_ids.back();
+		free_ids.pop_back();
+		blocks[id] = b;
+	}
+	else
+	{
+		id = (int32_t)blocks.size();
+		blocks.push_back(b);
+	}
+	index[addr] = id;
+
+	// a block covers one or two pages
+	uint8_t first = addr >> 8, last = (a - 1) >> 8;
+	page_blocks[first].push_back(id);
+	if (last != first)
+		page_blocks[last].push_back(id);
+	for (uint32_t i = addr; i < a; i++)
+		code_bytes[i >> 8][(i & 0xFF) >> 6] |= 1ull << (i & 63);
+	SetCodePage(first, true);
+	SetCodePage(last, true);
+
+	return &blocks[id];
+}
+
+void BlockCache::Written(uint16_t addr)
+{
+	if (code_bytes[addr >> 8][(addr & 0xFF) >> 6] & (1ull << (addr & 63)))
+		InvalidatePage(addr >> 8);
+}
+
+void BlockCache::Kill(int32_t id, uint8_t page)
+{
+	Block& b = blocks[id];
+	if (!b.alive)
+		return;
+	b.alive = false;
+	index[b.start] = -1;
+	free_ids.push_back(id);
+
+	// forget it on the other page too
+	uint8_t other = (b.start >> 8) == page ? (uint8_t)((uint16_t)(b.end - 1) >> 8) : (uint8_t)(b.start >> 8);
+	if (other != page)
+	{
+		std::vector<int32_t>& list = page_blocks[other];
+		for (size_t i = 0; i < list.size(); i++)
+			if (list[i] == id)
+			{
+				list[i] = list.back();
+				list.pop_back();
+				break;
+			}
+	}
+}
+
+void BlockCache::InvalidatePage(uint8_t page)
+{
+	for (int32_t id : page_blocks[page])
+		Kill(id, page);
+	page_blocks[page].clear();
+	std::memset(code_bytes[page], 0, sizeof(code_bytes[page]));
+	SetCodePage(page, false);
+	generation++;
+}
+
+void BlockCache::Clear()
+{
+	for (unsigned p = 0; p < 256; p++)
+	{
+		page_blocks[p].clear();
+		SetCodePage(p, false);
+	}
+	blocks.clear();
+	free_ids.clear();
+	std::fill(index.get(), index.get() + 0x10000, -1);
+	std::memset(code_bytes, 0, sizeof(code_bytes));
+	generation++;
+}
+
+void BlockCache::DropNative()
+{
+	for (Block& b : blocks)
+		b.native = nullptr;
+}
+
+void BlockCache::SetCodePage(uint8_t page, bool code)
+{
+	if (bus.pages[page].code != code)
+	{
+		bus.pages[page].code = code;
+		bus.UpdatePage(page);
+	}
+}
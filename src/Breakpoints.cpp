@@ -0,0 +1,386 @@
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+#include "Breakpoints.h"
+#include "Bus.h"
+
+// precedence climbing, straight to postfix code
+struct Condition::Parser
+{
+	const char* p;
+	std::vector<int32_t>& code;
+	std::string error;
+	int depth = 0;
+	int nesting = 0;
+	static const int MaxNesting = 64;
+
+	Parser(const char* text, std::vector<int32_t>& c) : p(text), code(c) {}
+
+	void Skip()
+	{
+		while (*p == ' ' || *p == '\t')
+			p++;
+	}
+
+	bool Fail(const std::string& what)
+	{
+		if (error.empty())
+			error = what;
+		return false;
+	}
+
+	// stack depth after the op, the deepest point decides if Eval()'s stack is big enough
+	void Emit(int32_t op, int change)
+	{
+		code.push_back(op);
+		depth += change;
+		if (depth > MaxDepth)
+			Fail("condition too long");
+	}
+
+	bool Number()
+	{
+		int base = 10;
+		if (*p == '$')
+		{
+			base = 16;
+			p++;
+		}
+		else if (*p == '%')
+		{
+			base = 2;
+			p++;
+		}
+		else if (p[0] == '0' && (p[1] | 0x20) == 'x')
+		{
+			base = 16;
+			p += 2;
+		}
+		// digits only (strtoul would take a sign, blanks or a second 0x), wrapping like the other arithmetic
+		const char* start = p;
+		uint32_t v = 0;
+		for (;; p++)
+		{
+			char c = (char)std::tolower((unsigned char)*p);
+			int d = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : base;
+			if (d >= base)
+				break;
+			v = v * base + d;
+		}
+		if (p == start || std::isalnum((unsigned char)*p))
+			return Fail(std::string("bad number at '") + start + "'");
+		Emit(Push, 1);
+		code.push_back((int32_t)v);
+		return true;
+	}
+
+	bool Name()
+	{
+		std::string name;
+		while (std::isalnum((unsigned char)*p))
+			name += (char)std::toupper((unsigned char)*p++);
+
+		static const struct { const char* name; Op op; int32_t flag; } names[] =
+		{
+			{ "A", RegA, 0 }, { "X", RegX, 0 }, { "Y", RegY, 0 }, { "SP", RegSP, 0 }, { "P", RegP, 0 },
+			{ "PC", RegPC, 0 }, { "ADDR", Addr, 0 }, { "DATA", Data, 0 },
+			{ "N", Flag, 0x80 }, { "V", Flag, 0x40 }, { "D", Flag, 0x08 }, { "I", Flag, 0x04 },
+			{ "Z", Flag, 0x02 }, { "C", Flag, 0x01 },
+		};
+		for (auto& n : names)
+		{
+			if (name == n.name)
+			{
+				Emit(n.op, 1);
+				if (n.op == Flag)
+					code.push_back(n.flag);
+				return true;
+			}
+		}
+		return Fail("unknown name '" + name + "'");
+	}
+
+	// parentheses and unary operators recurse, the depth is capped so a long run of them fails instead of
+	// running out of stack
+	bool Primary()
+	{
+		if (nesting >= MaxNesting)
+			return Fail("nested too deep");
+		nesting++;
+		bool ok = Operand();
+		nesting--;
+		return ok;
+	}
+
+	bool Operand()
+	{
+		Skip();
+		char c = *p;
+		if (c == '!' || c == '-' || c == '~')
+		{
+			p++;
+			if (!Primary())
+				return false;
+			Emit(c == '!' ? Not : c == '-' ? Neg : Compl, 0);
+			return true;
+		}
+		if (c == '(' || c == '[')
+		{
+			p++;
+			if (!Expr(1))
+				return false;
+			Skip();
+			if (*p != (c == '(' ? ')' : ']'))
+				return Fail(std::string("expected '") + (c == '(' ? ')' : ']') + "'");
+			p++;
+			if (c == '[')
+				Emit(Mem, 0);
+			return true;
+		}
+		if (c == '$' || c == '%' || std::isdigit((unsigned char)c))
+			return Number();
+		if (std::isalpha((unsigned char)c))
+			return Name();
+		return Fail(c ? std::string("unexpected '") + c + "'" : "unexpected end");
+	}
+
+	// the binary operator at p and its precedence, longest match first
+	bool Binary(Op& op, int& level, size_t& len)
+	{
+		static const struct { const char* text; Op op; int level; } ops[] =
+		{
+			{ "||", LOr, 1 }, { "&&", LAnd, 2 }, { "==", Eq, 6 }, { "!=", Ne, 6 }, { "<=", Le, 7 }, { ">=", Ge, 7 },
+			{ "<<", Shl, 8 }, { ">>", Shr, 8 }, { "|", Or, 3 }, { "^", Xor, 4 }, { "&", And, 5 }, { "<", Lt, 7 },
+			{ ">", Gt, 7 }, { "+", Add, 9 }, { "-", Sub, 9 }, { "*", Mul, 10 }, { "/", Div, 10 }, { "%", Mod, 10 },
+		};
+		for (auto& o : ops)
+		{
+			size_t n = std::char_traits<char>::length(o.text);
+			if (std::char_traits<char>::compare(p, o.text, n) == 0)
+			{
+				op = o.op;
+				level = o.level;
+				len = n;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool Expr(int min_level)
+	{
+		if (!Primary())
+			return false;
+		for (;;)
+		{
+			Skip();
+			Op op;
+			int level;
+			size_t len;
+			if (!Binary(op, level, len) || level < min_level)
+				return true;
+			p += len;
+			// left associative: the right side only takes the tighter operators
+			if (!Expr(level + 1))
+				return false;
+			Emit(op, -1);
+		}
+	}
+};
+
+bool Condition::Compile(const std::string& text)
+{
+	code.clear();
+	error.clear();
+	Parser parser(text.c_str(), code);
+	parser.Skip();
+	if (!*parser.p)
+		return true;
+	if (parser.Expr(1))
+	{
+		parser.Skip();
+		if (*parser.p)
+			parser.Fail(std::string("unexpected '") + parser.p + "'");
+	}
+	if (!parser.error.empty())
+	{
+		error = parser.error;
+		code.clear();
+		return false;
+	}
+	return true;
+}
+
+int32_t Condition::Eval(Bus& bus, uint16_t addr, uint8_t data) const
+{
+	if (code.empty())
+		return 1;
+	int32_t stack[MaxDepth];
+	int sp = 0;
+	Registers6502 r = bus.CPU.readRegisters();
+	for (size_t i = 0; i < code.size(); i++)
+	{
+		switch (code[i])
+		{
+		case Push: stack[sp++] = code[++i]; break;
+		case RegA: stack[sp++] = r.A; break;
+		case RegX: stack[sp++] = r.X; break;
+		case RegY: stack[sp++] = r.Y; break;
+		case RegSP: stack[sp++] = r.SP; break;
+		case RegP: stack[sp++] = bus.CPU.readFlags(); break;
+		case RegPC: stack[sp++] = r.PC; break;
+		case Flag: stack[sp++] = (bus.CPU.readFlags() & code[++i]) != 0; break;
+		case Addr: stack[sp++] = addr; break;
+		case Data: stack[sp++] = data; break;
+		case Mem: stack[sp - 1] = bus.Peek((uint16_t)stack[sp - 1]); break;
+		case Not: stack[sp - 1] = !stack[sp - 1]; break;
+		case Neg: stack[sp - 1] = (int32_t)(0u - (uint32_t)stack[sp - 1]); break;
+		case Compl: stack[sp - 1] = ~stack[sp - 1]; break;
+		default:
+		{
+			int32_t b = stack[--sp];
+			int32_t& a = stack[sp - 1];
+			switch (code[i])
+			{
+			case Mul: a = (int32_t)((uint32_t)a * (uint32_t)b); break;
+			case Div: a = b && !(a == INT32_MIN && b == -1) ? a / b : 0; break;
+			case Mod: a = b && !(a == INT32_MIN && b == -1) ? a % b : 0; break;
+			case Add: a = (int32_t)((uint32_t)a + (uint32_t)b); break;
+			case Sub: a = (int32_t)((uint32_t)a - (uint32_t)b); break;
+			case Shl: a = (int32_t)((uint32_t)a << (b & 31)); break;
+			case Shr: a = (int32_t)((uint32_t)a >> (b & 31)); break;
+			case Lt: a = a < b; break;
+			case Le: a = a <= b; break;
+			case Gt: a = a > b; break;
+			case Ge: a = a >= b; break;
+			case Eq: a = a == b; break;
+			case Ne: a = a != b; break;
+			case And: a &= b; break;
+			case Xor: a ^= b; break;
+			case Or: a |= b; break;
+			case LAnd: a = a && b; break;
+			case LOr: a = a || b; break;
+			}
+			break;
+		}
+		}
+	}
+	return stack[0];
+}
+
+Breakpoints::Breakpoints(Bus& b) : bus(b)
+{
+	bus.SetBreakpoints(this);
+}
+
+Breakpoints::~Breakpoints()
+{
+	bus.SetBreakpoints(nullptr);
+}
+
+int Breakpoints::Add(uint8_t kinds, uint16_t first, uint16_t last, const std::string& condition)
+{
+	error.clear();
+	if (!(kinds & (BreakExec | BreakRead | BreakWrite)) || first > last)
+	{
+		error = "no kind or empty range";
+		return -1;
+	}
+	Breakpoint b;
+	b.id = next_id;
+	b.kinds = kinds;
+	b.first = first;
+	b.last = last;
+	if (!b.condition.Compile(condition))
+	{
+		error = b.condition.Error();
+		return -1;
+	}
+	next_id++;
+	list.push_back(std::move(b));
+	Rebuild();
+	return list.back().id;
+}
+
+bool Breakpoints::Remove(int id)
+{
+	for (auto it = list.begin(); it != list.end(); ++it)
+	{
+		if (it->id == id)
+		{
+			list.erase(it);
+			Rebuild();
+			return true;
+		}
+	}
+	return false;
+}
+
+void Breakpoints::Clear()
+{
+	list.clear();
+	Rebuild();
+}
+
+bool Breakpoints::Take(BreakHit& out)
+{
+	if (!hit.id)
+		return false;
+	out = hit;
+	hit.id = 0;
+	return true;
+}
+
+uint64_t Breakpoints::Hits(int id) const
+{
+	for (const Breakpoint& b : list)
+		if (b.id == id)
+			return b.hits;
+	return 0;
+}
+
+bool Breakpoints::Check(BreakKind kind, uint16_t addr, uint8_t data, uint16_t pc)
+{
+	// the first one set wins when several are hit at once
+	for (Breakpoint& b : list)
+	{
+		if (!(b.kinds & kind) || addr < b.first || addr > b.last || !b.condition.Eval(bus, addr, data))
+			continue;
+		b.hits++;
+		hit = { b.id, kind, addr, data, pc };
+		pending = true;
+		return true;
+	}
+	return false;
+}
+
+void Breakpoints::Rebuild()
+{
+	std::fill(std::begin(exec), std::end(exec), 0);
+	std::fill(std::begin(read), std::end(read), 0);
+	std::fill(std::begin(write), std::end(write), 0);
+	for (const Breakpoint& b : list)
+	{
+		for (uint32_t a = b.first; a <= b.last; a++)
+		{
+			uint8_t bit = (uint8_t)(1 << (a & 7));
+			if (b.kinds & BreakExec)
+				exec[a >> 3] |= bit;
+			if (b.kinds & BreakRead)
+				read[a >> 3] |= bit;
+			if (b.kinds & BreakWrite)
+				write[a >> 3] |= bit;
+		}
+	}
+	for (unsigned page = 0; page < 256; page++)
+	{
+		read_pages[page] = write_pages[page] = false;
+		for (unsigned i = page * 32; i < page * 32 + 32; i++)
+		{
+			read_pages[page] = read_pages[page] || read[i];
+			write_pages[page] = write_pages[page] || write[i];
+		}
+	}
+	// watched pages off the fast path, the others back on
+	bus.SetBreakpoints(this);
+}
@@ -1,30 +1,111 @@
 #include "Bus.h"
+#include "Mapper.h"
+#include "BlockCache.h"
+#include "Jit.h"
+#include "Rewind.h"
+#include "Loader.h"
+#include "Disassembly.h"
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// RAM of a new bus, until written: one for all of them
+static std::shared_ptr<const std::vector<uint8_t>> Zeros()
+{
+	static const std::shared_ptr<const std::vector<uint8_t>> zeros = std::make_shared<std::vector<uint8_t>>(0x10000);
+	return zeros;
+}
+
+Bus::Bus() : shared_image(Zeros())
+{
+	// plain RAM everywhere
+	slot_shared.fill(true);
+	MapRam(0x00, 256, 0);
+}
+
+Bus::~Bus()
+{
+}
+
+void* Bus::operator new(size_t size)
+{
+	void* p = nullptr;
+#ifdef _WIN32
+	p = _aligned_malloc(size, alignof(mos6502));
+#else
+	if (posix_memalign(&p, alignof(mos6502), size))
+		p = nullptr;
+#endif
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void Bus::operator delete(void* p)
+{
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
 
 bool Bus::ReadFromFile(const char* filename, uint16_t offset)
 {
-	std::streampos fileSize;
-	std::ifstream file(filename, std::ios::binary);
+	Image image;
+	if (!image.Open(filename, ImageFormat::Raw, offset))
+		return false;
+	Load(image);
+	return true;
+}
+
+bool Bus::ReadFromFile(const char* filename, const MapperConfig& config)
+{
+	std::string error;
+	std::shared_ptr<MappedFile> file = MappedFile::Open(filename, error);
+	if (!file)
+		return false;
+
+	return SetMapper(config, std::vector<uint8_t>(file->Data(), file->Data() + file->Size()));
+}
 
-	file.seekg(0, std::ios::end);
-	fileSize = file.tellg();
-	file.seekg(0, std::ios::beg);
-	file.read((char*)&RAM[offset], fileSize);
+bool Bus::SetMapper(const MapperConfig& config, std::vector<uint8_t> image)
+{
+	std::string error;
+	if (config.type != MapperType::None && !Mapper::Check(config, error))
+		return false;
 
+	// the slots change with the mapper, states taken so far don't fit anymore
+	StopTracking();
+	fork_image.reset();
+	mapper.reset();
+	if (config.type != MapperType::None)
+		mapper.reset(new Mapper(*this, config, std::move(image)));
+	// the history is of other memory
+	if (rewind)
+		rewind->Clear();
 	return true;
 }
 
 void Bus::CPU_Step()
 {
 	if (pins.RW)
-		pins.DATA = RAM[pins.ADDR];
-
+		pins.DATA = Read(pins.ADDR);
+	if (trace)
+		trace->Record(CPU.readTicksTotal(), pins);
 
-	pins = CPU.tick(pins);
+	if (core == Core::Microcode)
+		pins = CPU.tick_mc(pins);
+	else
+		pins = CPU.tick(pins);
 
 	TickHandler();
 
 	if (!pins.RW)
-		RAM[pins.ADDR] = pins.DATA;
+		Write(pins.ADDR, pins.DATA);
 
 
 	if (pins.SYNC)
@@ -33,15 +114,209 @@ void Bus::CPU_Step()
 	}
 }
 
+BlockCache& Bus::GetBlockCache()
+{
+	if (!blocks)
+		blocks.reset(new BlockCache(*this));
+	return *blocks;
+}
+
+Jit& Bus::GetJit()
+{
+	if (!jit)
+		jit.reset(new Jit(*this, GetBlockCache()));
+	return *jit;
+}
+
+unsigned Bus::JitStep(Jit& j)
+{
+	return j.Step();
+}
+
+void Bus::FlushCode()
+{
+	if (blocks)
+		blocks->Clear();
+	if (disasm)
+		disasm->Changed();
+}
+
+void Bus::Clear()
+{
+	SetMapper(MapperConfig());
+	FlushCode();
+	// the pages written so far are kept, zeroed
+	shared_image = Zeros();
+	for (uint32_t slot = 0; slot < RamSlots; slot++)
+	{
+		slot_shared[slot] = !ram_pages[slot];
+		if (ram_pages[slot])
+			std::memset(ram_pages[slot].get(), 0, 256);
+	}
+	MapRam(0x00, 256, 0);
+	rom_files.clear();
+	pins = {};
+	opaddr = 0;
+	if (rewind)
+		rewind->Clear();
+}
+
 void Bus::CPU_Step_Op()
 {
+	if (core == Core::Instruction || core == Core::Block || core == Core::Jit)
+	{
+		CPU.step(*this);
+		opaddr = CPU.readPC();
+		return;
+	}
+
 	do
 	{
 		CPU_Step();
 	} while (!pins.SYNC);
 }
 
+void Bus::UpdatePage(uint8_t page)
+{
+	const Page& p = pages[page];
+	bool watch_read = breaks && breaks->Watched(page, BreakRead);
+	bool watch_write = breaks && breaks->Watched(page, BreakWrite);
+	page_read[page] = p.device || watch_read ? nullptr : p.mem;
+	page_write[page] = p.device || p.readonly || p.code || p.clean || p.shared || rewind || disasm || watch_write ? nullptr : p.mem;
+}
+
+uint8_t Bus::ReadSlow(uint16_t addr)
+{
+	const Page& p = pages[addr >> 8];
+	uint8_t data = p.mem[addr & 0xFF];
+	if (p.device)
+		p.device->Read(addr, data);
+	if (breaks)
+		breaks->Access(BreakRead, addr, data);
+	return data;
+}
+
+void Bus::WriteSlow(uint16_t addr, uint8_t data)
+{
+	const Page& p = pages[addr >> 8];
+	if (breaks)
+		breaks->Access(BreakWrite, addr, data);
+	if (p.device)
+		p.device->Write(addr, data);
+	if (!p.readonly)
+	{
+		if (p.shared)
+			Unshare(p.slot);
+		if (p.clean)
+			MarkDirty(addr >> 8);
+		if (rewind)
+			rewind->Journal(addr, p.slot, p.mem[addr & 0xFF]);
+		p.mem[addr & 0xFF] = data;
+		if (p.code)
+			blocks->Written(addr);
+		if (disasm)
+			disasm->Written(addr);
+	}
+}
+
+void Bus::MapMemory(uint8_t first, unsigned count, uint8_t* mem, bool readonly)
+{
+	// foreign memory has no slot, the mapper sets the slots of its banks
+	for (unsigned i = 0; i < count && first + i < 256; i++)
+		MapPage((uint8_t)(first + i), mem + i * 256, NoSlot, readonly);
+}
+
+void Bus::MapRam(uint8_t first, unsigned count, uint32_t slot, bool readonly)
+{
+	for (unsigned i = 0; i < count && first + i < 256 && slot + i < RamSlots; i++)
+		MapPage((uint8_t)(first + i), RamSlot(slot + i), slot + i, readonly);
+}
+
+void Bus::MapPage(uint8_t page, uint8_t* mem, uint32_t slot, bool readonly)
+{
+	Page& p = pages[page];
+	if (p.code && p.mem != mem)
+		blocks->InvalidatePage(page);
+	if (disasm && p.mem != mem)
+		disasm->Written((uint16_t)(page << 8));
+	p.mem = mem;
+	p.readonly = readonly;
+	p.slot = slot;
+	// still in the shared image until the slot is written
+	p.shared = slot < RamSlots && slot_shared[slot];
+	p.clean = tracking && slot != NoSlot && !slot_dirty[slot];
+	UpdatePage(page);
+}
+
+void Bus::SetRewind(Rewind* r)
+{
+	rewind = r;
+	for (unsigned i = 0; i < 256; i++)
+		UpdatePage((uint8_t)i);
+}
+
+void Bus::SetDisassembly(Disassembly* d)
+{
+	disasm = d;
+	for (unsigned i = 0; i < 256; i++)
+		UpdatePage((uint8_t)i);
+}
+
+void Bus::SetBreakpoints(Breakpoints* b)
+{
+	breaks = b;
+	for (unsigned i = 0; i < 256; i++)
+		UpdatePage((uint8_t)i);
+}
+
+void Bus::SetSlots(uint8_t first, unsigned count, uint32_t slot)
+{
+	for (unsigned i = 0; i < count && first + i < 256; i++)
+	{
+		Page& p = pages[first + i];
+		p.slot = slot + i;
+		p.clean = tracking && !slot_dirty[p.slot];
+		UpdatePage(first + i);
+	}
+}
+
+void Bus::MarkDirty(uint8_t page)
+{
+	Page& p = pages[page];
+	if (!slot_dirty[p.slot])
+	{
+		slot_dirty[p.slot] = 1;
+		dirty_slots.push_back(p.slot);
+	}
+	p.clean = false;
+	UpdatePage(page);
+}
+
+void Bus::SetReadOnly(uint8_t first, unsigned count, bool readonly)
+{
+	for (unsigned i = 0; i < count && first + i < 256; i++)
+	{
+		pages[first + i].readonly = readonly;
+		UpdatePage(first + i);
+	}
+}
+
+void Bus::MapDevice(uint8_t first, unsigned count, Device* device)
+{
+	for (unsigned i = 0; i < count && first + i < 256; i++)
+	{
+		if (pages[first + i].code && device)
+			blocks->InvalidatePage(first + i);
+		pages[first + i].device = device;
+		UpdatePage(first + i);
+	}
+}
+
 uint8_t& Bus::operator[](uint16_t addr)
 {
-	return RAM[addr];
+	// the reference may be written through, a shared page can't be handed out
+	const Page& p = pages[addr >> 8];
+	if (p.shared)
+		Unshare(p.slot);
+	return p.mem[addr & 0xFF];
 }
@@ -0,0 +1,375 @@
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include "Disassembly.h"
+#include "Bus.h"
+
+namespace
+{
+	std::string hex(uint32_t n, uint8_t d)
+	{
+		std::string s(d, '0');
+		for (int i = d - 1; i >= 0; i--, n >>= 4)
+			s[i] = "0123456789ABCDEF"[n & 0xF];
+		return s;
+	}
+}
+
+Disassembly::~Disassembly()
+{
+	if (attached)
+		bus.SetDisassembly(nullptr);
+}
+
+void Disassembly::Reset(uint16_t from, uint16_t to)
+{
+	if (!entries)
+		entries.reset(new Entry[0x10000]);
+	for (uint32_t a = 0; a < 0x10000; a++)
+		entries[a] = { 0, 0 };
+	first = from;
+	last = to;
+	flow = false;
+	for (auto& c : changed)
+		c.store(false, std::memory_order_relaxed);
+	any_changed = false;
+
+	if (!attached)
+	{
+		bus.SetDisassembly(this);
+		attached = true;
+	}
+}
+
+void Disassembly::Build(uint16_t from, uint16_t to)
+{
+	Reset(from, std::min<uint16_t>(to, 0xFFFC));
+	Sweep(first, false);
+}
+
+void Disassembly::Trace(const std::vector<uint16_t>& from, unsigned count)
+{
+	Reset(0, 0xFFFF);
+	flow = true;
+	seeds = from;
+	threads = count ? count : std::max(1u, std::thread::hardware_concurrency());
+	Retrace();
+}
+
+void Disassembly::Seed(uint16_t addr)
+{
+	// writes not looked at yet first, the snapshot below would hide them from Update()
+	Update();
+	if (!flow || IsInstruction(addr))
+		return;
+	seeds.push_back(addr);
+	Snapshot(false);
+	Follow({ addr }, 1);
+	Classify();
+}
+
+void Disassembly::Snapshot(bool all)
+{
+	// page by page from the backing memory, bus[] would unshare the pages of a fork
+	mem.resize(0x10000);
+	for (unsigned page = 0; page < 256; page++)
+	{
+		if (all || stale[page])
+			std::memcpy(&mem[page << 8], bus.PageMemory((uint8_t)page), 256);
+		stale[page] = false;
+	}
+}
+
+void Disassembly::Retrace()
+{
+	Snapshot(true);
+	if (!reached)
+		reached.reset(new std::atomic<uint8_t>[0x10000]);
+	for (uint32_t a = 0; a < 0x10000; a++)
+		reached[a].store(0, std::memory_order_relaxed);
+
+	std::vector<uint16_t> work = seeds;
+	for (uint16_t v : { 0xFFFA, 0xFFFC, 0xFFFE })
+		work.push_back(mem[v] | mem[v + 1] << 8);
+	Follow(std::move(work), threads);
+	Classify();
+}
+
+void Disassembly::Follow(std::vector<uint16_t> work, unsigned count)
+{
+	// each thread follows its own targets, and hands half of them over when it has a few; done when the
+	// list is empty and nobody is busy any more (who could add to it)
+	std::mutex lock;
+	unsigned busy = 0;
+	auto worker = [&]()
+	{
+		std::vector<uint16_t> mine;
+		for (;;)
+		{
+			{
+				std::lock_guard<std::mutex> hold(lock);
+				if (!work.empty())
+				{
+					mine.push_back(work.back());
+					work.pop_back();
+					busy++;
+				}
+				else if (!busy)
+					return;
+			}
+			if (mine.empty())
+			{
+				std::this_thread::yield();
+				continue;
+			}
+			while (!mine.empty())
+			{
+				uint16_t addr = mine.back();
+				mine.pop_back();
+				Path(addr, mine);
+				if (count > 1 && mine.size() >= 8)
+				{
+					std::lock_guard<std::mutex> hold(lock);
+					work.insert(work.end(), mine.begin(), mine.begin() + mine.size() / 2);
+					mine.erase(mine.begin(), mine.begin() + mine.size() / 2);
+				}
+			}
+			std::lock_guard<std::mutex> hold(lock);
+			busy--;
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (unsigned i = 1; i < count; i++)
+		pool.emplace_back(worker);
+	worker();
+	for (auto& t : pool)
+		t.join();
+}
+
+void Disassembly::Path(uint16_t addr, std::vector<uint16_t>& targets)
+{
+	for (uint32_t a = addr;;)
+	{
+		uint8_t opcode = mem[a];
+		uint8_t len = mos6502::Length(opcode);
+		// taken by another path already, a dead end stays one
+		uint8_t mark = 0;
+		if (!reached[a].compare_exchange_strong(mark, Reached, std::memory_order_relaxed))
+			return;
+		// undefined opcodes are taken for data, so is an instruction running past $FFFF
+		if (mos6502::Bad(opcode) || a + len > 0x10000)
+		{
+			reached[a].store(DeadEnd, std::memory_order_relaxed);
+			return;
+		}
+		uint8_t lo = len > 1 ? mem[a + 1] : 0;
+		uint16_t word = lo | (len > 2 ? mem[a + 2] : 0) << 8;
+
+		switch (opcode)
+		{
+		case 0x20:  // JSR
+			targets.push_back(word);
+			break;
+		case 0x4C:  // JMP abs
+			targets.push_back(word);
+			return;
+		case 0x00:  // BRK
+		case 0x40:  // RTI
+		case 0x60:  // RTS
+		case 0x6C:  // JMP (ind)
+			return;
+		default:
+			if (mos6502::Branch(opcode))
+				targets.push_back((uint16_t)(a + 2 + (int8_t)lo));
+			break;
+		}
+		a += len;
+	}
+}
+
+void Disassembly::Classify()
+{
+	uint32_t covered = 0;   // past the last listed instruction
+	for (uint32_t a = 0; a < 0x10000; a++)
+	{
+		Entry& e = entries[a];
+		e.opcode = mem[a];
+		if (a < covered)
+			e.info = 0;
+		else if (reached[a].load(std::memory_order_relaxed) == Reached)
+		{
+			uint8_t len = mos6502::Length(e.opcode);
+			e.info = Start | len << 4 | (uint8_t)mos6502::AddrMode(e.opcode);
+			covered = a + len;
+		}
+		else
+			e.info = Data;
+	}
+}
+
+bool Disassembly::Steers(uint16_t addr) const
+{
+	// any opcode a path got to, listed or not (overlapped, undefined ones)
+	if (addr >= 0xFFFA || reached[addr].load(std::memory_order_relaxed))
+		return true;
+	// the operands of the jumps and branches, with the opcodes as they were traced
+	for (uint16_t back = 1; back <= 2 && back <= addr; back++)
+	{
+		uint16_t start = addr - back;
+		uint8_t opcode = mem[start];
+		if (reached[start].load(std::memory_order_relaxed) == Reached && mos6502::Length(opcode) > back
+			&& (opcode == 0x20 || opcode == 0x4C || mos6502::Branch(opcode)))
+			return true;
+	}
+	return false;
+}
+
+void Disassembly::Sweep(uint32_t addr, bool resync)
+{
+	for (uint32_t a = addr; a <= last && a >= first;)
+	{
+		uint8_t opcode = bus.Peek((uint16_t)a);
+		Entry& e = entries[a];
+		// back in step: the old instruction here is still the same, so is everything after it
+		if (resync && a != addr && (e.info & Start) && e.opcode == opcode)
+			break;
+
+		uint8_t len = mos6502::Length(opcode);
+		e.opcode = opcode;
+		e.info = Start | len << 4 | (uint8_t)mos6502::AddrMode(opcode);
+		for (uint32_t i = 1; i < len && a + i < 0x10000; i++)
+		{
+			entries[a + i].opcode = bus.Peek((uint16_t)(a + i));
+			entries[a + i].info = 0;
+		}
+		a += len;
+	}
+}
+
+void Disassembly::Update()
+{
+	if (!entries || !any_changed.exchange(false, std::memory_order_acquire))
+		return;
+	bool again = false;
+	for (unsigned page = 0; page < 256; page++)
+	{
+		if (!changed[page].exchange(false, std::memory_order_relaxed))
+			continue;
+		if (flow)
+		{
+			stale[page] = true;
+			for (uint32_t a = page << 8; a < (page + 1) << 8; a++)
+			{
+				uint8_t data = bus.Peek((uint16_t)a);
+				if (entries[a].opcode != data)
+				{
+					again = again || Steers((uint16_t)a);
+					entries[a].opcode = data;
+				}
+			}
+			continue;
+		}
+		for (uint32_t a = page << 8; a < (page + 1) << 8; a++)
+		{
+			if ((entries[a].info & Start) && entries[a].opcode != bus.Peek((uint16_t)a))
+				Sweep(a, true);
+		}
+	}
+	if (again)
+		Retrace();
+}
+
+void Disassembly::Changed()
+{
+	for (auto& c : changed)
+		c.store(true, std::memory_order_relaxed);
+	any_changed.store(true, std::memory_order_release);
+}
+
+bool Disassembly::Next(uint16_t& addr) const
+{
+	uint32_t next;
+	if (IsInstruction(addr))
+		next = addr + Length(addr);
+	else if (IsData(addr))
+		next = addr + 1;
+	else
+		return false;
+	if (next > last || !(IsInstruction((uint16_t)next) || IsData((uint16_t)next)))
+		return false;
+	addr = (uint16_t)next;
+	return true;
+}
+
+bool Disassembly::Prev(uint16_t& addr) const
+{
+	if (addr > first && IsData((uint16_t)(addr - 1)))
+	{
+		addr--;
+		return true;
+	}
+	// instructions follow each other, the one before ends right at addr
+	for (uint32_t len = 1; len <= 3 && len <= addr; len++)
+	{
+		uint16_t a = (uint16_t)(addr - len);
+		if (a >= first && IsInstruction(a) && Length(a) == len)
+		{
+			addr = a;
+			return true;
+		}
+	}
+	return false;
+}
+
+std::string Disassembly::Text(uint16_t addr) const
+{
+	if (IsData(addr))
+		return "$" + hex(addr, 4) + ": .byte $" + hex(bus.Peek(addr), 2);
+	return IsInstruction(addr) ? Line(bus, addr) : "";
+}
+
+std::string Disassembly::Text(uint16_t addr, const uint8_t* memory) const
+{
+	if (IsData(addr))
+		return DataLine(memory, addr);
+	return IsInstruction(addr) ? Line(memory, addr) : "";
+}
+
+std::string Disassembly::Line(const Bus& bus, uint16_t addr)
+{
+	return Format(addr, bus.Peek(addr), bus.Peek((uint16_t)(addr + 1)), bus.Peek((uint16_t)(addr + 2)));
+}
+
+std::string Disassembly::Line(const uint8_t* memory, uint16_t addr)
+{
+	return Format(addr, memory[addr], memory[(uint16_t)(addr + 1)], memory[(uint16_t)(addr + 2)]);
+}
+
+std::string Disassembly::DataLine(const uint8_t* memory, uint16_t addr)
+{
+	return "$" + hex(addr, 4) + ": .byte $" + hex(memory[addr], 2);
+}
+
+std::string Disassembly::Format(uint16_t addr, uint8_t opcode, uint8_t lo, uint8_t hi)
+{
+	uint16_t word = lo | hi << 8;
+	std::string s = "$" + hex(addr, 4) + ": " + mos6502::Mnemonic(opcode) + " ";
+	switch (mos6502::AddrMode(opcode))
+	{
+	case mos6502::Mode::IMP: s += " {IMP}"; break;
+	case mos6502::Mode::IMM: s += "#$" + hex(lo, 2) + " {IMM}"; break;
+	case mos6502::Mode::ZP0: s += "$" + hex(lo, 2) + " {ZP0}"; break;
+	case mos6502::Mode::ZPX: s += "$" + hex(lo, 2) + ", X {ZPX}"; break;
+	case mos6502::Mode::ZPY: s += "$" + hex(lo, 2) + ", Y {ZPY}"; break;
+	case mos6502::Mode::IZX: s += "($" + hex(lo, 2) + ", X) {IZX}"; break;
+	case mos6502::Mode::IZY: s += "($" + hex(lo, 2) + "), Y {IZY}"; break;
+	case mos6502::Mode::ABS: s += "$" + hex(word, 4) + " {ABS}"; break;
+	case mos6502::Mode::ABX: s += "$" + hex(word, 4) + ", X {ABX}"; break;
+	case mos6502::Mode::ABY: s += "$" + hex(word, 4) + ", Y {ABY}"; break;
+	case mos6502::Mode::IND: s += "($" + hex(word, 4) + ") {IND}"; break;
+	case mos6502::Mode::REL: s += "$" + hex(lo, 2) + " [$" + hex((uint16_t)(addr + 2 + (int8_t)lo), 4) + "] {REL}"; break;
+	}
+	return s;
+}
@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "ExecStats.h"
+#include "mos6502.h"
+
+ExecStats::ExecStats()
+{
+	for (unsigned op = 0; op < 256; op++)
+	{
+		base[op] = mos6502::MinCycles((uint8_t)op);
+		branch[op] = mos6502::Branch((uint8_t)op);
+	}
+	Clear();
+}
+
+void ExecStats::Clear()
+{
+	memset(ops, 0, sizeof(ops));
+	irq = 0;
+	nmi = 0;
+	interrupt_cycles = 0;
+	min_sp = 0xFF;
+}
+
+void ExecStats::Merge(const ExecStats& s)
+{
+	for (unsigned op = 0; op < 256; op++)
+	{
+		ops[op].count += s.ops[op].count;
+		ops[op].cycles += s.ops[op].cycles;
+		ops[op].taken += s.ops[op].taken;
+		ops[op].crossed += s.ops[op].crossed;
+	}
+	irq += s.irq;
+	nmi += s.nmi;
+	interrupt_cycles += s.interrupt_cycles;
+	min_sp = std::min(min_sp, s.min_sp);
+}
+
+uint64_t ExecStats::Instructions() const
+{
+	uint64_t n = 0;
+	for (const Op& o : ops)
+		n += o.count;
+	return n;
+}
+
+uint64_t ExecStats::Cycles() const
+{
+	uint64_t n = interrupt_cycles;
+	for (const Op& o : ops)
+		n += o.cycles;
+	return n;
+}
+
+namespace
+{
+	// executed opcodes, most cycles first
+	std::vector<uint8_t> Executed(const ExecStats& s)
+	{
+		std::vector<uint8_t> list;
+		for (unsigned op = 0; op < 256; op++)
+			if (s.ops[op].count)
+				list.push_back((uint8_t)op);
+		std::stable_sort(list.begin(), list.end(), [&](uint8_t a, uint8_t b) { return s.ops[a].cycles > s.ops[b].cycles; });
+		return list;
+	}
+
+	std::string Format(const char* fmt, ...)
+	{
+		char buf[256];
+		va_list args;
+		va_start(args, fmt);
+		vsnprintf(buf, sizeof(buf), fmt, args);
+		va_end(args);
+		return buf;
+	}
+
+	double Percent(uint64_t part, uint64_t total)
+	{
+		return total ? 100.0 * part / total : 0.0;
+	}
+}
+
+std::string ExecStats::Json() const
+{
+	uint64_t taken = 0, not_taken = 0, branch_crossed = 0, indexed = 0, indexed_crossed = 0;
+	for (unsigned op = 0; op < 256; op++)
+	{
+		if (branch[op])
+		{
+			taken += ops[op].taken;
+			not_taken += ops[op].count - ops[op].taken;
+			branch_crossed += ops[op].crossed;
+		}
+		else if (mos6502::PageCrossing((uint8_t)op))
+		{
+			indexed += ops[op].count;
+			indexed_crossed += ops[op].crossed;
+		}
+	}
+
+	std::string s = "{\n";
+	s += Format("  \"instructions\": %llu,\n", (unsigned long long)Instructions());
+	s += Format("  \"cycles\": %llu,\n", (unsigned long long)Cycles());
+	s += Format("  \"irq\": %llu,\n", (unsigned long long)irq);
+	s += Format("  \"nmi\": %llu,\n", (unsigned long long)nmi);
+	s += Format("  \"interrupt_cycles\": %llu,\n", (unsigned long long)interrupt_cycles);
+	s += Format("  \"min_sp\": %u,\n", (unsigned)min_sp);
+	s += Format("  \"max_stack_depth\": %u,\n", MaxStackDepth());
+	s += Format("  \"branches\": { \"taken\": %llu, \"not_taken\": %llu, \"taken_page_crossed\": %llu },\n",
+		(unsigned long long)taken, (unsigned long long)not_taken, (unsigned long long)branch_crossed);
+	s += Format("  \"indexed\": { \"count\": %llu, \"page_crossed\": %llu },\n",
+		(unsigned long long)indexed, (unsigned long long)indexed_crossed);
+	s += "  \"opcodes\": [";
+	const char* sep = "\n";
+	for (uint8_t op : Executed(*this))
+	{
+		const Op& o = ops[op];
+		s += Format("%s    { \"opcode\": %u, \"mnemonic\": \"%s\", \"count\": %llu, \"cycles\": %llu", sep, (unsigned)op,
+			mos6502::Mnemonic(op), (unsigned long long)o.count, (unsigned long long)o.cycles);
+		if (branch[op])
+			s += Format(", \"taken\": %llu", (unsigned long long)o.taken);
+		if (branch[op] || mos6502::PageCrossing(op))
+			s += Format(", \"page_crossed\": %llu", (unsigned long long)o.crossed);
+		s += " }";
+		sep = ",\n";
+	}
+	s += "\n  ]\n}\n";
+	return s;
+}
+
+std::string ExecStats::Table() const
+{
+	uint64_t instructions = Instructions(), cycles = Cycles();
+	std::string s = Format("%llu instructions, %llu cycles, %llu irq, %llu nmi, max stack depth %u\n",
+		(unsigned long long)instructions, (unsigned long long)cycles, (unsigned long long)irq, (unsigned long long)nmi,
+		MaxStackDepth());
+	s += Format("%-2s  %-8s %14s %7s %15s %8s %7s %9s\n", "op", "mnemonic", "count", "count%", "cycles", "cycles%", "taken%",
+		"crossed%");
+	for (uint8_t op : Executed(*this))
+	{
+		const Op& o = ops[op];
+		s += Format("%02X  %-8s %14llu %7.2f %15llu %8.2f", (unsigned)op, mos6502::Mnemonic(op), (unsigned long long)o.count,
+			Percent(o.count, instructions), (unsigned long long)o.cycles, Percent(o.cycles, cycles));
+		if (branch[op])
+			s += Format(" %7.2f", Percent(o.taken, o.count));
+		else
+			s += "        ";
+		if (branch[op] || mos6502::PageCrossing(op))
+			s += Format(" %9.2f", Percent(o.crossed, branch[op] ? o.taken : o.count));
+		s.erase(s.find_last_not_of(' ') + 1);
+		s += "\n";
+	}
+	return s;
+}
@@ -0,0 +1,212 @@
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "Fleet.h"
+#include "BlockCache.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+	class FleetBus final : public BusT<FleetBus>
+	{
+	public:
+		void TickHandler() override
+		{
+			// headless, no devices
+		}
+	};
+
+	void PinThread(unsigned cpu)
+	{
+#if defined(_WIN32)
+		SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << (cpu % (8 * sizeof(DWORD_PTR))));
+#elif defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu % CPU_SETSIZE, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+		(void)cpu;
+#endif
+	}
+
+	bool LoadJob(FleetBus& m, const FleetJob& job)
+	{
+		if (job.file)
+		{
+			if (job.readonly)
+				m.MapRom(*job.file);
+			else
+				m.Load(*job.file);
+			return true;
+		}
+		if (job.image)
+		{
+			for (size_t i = 0; i < job.image->size() && job.load + i < 0x10000; i++)
+				m[(uint16_t)(job.load + i)] = (*job.image)[i];
+			m.FlushCode();
+			return true;
+		}
+		return m.ReadFromFile(job.rom.c_str(), job.load);
+	}
+
+	FleetResult RunJob(FleetBus& m, const FleetJob& job)
+	{
+		FleetResult r;
+		if (!LoadJob(m, job))
+			return r;
+
+		m.core = job.core;
+		m.pins = m.CPU.reset();
+		m.pins.RES = true;
+		while (m.pins.RES)
+			m.CPU_Step();
+		if (job.start_set)
+			m.pins = m.CPU.forceJumpTo(job.start);
+
+		bool blocks = job.core == Core::Block || job.core == Core::Jit;
+		uint64_t instructions = 0, last_instructions = 0;
+		uint64_t blocks_start = blocks ? m.GetBlockCache().instructions : 0;
+		uint16_t last_pc = m.CPU.readPC();
+		uint64_t ticks_start = m.CPU.readTicksTotal();
+		r.stop = "cycles";
+
+		// the same stop conditions benchCPU has
+		auto check_stop = [&](FleetBus& b)
+		{
+			uint16_t pc = b.CPU.readPC();
+			instructions = blocks ? b.GetBlockCache().instructions - blocks_start : instructions + 1;
+			if (job.until_set && pc == job.until)
+			{
+				r.stop = "pc";
+				return true;
+			}
+			if (job.trap && pc == last_pc && instructions - last_instructions == 1)
+			{
+				r.stop = "trap";
+				return true;
+			}
+			last_pc = pc;
+			last_instructions = instructions;
+			return false;
+		};
+
+		auto t0 = std::chrono::steady_clock::now();
+		m.RunUntil(check_stop, job.cycles);
+		auto t1 = std::chrono::steady_clock::now();
+
+		if (blocks)
+			instructions = m.GetBlockCache().instructions - blocks_start;
+
+		r.pc = m.CPU.readPC();
+		r.cycles = m.CPU.readTicksTotal() - ticks_start;
+		r.instructions = instructions;
+		r.seconds = std::chrono::duration<double>(t1 - t0).count();
+		return r;
+	}
+}
+
+struct Fleet::Worker
+{
+	std::mutex lock;
+	std::deque<size_t> queue;
+};
+
+Fleet::Fleet(const Options& _options) : options(_options)
+{
+	threads = options.threads ? options.threads : std::thread::hardware_concurrency();
+	if (!threads)
+		threads = 1;
+	stats.resize(threads);
+	for (unsigned i = 0; i < threads; i++)
+		workers.emplace_back(new Worker());
+}
+
+Fleet::~Fleet()
+{
+}
+
+std::vector<FleetResult> Fleet::Run(const std::vector<FleetJob>& jobs)
+{
+	std::vector<FleetResult> results(jobs.size());
+
+	for (unsigned i = 0; i < threads; i++)
+	{
+		workers[i]->queue.clear();
+		stats[i] = WorkerStats();
+	}
+	for (size_t j = 0; j < jobs.size(); j++)
+		workers[j % threads]->queue.push_back(j);
+
+	std::vector<std::thread> pool;
+	for (unsigned i = 0; i < threads; i++)
+		pool.emplace_back(&Fleet::WorkerMain, this, i, std::cref(jobs), std::ref(results));
+	for (std::thread& t : pool)
+		t.join();
+
+	return results;
+}
+
+void Fleet::WorkerMain(unsigned id, const std::vector<FleetJob>& jobs, std::vector<FleetResult>& results)
+{
+	if (options.pin_threads)
+		PinThread(id);
+
+	// allocated (and zeroed) here, after pinning - the machine memory is local to this worker
+	std::unique_ptr<FleetBus> m;
+	WorkerStats& st = stats[id];
+
+	size_t job;
+	while (Pop(id, job) || Steal(id, job))
+	{
+		// the same machine for every job, cleared so nothing leaks from the previous one
+		if (m)
+			m->Clear();
+		else
+			m.reset(new FleetBus());
+
+		results[job] = RunJob(*m, jobs[job]);
+		results[job].worker = id;
+		results[job].regs = m->CPU.readRegisters();
+		results[job].flags = m->CPU.readFlags();
+
+		st.jobs++;
+		st.cycles += results[job].cycles;
+		st.busy_seconds += results[job].seconds;
+	}
+}
+
+bool Fleet::Pop(unsigned id, size_t& job)
+{
+	Worker& w = *workers[id];
+	std::lock_guard<std::mutex> guard(w.lock);
+	if (w.queue.empty())
+		return false;
+	job = w.queue.back();
+	w.queue.pop_back();
+	return true;
+}
+
+bool Fleet::Steal(unsigned id, size_t& job)
+{
+	for (unsigned k = 1; k < threads; k++)
+	{
+		Worker& w = *workers[(id + k) % threads];
+		std::lock_guard<std::mutex> guard(w.lock);
+		if (!w.queue.empty())
+		{
+			job = w.queue.front();
+			w.queue.pop_front();
+			stats[id].steals++;
+			return true;
+		}
+	}
+	return false;
+}
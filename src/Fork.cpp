@@ -0,0 +1,62 @@
+#include <cstring>
+#include "Bus.h"
+#include "Mapper.h"
+#include "BlockCache.h"
+
+void Bus::ForkFrom(Bus& parent)
+{
+	// one image per fork point, it never changes once made so any number of threads can read it
+	if (!parent.fork_image || parent.fork_ticks != parent.CPU.readTicksTotal())
+	{
+		std::shared_ptr<std::vector<uint8_t>> image = std::make_shared<std::vector<uint8_t>>(RamSlots * 256);
+		for (uint32_t slot = 0; slot < RamSlots; slot++)
+			std::memcpy(&(*image)[slot * 256], parent.SlotData(slot), 256);
+		parent.fork_image = image;
+		parent.fork_ticks = parent.CPU.readTicksTotal();
+	}
+
+	StopTracking();
+	mapper.reset();
+	shared_image = parent.fork_image;
+	rom_files = parent.rom_files;
+	slot_shared.fill(true);
+
+	// same memory map as the parent, the mapper banks get mapped by the copy of the mapper
+	for (unsigned i = 0; i < 256; i++)
+	{
+		const Page& q = parent.pages[i];
+		if (q.slot < RamSlots)
+			MapRam((uint8_t)i, 1, q.slot, q.readonly);
+		else
+			MapMemory((uint8_t)i, 1, q.mem, q.readonly);
+	}
+	if (parent.mapper)
+		mapper.reset(new Mapper(*this, *parent.mapper));
+	FlushCode();
+
+	CPU = parent.CPU;
+	pins = parent.pins;
+	core = parent.core;
+	opaddr = parent.opaddr.load();
+}
+
+void Bus::Unshare(uint32_t slot)
+{
+	if (!ram_pages[slot])
+		ram_pages[slot].reset(new uint8_t[256]);
+	uint8_t* mem = ram_pages[slot].get();
+	std::memcpy(mem, &(*shared_image)[slot * 256], 256);
+	slot_shared[slot] = false;
+
+	// mirrors of the slot move along, the bytes are the same so cached blocks stay valid
+	for (unsigned i = 0; i < 256; i++)
+	{
+		Page& p = pages[i];
+		if (p.shared && p.slot == slot)
+		{
+			p.mem = mem;
+			p.shared = false;
+			UpdatePage((uint8_t)i);
+		}
+	}
+}
@@ -0,0 +1,343 @@
+#include <algorithm>
+#include <chrono>
+#include "Fuzzer.h"
+
+namespace
+{
+	// input register, everything else on its page reads and writes the backing memory
+	class FuzzInput : public Device
+	{
+	public:
+		uint16_t reg = 0;
+		const uint8_t* data = nullptr;
+		size_t size = 0;
+		size_t pos = 0;
+		bool starved = false;       // read with the input used up
+
+		void Set(const uint8_t* _data, size_t _size)
+		{
+			data = _data;
+			size = _size;
+			pos = 0;
+			starved = false;
+		}
+
+		void Read(uint16_t addr, uint8_t& d) override
+		{
+			if (addr != reg)
+				return;
+			if (pos < size)
+				d = data[pos++];
+			else
+			{
+				d = 0;
+				starved = true;
+			}
+		}
+
+		void Write(uint16_t, uint8_t&) override
+		{
+		}
+	};
+
+	// AFL style hit count buckets, one bit each
+	uint8_t Bucket(uint8_t hits)
+	{
+		if (hits < 4)
+			return hits == 3 ? 4 : hits;
+		if (hits < 8)
+			return 8;
+		if (hits < 16)
+			return 16;
+		if (hits < 32)
+			return 32;
+		return hits < 128 ? 64 : 128;
+	}
+}
+
+struct Fuzzer::Machine final : public BusT<Fuzzer::Machine>
+{
+	FuzzInput input;
+
+	void TickHandler() override
+	{
+		// headless, the input is on the page table
+	}
+};
+
+Fuzzer::Fuzzer(const FuzzConfig& _config) : config(_config), m(new Machine()), rng(_config.seed)
+{
+	m->input.reg = config.input;
+	m->MapDevice(config.input >> 8, 1, &m->input);
+
+	trace.assign(0x10000, 0);
+	seen.assign(0x10000, 0);
+	// jumps, branches, JSR/RTS/RTI and BRK; not the other block enders (PLP, CLI, SEI), they go on in line
+	for (unsigned op = 0; op < 256; op++)
+		flow[op] = mos6502::Branch((uint8_t)op) || op == 0x4C || op == 0x6C || op == 0x20 || op == 0x60 || op == 0x40 || op == 0x00;
+}
+
+Fuzzer::~Fuzzer()
+{
+}
+
+void Fuzzer::Load(const std::vector<uint8_t>& image, uint16_t at, bool readonly)
+{
+	for (size_t i = 0; i < image.size() && at + i < 0x10000; i++)
+		(*m)[(uint16_t)(at + i)] = image[i];
+	if (readonly && !image.empty())
+		m->SetReadOnly(at >> 8, (unsigned)((at + std::min<size_t>(image.size(), 0x10000 - at) + 255) / 256 - (at >> 8)));
+	m->FlushCode();
+}
+
+bool Fuzzer::Start()
+{
+	m->pins = m->CPU.reset();
+	m->pins.RES = true;
+	while (m->pins.RES)
+		m->CPU_Step();
+	return Start(m->CPU.readPC());
+}
+
+bool Fuzzer::Start(uint16_t start)
+{
+	m->pins = m->CPU.forceJumpTo(start);
+	m->core = Core::Instruction;
+	m->input.Set(config.prefix.data(), config.prefix.size());
+
+	// the read asking for more than the prefix is done again by every case, the snapshot goes before it
+	mos6502 cpu = m->CPU;
+	Pins pins = m->pins;
+	m->RunUntil([&](Machine& b)
+	{
+		if (b.input.starved)
+			return true;
+		cpu = b.CPU;
+		pins = b.pins;
+		return false;
+	}, config.start_cycles);
+	if (!m->input.starved)
+		return false;
+
+	m->CPU = cpu;
+	m->pins = pins;
+	m->input.Set(nullptr, 0);
+	m->SaveState(snapshot);
+	return true;
+}
+
+void Fuzzer::AddSeed(const std::vector<uint8_t>& input)
+{
+	uint16_t pc = 0;
+	bool hang;
+	const char* reason = Case(input, pc, hang);
+	NewCoverage();
+	if (reason)
+		Crash(reason, pc, input);
+	else
+		corpus.push_back(input);
+}
+
+void Fuzzer::Crash(const char* reason, uint16_t pc, const std::vector<uint8_t>& input)
+{
+	stats.crashes++;
+	auto same = [&](const FuzzCrash& c) { return c.pc == pc && c.reason == reason; };
+	if (std::find_if(crashes.begin(), crashes.end(), same) == crashes.end())
+		crashes.push_back({ reason, pc, input });
+}
+
+const char* Fuzzer::Exec(const std::vector<uint8_t>& input, uint16_t* pc)
+{
+	uint16_t at = 0;
+	bool hang;
+	const char* reason = Case(input, at, hang);
+	if (pc && reason)
+		*pc = at;
+	return reason;
+}
+
+const char* Fuzzer::Case(const std::vector<uint8_t>& input, uint16_t& pc, bool& hang)
+{
+	// back to the snapshot, only the pages written by the last case get copied
+	m->LoadState(snapshot.data(), snapshot.size());
+	m->input.Set(input.data(), input.size());
+
+	for (uint16_t e : touched)
+		trace[e] = 0;
+	touched.clear();
+
+	const char* reason = nullptr;
+	uint16_t last_pc = m->CPU.readPC();
+	uint8_t last_op = m->Peek(last_pc);
+	uint8_t last_sp = m->CPU.readSP();
+
+	auto check = [&](Machine& b)
+	{
+		uint16_t at = b.CPU.readPC();
+		uint8_t sp = b.CPU.readSP();
+
+		if (flow[last_op])
+		{
+			uint16_t e = (uint16_t)(last_pc * 0x9E3Bu) ^ at;
+			uint8_t& hits = trace[e];
+			if (!hits)
+				touched.push_back(e);
+			if (hits != 255)
+				hits++;
+		}
+
+		// SP moves by 3 at most per instruction, anything else went around (TXS sets it at will)
+		if (last_op != 0x9A)
+		{
+			int s = last_sp + (int8_t)(sp - last_sp);
+			if (s < 0 || s > 255)
+			{
+				reason = s < 0 ? "stack overflow" : "stack underflow";
+				pc = last_pc;
+				return true;
+			}
+		}
+
+		if (b.input.starved)
+			return true;
+
+		// checked before they run, pc is the instruction itself
+		uint8_t op = b.Peek(at);
+		if (op == 0x00 && std::find(config.brk_ok.begin(), config.brk_ok.end(), at) == config.brk_ok.end())
+			reason = "brk";
+		else if (mos6502::Bad(op))
+			reason = "bad opcode";
+		if (reason)
+		{
+			pc = at;
+			return true;
+		}
+
+		last_pc = at;
+		last_op = op;
+		last_sp = sp;
+		return false;
+	};
+
+	stats.cycles += m->RunUntil(check, config.cycles);
+	stats.cases++;
+	hang = !reason && !m->input.starved;
+	return reason;
+}
+
+bool Fuzzer::NewCoverage()
+{
+	bool found = false;
+	for (uint16_t e : touched)
+	{
+		uint8_t bit = Bucket(trace[e]);
+		if (!(seen[e] & bit))
+		{
+			if (!seen[e])
+				stats.edges++;
+			seen[e] |= bit;
+			found = true;
+		}
+	}
+	return found;
+}
+
+void Fuzzer::Run(uint64_t cases)
+{
+	auto t0 = std::chrono::steady_clock::now();
+	if (corpus.empty())
+		AddSeed({});
+	// mutations need something to start from, even an empty input that crashes
+	if (corpus.empty())
+		corpus.push_back({});
+
+	for (uint64_t i = 0; i < cases; i++)
+	{
+		std::vector<uint8_t> input = Mutate(corpus[next++ % corpus.size()]);
+		uint16_t pc = 0;
+		bool hang;
+		const char* reason = Case(input, pc, hang);
+		bool found = NewCoverage();
+
+		if (reason)
+			Crash(reason, pc, input);
+		else if (hang)
+			stats.hangs++;
+		else if (found)
+			corpus.push_back(input);
+	}
+
+	stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+std::vector<uint8_t> Fuzzer::Mutate(const std::vector<uint8_t>& in)
+{
+	static const uint8_t interesting[] = { 0x00, 0x01, 0x7F, 0x80, 0xFF, '\r', '\n', ' ', '"', ',', ':', ';', '$', '(', ')', '0', '9', 'A', 'Z' };
+	std::vector<uint8_t> out = in;
+
+	// stacked mutations, 1 to 16 of them
+	unsigned n = 1u << (rng() % 5);
+	for (unsigned k = 0; k < n; k++)
+	{
+		size_t len = out.size();
+		switch (rng() % (config.dictionary.empty() ? 8 : 9))
+		{
+		case 0: // flip a bit
+			if (len)
+				out[rng() % len] ^= (uint8_t)(1 << (rng() % 8));
+			break;
+		case 1: // random byte
+			if (len)
+				out[rng() % len] = (uint8_t)rng();
+			break;
+		case 2: // interesting byte
+			if (len)
+				out[rng() % len] = interesting[rng() % sizeof(interesting)];
+			break;
+		case 3: // small add/sub
+			if (len)
+				out[rng() % len] += (uint8_t)(rng() % 33 + 240);
+			break;
+		case 4: // insert a byte
+			out.insert(out.begin() + rng() % (len + 1), rng() % 2 ? (uint8_t)rng() : interesting[rng() % sizeof(interesting)]);
+			break;
+		case 5: // delete a few bytes
+			if (len)
+			{
+				size_t at = rng() % len;
+				size_t count = 1 + rng() % std::min<size_t>(len - at, 8);
+				out.erase(out.begin() + at, out.begin() + at + count);
+			}
+			break;
+		case 6: // copy a few bytes elsewhere
+			if (len)
+			{
+				size_t from = rng() % len;
+				size_t count = 1 + rng() % std::min<size_t>(len - from, 16);
+				std::vector<uint8_t> chunk(out.begin() + from, out.begin() + from + count);
+				out.insert(out.begin() + rng() % (len + 1), chunk.begin(), chunk.end());
+			}
+			break;
+		case 7: // splice with another corpus entry
+		{
+			const std::vector<uint8_t>& other = corpus[rng() % corpus.size()];
+			if (!other.empty())
+			{
+				out.resize(rng() % (len + 1));
+				out.insert(out.end(), other.begin() + rng() % other.size(), other.end());
+			}
+			break;
+		}
+		default: // dictionary token
+		{
+			const std::string& token = config.dictionary[rng() % config.dictionary.size()];
+			out.insert(out.begin() + rng() % (len + 1), token.begin(), token.end());
+			break;
+		}
+		}
+	}
+
+	if (out.size() > config.max_len)
+		out.resize(config.max_len);
+	return out;
+}
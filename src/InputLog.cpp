@@ -0,0 +1,130 @@
+#include <cstring>
+#include "InputLog.h"
+
+static const uint16_t InputLogVersion = 1;
+
+InputRecorder::InputRecorder(std::ostream& _out, Bus& bus) : out(_out)
+{
+	std::vector<uint8_t> state;
+	bus.SaveState(state);
+	last_ticks = bus.CPU.readTicksTotal();
+
+	std::vector<uint8_t> header;
+	StateWriter w(header);
+	w.bytes((const uint8_t*)"65IN", 4);
+	w.u16(InputLogVersion);
+	w.u8((uint8_t)bus.core);
+	w.u8(0);
+	w.u32((uint32_t)state.size());
+	out.write((const char*)header.data(), header.size());
+	out.write((const char*)state.data(), state.size());
+}
+
+InputRecorder::~InputRecorder()
+{
+	Close();
+}
+
+void InputRecorder::Event(uint64_t ticks, uint8_t tag)
+{
+	// ticks only go forward, varint of the difference
+	uint64_t delta = ticks > last_ticks ? ticks - last_ticks : 0;
+	last_ticks += delta;
+	while (delta >= 0x80)
+	{
+		out.put((char)(delta | 0x80));
+		delta >>= 7;
+	}
+	out.put((char)delta);
+	out.put((char)tag);
+}
+
+void InputRecorder::Pin(uint64_t ticks, InputPin pin, bool level)
+{
+	if (closed)
+		return;
+	Event(ticks, (uint8_t)(0x10 | ((uint8_t)pin << 1) | (level ? 1 : 0)));
+}
+
+bool InputRecorder::Data(uint64_t ticks, uint8_t channel, uint8_t value)
+{
+	if (closed || channel > 0x0F)
+		return false;
+	Event(ticks, (uint8_t)(0x20 | channel));
+	out.put((char)value);
+	return true;
+}
+
+void InputRecorder::Close()
+{
+	if (closed)
+		return;
+	Event(last_ticks, 0x00);
+	out.flush();
+	closed = true;
+}
+
+bool InputReplayer::Start(Bus& bus)
+{
+	char header[12];
+	if (!in.read(header, sizeof(header)) || std::memcmp(header, "65IN", 4) != 0)
+		return false;
+	StateReader r((const uint8_t*)header + 4, sizeof(header) - 4);
+	if (r.u16() != InputLogVersion)
+		return false;
+	core = (Core)r.u8();
+	r.u8();
+	uint32_t size = r.u32();
+
+	std::vector<uint8_t> state(size);
+	if (!in.read((char*)state.data(), size) || !bus.LoadState(state.data(), size))
+		return false;
+
+	next.ticks = bus.CPU.readTicksTotal();
+	done = false;
+	Read();
+	return true;
+}
+
+void InputReplayer::Read()
+{
+	uint64_t delta = 0;
+	for (unsigned shift = 0; ; shift += 7)
+	{
+		int c = in.get();
+		if (c == EOF || shift > 63)
+		{
+			done = true;
+			return;
+		}
+		delta |= (uint64_t)(c & 0x7F) << shift;
+		if (!(c & 0x80))
+			break;
+	}
+
+	int tag = in.get();
+	if (tag == EOF || tag == 0x00)
+	{
+		done = true;
+		return;
+	}
+
+	next.ticks += delta;
+	next.data = (tag & 0xF0) == 0x20;
+	if (next.data)
+	{
+		int value = in.get();
+		if (value == EOF)
+		{
+			done = true;
+			return;
+		}
+		next.id = (uint8_t)(tag & 0x0F);
+		next.value = (uint8_t)value;
+	}
+	else
+	{
+		next.id = (uint8_t)((tag >> 1) & 0x07);
+		next.value = (uint8_t)(tag & 1);
+	}
+}
@@ -0,0 +1,511 @@
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#include <initializer_list>
+#include "Jit.h"
+#include "Bus.h"
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define JIT_X64
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	// just the bits of x86-64 encoding the translator needs
+	struct Emitter
+	{
+		std::vector<uint8_t> out;
+
+		void b(std::initializer_list<uint8_t> bytes) { out.insert(out.end(), bytes); }
+		void u8(uint8_t v) { out.push_back(v); }
+		void u16(uint16_t v) { u8(v & 0xFF); u8(v >> 8); }
+		void u32(uint32_t v) { u16(v & 0xFFFF); u16(v >> 16); }
+		void u64(uint64_t v) { u32((uint32_t)v); u32(v >> 32); }
+		size_t pos() const { return out.size(); }
+
+		// rel32 jumps, the returned position is patched with the target later
+		size_t jcc(uint8_t cc) { b({ 0x0F, (uint8_t)(0x80 | cc) }); u32(0); return pos(); }
+		size_t jmp() { u8(0xE9); u32(0); return pos(); }
+		void patch(size_t at, size_t target)
+		{
+			int32_t rel = (int32_t)(target - at);
+			memcpy(&out[at - 4], &rel, 4);
+		}
+
+		void call(const void* f) { b({ 0x48, 0xB8 }); u64((uint64_t)f); b({ 0xFF, 0xD0 }); }  // mov rax, f; call rax
+	};
+
+	const uint8_t CC_E = 0x4;
+	const uint8_t CC_NE = 0x5;
+
+	const size_t CodeBufferSize = 16 << 20;
+}
+
+Jit::Jit(Bus& _bus, BlockCache& _cache) : bus(_bus), cache(_cache)
+{
+	memcpy(snapshot, &bus.CPU, sizeof(snapshot));
+#ifdef JIT_X64
+	void* p = mmap(nullptr, CodeBufferSize, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p != MAP_FAILED)
+	{
+		code = (uint8_t*)p;
+		code_size = CodeBufferSize;
+	}
+#endif
+}
+
+Jit::~Jit()
+{
+	Release();
+}
+
+bool Jit::Supported()
+{
+#ifdef JIT_X64
+	return true;
+#else
+	return false;
+#endif
+}
+
+void Jit::SetVerify(bool v)
+{
+	if (verify != v)
+	{
+		verify = v;
+		Flush();
+	}
+}
+
+void Jit::Flush()
+{
+	cache.DropNative();
+	code_used = 0;
+	stats.flushes++;
+}
+
+void Jit::Release()
+{
+	cache.DropNative();
+#ifdef JIT_X64
+	if (code)
+		munmap(code, code_size);
+#endif
+	code = nullptr;
+	code_size = 0;
+	code_used = 0;
+}
+
+unsigned Jit::Step()
+{
+	mos6502& cpu = bus.CPU;
+
+	if (!code || !cpu.BlockReady(bus.pins))
+		return cpu.step_block(bus, cache);
+#ifdef MOS6502_STATS
+	// native blocks don't count their instructions
+	if (cpu.stats)
+		return cpu.step_block(bus, cache);
+#endif
+
+	BlockCache::Block* block = cache.Get(cpu.R.PC);
+	if (!block)
+		return cpu.step_block(bus, cache);
+
+	if (!block->native)
+	{
+		if (++block->hits < HotRuns || !Compile(*block))
+			return cpu.step_block(bus, cache);
+	}
+
+	cpu._pins = bus.pins;
+
+	unsigned ops = 0;
+	unsigned cycles = ((NativeBlock)block->native)(&cpu, &bus, &ops);
+	cache.instructions += ops;
+
+	cpu.StepDone(bus);
+	cpu.ticks_total += cycles;
+	return cycles;
+}
+
+//
+// Generated code: rbx = mos6502*, r12 = Bus*, r13d = ticks, r14d = cache generation on entry, r15 = ops counter*
+//
+bool Jit::Compile(BlockCache::Block& block)
+{
+#ifdef JIT_X64
+	const uint8_t oA = offsetof(mos6502, R) + offsetof(Registers6502, A);
+	const uint8_t oX = offsetof(mos6502, R) + offsetof(Registers6502, X);
+	const uint8_t oY = offsetof(mos6502, R) + offsetof(Registers6502, Y);
+	const uint8_t oSP = offsetof(mos6502, R) + offsetof(Registers6502, SP);
+	const uint8_t oPC = offsetof(mos6502, R) + offsetof(Registers6502, PC);
+	const uint8_t oS = offsetof(mos6502, S);
+	const uint8_t C = static_cast<uint8_t>(FLAGS6502::CF);
+	const uint8_t Z = static_cast<uint8_t>(FLAGS6502::ZF);
+	const uint8_t I = static_cast<uint8_t>(FLAGS6502::IF);
+	const uint8_t D = static_cast<uint8_t>(FLAGS6502::DF);
+	const uint8_t V = static_cast<uint8_t>(FLAGS6502::VF);
+	const uint8_t N = static_cast<uint8_t>(FLAGS6502::NF);
+
+	const void* generation = &cache.generation;
+
+	Emitter e;
+	std::vector<size_t> exits;  // jumps to the epilogue
+
+	auto load_al = [&](uint8_t off) { e.b({ 0x8A, 0x43, off }); };    // mov al, [rbx+off]
+	auto store_al = [&](uint8_t off) { e.b({ 0x88, 0x43, off }); };   // mov [rbx+off], al
+	auto set_pc = [&](uint16_t pc) { e.b({ 0x66, 0xC7, 0x43, oPC }); e.u16(pc); };
+	auto add_cycles = [&](uint32_t n) { e.b({ 0x41, 0x81, 0xC5 }); e.u32(n); };
+	auto flag_and = [&](uint8_t m) { e.b({ 0x80, 0x63, oS, (uint8_t)~m }); };
+	auto flag_or = [&](uint8_t m) { e.b({ 0x80, 0x4B, oS, m }); };
+	// S = S & ~(N|Z) | dl bits, N and Z from al
+	auto flags_nz = [&](uint8_t keep) {
+		e.b({ 0x8A, 0x53, oS });                    // mov dl, [rbx+S]
+		e.b({ 0x80, 0xE2, keep });                  // and dl, keep
+		e.b({ 0x84, 0xC0 });                        // test al, al
+		e.b({ 0x0F, 0x94, 0xC1 });                  // sete cl
+		e.b({ 0x00, 0xC9 });                        // add cl, cl  (-> Z)
+		e.b({ 0x08, 0xCA });                        // or dl, cl
+		e.b({ 0x88, 0xC1 });                        // mov cl, al
+		e.b({ 0x80, 0xE1, N });                     // and cl, N
+		e.b({ 0x08, 0xCA });                        // or dl, cl
+		e.b({ 0x88, 0x53, oS });                    // mov [rbx+S], dl
+	};
+	auto update_nz = [&]() { flags_nz((uint8_t)~(N | Z)); };
+	// compare register with the value in cl: C, then N/Z of the difference
+	auto compare = [&](uint8_t reg) {
+		load_al(reg);
+		e.b({ 0x38, 0xC8 });                        // cmp al, cl
+		e.b({ 0x0F, 0x93, 0xC6 });                  // setae dh
+		e.b({ 0x28, 0xC8 });                        // sub al, cl
+		e.b({ 0x8A, 0x53, oS });                    // mov dl, [rbx+S]
+		e.b({ 0x80, 0xE2, (uint8_t)~(N | Z | C) }); // and dl, ~(N|Z|C)
+		e.b({ 0x08, 0xF2 });                        // or dl, dh
+		e.b({ 0x84, 0xC0 });                        // test al, al
+		e.b({ 0x0F, 0x94, 0xC1 });                  // sete cl
+		e.b({ 0x00, 0xC9 });                        // add cl, cl
+		e.b({ 0x08, 0xCA });                        // or dl, cl
+		e.b({ 0x88, 0xC1 });                        // mov cl, al
+		e.b({ 0x80, 0xE1, N });                     // and cl, N
+		e.b({ 0x08, 0xCA });                        // or dl, cl
+		e.b({ 0x88, 0x53, oS });                    // mov [rbx+S], dl
+	};
+	// leave the block: ops done, PC is expected to be set already
+	auto exit_block = [&](unsigned ops) {
+		e.b({ 0x41, 0xC7, 0x07 }); e.u32(ops);      // mov dword [r15], ops
+		exits.push_back(e.jmp());
+	};
+	// stop if the cached code got invalidated (by the block itself)
+	auto check_generation = [&](unsigned ops, int next_pc) {
+		e.b({ 0x48, 0xB8 }); e.u64((uint64_t)generation); // mov rax, &generation
+		e.b({ 0x44, 0x3B, 0x30 });                  // cmp r14d, [rax]
+		size_t same = e.jcc(CC_E);
+		if (next_pc >= 0)
+			set_pc((uint16_t)next_pc);
+		exit_block(ops);
+		e.patch(same, e.pos());
+	};
+	// memory byte at a fixed address to al, through the page table
+	auto read_mem = [&](uint16_t addr) {
+		e.b({ 0x48, 0xB8 }); e.u64((uint64_t)&bus.page_read[addr >> 8]);
+		e.b({ 0x48, 0x8B, 0x00 });                  // mov rax, [rax]
+		e.b({ 0x48, 0x85, 0xC0 });                  // test rax, rax
+		size_t fast = e.jcc(CC_NE);
+		e.b({ 0x4C, 0x89, 0xE7 });                  // mov rdi, r12
+		e.u8(0xBE); e.u32(addr);                    // mov esi, addr
+		e.call((const void*)&Jit::HelperRead);
+		size_t done = e.jmp();
+		e.patch(fast, e.pos());
+		e.b({ 0x0F, 0xB6, 0x80 }); e.u32(addr & 0xFF); // movzx eax, byte [rax+lo]
+		e.patch(done, e.pos());
+	};
+	// register to a fixed address, through the page table
+	auto write_mem = [&](uint8_t reg, uint16_t addr, unsigned ops, uint16_t next_pc) {
+		e.b({ 0x8A, 0x4B, reg });                   // mov cl, [rbx+reg]
+		e.b({ 0x48, 0xB8 }); e.u64((uint64_t)&bus.page_write[addr >> 8]);
+		e.b({ 0x48, 0x8B, 0x00 });                  // mov rax, [rax]
+		e.b({ 0x48, 0x85, 0xC0 });                  // test rax, rax
+		size_t fast = e.jcc(CC_NE);
+		e.b({ 0x4C, 0x89, 0xE7 });                  // mov rdi, r12
+		e.u8(0xBE); e.u32(addr);                    // mov esi, addr
+		e.b({ 0x0F, 0xB6, 0xD1 });                  // movzx edx, cl
+		e.call((const void*)&Jit::HelperWrite);
+		check_generation(ops, next_pc);             // slow path may hit cached code
+		size_t done = e.jmp();
+		e.patch(fast, e.pos());
+		e.b({ 0x88, 0x88 }); e.u32(addr & 0xFF);    // mov [rax+lo], cl
+		e.patch(done, e.pos());
+	};
+
+	// prologue
+	e.b({ 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57 });  // push rbx, r12, r13, r14, r15
+	e.b({ 0x48, 0x89, 0xFB });                      // mov rbx, rdi
+	e.b({ 0x49, 0x89, 0xF4 });                      // mov r12, rsi
+	e.b({ 0x49, 0x89, 0xD7 });                      // mov r15, rdx
+	e.b({ 0x45, 0x31, 0xED });                      // xor r13d, r13d
+	e.b({ 0x48, 0xB8 }); e.u64((uint64_t)generation);
+	e.b({ 0x44, 0x8B, 0x30 });                      // mov r14d, [rax]
+
+	uint16_t pc = block.start;
+	bool pc_set = false;    // the last instruction left PC where the block continues
+
+	for (unsigned i = 0; i < block.count; i++)
+	{
+		const mos6502::DecodedOp& op = block.ops[i];
+		uint16_t next = pc + op.len;
+		uint16_t addr = op.len == 2 ? (op.operand & 0xFF) : op.operand;   // zero page / absolute
+		uint8_t imm = (uint8_t)op.operand;
+		bool native = true;
+		bool ticks_done = false;    // branches add their ticks themselves
+		pc_set = false;
+
+		if (verify)
+		{
+			e.b({ 0x48, 0xBF }); e.u64((uint64_t)this); // mov rdi, this
+			e.b({ 0x48, 0x89, 0xDE });              // mov rsi, rbx
+			e.b({ 0x44, 0x89, 0xEA });              // mov edx, r13d
+			e.call((const void*)&Jit::HelperSnapshot);
+		}
+
+		switch (op.opcode)
+		{
+		// transfers, increments, flags
+		case 0xAA: load_al(oA); store_al(oX); update_nz(); break;   // TAX
+		case 0xA8: load_al(oA); store_al(oY); update_nz(); break;   // TAY
+		case 0x8A: load_al(oX); store_al(oA); update_nz(); break;   // TXA
+		case 0x98: load_al(oY); store_al(oA); update_nz(); break;   // TYA
+		case 0xBA: load_al(oSP); store_al(oX); update_nz(); break;  // TSX
+		case 0x9A: load_al(oX); store_al(oSP); break;               // TXS
+		case 0xE8: load_al(oX); e.b({ 0xFE, 0xC0 }); store_al(oX); update_nz(); break; // INX
+		case 0xC8: load_al(oY); e.b({ 0xFE, 0xC0 }); store_al(oY); update_nz(); break; // INY
+		case 0xCA: load_al(oX); e.b({ 0xFE, 0xC8 }); store_al(oX); update_nz(); break; // DEX
+		case 0x88: load_al(oY); e.b({ 0xFE, 0xC8 }); store_al(oY); update_nz(); break; // DEY
+		case 0x18: flag_and(C); break;  // CLC
+		case 0x38: flag_or(C); break;   // SEC
+		case 0x58: flag_and(I); break;  // CLI
+		case 0x78: flag_or(I); break;   // SEI
+		case 0xB8: flag_and(V); break;  // CLV
+		case 0xD8: flag_and(D); break;  // CLD
+		case 0xF8: flag_or(D); break;   // SED
+		case 0xEA: break;               // NOP
+
+		// immediate
+		case 0xA9: e.b({ 0xB0, imm }); store_al(oA); update_nz(); break;   // LDA #
+		case 0xA2: e.b({ 0xB0, imm }); store_al(oX); update_nz(); break;   // LDX #
+		case 0xA0: e.b({ 0xB0, imm }); store_al(oY); update_nz(); break;   // LDY #
+		case 0x09: load_al(oA); e.b({ 0x0C, imm }); store_al(oA); update_nz(); break;  // ORA #
+		case 0x29: load_al(oA); e.b({ 0x24, imm }); store_al(oA); update_nz(); break;  // AND #
+		case 0x49: load_al(oA); e.b({ 0x34, imm }); store_al(oA); update_nz(); break;  // EOR #
+		case 0xC9: e.b({ 0xB1, imm }); compare(oA); break;  // CMP #
+		case 0xE0: e.b({ 0xB1, imm }); compare(oX); break;  // CPX #
+		case 0xC0: e.b({ 0xB1, imm }); compare(oY); break;  // CPY #
+
+		// zero page / absolute loads
+		case 0xA5: case 0xAD: read_mem(addr); store_al(oA); update_nz(); break;    // LDA
+		case 0xA6: case 0xAE: read_mem(addr); store_al(oX); update_nz(); break;    // LDX
+		case 0xA4: case 0xAC: read_mem(addr); store_al(oY); update_nz(); break;    // LDY
+		case 0x05: case 0x0D: read_mem(addr); e.b({ 0x0A, 0x43, oA }); store_al(oA); update_nz(); break;  // ORA
+		case 0x25: case 0x2D: read_mem(addr); e.b({ 0x22, 0x43, oA }); store_al(oA); update_nz(); break;  // AND
+		case 0x45: case 0x4D: read_mem(addr); e.b({ 0x32, 0x43, oA }); store_al(oA); update_nz(); break;  // EOR
+		case 0xC5: case 0xCD: read_mem(addr); e.b({ 0x88, 0xC1 }); compare(oA); break;  // CMP
+		case 0xE4: case 0xEC: read_mem(addr); e.b({ 0x88, 0xC1 }); compare(oX); break;  // CPX
+		case 0xC4: case 0xCC: read_mem(addr); e.b({ 0x88, 0xC1 }); compare(oY); break;  // CPY
+
+		// zero page / absolute stores
+		// (ticks go first, the block may end right after the write)
+		case 0x85: case 0x8D: add_cycles(op.cycles); ticks_done = true; write_mem(oA, addr, i + 1, next); break;    // STA
+		case 0x86: case 0x8E: add_cycles(op.cycles); ticks_done = true; write_mem(oX, addr, i + 1, next); break;    // STX
+		case 0x84: case 0x8C: add_cycles(op.cycles); ticks_done = true; write_mem(oY, addr, i + 1, next); break;    // STY
+
+		// branches: 2 ticks if not taken, 3 if taken, 4 if taken to another page
+		case 0x10: case 0x30: case 0x50: case 0x70:
+		case 0x90: case 0xB0: case 0xD0: case 0xF0:
+		{
+			static const uint8_t flag[4] = { N, V, C, Z };
+			uint8_t m = flag[op.opcode >> 6];
+			bool if_set = op.opcode & 0x20;
+			uint16_t target = next + (int8_t)imm;
+
+			e.b({ 0xF6, 0x43, oS, m });             // test byte [rbx+S], m
+			size_t not_taken = e.jcc(if_set ? CC_E : CC_NE);
+			set_pc(target);
+			add_cycles((next & 0xFF00) == (target & 0xFF00) ? 3 : 4);
+			size_t done = e.jmp();
+			e.patch(not_taken, e.pos());
+			set_pc(next);
+			add_cycles(2);
+			e.patch(done, e.pos());
+			pc_set = true;
+			ticks_done = true;
+			break;
+		}
+		case 0x4C: set_pc(op.operand); pc_set = true; break;  // JMP
+
+		default:
+			native = false;
+			break;
+		}
+
+		if (native)
+		{
+			stats.native_ops++;
+			if (!ticks_done)
+				add_cycles(op.cycles);
+
+			if (verify)
+			{
+				e.b({ 0x48, 0xBF }); e.u64((uint64_t)this); // mov rdi, this
+				e.b({ 0x4C, 0x89, 0xE6 });          // mov rsi, r12
+				e.b({ 0x48, 0xBA }); e.u64(Pack(op)); // mov rdx, op
+				e.b({ 0x44, 0x89, 0xE9 });          // mov ecx, r13d
+				e.b({ 0x41, 0xB8 }); e.u32(pc);     // mov r8d, pc
+				e.call((const void*)&Jit::HelperCheck);
+				e.b({ 0x41, 0x01, 0xC5 });          // add r13d, eax
+			}
+		}
+		else
+		{
+			// the interpreter does this one, PC has to be right for it
+			stats.helper_ops++;
+			set_pc(pc);
+			e.b({ 0x48, 0x89, 0xDF });              // mov rdi, rbx
+			e.b({ 0x4C, 0x89, 0xE6 });              // mov rsi, r12
+			e.b({ 0x48, 0xBA }); e.u64(Pack(op));   // mov rdx, op
+			e.call((const void*)&Jit::HelperExec);
+			e.b({ 0x41, 0x01, 0xC5 });              // add r13d, eax
+			pc_set = true;
+			if (i + 1 < block.count)
+				check_generation(i + 1, -1);
+		}
+
+		pc = next;
+	}
+
+	if (!pc_set)
+		set_pc(pc);
+	e.b({ 0x41, 0xC7, 0x07 }); e.u32(block.count);  // mov dword [r15], count
+
+	// epilogue
+	size_t epilogue = e.pos();
+	for (size_t j : exits)
+		e.patch(j, epilogue);
+	e.b({ 0x44, 0x89, 0xE8 });                      // mov eax, r13d
+	e.b({ 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B });  // pop r15, r14, r13, r12, rbx
+	e.u8(0xC3);                                     // ret
+
+	if (code_used + e.out.size() > code_size)
+		Flush();
+	if (e.out.size() > code_size)
+		return false;
+
+	// only the pages the block goes on are made writable, the blocks elsewhere stay as they are
+	uint8_t* dst = code + code_used;
+	const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+	uint8_t* first = (uint8_t*)((uintptr_t)dst & ~(page - 1));
+	size_t len = (((uintptr_t)dst + e.out.size() + page - 1) & ~(page - 1)) - (uintptr_t)first;
+	if (mprotect(first, len, PROT_READ | PROT_WRITE) != 0)
+	{
+		Release();
+		return false;
+	}
+	memcpy(dst, e.out.data(), e.out.size());
+	if (mprotect(first, len, PROT_READ | PROT_EXEC) != 0)
+	{
+		// the blocks on those pages can't run any more
+		Release();
+		return false;
+	}
+
+	code_used += (e.out.size() + 15) & ~(size_t)15;
+	block.native = dst;
+	stats.compiled++;
+	return true;
+#else
+	(void)block;
+	return false;
+#endif
+}
+
+unsigned Jit::HelperExec(mos6502* cpu, Bus* bus, uint64_t op)
+{
+	return cpu->Exec(*bus, Unpack(op));
+}
+
+unsigned Jit::HelperRead(Bus* bus, uint32_t addr)
+{
+	return bus->Read((uint16_t)addr);
+}
+
+void Jit::HelperWrite(Bus* bus, uint32_t addr, uint32_t data)
+{
+	bus->Write((uint16_t)addr, (uint8_t)data);
+}
+
+void Jit::HelperSnapshot(Jit* jit, mos6502* cpu, unsigned cycles)
+{
+	memcpy(jit->snapshot, cpu, sizeof(jit->snapshot));
+	jit->snapshot_cycles = cycles;
+}
+
+// runs the instruction just done by the native code through the interpreter on the snapshot and compares,
+// returns the ticks correction
+int Jit::HelperCheck(Jit* jit, Bus* bus, uint64_t packed, unsigned cycles, uint32_t addr)
+{
+	mos6502::DecodedOp op = Unpack(packed);
+	mos6502& cpu = bus->CPU;
+	mos6502 ref;
+	memcpy(&ref, jit->snapshot, sizeof(ref));
+	ref.R.PC = (uint16_t)addr;
+
+	uint16_t ea = op.len == 2 ? (op.operand & 0xFF) : op.operand;
+	const Bus::Page& page = bus->pages[ea >> 8];
+	bool load = false, store = false;
+	switch (op.opcode)
+	{
+	case 0xA5: case 0xAD: case 0xA6: case 0xAE: case 0xA4: case 0xAC:
+	case 0x05: case 0x0D: case 0x25: case 0x2D: case 0x45: case 0x4D:
+	case 0xC5: case 0xCD: case 0xE4: case 0xEC: case 0xC4: case 0xCC:
+		load = true;
+		break;
+	case 0x85: case 0x8D: case 0x86: case 0x8E: case 0x84: case 0x8C:
+		store = true;
+		break;
+	}
+
+	unsigned native_cycles = cycles - jit->snapshot_cycles;
+	unsigned ref_cycles = op.cycles;
+	bool ok;
+
+	if (store)
+	{
+		// stores change no registers, check the byte landed (plain memory only, devices don't keep it)
+		uint8_t v = op.opcode & 0x01 ? ref.R.A : (op.opcode & 0x02 ? ref.R.X : ref.R.Y);
+		ok = page.device || page.readonly || page.mem[ea & 0xFF] == v;
+		ok = ok && cpu.R.A == ref.R.A && cpu.R.X == ref.R.X && cpu.R.Y == ref.R.Y && (uint8_t)cpu.S == (uint8_t)ref.S;
+	}
+	else if (load && page.device)
+	{
+		// reading the device again could change it
+		return 0;
+	}
+	else
+	{
+		bool sets_pc = (op.opcode & 0x1F) == 0x10 || op.opcode == 0x4C;
+		ref_cycles = ref.Exec(*bus, op);
+		ok = cpu.R.A == ref.R.A && cpu.R.X == ref.R.X && cpu.R.Y == ref.R.Y && cpu.R.SP == ref.R.SP &&
+			(uint8_t)cpu.S == (uint8_t)ref.S && (!sets_pc || cpu.R.PC == ref.R.PC);
+	}
+	ok = ok && native_cycles == ref_cycles;
+
+	if (ok)
+		return 0;
+
+	if (!jit->stats.mismatches++)
+		std::fprintf(stderr, "jit: mismatch at $%04X (opcode $%02X), using the interpreter result\n", addr, op.opcode);
+	cpu.R = ref.R;
+	cpu.S = ref.S;
+	return (int)ref_cycles - (int)native_cycles;
+}
@@ -0,0 +1,471 @@
+#include <algorithm>
+#include <cstring>
+#include "Loader.h"
+#include "Bus.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#define LOADER_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#include <iterator>
+#endif
+
+std::shared_ptr<MappedFile> MappedFile::Open(const char* path, std::string& error)
+{
+	std::shared_ptr<MappedFile> f(new MappedFile());
+#if defined(_WIN32)
+	HANDLE h = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (h == INVALID_HANDLE_VALUE)
+	{
+		error = std::string("can't open ") + path;
+		return nullptr;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(h, &size))
+	{
+		CloseHandle(h);
+		error = std::string("can't read ") + path;
+		return nullptr;
+	}
+	if (size.QuadPart > 0)
+	{
+		HANDLE m = CreateFileMappingA(h, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+		void* p = m ? MapViewOfFile(m, FILE_MAP_COPY, 0, 0, 0) : nullptr;
+		if (!p)
+		{
+			if (m)
+				CloseHandle(m);
+			CloseHandle(h);
+			error = std::string("can't map ") + path;
+			return nullptr;
+		}
+		f->map = m;
+		f->data = (uint8_t*)p;
+		f->size = (size_t)size.QuadPart;
+		f->mapped = true;
+	}
+	CloseHandle(h);
+#elif defined(LOADER_MMAP)
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		error = std::string("can't open ") + path;
+		return nullptr;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+	{
+		close(fd);
+		error = std::string("not a file: ") + path;
+		return nullptr;
+	}
+	if (st.st_size > 0)
+	{
+		// private and writable: the bus may map ROM pages straight from here, writes never reach the file
+		void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED)
+		{
+			close(fd);
+			error = std::string("can't map ") + path;
+			return nullptr;
+		}
+		f->data = (uint8_t*)p;
+		f->size = (size_t)st.st_size;
+		f->mapped = true;
+	}
+	close(fd);
+#else
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		error = std::string("can't open ") + path;
+		return nullptr;
+	}
+	f->copy.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+#endif
+	if (!f->mapped)
+	{
+		f->data = f->copy.data();
+		f->size = f->copy.size();
+	}
+	return f;
+}
+
+MappedFile::~MappedFile()
+{
+	if (!mapped)
+		return;
+#if defined(_WIN32)
+	UnmapViewOfFile(data);
+	CloseHandle(map);
+#elif defined(LOADER_MMAP)
+	munmap(data, size);
+#endif
+}
+
+namespace
+{
+	bool EndsWith(const std::string& s, const char* ext)
+	{
+		size_t n = std::strlen(ext);
+		if (s.size() < n)
+			return false;
+		for (size_t i = 0; i < n; i++)
+		{
+			char c = s[s.size() - n + i];
+			if (c >= 'A' && c <= 'Z')
+				c += 'a' - 'A';
+			if (c != ext[i])
+				return false;
+		}
+		return true;
+	}
+
+	int HexDigit(uint8_t c)
+	{
+		if (c >= '0' && c <= '9')
+			return c - '0';
+		if (c >= 'A' && c <= 'F')
+			return c - 'A' + 10;
+		if (c >= 'a' && c <= 'f')
+			return c - 'a' + 10;
+		return -1;
+	}
+
+	// text line reader for the record formats
+	struct Lines
+	{
+		const uint8_t* p;
+		const uint8_t* end;
+		unsigned number = 0;
+
+		bool Next(const uint8_t*& line, size_t& size)
+		{
+			while (p < end && (*p == '\r' || *p == '\n' || *p == ' ' || *p == '\t'))
+			{
+				number += *p == '\n';
+				p++;
+			}
+			if (p == end)
+				return false;
+			line = p;
+			while (p < end && *p != '\r' && *p != '\n')
+				p++;
+			size = p - line;
+			while (size && (line[size - 1] == ' ' || line[size - 1] == '\t'))
+				size--;
+			return true;
+		}
+	};
+
+	// hex byte pairs of a record, false on a bad digit
+	bool HexBytes(const uint8_t* text, size_t count, std::vector<uint8_t>& out)
+	{
+		out.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			int hi = HexDigit(text[i * 2]), lo = HexDigit(text[i * 2 + 1]);
+			if (hi < 0 || lo < 0)
+				return false;
+			out[i] = (uint8_t)(hi << 4 | lo);
+		}
+		return true;
+	}
+}
+
+bool Image::Fail(const std::string& what)
+{
+	error = what;
+	segments.clear();
+	decoded.clear();
+	return false;
+}
+
+bool Image::AddSegment(uint32_t addr, const uint8_t* data, size_t size, bool mapped)
+{
+	if (addr > 0xFFFF || size > 0x10000 - addr)
+		return false;
+	if (size)
+		segments.push_back({ (uint16_t)addr, (uint32_t)size, data, mapped });
+	return true;
+}
+
+bool Image::Open(const char* path, ImageFormat _format, uint16_t load)
+{
+	file = MappedFile::Open(path, error);
+	if (!file)
+		return Fail(error);
+
+	if (_format == ImageFormat::Auto)
+	{
+		std::string name = path;
+		const uint8_t* d = file->Data();
+		size_t n = file->Size();
+		if (EndsWith(name, ".prg"))
+			_format = ImageFormat::Prg;
+		else if (EndsWith(name, ".hex") || EndsWith(name, ".ihx"))
+			_format = ImageFormat::IntelHex;
+		else if (EndsWith(name, ".s19") || EndsWith(name, ".s28") || EndsWith(name, ".s37") || EndsWith(name, ".srec") || EndsWith(name, ".mot"))
+			_format = ImageFormat::SRecord;
+		else if (n >= 11 && d[0] == ':' && HexDigit(d[1]) >= 0 && HexDigit(d[2]) >= 0)
+			_format = ImageFormat::IntelHex;
+		else if (n >= 10 && d[0] == 'S' && d[1] >= '0' && d[1] <= '9' && HexDigit(d[2]) >= 0)
+			_format = ImageFormat::SRecord;
+		else
+			_format = ImageFormat::Raw;
+	}
+
+	if (!Parse(file->Data(), file->Size(), _format, load))
+		return Fail(std::string(path) + ": " + error);
+	return true;
+}
+
+bool Image::Parse(const uint8_t* data, size_t size, ImageFormat _format, uint16_t load)
+{
+	// only segments in a file mapping can be mapped onto the bus
+	if (file && data != file->Data())
+		file.reset();
+	bool mappable = file && file->mapped;
+
+	format = _format;
+	segments.clear();
+	decoded.clear();
+	has_start = false;
+	error.clear();
+
+	switch (format)
+	{
+	case ImageFormat::Prg:
+		if (size < 2)
+			return Fail("PRG without a load address");
+		if (!AddSegment(data[0] | (data[1] << 8), data + 2, size - 2, mappable))
+			return Fail("PRG doesn't fit the address space");
+		return true;
+	case ImageFormat::IntelHex:
+		return ParseHex(data, size);
+	case ImageFormat::SRecord:
+		return ParseSRecord(data, size);
+	default:
+		format = ImageFormat::Raw;
+		if (!AddSegment(load, data, size, mappable))
+			return Fail("image doesn't fit the address space");
+		return true;
+	}
+}
+
+// the text formats decode into one buffer: segments keep offsets until it stops growing
+struct DecodedRun
+{
+	uint32_t addr;
+	size_t offset;
+	size_t size;
+};
+
+static bool AddRun(std::vector<DecodedRun>& runs, std::vector<uint8_t>& decoded, uint32_t addr, const uint8_t* data, size_t size)
+{
+	if (addr > 0xFFFF || size > 0x10000 - addr)
+		return false;
+	if (runs.empty() || runs.back().addr + runs.back().size != addr)
+		runs.push_back({ addr, decoded.size(), 0 });
+	decoded.insert(decoded.end(), data, data + size);
+	runs.back().size += size;
+	return true;
+}
+
+bool Image::ParseHex(const uint8_t* text, size_t size)
+{
+	Lines lines = { text, text + size };
+	std::vector<DecodedRun> runs;
+	std::vector<uint8_t> rec;
+	uint32_t base = 0;
+	bool eof = false;
+
+	const uint8_t* line;
+	size_t n;
+	while (!eof && lines.Next(line, n))
+	{
+		std::string where = "line " + std::to_string(lines.number + 1);
+		if (line[0] != ':' || n < 11 || (n - 1) % 2)
+			return Fail(where + ": not an Intel HEX record");
+		if (!HexBytes(line + 1, (n - 1) / 2, rec))
+			return Fail(where + ": bad hex digit");
+		if (rec.size() != 5u + rec[0])
+			return Fail(where + ": record length mismatch");
+		uint8_t sum = 0;
+		for (uint8_t b : rec)
+			sum += b;
+		if (sum)
+			return Fail(where + ": checksum mismatch");
+
+		uint16_t offset = (uint16_t)(rec[1] << 8 | rec[2]);
+		const uint8_t* payload = &rec[4];
+		// address records: a 2 byte segment/upper address or a 4 byte start address, no offset
+		bool upper = rec[3] == 0x02 || rec[3] == 0x04, entry = rec[3] == 0x03 || rec[3] == 0x05;
+		if ((upper || entry) && (rec[0] != (upper ? 2 : 4) || offset))
+			return Fail(where + ": bad address record");
+		switch (rec[3])
+		{
+		case 0x00:
+			if (!AddRun(runs, decoded, base + offset, payload, rec[0]))
+				return Fail(where + ": data outside the address space");
+			break;
+		case 0x01:
+			eof = true;
+			break;
+		case 0x02:
+			base = (uint32_t)(payload[0] << 8 | payload[1]) << 4;
+			break;
+		case 0x04:
+			base = (uint32_t)(payload[0] << 8 | payload[1]) << 16;
+			break;
+		case 0x03:
+		case 0x05:
+		{
+			// CS:IP or a linear address, either way it has to land in the 64K
+			uint32_t a = rec[3] == 0x03
+				? ((uint32_t)(payload[0] << 8 | payload[1]) << 4) + (uint32_t)(payload[2] << 8 | payload[3])
+				: (uint32_t)payload[0] << 24 | (uint32_t)payload[1] << 16 | (uint32_t)payload[2] << 8 | payload[3];
+			if (a > 0xFFFF)
+				return Fail(where + ": start address outside the address space");
+			has_start = true;
+			start = (uint16_t)a;
+			break;
+		}
+		default:
+			return Fail(where + ": unknown record type");
+		}
+	}
+	if (!eof)
+		return Fail("no end of file record");
+
+	for (const DecodedRun& r : runs)
+		segments.push_back({ (uint16_t)r.addr, (uint32_t)r.size, decoded.data() + r.offset, false });
+	return true;
+}
+
+bool Image::ParseSRecord(const uint8_t* text, size_t size)
+{
+	Lines lines = { text, text + size };
+	std::vector<DecodedRun> runs;
+	std::vector<uint8_t> rec;
+
+	const uint8_t* line;
+	size_t n;
+	while (lines.Next(line, n))
+	{
+		std::string where = "line " + std::to_string(lines.number + 1);
+		if (line[0] != 'S' || n < 10 || n % 2 || line[1] < '0' || line[1] > '9')
+			return Fail(where + ": not an S-record");
+		unsigned type = line[1] - '0';
+		if (!HexBytes(line + 2, (n - 2) / 2, rec))
+			return Fail(where + ": bad hex digit");
+		if (rec.size() != 1u + rec[0])
+			return Fail(where + ": record length mismatch");
+		uint8_t sum = 0;
+		for (uint8_t b : rec)
+			sum += b;
+		if (sum != 0xFF)
+			return Fail(where + ": checksum mismatch");
+
+		static const unsigned addr_bytes[10] = { 2, 2, 3, 4, 0, 2, 3, 4, 3, 2 };
+		unsigned ab = addr_bytes[type];
+		if (type == 4 || rec[0] < ab + 1)
+			return Fail(where + ": bad record");
+		uint32_t addr = 0;
+		for (unsigned i = 0; i < ab; i++)
+			addr = addr << 8 | rec[1 + i];
+		const uint8_t* payload = &rec[1 + ab];
+		size_t count = rec[0] - ab - 1;
+
+		if (type >= 1 && type <= 3)
+		{
+			if (!AddRun(runs, decoded, addr, payload, count))
+				return Fail(where + ": data outside the address space");
+		}
+		else if (type >= 7)
+		{
+			if (addr > 0xFFFF)
+				return Fail(where + ": start address outside the address space");
+			has_start = true;
+			start = (uint16_t)addr;
+		}
+		// S0 header, S5/S6 record counts: nothing to load
+	}
+
+	for (const DecodedRun& r : runs)
+		segments.push_back({ (uint16_t)r.addr, (uint32_t)r.size, decoded.data() + r.offset, false });
+	return true;
+}
+
+void Bus::Copy(uint16_t addr, const uint8_t* data, uint32_t size)
+{
+	for (uint32_t i = 0; i < size; )
+	{
+		uint32_t a = addr + i;
+		uint32_t n = std::min<uint32_t>(256 - (a & 0xFF), size - i);
+		const Page& p = pages[a >> 8];
+		// never into a mapped file, every bus mapping it sees the same pages: its page goes back to RAM
+		const uint8_t* from = nullptr;
+		if (p.slot == NoSlot)
+		{
+			for (const std::shared_ptr<MappedFile>& f : rom_files)
+			{
+				if (p.mem >= f->data && p.mem < f->data + f->size)
+				{
+					from = p.mem;
+					MapRam((uint8_t)(a >> 8), 1, a >> 8, p.readonly);
+					break;
+				}
+			}
+		}
+		if (p.shared)
+			Unshare(p.slot);
+		if (p.clean)
+			MarkDirty((uint8_t)(a >> 8));
+		if (from)
+			std::memcpy(p.mem, from, 256);
+		std::memcpy(&p.mem[a & 0xFF], data + i, n);
+		i += n;
+	}
+}
+
+void Bus::Load(const Image& image)
+{
+	for (const ImageSegment& s : image.Segments())
+		Copy(s.addr, s.data, s.size);
+	FlushCode();
+	fork_image.reset();
+}
+
+void Bus::MapRom(const Image& image)
+{
+	if (image.file && image.file->mapped)
+		rom_files.push_back(image.file);
+
+	for (const ImageSegment& s : image.Segments())
+	{
+		if (s.mapped)
+		{
+			// whole pages straight from the file (the mapping is private, so it can take bus[] writes),
+			// a partial page at either end is copied
+			uint32_t head = std::min<uint32_t>(s.size, (256 - (s.addr & 0xFF)) & 0xFF);
+			uint32_t whole = (s.size - head) / 256;
+			uint32_t done = head + whole * 256;
+			Copy(s.addr, s.data, head);
+			if (whole)
+				MapMemory((uint8_t)((s.addr + head) >> 8), whole, const_cast<uint8_t*>(s.data) + head, true);
+			Copy((uint16_t)(s.addr + done), s.data + done, s.size - done);
+		}
+		else
+			Copy(s.addr, s.data, s.size);
+		SetReadOnly(s.addr >> 8, (s.addr + s.size + 255) / 256 - (s.addr >> 8));
+	}
+	FlushCode();
+	fork_image.reset();
+}
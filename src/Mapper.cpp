@@ -0,0 +1,67 @@
+#include <algorithm>
+#include "Mapper.h"
+
+bool Mapper::Check(const MapperConfig& config, std::string& error)
+{
+	unsigned windows = config.type == MapperType::RomWindowFixedLast ? 2 : 1;
+	unsigned end = config.window + config.pages * windows;
+	unsigned control = config.control >> 8;
+	if (!config.pages)
+		error = "empty bank window";
+	else if (config.type == MapperType::RamWindow && !config.ram_banks)
+		error = "no RAM banks";
+	else if (end > 256)
+		error = "bank window past the end of memory";
+	else if (control >= config.window && control < end)
+		error = "control register inside the bank window";
+	else
+		return true;
+	return false;
+}
+
+Mapper::Mapper(Bus& _bus, const MapperConfig& _config, std::vector<uint8_t> image)
+	: bus(_bus), config(_config), mem(std::move(image))
+{
+	size_t window_size = config.pages * 256;
+
+	if (config.type == MapperType::RamWindow)
+		mem.assign(config.ram_banks * window_size, 0);
+	else
+		mem.resize(std::max<size_t>(1, (mem.size() + window_size - 1) / window_size) * window_size, 0xFF);
+	banks = (unsigned)(mem.size() / window_size);
+	Attach(0);
+}
+
+Mapper::Mapper(Bus& _bus, const Mapper& other)
+	: bus(_bus), config(other.config), mem(other.mem), banks(other.banks)
+{
+	Attach(other.bank);
+}
+
+void Mapper::Attach(unsigned n)
+{
+	size_t window_size = config.pages * 256;
+	if (config.type == MapperType::RomWindowFixedLast)
+		bus.MapMemory((uint8_t)(config.window + config.pages), config.pages, &mem[(banks - 1) * window_size], true);
+
+	previous = bus.PageDevice(config.control >> 8);
+	bus.MapDevice(config.control >> 8, 1, this);
+	Select(n);
+}
+
+Mapper::~Mapper()
+{
+	// back to plain RAM and whatever was on the control page
+	bus.MapDevice(config.control >> 8, 1, previous);
+	unsigned pages = config.type == MapperType::RomWindowFixedLast ? config.pages * 2 : config.pages;
+	bus.MapRam(config.window, pages, config.window);
+}
+
+void Mapper::Select(unsigned n)
+{
+	bank = n % banks;
+	bus.MapMemory(config.window, config.pages, &mem[bank * config.pages * 256], config.type != MapperType::RamWindow);
+	// RAM bank pages come after the Bus::RAM slots
+	if (config.type == MapperType::RamWindow)
+		bus.SetSlots(config.window, config.pages, Bus::RamSlots + bank * config.pages);
+}
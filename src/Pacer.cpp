@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <cstdlib>
+#include "Pacer.h"
+
+constexpr double Pacer::Clock1MHz;
+constexpr double Pacer::ClockNTSC;
+constexpr double Pacer::ClockPAL;
+
+namespace
+{
+	// behind by more than this, the schedule starts over
+	const std::chrono::milliseconds MaxBehind(50);
+}
+
+bool Pacer::ParseClock(const std::string& s, double& hz)
+{
+	if (s == "1mhz")
+		hz = Clock1MHz;
+	else if (s == "ntsc")
+		hz = ClockNTSC;
+	else if (s == "pal")
+		hz = ClockPAL;
+	else
+	{
+		char* end;
+		hz = std::strtod(s.c_str(), &end);
+		if (*end || !(hz >= 1.0))
+			return false;
+	}
+	return true;
+}
+
+Pacer::Pacer(PaceMode m, double h) : mode(m), hz(h), origin(Time::now())
+{
+}
+
+void Pacer::SetMode(PaceMode m, double h)
+{
+	std::lock_guard<std::mutex> hold(lock);
+	mode = m;
+	if (h > 0)
+		hz = h;
+	origin = Time::now();
+	cycles = 0;
+	late = Time::duration::zero();
+	generation++;
+	wake.notify_all();
+}
+
+PaceMode Pacer::Mode() const
+{
+	std::lock_guard<std::mutex> hold(lock);
+	return mode;
+}
+
+double Pacer::Clock() const
+{
+	std::lock_guard<std::mutex> hold(lock);
+	return hz;
+}
+
+void Pacer::Wake()
+{
+	std::lock_guard<std::mutex> hold(lock);
+	woken = true;
+	wake.notify_all();
+}
+
+uint64_t Pacer::Next()
+{
+	std::unique_lock<std::mutex> hold(lock);
+	for (;;)
+	{
+		if (woken)
+		{
+			woken = false;
+			return 0;
+		}
+		uint64_t g = generation;
+		switch (mode)
+		{
+		case PaceMode::Unthrottled:
+			return batch_cycles;
+
+		case PaceMode::Paused:
+			wake.wait(hold, [&] { return woken || generation != g; });
+			break;
+
+		case PaceMode::Paced:
+		{
+			Time::time_point now = Time::now();
+			Time::time_point due = origin + std::chrono::duration_cast<Time::duration>(std::chrono::duration<double>(cycles / hz));
+			if (now >= due)
+			{
+				late = std::max(late, now - due);
+				if (now - due > MaxBehind)
+				{
+					origin = now;
+					cycles = 0;
+				}
+				return std::max<uint64_t>(1, (uint64_t)(hz / 1000));
+			}
+			wake.wait_until(hold, due, [&] { return woken || generation != g; });
+			break;
+		}
+		}
+	}
+}
+
+void Pacer::Done(uint64_t n)
+{
+	std::lock_guard<std::mutex> hold(lock);
+	cycles += n;
+}
+
+double Pacer::MaxLate() const
+{
+	std::lock_guard<std::mutex> hold(lock);
+	return std::chrono::duration<double>(late).count();
+}
@@ -0,0 +1,298 @@
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include "Profiler.h"
+#include "Bus.h"
+#include "Disassembly.h"
+
+namespace
+{
+	std::string Format(const char* fmt, ...)
+	{
+		char buf[512];
+		va_list args;
+		va_start(args, fmt);
+		vsnprintf(buf, sizeof(buf), fmt, args);
+		va_end(args);
+		return buf;
+	}
+
+	// $C000, 0xC000, C000, C:C000 (VICE memspace prefix)
+	bool ParseAddr(std::string s, uint16_t& addr)
+	{
+		if (s.size() > 2 && s[1] == ':')
+			s = s.substr(2);
+		if (!s.empty() && s[0] == '$')
+			s = s.substr(1);
+		else if (s.size() > 2 && s[0] == '0' && (s[1] | 0x20) == 'x')
+			s = s.substr(2);
+		if (s.empty() || s.size() > 8)
+			return false;
+		char* end;
+		unsigned long v = std::strtoul(s.c_str(), &end, 16);
+		if (*end || v > 0xFFFFFF)
+			return false;
+		addr = (uint16_t)v;
+		return true;
+	}
+}
+
+bool Symbols::Load(const char* path)
+{
+	std::ifstream in(path);
+	if (!in.is_open())
+	{
+		error = std::string("can't read ") + path;
+		return false;
+	}
+
+	std::string line;
+	unsigned number = 0;
+	while (std::getline(in, line))
+	{
+		number++;
+		line = line.substr(0, line.find_first_of(";#"));
+		size_t eq = line.find('=');
+		if (eq != std::string::npos)
+			line = line.substr(0, eq) + " = " + line.substr(eq + 1);
+		std::istringstream words(line);
+		std::vector<std::string> w;
+		std::string s;
+		while (words >> s)
+			w.push_back(s);
+		if (w.empty())
+			continue;
+
+		uint16_t addr;
+		std::string name;
+		if (w[0] == "al" && w.size() == 3 && ParseAddr(w[1], addr))
+			name = w[2][0] == '.' ? w[2].substr(1) : w[2];
+		else if (w.size() == 3 && (w[1] == "=" || w[1] == "equ" || w[1] == "EQU") && ParseAddr(w[2], addr))
+			name = w[0];
+		else if (w.size() == 2 && ParseAddr(w[0], addr))
+			name = w[1];
+		if (name.empty())
+		{
+			error = std::string(path) + ": line " + std::to_string(number) + ": expected a label and an address";
+			return false;
+		}
+		if (name.back() == ':')
+			name.pop_back();
+		Add(addr, name);
+	}
+	return true;
+}
+
+std::string Symbols::Name(uint16_t addr) const
+{
+	auto it = labels.upper_bound(addr);
+	if (it != labels.begin())
+	{
+		--it;
+		if (it->first == addr)
+			return it->second;
+		if (addr - it->first < 0x100)
+			return it->second + "+" + std::to_string(addr - it->first);
+	}
+	return Format("$%04X", (unsigned)addr);
+}
+
+bool Profiler::Instruction()
+{
+	uint64_t ticks = bus.CPU.readTicksTotal();
+	uint16_t pc = bus.CPU.readPC();
+	uint8_t sp = bus.CPU.readSP();
+
+	if (!started)
+	{
+		// the routine running now is the root of the call tree
+		nodes.push_back({ pc, 0 });
+		nodes[0].calls = 1;
+		frames.push_back({ 0, 0xFF });
+		started = true;
+	}
+	else if (ticks < last_ticks)
+	{
+		// the machine went back (state loaded), the call stack starts over from the root
+		frames.resize(1);
+	}
+	else if (ticks != last_ticks)
+	{
+		unsigned t = (unsigned)(ticks - last_ticks);
+		cycles += t;
+
+		// interrupt entry: 3 bytes pushed, with the PC it was about to run (BRK pushes its PC + 2)
+		uint16_t pushed = bus.Peek((uint16_t)(0x100 + (uint8_t)(sp + 2))) | bus.Peek((uint16_t)(0x100 + (uint8_t)(sp + 3))) << 8;
+		if (sp == (uint8_t)(last_sp - 3) && pushed == last_pc && pc != last_pc)
+		{
+			interrupts++;
+			Call(pc, last_sp);
+			nodes[frames.back().node].self += t;
+		}
+		else
+		{
+			instructions++;
+			pc_cycles[last_pc] += t;
+			pc_count[last_pc]++;
+			nodes[frames.back().node].self += t;
+
+			if ((last_op == 0x20 && sp == (uint8_t)(last_sp - 2)) || (last_op == 0x00 && sp == (uint8_t)(last_sp - 3)))
+				Call(pc, last_sp);
+			else if (sp > last_sp)
+			{
+				// returned (or dropped the return address): the frames SP is back at are gone, the root stays
+				while (frames.size() > 1 && frames.back().sp <= sp)
+					frames.pop_back();
+			}
+		}
+	}
+
+	last_ticks = ticks;
+	last_pc = pc;
+	last_sp = sp;
+	// the opcode as it is before it runs, it may write over itself
+	last_op = bus.Peek(pc);
+	return false;
+}
+
+void Profiler::Call(uint16_t routine, uint8_t sp)
+{
+	if (frames.size() == MaxFrames)
+		return;
+	uint32_t parent = frames.back().node;
+	uint64_t key = (uint64_t)parent << 16 | routine;
+	auto it = children.find(key);
+	uint32_t node;
+	if (it != children.end())
+		node = it->second;
+	else
+	{
+		node = (uint32_t)nodes.size();
+		nodes.push_back({ routine, parent });
+		children[key] = node;
+	}
+	nodes[node].calls++;
+	frames.push_back({ node, sp });
+}
+
+void Profiler::Clear()
+{
+	started = false;
+	cycles = 0;
+	instructions = 0;
+	interrupts = 0;
+	std::fill(pc_cycles.begin(), pc_cycles.end(), 0);
+	std::fill(pc_count.begin(), pc_count.end(), 0);
+	nodes.clear();
+	children.clear();
+	frames.clear();
+}
+
+std::vector<uint64_t> Profiler::Inclusive() const
+{
+	std::vector<uint64_t> total(nodes.size());
+	for (size_t i = nodes.size(); i-- > 0;)
+	{
+		total[i] += nodes[i].self;
+		if (i)
+			total[nodes[i].parent] += total[i];
+	}
+	return total;
+}
+
+std::string Profiler::Path(uint32_t node, const Symbols& symbols) const
+{
+	std::vector<uint32_t> path;
+	for (uint32_t n = node;; n = nodes[n].parent)
+	{
+		path.push_back(n);
+		if (!n)
+			break;
+	}
+	std::string s;
+	for (size_t i = path.size(); i-- > 0;)
+	{
+		// ; separates the frames
+		std::string name = symbols.Name(nodes[path[i]].routine);
+		std::replace(name.begin(), name.end(), ';', '_');
+		std::replace(name.begin(), name.end(), ' ', '_');
+		s += name;
+		if (i)
+			s += ';';
+	}
+	return s;
+}
+
+std::string Profiler::Folded(const Symbols& symbols) const
+{
+	std::string s;
+	for (uint32_t n = 0; n < nodes.size(); n++)
+		if (nodes[n].self)
+			s += Path(n, symbols) + " " + std::to_string(nodes[n].self) + "\n";
+	return s;
+}
+
+std::string Profiler::Flat(const Symbols& symbols, size_t lines) const
+{
+	struct Routine
+	{
+		uint16_t addr;
+		uint64_t self = 0, total = 0, calls = 0;
+	};
+	std::vector<uint64_t> inclusive = Inclusive();
+	std::map<uint16_t, Routine> routines;
+	for (uint32_t n = 0; n < nodes.size(); n++)
+	{
+		Routine& r = routines[nodes[n].routine];
+		r.addr = nodes[n].routine;
+		r.self += nodes[n].self;
+		r.calls += nodes[n].calls;
+		// recursion: only the outermost node of the routine on the path counts
+		bool outermost = true;
+		for (uint32_t p = n; p && outermost;)
+		{
+			p = nodes[p].parent;
+			outermost = nodes[p].routine != nodes[n].routine;
+		}
+		if (outermost)
+			r.total += inclusive[n];
+	}
+	std::vector<Routine> sorted;
+	for (auto& r : routines)
+		sorted.push_back(r.second);
+	std::stable_sort(sorted.begin(), sorted.end(), [](const Routine& a, const Routine& b) { return a.self > b.self; });
+
+	auto percent = [&](uint64_t part) { return cycles ? 100.0 * part / cycles : 0.0; };
+
+	std::string s = Format("%llu cycles, %llu instructions, %llu interrupts\n\n", (unsigned long long)cycles,
+		(unsigned long long)instructions, (unsigned long long)interrupts);
+	s += Format("%7s %14s %7s %14s %10s  %s\n", "self%", "self", "total%", "total", "calls", "routine");
+	for (size_t i = 0; i < sorted.size() && i < lines; i++)
+	{
+		const Routine& r = sorted[i];
+		s += Format("%7.2f %14llu %7.2f %14llu %10llu  %s\n", percent(r.self), (unsigned long long)r.self, percent(r.total),
+			(unsigned long long)r.total, (unsigned long long)r.calls, symbols.Name(r.addr).c_str());
+	}
+
+	std::vector<uint16_t> hot;
+	for (unsigned pc = 0; pc < 0x10000; pc++)
+		if (pc_cycles[pc])
+			hot.push_back((uint16_t)pc);
+	std::stable_sort(hot.begin(), hot.end(), [&](uint16_t a, uint16_t b) { return pc_cycles[a] > pc_cycles[b]; });
+	if (hot.size() > lines)
+		hot.resize(lines);
+
+	s += Format("\n%7s %14s %12s  %-5s %-20s %s\n", "self%", "self", "count", "pc", "label", "instruction");
+	for (uint16_t pc : hot)
+	{
+		std::string text = Disassembly::Line(bus, pc);
+		text = text.substr(text.find(": ") + 2);
+		s += Format("%7.2f %14llu %12llu  $%04X %-20s %s\n", percent(pc_cycles[pc]), (unsigned long long)pc_cycles[pc],
+			(unsigned long long)pc_count[pc], (unsigned)pc, symbols.Empty() ? "" : symbols.Name(pc).c_str(), text.c_str());
+	}
+	return s;
+}
@@ -0,0 +1,69 @@
+#include <cstring>
+#include "Publisher.h"
+#include "Bus.h"
+#include "Disassembly.h"
+
+Publisher::Publisher(Bus& b, Disassembly* c) : bus(b), code(c), views(new MachineView[3]())
+{
+}
+
+bool Publisher::Publish(bool force)
+{
+	if (!force && (middle.load(std::memory_order_relaxed) & Fresh))
+		return false;
+
+	MachineView& v = views[back];
+	v.serial = serial++;
+	v.ticks = bus.CPU.readTicksTotal();
+	v.pc = bus.opaddr;
+	v.regs = bus.CPU.readRegisters();
+	v.flags = bus.CPU.readFlags();
+	v.pins = bus.pins;
+	// the pages changed since this buffer was filled last (two snapshots ago)
+	for (unsigned page = 0; page < 256; page++)
+	{
+		const uint8_t* mem = bus.PageMemory((uint8_t)page);
+		if (std::memcmp(&v.memory[page << 8], mem, 256) != 0)
+			std::memcpy(&v.memory[page << 8], mem, 256);
+	}
+	List(v);
+
+	back = middle.exchange(back | Fresh, std::memory_order_acq_rel) & 3;
+	return true;
+}
+
+const MachineView& Publisher::Latest()
+{
+	if (middle.load(std::memory_order_relaxed) & Fresh)
+		front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+	return views[front];
+}
+
+void Publisher::List(MachineView& v)
+{
+	v.code_lines = v.code_pc = 0;
+	if (!code)
+		return;
+	// code written since the last snapshot, and running code the trace didn't get to (JMP (ind), code copied
+	// to RAM) traced from here on
+	code->Update();
+	code->Seed(v.pc);
+	if (!code->IsInstruction(v.pc))
+		return;
+
+	uint16_t addr = v.pc;
+	int before = 0;
+	while (before < MachineView::CodeBefore && code->Prev(addr))
+		before++;
+	for (int i = 0; i < before; i++)
+	{
+		v.code[i] = { addr, code->IsData(addr) };
+		code->Next(addr);
+	}
+	v.code_pc = (uint8_t)before;
+	int n = before;
+	do
+		v.code[n++] = { addr, code->IsData(addr) };
+	while (n < MachineView::CodeLines && code->Next(addr));
+	v.code_lines = (uint8_t)n;
+}
@@ -0,0 +1,244 @@
+#include <algorithm>
+#include "Rewind.h"
+#include "Mapper.h"
+#include "BlockCache.h"
+#include "Disassembly.h"
+
+//
+// Journal record, appended between two marks and read back from its end:
+//   writes      WriteSize bytes each, in order
+//   delta       the bytes of the previous mark image that differ from this one, in order
+//   mask        mask_bytes, bit i set when image byte i is in the delta
+//   u32         number of writes
+//
+
+Rewind::Rewind(Bus& _bus, const RewindConfig& _config) : bus(_bus), config(_config)
+{
+	Capture(last);
+	mask_bytes = (unsigned)(last.size() + 7) / 8;
+	mask.resize(mask_bytes);
+	Clear();
+	bus.SetRewind(this);
+}
+
+Rewind::~Rewind()
+{
+	bus.SetRewind(nullptr);
+}
+
+void Rewind::Capture(std::vector<uint8_t>& image)
+{
+	image.clear();
+	StateWriter w(image);
+	bus.CPU.saveState(w);
+	w.pins(bus.pins);
+	w.u32(bus.mapper ? bus.mapper->Bank() : 0);
+}
+
+void Rewind::Restore(const std::vector<uint8_t>& image)
+{
+	StateReader r(image.data(), image.size());
+	bus.CPU.loadState(r);
+	bus.pins = r.pins();
+	uint32_t bank = r.u32();
+	if (bus.mapper && bus.mapper->Bank() != bank)
+		bus.mapper->Select(bank);
+	bus.opaddr = bus.CPU.readPC();
+}
+
+void Rewind::UndoWrites(Segment& s, size_t from, size_t to)
+{
+	for (size_t at = to; at > from; at -= WriteSize)
+	{
+		const uint8_t* w = &s.journal[at - WriteSize];
+		uint32_t slot;
+		std::memcpy(&slot, w, 4);
+		uint16_t addr = (uint16_t)(w[4] | (w[5] << 8));
+		if (slot != Bus::NoSlot)
+			bus.WriteSlot(slot, (uint8_t)addr, w[6]);
+		else if (!bus.pages[addr >> 8].readonly)
+			bus.pages[addr >> 8].mem[addr & 0xFF] = w[6];   // foreign memory, wherever the page maps now
+		if (bus.pages[addr >> 8].code)
+			bus.blocks->Written(addr);
+		if (bus.disasm)
+			bus.disasm->Written(addr);
+	}
+}
+
+void Rewind::NewSegment()
+{
+	if (!segments.empty())
+		closed_bytes += segments.back().journal.size();
+
+	segments.emplace_back();
+	Segment& s = segments.back();
+	s.ticks = bus.CPU.readTicksTotal();
+	bus.SaveState(s.keyframe);
+	closed_bytes += s.keyframe.size();
+	open = 0;
+
+	// the oldest segments go first, the current one always stays
+	while (closed_bytes > config.max_bytes && segments.size() > 1)
+	{
+		closed_bytes -= segments.front().keyframe.size() + segments.front().journal.size();
+		segments.pop_front();
+	}
+}
+
+void Rewind::Clear()
+{
+	segments.clear();
+	closed_bytes = 0;
+	NewSegment();
+	Capture(last);
+	last_ticks = bus.CPU.readTicksTotal();
+}
+
+void Rewind::Mark()
+{
+	Segment& s = segments.back();
+	uint64_t ticks = bus.CPU.readTicksTotal();
+	if (ticks == last_ticks && s.journal.size() == open)
+		return;
+
+	Capture(current);
+	size_t writes = (s.journal.size() - open) / WriteSize;
+
+	// reverse delta: what the instruction changed, as it was before
+	std::fill(mask.begin(), mask.end(), 0);
+	for (size_t i = 0; i < current.size(); i++)
+	{
+		if (current[i] != last[i])
+		{
+			mask[i / 8] |= (uint8_t)(1 << (i % 8));
+			s.journal.push_back(last[i]);
+		}
+	}
+	s.journal.insert(s.journal.end(), mask.begin(), mask.end());
+	for (unsigned i = 0; i < 4; i++)
+		s.journal.push_back((uint8_t)(writes >> (i * 8)));
+
+	s.records++;
+	last.swap(current);
+	last_ticks = ticks;
+
+	if (ticks - s.ticks >= config.keyframe_cycles || s.journal.size() > config.max_bytes / 8)
+		NewSegment();
+	else
+		open = s.journal.size();
+}
+
+bool Rewind::StepBack()
+{
+	Segment* s = &segments.back();
+
+	// ran past the last mark (cycle stepping): back to it first
+	if (s->journal.size() != open || bus.CPU.readTicksTotal() != last_ticks)
+	{
+		UndoWrites(*s, open, s->journal.size());
+		s->journal.resize(open);
+		Restore(last);
+		return true;
+	}
+
+	// at the keyframe, it is the end of the previous segment as well
+	if (!s->records)
+	{
+		if (segments.size() == 1)
+			return false;
+		closed_bytes -= s->keyframe.size();
+		segments.pop_back();
+		s = &segments.back();
+		closed_bytes -= s->journal.size();
+	}
+
+	// take the record apart from its end
+	std::vector<uint8_t>& j = s->journal;
+	size_t end = j.size() - 4;
+	size_t writes = 0;
+	for (unsigned i = 0; i < 4; i++)
+		writes |= (size_t)j[end + i] << (i * 8);
+	end -= mask_bytes;
+	std::copy(j.begin() + end, j.begin() + end + mask_bytes, mask.begin());
+	size_t delta = 0;
+	for (uint8_t m : mask)
+		for (; m; m &= m - 1)
+			delta++;
+	end -= delta;
+	size_t start = end - writes * WriteSize;
+
+	UndoWrites(*s, start, end);
+	for (size_t i = 0, d = end; i < last.size(); i++)
+	{
+		if (mask[i / 8] >> (i % 8) & 1)
+			last[i] = j[d++];
+	}
+	Restore(last);
+	last_ticks = bus.CPU.readTicksTotal();
+
+	j.resize(start);
+	s->records--;
+	open = start;
+	return true;
+}
+
+void Rewind::ToKeyframe()
+{
+	Segment& s = segments.back();
+	bus.LoadState(s.keyframe.data(), s.keyframe.size());
+	s.journal.clear();
+	s.records = 0;
+	open = 0;
+	Capture(last);
+	last_ticks = bus.CPU.readTicksTotal();
+}
+
+bool Rewind::JumpBack(unsigned n)
+{
+	if (!n)
+		return false;
+	// already at the current keyframe: it doesn't count
+	const Segment& s = segments.back();
+	if (!s.records && s.journal.empty() && bus.CPU.readTicksTotal() == s.ticks)
+		n++;
+	if (n > segments.size())
+	{
+		if (segments.size() == 1 && n == 2)
+			return false;
+		n = (unsigned)segments.size();
+	}
+
+	for (unsigned i = 1; i < n; i++)
+	{
+		closed_bytes -= segments.back().keyframe.size();
+		segments.pop_back();
+		closed_bytes -= segments.back().journal.size();
+	}
+	ToKeyframe();
+	return true;
+}
+
+bool Rewind::BackCycles(uint64_t cycles)
+{
+	uint64_t ticks = bus.CPU.readTicksTotal();
+	if (cycles > ticks - segments.front().ticks)
+		return false;
+	uint64_t target = ticks - cycles;
+
+	while (segments.back().ticks > target)
+	{
+		closed_bytes -= segments.back().keyframe.size();
+		segments.pop_back();
+		closed_bytes -= segments.back().journal.size();
+	}
+	ToKeyframe();
+
+	// replay on the cycle level, recording as it goes
+	while (bus.CPU.readTicksTotal() < target)
+	{
+		bus.CPU_Step();
+		if (bus.pins.SYNC)
+			Mark();
+	}
+	return true;
+}
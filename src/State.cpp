@@ -0,0 +1,209 @@
+#include <cstring>
+#include "Bus.h"
+#include "Mapper.h"
+#include "BlockCache.h"
+#include "Disassembly.h"
+
+static const uint16_t StateVersion = 1;
+
+// state ids only need to differ between states that could be mixed up, splitmix64 of a counter does
+static uint64_t NewStateId(uint64_t seed)
+{
+	uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	z ^= z >> 31;
+	return z ? z : 1;
+}
+
+uint32_t Bus::Slots() const
+{
+	return RamSlots + (mapper ? mapper->RamPages() : 0);
+}
+
+uint8_t* Bus::SlotMem(uint32_t slot)
+{
+	if (slot < RamSlots && slot_shared[slot])
+		Unshare(slot);
+	return slot < RamSlots ? ram_pages[slot].get() : mapper->RamPage(slot - RamSlots);
+}
+
+void Bus::WriteSlot(uint32_t slot, uint8_t offset, uint8_t data)
+{
+	SlotMem(slot)[offset] = data;
+	if (!tracking || slot_dirty[slot])
+		return;
+	slot_dirty[slot] = 1;
+	dirty_slots.push_back(slot);
+	for (unsigned i = 0; i < 256; i++)
+	{
+		if (pages[i].slot == slot)
+		{
+			pages[i].clean = false;
+			UpdatePage((uint8_t)i);
+		}
+	}
+}
+
+const uint8_t* Bus::SlotData(uint32_t slot) const
+{
+	return slot < RamSlots ? RamSlot(slot) : mapper->RamPage(slot - RamSlots);
+}
+
+void Bus::Checkpoint(uint64_t id)
+{
+	checkpoint = id;
+	tracking = true;
+	slot_dirty.assign(Slots(), 0);
+	dirty_slots.clear();
+	for (unsigned i = 0; i < 256; i++)
+	{
+		pages[i].clean = pages[i].slot != NoSlot;
+		UpdatePage((uint8_t)i);
+	}
+}
+
+void Bus::StopTracking()
+{
+	if (!tracking)
+		return;
+	tracking = false;
+	checkpoint = 0;
+	slot_dirty.clear();
+	dirty_slots.clear();
+	for (unsigned i = 0; i < 256; i++)
+	{
+		pages[i].clean = false;
+		UpdatePage((uint8_t)i);
+	}
+}
+
+void Bus::SaveState(std::vector<uint8_t>& out, StateKind kind)
+{
+	if (!tracking)
+		kind = StateKind::Full;
+	uint64_t id = NewStateId(++states ^ CPU.readTicksTotal() ^ (uint64_t)(uintptr_t)this);
+	uint32_t count = kind == StateKind::Full ? Slots() : (uint32_t)dirty_slots.size();
+
+	out.clear();
+	out.reserve(128 + count * 260);
+	StateWriter w(out);
+
+	w.bytes((const uint8_t*)"65ST", 4);
+	w.u16(StateVersion);
+	w.u8((uint8_t)kind);
+	w.u8(0);
+	w.u64(id);
+	w.u64(kind == StateKind::Delta ? checkpoint : 0);
+
+	CPU.saveState(w);
+	w.pins(pins);
+
+	MapperConfig config;
+	if (mapper)
+		config = mapper->Config();
+	w.u8((uint8_t)config.type);
+	w.u8(config.window);
+	w.u8(config.pages);
+	w.u16(config.control);
+	w.u32(mapper ? mapper->Banks() : 0);
+	w.u32(mapper ? mapper->Bank() : 0);
+
+	w.u32(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t slot = kind == StateKind::Full ? i : dirty_slots[i];
+		w.u32(slot);
+		w.bytes(SlotData(slot), 256);
+	}
+
+	Checkpoint(id);
+}
+
+bool Bus::LoadState(const uint8_t* data, size_t size)
+{
+	StateReader r(data, size);
+
+	const uint8_t* magic = r.take(4);
+	if (!magic || std::memcmp(magic, "65ST", 4) != 0 || r.u16() != StateVersion)
+		return false;
+	uint8_t kind = r.u8();
+	r.u8();
+	uint64_t id = r.u64();
+	uint64_t base = r.u64();
+	if (kind > (uint8_t)StateKind::Delta)
+		return false;
+	// a delta only fits the state it was taken against, with nothing written since
+	if (kind == (uint8_t)StateKind::Delta && (!tracking || base != checkpoint || !dirty_slots.empty()))
+		return false;
+
+	mos6502 cpu = CPU;
+	if (!cpu.loadState(r))
+		return false;
+	Pins p = r.pins();
+
+	// the mapper has to be set up the same way, its ROM isn't part of the state
+	MapperConfig config;
+	if (mapper)
+		config = mapper->Config();
+	if (r.u8() != (uint8_t)config.type || r.u8() != config.window || r.u8() != config.pages || r.u16() != config.control)
+		return false;
+	if (r.u32() != (mapper ? mapper->Banks() : 0))
+		return false;
+	uint32_t bank = r.u32();
+
+	uint32_t count = r.u32();
+	uint32_t slots = Slots();
+	if (!r.ok || (kind == (uint8_t)StateKind::Full && count != slots))
+		return false;
+
+	// check all pages before touching anything
+	StateReader check = r;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (check.u32() >= slots || !check.take(256))
+			return false;
+	}
+	if (!check.done())
+		return false;
+
+	// the full state of the checkpoint itself (back to a snapshot): only the slots written since differ
+	bool reload = kind == (uint8_t)StateKind::Full && tracking && id == checkpoint;
+
+	CPU = cpu;
+	pins = p;
+	opaddr = CPU.readPC();
+	fork_image.reset();
+	if (mapper)
+		mapper->Select(bank);
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t slot = r.u32();
+		const uint8_t* mem = r.take(256);
+		if (reload && !slot_dirty[slot])
+			continue;
+		std::memcpy(SlotMem(slot), mem, 256);
+		if (kind == (uint8_t)StateKind::Delta)
+			slot_dirty[slot] = 1;
+	}
+
+	if (kind == (uint8_t)StateKind::Full && !reload)
+		FlushCode();
+	else if (blocks || disasm)
+	{
+		// only the blocks on the restored pages are stale
+		for (unsigned i = 0; i < 256; i++)
+		{
+			if (pages[i].slot == NoSlot || !slot_dirty[pages[i].slot])
+				continue;
+			if (pages[i].code)
+				blocks->InvalidatePage((uint8_t)i);
+			if (disasm)
+				disasm->Written((uint16_t)(i << 8));
+		}
+	}
+
+	Checkpoint(id);
+	return true;
+}
@@ -0,0 +1,532 @@
+#include <algorithm>
+#include <cstring>
+#include "Trace.h"
+#include "Loader.h"
+#include "State.h"
+
+static const uint16_t TraceVersion = 1;
+static const size_t HeaderSize = 12;
+static const size_t ChunkHeaderSize = 28;
+static const size_t IndexEntrySize = 36;
+static const size_t FooterSize = 16;
+// chunk buffers in flight, the run loop waits for the writer thread beyond that
+static const unsigned MaxBuffers = 8;
+
+// 8 bytes per step, the tail zero padded
+static uint64_t ChunkHash(const uint8_t* p, size_t n)
+{
+	uint64_t h = 0x9E3779B97F4A7C15ull ^ n;
+	for (size_t i = 0; i < n; i += 8)
+	{
+		uint64_t w = 0;
+		std::memcpy(&w, p + i, n - i < 8 ? n - i : 8);
+		h = (h ^ w) * 0xFF51AFD7ED558CCDull;
+		h ^= h >> 32;
+	}
+	return h;
+}
+
+TraceWriter::~TraceWriter()
+{
+	Close();
+}
+
+bool TraceWriter::Open(const char* path, uint32_t _chunk_cycles)
+{
+	if (writer.joinable())
+	{
+		error = "trace already open";
+		return false;
+	}
+	file.open(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		error = std::string("can't create ") + path;
+		return false;
+	}
+
+	std::vector<uint8_t> header;
+	StateWriter w(header);
+	w.bytes((const uint8_t*)"65TR", 4);
+	w.u16(TraceVersion);
+	w.u16(0);
+	w.u32(_chunk_cycles ? _chunk_cycles : 1);
+	file.write((const char*)header.data(), header.size());
+
+	chunk_cycles = _chunk_cycles ? _chunk_cycles : 1;
+	offset = HeaderSize;
+	index.clear();
+	cycles = 0;
+	failed = !file;
+	error.clear();
+	closing = false;
+	queue.clear();
+	spare.clear();
+	buffers = 1;
+	current.reset(new Buffer());
+	current->records.resize(chunk_cycles);
+	fill = current->records.data();
+	end = fill + chunk_cycles;
+	// the first Record() starts the chunk
+	next_ticks = ~0ull;
+
+	writer = std::thread(&TraceWriter::WriterThread, this);
+	return true;
+}
+
+uint32_t TraceWriter::Jump(uint64_t ticks)
+{
+	// the CPU held by RDY or reset, the same ticks_total again
+	if (fill != end && fill != current->records.data() && ticks + 1 == next_ticks)
+		return 1u << 30;
+	NewChunk(ticks);
+	return 0;
+}
+
+void TraceWriter::NewChunk(uint64_t ticks)
+{
+	if (fill != current->records.data())
+	{
+		Submit();
+
+		std::unique_lock<std::mutex> l(lock);
+		done.wait(l, [this] { return !spare.empty() || buffers < MaxBuffers; });
+		if (!spare.empty())
+		{
+			current = std::move(spare.front());
+			spare.pop_front();
+		}
+		else
+		{
+			buffers++;
+			current.reset(new Buffer());
+			current->records.resize(chunk_cycles);
+		}
+	}
+	current->first = ticks;
+	fill = current->records.data();
+	end = fill + chunk_cycles;
+}
+
+void TraceWriter::Submit()
+{
+	current->count = fill - current->records.data();
+	current->last = next_ticks - 1;
+	cycles += current->count;
+	{
+		std::lock_guard<std::mutex> l(lock);
+		queue.push_back(std::move(current));
+	}
+	ready.notify_one();
+}
+
+void TraceWriter::WriterThread()
+{
+	for (;;)
+	{
+		std::unique_ptr<Buffer> b;
+		{
+			std::unique_lock<std::mutex> l(lock);
+			ready.wait(l, [this] { return !queue.empty() || closing; });
+			if (queue.empty())
+				return;
+			b = std::move(queue.front());
+			queue.pop_front();
+		}
+		Write(*b);
+		{
+			std::lock_guard<std::mutex> l(lock);
+			spare.push_back(std::move(b));
+		}
+		done.notify_one();
+	}
+}
+
+void TraceWriter::Write(const Buffer& b)
+{
+	// 5 bytes per cycle at most
+	encoded.resize(ChunkHeaderSize + b.count * 5);
+	uint8_t* out = encoded.data() + ChunkHeaderSize;
+
+	// every chunk starts from zeroes, so it decodes on its own
+	uint16_t prev = 0, sync = 0;
+	uint8_t lines = 0;
+	for (size_t i = 0; i < b.count; i++)
+	{
+		uint32_t r = b.records[i];
+		uint16_t addr = (uint16_t)r;
+		uint8_t bits = (uint8_t)(r >> 24);
+		uint8_t held_lines = (uint8_t)((bits & 15) | ((bits >> 6) & 1) << 4);
+		bool is_sync = (bits >> 5) & 1;
+		int delta = (int16_t)(uint16_t)(addr - (is_sync ? sync : prev));
+
+		uint8_t ctl = (uint8_t)(((bits >> 4) & 1) | is_sync << 1 | (held_lines != lines) << 2);
+		if (delta >= -8 && delta <= 19)
+			*out++ = (uint8_t)(ctl | (delta + 8) << 3);
+		else
+			*out++ = (uint8_t)(ctl | (delta >= -128 && delta <= 127 ? 28 : 29) << 3);
+		if (ctl & 4)
+			*out++ = lines = held_lines;
+		if (delta < -8 || delta > 19)
+		{
+			if (delta >= -128 && delta <= 127)
+				*out++ = (uint8_t)delta;
+			else
+			{
+				*out++ = (uint8_t)addr;
+				*out++ = (uint8_t)(addr >> 8);
+			}
+		}
+		*out++ = (uint8_t)(r >> 16);
+
+		prev = addr;
+		if (is_sync)
+			sync = addr;
+	}
+
+	uint32_t bytes = (uint32_t)(out - encoded.data() - ChunkHeaderSize);
+	uint64_t hash = ChunkHash(encoded.data() + ChunkHeaderSize, bytes);
+	encoded.resize(0);
+	StateWriter w(encoded);
+	w.u64(b.first);
+	w.u32((uint32_t)b.count);
+	w.u32((uint32_t)(b.last - b.first + 1));
+	w.u32(bytes);
+	w.u64(hash);
+	file.write((const char*)encoded.data(), ChunkHeaderSize + bytes);
+	if (!file && !failed)
+	{
+		failed = true;
+		error = "can't write the trace";
+	}
+
+	index.push_back({ b.first, (uint32_t)b.count, (uint32_t)(b.last - b.first + 1), bytes, hash, offset });
+	offset += ChunkHeaderSize + bytes;
+}
+
+bool TraceWriter::Close()
+{
+	if (!writer.joinable())
+		return !failed;
+
+	if (fill != current->records.data())
+		Submit();
+	current.reset();
+	fill = end = nullptr;
+	{
+		std::lock_guard<std::mutex> l(lock);
+		closing = true;
+	}
+	ready.notify_one();
+	writer.join();
+	queue.clear();
+	spare.clear();
+
+	std::vector<uint8_t> tail;
+	StateWriter w(tail);
+	for (const TraceChunk& c : index)
+	{
+		w.u64(c.first);
+		w.u32(c.cycles);
+		w.u32(c.ticks);
+		w.u32(c.bytes);
+		w.u64(c.hash);
+		w.u64(c.offset);
+	}
+	w.u64(offset);
+	w.u32((uint32_t)index.size());
+	w.bytes((const uint8_t*)"65TI", 4);
+	file.write((const char*)tail.data(), tail.size());
+	file.close();
+	if (!file && !failed)
+	{
+		failed = true;
+		error = "can't write the trace";
+	}
+	return !failed;
+}
+
+bool TraceReader::Open(const char* path)
+{
+	chunks.clear();
+	decoded.clear();
+	chunk = pos = 0;
+	file = MappedFile::Open(path, error);
+	if (!file)
+		return false;
+
+	const uint8_t* data = file->Data();
+	size_t size = file->Size();
+	StateReader r(data, size);
+	const uint8_t* magic = r.take(4);
+	uint16_t version = r.u16();
+	r.u16();
+	r.u32();
+	if (!r.ok || std::memcmp(magic, "65TR", 4) != 0 || version != TraceVersion)
+	{
+		error = std::string(path) + ": not a trace";
+		return false;
+	}
+
+	// the index when the footer made it to the file...
+	size_t end = size;
+	if (size >= HeaderSize + FooterSize && std::memcmp(data + size - 4, "65TI", 4) == 0)
+	{
+		StateReader f(data + size - FooterSize, FooterSize);
+		uint64_t at = f.u64();
+		uint32_t count = f.u32();
+		if (at >= HeaderSize && at <= size - FooterSize && (size - FooterSize - at) / IndexEntrySize == count
+			&& (size - FooterSize - at) % IndexEntrySize == 0)
+		{
+			end = (size_t)at;
+			StateReader x(data + at, (size_t)count * IndexEntrySize);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				TraceChunk c;
+				c.first = x.u64();
+				c.cycles = x.u32();
+				c.ticks = x.u32();
+				c.bytes = x.u32();
+				c.hash = x.u64();
+				c.offset = x.u64();
+				// no sums of file values, they can wrap around
+				if (c.offset < HeaderSize || at < ChunkHeaderSize + (uint64_t)c.bytes || c.offset > at - ChunkHeaderSize - c.bytes)
+				{
+					chunks.clear();
+					break;
+				}
+				chunks.push_back(c);
+			}
+			if (chunks.size() == count)
+				return true;
+		}
+	}
+
+	// ...or walk the chunks up to the first incomplete one (or the index, it isn't a chunk)
+	uint64_t at = HeaderSize;
+	while (at + ChunkHeaderSize <= end)
+	{
+		StateReader h(data + at, ChunkHeaderSize);
+		TraceChunk c;
+		c.first = h.u64();
+		c.cycles = h.u32();
+		c.ticks = h.u32();
+		c.bytes = h.u32();
+		c.hash = h.u64();
+		c.offset = at;
+		if (c.bytes > end - at - ChunkHeaderSize)
+			break;
+		chunks.push_back(c);
+		at += ChunkHeaderSize + c.bytes;
+	}
+	return true;
+}
+
+uint64_t TraceReader::Cycles() const
+{
+	uint64_t n = 0;
+	for (const TraceChunk& c : chunks)
+		n += c.cycles;
+	return n;
+}
+
+bool TraceReader::Decode(size_t n, std::vector<TraceCycle>& out)
+{
+	out.clear();
+	if (n >= chunks.size())
+		return false;
+	const TraceChunk& c = chunks[n];
+	// 2 bytes per cycle at least
+	const uint8_t* data = file->Data() + c.offset + ChunkHeaderSize;
+	if (c.cycles > c.bytes / 2 || ChunkHash(data, c.bytes) != c.hash)
+	{
+		error = "damaged chunk at cycle " + std::to_string(c.first);
+		return false;
+	}
+	StateReader r(data, c.bytes);
+	out.resize(c.cycles);
+
+	uint16_t prev = 0, sync = 0;
+	uint8_t lines = 0;
+	uint64_t cycle = c.first;
+	for (uint32_t i = 0; i < c.cycles; i++)
+	{
+		uint8_t ctl = r.u8();
+		unsigned code = ctl >> 3;
+		bool is_sync = (ctl >> 1) & 1;
+		if (ctl & 4)
+			lines = r.u8() & 31;
+		bool held = i && (lines & 16);
+		cycle += i && !held;
+
+		uint16_t base = is_sync ? sync : prev;
+		uint16_t addr = 0;
+		if (code < 28)
+			addr = (uint16_t)(base + (int)code - 8);
+		else if (code == 28)
+			addr = (uint16_t)(base + (int8_t)r.u8());
+		else if (code == 29)
+			addr = r.u16();
+		else
+			r.ok = false;
+
+		TraceCycle& t = out[i];
+		t.cycle = cycle;
+		t.held = held;
+		t.pins.IRQ = lines & 1;
+		t.pins.NMI = (lines >> 1) & 1;
+		t.pins.RDY = (lines >> 2) & 1;
+		t.pins.RES = (lines >> 3) & 1;
+		t.pins.RW = ctl & 1;
+		t.pins.SYNC = is_sync;
+		t.pins.PORT = 0;
+		t.pins.DATA = r.u8();
+		t.pins.ADDR = addr;
+		if (!r.ok)
+			break;
+
+		prev = addr;
+		if (is_sync)
+			sync = addr;
+	}
+	if (!r.ok || !r.done() || (c.cycles && cycle - c.first + 1 != c.ticks))
+	{
+		error = "damaged chunk at cycle " + std::to_string(c.first);
+		out.clear();
+		return false;
+	}
+	return true;
+}
+
+bool TraceReader::Seek(uint64_t cycle)
+{
+	// from the end: after a jump back the latest recording of the cycle wins
+	for (size_t i = chunks.size(); i-- > 0; )
+	{
+		const TraceChunk& c = chunks[i];
+		if (cycle >= c.first && cycle - c.first < c.ticks)
+		{
+			if (!Decode(i, decoded))
+				return false;
+			chunk = i + 1;
+			// the first record of the cycle, held ones come after it
+			pos = (size_t)(cycle - c.first);
+			while (decoded[pos].cycle < cycle)
+				pos++;
+			return true;
+		}
+	}
+	error = "cycle " + std::to_string(cycle) + " isn't in the trace";
+	return false;
+}
+
+bool TraceReader::SeekRecord(uint64_t n)
+{
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		if (n < chunks[i].cycles)
+		{
+			if (!Decode(i, decoded))
+				return false;
+			chunk = i + 1;
+			pos = (size_t)n;
+			return true;
+		}
+		n -= chunks[i].cycles;
+	}
+	error = "record past the end of the trace";
+	return false;
+}
+
+bool TraceReader::Next(TraceCycle& c)
+{
+	while (pos >= decoded.size())
+	{
+		if (chunk >= chunks.size() || !Decode(chunk++, decoded))
+			return false;
+		pos = 0;
+	}
+	c = decoded[pos++];
+	return true;
+}
+
+static bool SameCycle(const TraceCycle& a, const TraceCycle& b)
+{
+	return a.cycle == b.cycle && a.held == b.held && a.pins.ADDR == b.pins.ADDR && a.pins.DATA == b.pins.DATA
+		&& a.pins.RW == b.pins.RW && a.pins.SYNC == b.pins.SYNC && a.pins.IRQ == b.pins.IRQ
+		&& a.pins.NMI == b.pins.NMI && a.pins.RDY == b.pins.RDY && a.pins.RES == b.pins.RES;
+}
+
+TraceDiff CompareTraces(TraceReader& a, TraceReader& b, TraceMismatch& m)
+{
+	m = TraceMismatch();
+	const std::vector<TraceChunk>& ca = a.Chunks();
+	const std::vector<TraceChunk>& cb = b.Chunks();
+	std::vector<TraceCycle> da, db;
+
+	// chunk and record in it, per side; a chunk is decoded when the pair can't be skipped
+	size_t ia = 0, ib = 0;
+	uint32_t oa = 0, ob = 0;
+	bool decoded_a = false, decoded_b = false;
+	for (;;)
+	{
+		if (ia < ca.size() && oa == ca[ia].cycles)
+		{
+			ia++;
+			oa = 0;
+			decoded_a = false;
+			continue;
+		}
+		if (ib < cb.size() && ob == cb[ib].cycles)
+		{
+			ib++;
+			ob = 0;
+			decoded_b = false;
+			continue;
+		}
+		m.a_ended = ia == ca.size();
+		m.b_ended = ib == cb.size();
+		if (m.a_ended || m.b_ended)
+		{
+			if (m.a_ended && m.b_ended)
+				return TraceDiff::Same;
+			// the first cycle the longer one has on top
+			std::vector<TraceCycle>& d = m.a_ended ? db : da;
+			if (!(m.a_ended ? b : a).Decode(m.a_ended ? ib : ia, d))
+				return TraceDiff::Error;
+			m.cycle = d[m.a_ended ? ob : oa].cycle;
+			return TraceDiff::Differ;
+		}
+
+		const TraceChunk& x = ca[ia];
+		const TraceChunk& y = cb[ib];
+		if (!oa && !ob && x.first == y.first && x.cycles == y.cycles && x.ticks == y.ticks && x.hash == y.hash)
+		{
+			m.record += x.cycles;
+			m.chunks_skipped++;
+			ia++;
+			ib++;
+			continue;
+		}
+
+		if (!decoded_a && !a.Decode(ia, da))
+			return TraceDiff::Error;
+		if (!decoded_b && !b.Decode(ib, db))
+			return TraceDiff::Error;
+		decoded_a = decoded_b = true;
+
+		uint32_t n = std::min(x.cycles - oa, y.cycles - ob);
+		for (uint32_t k = 0; k < n; k++)
+		{
+			if (!SameCycle(da[oa + k], db[ob + k]))
+			{
+				m.record += k;
+				m.cycle = da[oa + k].cycle;
+				return TraceDiff::Differ;
+			}
+		}
+		oa += n;
+		ob += n;
+		m.record += n;
+	}
+}
@@ -1,6 +1,296 @@
 #include "mos6502.h"
-
-void mos6502::Op_RES()
+#include "Bus.h"
+
+// The Addr_xxx/Op_xxx steps and the bus side of a cycle have to end up as straight code in the cases of the
+// microcode core, the inliner gives up on functions this big. tick() still calls the steps through op_table,
+// so GCC's "might not be inlinable" warning for them is expected.
+#ifdef _MSC_VER
+#define MICRO_STEP __forceinline
+#define MICRO_INLINE __forceinline
+#else
+#pragma GCC diagnostic ignored "-Wattributes"
+#define MICRO_STEP __attribute__((always_inline))
+#define MICRO_INLINE inline __attribute__((always_inline))
+#endif
+
+//  CPU instructions jump table
+//  defined as constexpr so the microcode core (tick_mc) can unfold it at compile time
+constexpr mos6502::OpData mos6502::op_table[256] {
+    { "BRK", &mos6502::Addr_imp,      &mos6502::Op_BRK,         7 },  // 0x00 
+    { "ORA", &mos6502::Addr_ind_X,    &mos6502::Op_ORA,         6 },  // 0x01
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x02
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x03
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x04
+    { "ORA", &mos6502::Addr_zpg,      &mos6502::Op_ORA,         3 },  // 0x05
+    { "ASL", &mos6502::Addr_zpg,      &mos6502::Op_ASL,         5 },  // 0x06
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x07
+    { "PHP", &mos6502::Addr_imp,      &mos6502::Op_PHP,         3 },  // 0x08
+    { "ORA", &mos6502::Addr_imm,      &mos6502::Op_ORA,         2 },  // 0x09
+    { "ASL", &mos6502::Addr_imp,      &mos6502::Op_ASL_A,       2 },  // 0x0A
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x0B
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x0C
+    { "ORA", &mos6502::Addr_abs,      &mos6502::Op_ORA,         4 },  // 0x0D
+    { "ASL", &mos6502::Addr_abs,      &mos6502::Op_ASL,         6 },  // 0x0E
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x0F
+    { "BPL", &mos6502::Addr_rel,      &mos6502::Op_BPL,         4 },  // 0x10
+    { "ORA", &mos6502::Addr_ind_Y,    &mos6502::Op_ORA,         6 },  // 0x11
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x12
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x13
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x14
+    { "ORA", &mos6502::Addr_zpg_X,    &mos6502::Op_ORA,         4 },  // 0x15
+    { "ASL", &mos6502::Addr_zpg_X,    &mos6502::Op_ASL,         6 },  // 0x16
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x17
+    { "CLC", &mos6502::Addr_imp,      &mos6502::Op_CLC,         2 },  // 0x18
+    { "ORA", &mos6502::Addr_abs_Y,    &mos6502::Op_ORA,         5 },  // 0x19
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x1A
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x1B
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x1C
+    { "ORA", &mos6502::Addr_abs_X,    &mos6502::Op_ORA,         5 },  // 0x1D
+    { "ASL", &mos6502::Addr_abs_X,    &mos6502::Op_ASL,         7 },  // 0x1E
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x1F
+    { "JSR", &mos6502::Addr_jsr,      &mos6502::Op_JSR,         6 },  // 0x20
+    { "AND", &mos6502::Addr_ind_X,    &mos6502::Op_AND,         6 },  // 0x21
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x22
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x23
+    { "BIT", &mos6502::Addr_zpg,      &mos6502::Op_BIT,         3 },  // 0x24
+    { "AND", &mos6502::Addr_zpg,      &mos6502::Op_AND,         3 },  // 0x25
+    { "ROL", &mos6502::Addr_zpg,      &mos6502::Op_ROL,         5 },  // 0x26
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x27
+    { "PLP", &mos6502::Addr_imp,      &mos6502::Op_PLP,         4 },  // 0x28
+    { "AND", &mos6502::Addr_imm,      &mos6502::Op_AND,         2 },  // 0x29
+    { "ROL", &mos6502::Addr_imp,      &mos6502::Op_ROL_A,       2 },  // 0x2A
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x2B
+    { "BIT", &mos6502::Addr_abs,      &mos6502::Op_BIT,         4 },  // 0x2C
+    { "AND", &mos6502::Addr_abs,      &mos6502::Op_AND,         4 },  // 0x2D
+    { "ROL", &mos6502::Addr_abs,      &mos6502::Op_ROL,         6 },  // 0x2E
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x2F
+    { "BMI", &mos6502::Addr_rel,      &mos6502::Op_BMI,         4 },  // 0x30
+    { "AND", &mos6502::Addr_ind_Y,    &mos6502::Op_AND,         6 },  // 0x31
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x32
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x33
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x34
+    { "AND", &mos6502::Addr_zpg_X,    &mos6502::Op_AND,         7 },  // 0x35
+    { "ROL", &mos6502::Addr_zpg_X,    &mos6502::Op_ROL,         7 },  // 0x36
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x37
+    { "SEC", &mos6502::Addr_imp,      &mos6502::Op_SEC,         2 },  // 0x38
+    { "AND", &mos6502::Addr_abs_Y,    &mos6502::Op_AND,         5 },  // 0x39
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x3A
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x3B
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x3C
+    { "AND", &mos6502::Addr_abs_X,    &mos6502::Op_AND,         5 },  // 0x3D
+    { "ROL", &mos6502::Addr_abs_X,    &mos6502::Op_ROL,         7 },  // 0x3E
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x3F
+    { "RTI", &mos6502::Addr_imp,      &mos6502::Op_RTI,         6 },  // 0x40
+    { "EOR", &mos6502::Addr_ind_X,    &mos6502::Op_EOR,         6 },  // 0x41
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x42
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x43
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x44
+    { "EOR", &mos6502::Addr_zpg,      &mos6502::Op_EOR,         3 },  // 0x45
+    { "LSR", &mos6502::Addr_zpg,      &mos6502::Op_LSR,         5 },  // 0x46
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x47
+    { "PHA", &mos6502::Addr_imp,      &mos6502::Op_PHA,         3 },  // 0x48
+    { "EOR", &mos6502::Addr_imm,      &mos6502::Op_EOR,         2 },  // 0x49
+    { "LSR", &mos6502::Addr_imp,      &mos6502::Op_LSR_A,       2 },  // 0x4A
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x4B
+    { "JMP", &mos6502::Addr_abs,      &mos6502::Op_JMP,         3 },  // 0x4C
+    { "EOR", &mos6502::Addr_abs,      &mos6502::Op_EOR,         4 },  // 0x4D
+    { "LSR", &mos6502::Addr_abs,      &mos6502::Op_LSR,         6 },  // 0x4E
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x4F
+    { "BVC", &mos6502::Addr_rel,      &mos6502::Op_BVC,         4 },  // 0x50
+    { "EOR", &mos6502::Addr_ind_Y,    &mos6502::Op_EOR,         6 },  // 0x51
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x52
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x53
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x54
+    { "EOR", &mos6502::Addr_zpg_X,    &mos6502::Op_EOR,         4 },  // 0x55
+    { "LSR", &mos6502::Addr_zpg_X,    &mos6502::Op_LSR,         6 },  // 0x56
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x57
+    { "CLI", &mos6502::Addr_imp,      &mos6502::Op_CLI,         2 },  // 0x58
+    { "EOR", &mos6502::Addr_abs_Y,    &mos6502::Op_EOR,         5 },  // 0x59
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x5A
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x5B
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x5C
+    { "EOR", &mos6502::Addr_abs_X,    &mos6502::Op_EOR,         5 },  // 0x5D
+    { "LSR", &mos6502::Addr_abs_X,    &mos6502::Op_LSR,         7 },  // 0x5E
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x5F
+    { "RTS", &mos6502::Addr_imp,      &mos6502::Op_RTS,         6 },  // 0x60
+    { "ADC", &mos6502::Addr_ind_X,    &mos6502::Op_ADC,         6 },  // 0x61
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x62
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x63
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x64
+    { "ADC", &mos6502::Addr_zpg,      &mos6502::Op_ADC,         3 },  // 0x65
+    { "ROR", &mos6502::Addr_zpg,      &mos6502::Op_ROR,         5 },  // 0x66
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x67
+    { "PLA", &mos6502::Addr_imp,      &mos6502::Op_PLA,         4 },  // 0x68
+    { "ADC", &mos6502::Addr_imm,      &mos6502::Op_ADC,         2 },  // 0x69
+    { "ROR", &mos6502::Addr_imp,      &mos6502::Op_ROR_A,       2 },  // 0x6A
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x6B
+    { "JMP", &mos6502::Addr_ind,      &mos6502::Op_JMP,         5 },  // 0x6C
+    { "ADC", &mos6502::Addr_abs,      &mos6502::Op_ADC,         4 },  // 0x6D
+    { "ROR", &mos6502::Addr_abs,      &mos6502::Op_ROR,         6 },  // 0x6E
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x6F
+    { "BVS", &mos6502::Addr_rel,      &mos6502::Op_BVS,         4 },  // 0x70
+    { "ADC", &mos6502::Addr_ind_Y,    &mos6502::Op_ADC,         6 },  // 0x71
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x72
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x73
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x74
+    { "ADC", &mos6502::Addr_zpg_X,    &mos6502::Op_ADC,         4 },  // 0x75
+    { "ROR", &mos6502::Addr_zpg_X,    &mos6502::Op_ROR,         6 },  // 0x76
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x77
+    { "SEI", &mos6502::Addr_imp,      &mos6502::Op_SEI,         2 },  // 0x78
+    { "ADC", &mos6502::Addr_abs_Y,    &mos6502::Op_ADC,         5 },  // 0x79
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x7A
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x7B
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x7C
+    { "ADC", &mos6502::Addr_abs_X,    &mos6502::Op_ADC,         5 },  // 0x7D
+    { "ROR", &mos6502::Addr_abs_X,    &mos6502::Op_ROR,         7 },  // 0x7E
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x7F
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x80
+    { "STA", &mos6502::Addr_ind_X,    &mos6502::Op_STA,         6 },  // 0x81
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x82
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x83
+    { "STY", &mos6502::Addr_zpg,      &mos6502::Op_STY,         3 },  // 0x84
+    { "STA", &mos6502::Addr_zpg,      &mos6502::Op_STA,         3 },  // 0x85
+    { "STX", &mos6502::Addr_zpg,      &mos6502::Op_STX,         3 },  // 0x86
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x87
+    { "DEY", &mos6502::Addr_imp,      &mos6502::Op_DEY,         2 },  // 0x88
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x89
+    { "TXA", &mos6502::Addr_imp,      &mos6502::Op_TXA,         2 },  // 0x8A
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x8B
+    { "STY", &mos6502::Addr_abs,      &mos6502::Op_STY,         4 },  // 0x8C
+    { "STA", &mos6502::Addr_abs,      &mos6502::Op_STA,         4 },  // 0x8D
+    { "STX", &mos6502::Addr_abs,      &mos6502::Op_STX,         4 },  // 0x8E
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x8F
+    { "BCC", &mos6502::Addr_rel,      &mos6502::Op_BCC,         4 },  // 0x90
+    { "STA", &mos6502::Addr_ind_Y,    &mos6502::Op_STA,         6 },  // 0x91
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x92
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x93
+    { "STY", &mos6502::Addr_zpg_X,    &mos6502::Op_STY,         4 },  // 0x94
+    { "STA", &mos6502::Addr_zpg_X,    &mos6502::Op_STA,         4 },  // 0x95
+    { "STX", &mos6502::Addr_zpg_Y,    &mos6502::Op_STX,         4 },  // 0x96
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x97
+    { "TYA", &mos6502::Addr_imp,      &mos6502::Op_TYA,         2 },  // 0x98
+    { "STA", &mos6502::Addr_abs_Y,    &mos6502::Op_STA,         5 },  // 0x99
+    { "TXS", &mos6502::Addr_imp,      &mos6502::Op_TXS,         7 },  // 0x9A
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x9B
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x9C
+    { "STA", &mos6502::Addr_abs_X,    &mos6502::Op_STA,         5 },  // 0x9D
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x9E
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0x9F
+    { "LDY", &mos6502::Addr_imm,      &mos6502::Op_LDY,         2 },  // 0xA0
+    { "LDA", &mos6502::Addr_ind_X,    &mos6502::Op_LDA,         6 },  // 0xA1
+    { "LDX", &mos6502::Addr_imm,      &mos6502::Op_LDX,         2 },  // 0xA2
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xA3
+    { "LDY", &mos6502::Addr_zpg,      &mos6502::Op_LDY,         3 },  // 0xA4
+    { "LDA", &mos6502::Addr_zpg,      &mos6502::Op_LDA,         3 },  // 0xA5
+    { "LDX", &mos6502::Addr_zpg,      &mos6502::Op_LDX,         3 },  // 0xA6
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xA7
+    { "TAY", &mos6502::Addr_imp,      &mos6502::Op_TAY,         2 },  // 0xA8
+    { "LDA", &mos6502::Addr_imm,      &mos6502::Op_LDA,         2 },  // 0xA9
+    { "TAX", &mos6502::Addr_imp,      &mos6502::Op_TAX,         2 },  // 0xAA
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xAB
+    { "LDY", &mos6502::Addr_abs,      &mos6502::Op_LDY,         4 },  // 0xAC
+    { "LDA", &mos6502::Addr_abs,      &mos6502::Op_LDA,         4 },  // 0xAD
+    { "LDX", &mos6502::Addr_abs,      &mos6502::Op_LDX,         4 },  // 0xAE
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xAF
+    { "BCS", &mos6502::Addr_rel,      &mos6502::Op_BCS,         4 },  // 0xB0
+    { "LDA", &mos6502::Addr_ind_Y,    &mos6502::Op_LDA,         6 },  // 0xB1
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xB2
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xB3
+    { "LDY", &mos6502::Addr_zpg_X,    &mos6502::Op_LDY,         4 },  // 0xB4
+    { "LDA", &mos6502::Addr_zpg_X,    &mos6502::Op_LDA,         4 },  // 0xB5
+    { "LDX", &mos6502::Addr_zpg_Y,    &mos6502::Op_LDX,         4 },  // 0xB6
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xB7
+    { "CLV", &mos6502::Addr_imp,      &mos6502::Op_CLV,         2 },  // 0xB8
+    { "LDA", &mos6502::Addr_abs_Y,    &mos6502::Op_LDA,         5 },  // 0xB9
+    { "TSX", &mos6502::Addr_imp,      &mos6502::Op_TSX,         2 },  // 0xBA
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xBB
+    { "LDY", &mos6502::Addr_abs_X,    &mos6502::Op_LDY,         5 },  // 0xBC
+    { "LDA", &mos6502::Addr_abs_X,    &mos6502::Op_LDA,         5 },  // 0xBD
+    { "LDX", &mos6502::Addr_abs_Y,    &mos6502::Op_LDX,         5 },  // 0xBE
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xBF
+    { "CPY", &mos6502::Addr_imm,      &mos6502::Op_CPY,         2 },  // 0xC0
+    { "CMP", &mos6502::Addr_ind_X,    &mos6502::Op_CMP,         6 },  // 0xC1
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xC2
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xC3
+    { "CPY", &mos6502::Addr_zpg,      &mos6502::Op_CPY,         3 },  // 0xC4
+    { "CMP", &mos6502::Addr_zpg,      &mos6502::Op_CMP,         3 },  // 0xC5
+    { "DEC", &mos6502::Addr_zpg,      &mos6502::Op_DEC,         5 },  // 0xC6
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xC7
+    { "INY", &mos6502::Addr_imp,      &mos6502::Op_INY,         2 },  // 0xC8
+    { "CMP", &mos6502::Addr_imm,      &mos6502::Op_CMP,         2 },  // 0xC9
+    { "DEX", &mos6502::Addr_imp,      &mos6502::Op_DEX,         2 },  // 0xCA
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xCB
+    { "CPY", &mos6502::Addr_abs,      &mos6502::Op_CPY,         4 },  // 0xCC
+    { "CMP", &mos6502::Addr_abs,      &mos6502::Op_CMP,         4 },  // 0xCD
+    { "DEC", &mos6502::Addr_abs,      &mos6502::Op_DEC,         6 },  // 0xCE
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xCF
+    { "BNE", &mos6502::Addr_rel,      &mos6502::Op_BNE,         4 },  // 0xD0
+    { "CMP", &mos6502::Addr_ind_Y,    &mos6502::Op_CMP,         6 },  // 0xD1
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xD2
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xD3
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xD4
+    { "CMP", &mos6502::Addr_zpg_X,    &mos6502::Op_CMP,         4 },  // 0xD5
+    { "DEC", &mos6502::Addr_zpg_X,    &mos6502::Op_DEC,         6 },  // 0xD6
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xD7
+    { "CLD", &mos6502::Addr_imp,      &mos6502::Op_CLD,         2 },  // 0xD8
+    { "CMP", &mos6502::Addr_abs_Y,    &mos6502::Op_CMP,         5 },  // 0xD9
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xDA
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xDB
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xDC
+    { "CMP", &mos6502::Addr_abs_X,    &mos6502::Op_CMP,         5 },  // 0xDD
+    { "DEC", &mos6502::Addr_abs_X,    &mos6502::Op_DEC,         7 },  // 0xDE
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xDF
+    { "CPX", &mos6502::Addr_imm,      &mos6502::Op_CPX,         2 },  // 0xE0
+    { "SBC", &mos6502::Addr_ind_X,    &mos6502::Op_SBC,         6 },  // 0xE1
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xE2
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xE3
+    { "CPX", &mos6502::Addr_zpg,      &mos6502::Op_CPX,         3 },  // 0xE4
+    { "SBC", &mos6502::Addr_zpg,      &mos6502::Op_SBC,         3 },  // 0xE5
+    { "INC", &mos6502::Addr_zpg,      &mos6502::Op_INC,         5 },  // 0xE6
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xE7
+    { "INX", &mos6502::Addr_imp,      &mos6502::Op_INX,         2 },  // 0xE8
+    { "SBC", &mos6502::Addr_imm,      &mos6502::Op_SBC,         2 },  // 0xE9
+    { "NOP", &mos6502::Addr_imp,      &mos6502::Op_NOP,         2 },  // 0xEA
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xEB
+    { "CPX", &mos6502::Addr_abs,      &mos6502::Op_CPX,         4 },  // 0xEC
+    { "SBC", &mos6502::Addr_abs,      &mos6502::Op_SBC,         4 },  // 0xED
+    { "INC", &mos6502::Addr_abs,      &mos6502::Op_INC,         6 },  // 0xEE
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xEF
+    { "BEQ", &mos6502::Addr_rel,      &mos6502::Op_BEQ,         4 },  // 0xF0
+    { "SBC", &mos6502::Addr_ind_Y,    &mos6502::Op_SBC,         6 },  // 0xF1
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xF2
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xF3
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xF4
+    { "SBC", &mos6502::Addr_zpg_X,    &mos6502::Op_SBC,         4 },  // 0xF5
+    { "INC", &mos6502::Addr_zpg_X,    &mos6502::Op_INC,         6 },  // 0xF6
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xF7
+    { "SED", &mos6502::Addr_imp,      &mos6502::Op_SED,         2 },  // 0xF8
+    { "SBC", &mos6502::Addr_abs_Y,    &mos6502::Op_SBC,         5 },  // 0xF9
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xFA
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xFB
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 },  // 0xFC
+    { "SBC", &mos6502::Addr_abs_X,    &mos6502::Op_SBC,         5 },  // 0xFD
+    { "INC", &mos6502::Addr_abs_X,    &mos6502::Op_INC,         7 },  // 0xFE
+    { "BAD", &mos6502::Addr_imp,      &mos6502::Op_BAD,         2 }   // 0xFF
+};
+
+// instruction lengths, unfolded from op_table at compile time
+#define OP_LENGTH_ROW(h) \
+    AddrLength(op_table[h + 0x0].addr), AddrLength(op_table[h + 0x1].addr), AddrLength(op_table[h + 0x2].addr), AddrLength(op_table[h + 0x3].addr), \
+    AddrLength(op_table[h + 0x4].addr), AddrLength(op_table[h + 0x5].addr), AddrLength(op_table[h + 0x6].addr), AddrLength(op_table[h + 0x7].addr), \
+    AddrLength(op_table[h + 0x8].addr), AddrLength(op_table[h + 0x9].addr), AddrLength(op_table[h + 0xA].addr), AddrLength(op_table[h + 0xB].addr), \
+    AddrLength(op_table[h + 0xC].addr), AddrLength(op_table[h + 0xD].addr), AddrLength(op_table[h + 0xE].addr), AddrLength(op_table[h + 0xF].addr),
+
+constexpr uint8_t mos6502::op_length[256] {
+    OP_LENGTH_ROW(0x00) OP_LENGTH_ROW(0x10) OP_LENGTH_ROW(0x20) OP_LENGTH_ROW(0x30)
+    OP_LENGTH_ROW(0x40) OP_LENGTH_ROW(0x50) OP_LENGTH_ROW(0x60) OP_LENGTH_ROW(0x70)
+    OP_LENGTH_ROW(0x80) OP_LENGTH_ROW(0x90) OP_LENGTH_ROW(0xA0) OP_LENGTH_ROW(0xB0)
+    OP_LENGTH_ROW(0xC0) OP_LENGTH_ROW(0xD0) OP_LENGTH_ROW(0xE0) OP_LENGTH_ROW(0xF0)
+};
+
+#undef OP_LENGTH_ROW
+
+MICRO_STEP void mos6502::Op_RES()
 {
     switch (ticks)
     {        
@@ -10,22 +300,25 @@ void mos6502::Op_RES()
     case 4: AR |= (_pins.DATA << 8); break; // ...
     case 5: R.PC = AR; break;                 // update PC with a vector
     case 6: _pins.ADDR = R.PC; break;         // init address bus with PC
-    case 7: _pins.RES = false; break;       // finish reset state
+    case 7: _pins.RES = false; _pins.SYNC = true; break; // finish reset state, fetch next
     }
     ticks++; // force ticks increment here because the rest of tick() is skipped when CPU is in the reset state
+#ifdef MOS6502_STATS
+    stat_kind = StatNone; // the instruction cut short isn't counted
+#endif
 }
 
-void mos6502::Addr_imp()
+MICRO_STEP void mos6502::Addr_imp()
 {
     addressing_done = true;
 }
 
-void mos6502::Addr_rel()
+MICRO_STEP void mos6502::Addr_rel()
 {
     addressing_done = true;
 }
 
-void mos6502::Addr_imm()
+MICRO_STEP void mos6502::Addr_imm()
 {
     if (ticks == 0) {
         _pins.ADDR = R.PC++;
@@ -33,7 +326,7 @@ void mos6502::Addr_imm()
     }
 }
 
-void mos6502::Addr_ind_X()
+MICRO_STEP void mos6502::Addr_ind_X()
 {
     switch (ticks)
     {
@@ -48,7 +341,7 @@ void mos6502::Addr_ind_X()
     }
 }
 
-void mos6502::Addr_ind_Y()
+MICRO_STEP void mos6502::Addr_ind_Y()
 {
     switch (ticks)
     {
@@ -70,7 +363,7 @@ void mos6502::Addr_ind_Y()
     }
 }
 
-void mos6502::Addr_zpg()
+MICRO_STEP void mos6502::Addr_zpg()
 {
     switch (ticks)
     {
@@ -82,7 +375,7 @@ void mos6502::Addr_zpg()
     }
 }
 
-void mos6502::Addr_zpg_X()
+MICRO_STEP void mos6502::Addr_zpg_X()
 {
     switch (ticks)
     {
@@ -95,7 +388,7 @@ void mos6502::Addr_zpg_X()
     }
 }
 
-void mos6502::Addr_zpg_Y()
+MICRO_STEP void mos6502::Addr_zpg_Y()
 {
     switch (ticks)
     {
@@ -108,7 +401,7 @@ void mos6502::Addr_zpg_Y()
     }
 }
 
-void mos6502::Addr_abs()
+MICRO_STEP void mos6502::Addr_abs()
 {
     switch (ticks)
     {
@@ -121,12 +414,12 @@ void mos6502::Addr_abs()
     }
 }
 
-void mos6502::Addr_jsr()
+MICRO_STEP void mos6502::Addr_jsr()
 {
     addressing_done = true;
 }
 
-void mos6502::Addr_ind()
+MICRO_STEP void mos6502::Addr_ind()
 {
     switch (ticks)
     {
@@ -141,7 +434,7 @@ void mos6502::Addr_ind()
     }
 }
 
-void mos6502::Addr_abs_X()
+MICRO_STEP void mos6502::Addr_abs_X()
 {
     switch (ticks)
     {
@@ -162,7 +455,7 @@ void mos6502::Addr_abs_X()
     }
 }
 
-void mos6502::Addr_abs_Y()
+MICRO_STEP void mos6502::Addr_abs_Y()
 {
     switch (ticks)
     {
@@ -184,7 +477,7 @@ void mos6502::Addr_abs_Y()
 }
 
 // used as BRK instruction and also as a forced instruction when NMI or IRQ pin is triggered
-void mos6502::Op_BRK()
+MICRO_STEP void mos6502::Op_BRK()
 {
     switch (ticks)
     {
@@ -211,13 +504,13 @@ void mos6502::Op_BRK()
             AR = NMI_signal ? nmiVectorL : irqVectorL;
         }
         break;
-    case 4: _pins.ADDR = AR++; S.I = true; S.B = true; NMI_signal = false; IRQ_signal = false; break;
+    case 4: _pins.ADDR = AR++; S.I(true); S.B(true); NMI_signal = false; IRQ_signal = false; break;
     case 5: _pins.ADDR = AR; AR = _pins.DATA; break;
     case 6: R.PC = (_pins.DATA << 8) + AR; break;
     }
 }
 
-void mos6502::Op_ORA()
+MICRO_STEP void mos6502::Op_ORA()
 {
     switch (ticks_func)
     {
@@ -226,7 +519,7 @@ void mos6502::Op_ORA()
     }
 }
 
-void mos6502::Op_ASL()
+MICRO_STEP void mos6502::Op_ASL()
 {
     switch (ticks_func)
     {
@@ -237,7 +530,7 @@ void mos6502::Op_ASL()
     }
 }
 
-void mos6502::Op_ASL_A()
+MICRO_STEP void mos6502::Op_ASL_A()
 {
     switch (ticks)
     {
@@ -246,7 +539,7 @@ void mos6502::Op_ASL_A()
     }
 }
 
-void mos6502::Op_AND()
+MICRO_STEP void mos6502::Op_AND()
 {
     switch (ticks_func)
     {
@@ -255,7 +548,7 @@ void mos6502::Op_AND()
     }
 }
 
-void mos6502::Op_ROL()
+MICRO_STEP void mos6502::Op_ROL()
 {
     switch (ticks_func)
     {
@@ -265,7 +558,7 @@ void mos6502::Op_ROL()
     }
 }
 
-void mos6502::Op_ROL_A()
+MICRO_STEP void mos6502::Op_ROL_A()
 {
     switch (ticks)
     {
@@ -274,7 +567,7 @@ void mos6502::Op_ROL_A()
     }
 }
 
-void mos6502::Op_EOR()
+MICRO_STEP void mos6502::Op_EOR()
 {
     switch (ticks_func)
     {
@@ -282,7 +575,7 @@ void mos6502::Op_EOR()
     }
 }
 
-void mos6502::Op_LSR()
+MICRO_STEP void mos6502::Op_LSR()
 {
     switch (ticks_func)
     {
@@ -292,7 +585,7 @@ void mos6502::Op_LSR()
     }
 }
 
-void mos6502::Op_LSR_A()
+MICRO_STEP void mos6502::Op_LSR_A()
 {
     switch (ticks)
     {
@@ -301,7 +594,7 @@ void mos6502::Op_LSR_A()
     }
 }
 
-void mos6502::Op_ADC()
+MICRO_STEP void mos6502::Op_ADC()
 {
     switch (ticks_func)
     {
@@ -309,7 +602,7 @@ void mos6502::Op_ADC()
     }
 }
 
-void mos6502::Op_ROR()
+MICRO_STEP void mos6502::Op_ROR()
 {
     switch (ticks_func)
     {
@@ -319,7 +612,7 @@ void mos6502::Op_ROR()
     }
 }
 
-void mos6502::Op_ROR_A()
+MICRO_STEP void mos6502::Op_ROR_A()
 {
     switch (ticks)
     {
@@ -328,7 +621,7 @@ void mos6502::Op_ROR_A()
     }
 }
 
-void mos6502::Op_STA()
+MICRO_STEP void mos6502::Op_STA()
 {
     switch (ticks_func)
     {
@@ -337,7 +630,7 @@ void mos6502::Op_STA()
     }
 }
 
-void mos6502::Op_STX()
+MICRO_STEP void mos6502::Op_STX()
 {
     switch (ticks_func)
     {
@@ -346,7 +639,7 @@ void mos6502::Op_STX()
     }
 }
 
-void mos6502::Op_STY()
+MICRO_STEP void mos6502::Op_STY()
 {
     switch (ticks_func)
     {
@@ -355,7 +648,7 @@ void mos6502::Op_STY()
     }
 }
 
-void mos6502::Op_LDA()
+MICRO_STEP void mos6502::Op_LDA()
 {
     switch (ticks_func)
     {
@@ -363,7 +656,7 @@ void mos6502::Op_LDA()
     }
 }
 
-void mos6502::Op_LDX()
+MICRO_STEP void mos6502::Op_LDX()
 {
     switch (ticks_func)
     {
@@ -371,7 +664,7 @@ void mos6502::Op_LDX()
     }
 }
 
-void mos6502::Op_LDY()
+MICRO_STEP void mos6502::Op_LDY()
 {
     switch (ticks_func)
     {
@@ -379,7 +672,7 @@ void mos6502::Op_LDY()
     }
 }
 
-void mos6502::Op_CMP()
+MICRO_STEP void mos6502::Op_CMP()
 {
     switch (ticks_func)
     {
@@ -387,7 +680,7 @@ void mos6502::Op_CMP()
     }
 }
 
-void mos6502::Op_DEC()
+MICRO_STEP void mos6502::Op_DEC()
 {
     switch (ticks_func)
     {
@@ -397,7 +690,7 @@ void mos6502::Op_DEC()
     }
 }
 
-void mos6502::Op_CPY()
+MICRO_STEP void mos6502::Op_CPY()
 {
     switch (ticks_func)
     {
@@ -405,7 +698,7 @@ void mos6502::Op_CPY()
     }
 }
 
-void mos6502::Op_SBC()
+MICRO_STEP void mos6502::Op_SBC()
 {
     switch (ticks_func)
     {
@@ -413,7 +706,7 @@ void mos6502::Op_SBC()
     }
 }
 
-void mos6502::Op_INC()
+MICRO_STEP void mos6502::Op_INC()
 {
     switch (ticks_func)
     {
@@ -423,7 +716,7 @@ void mos6502::Op_INC()
     }
 }
 
-void mos6502::Op_CPX()
+MICRO_STEP void mos6502::Op_CPX()
 {
     switch (ticks_func)
     {
@@ -431,7 +724,7 @@ void mos6502::Op_CPX()
     }
 }
 
-void mos6502::Op_BIT()
+MICRO_STEP void mos6502::Op_BIT()
 {
     switch (ticks_func)
     {
@@ -439,47 +732,47 @@ void mos6502::Op_BIT()
     }
 }
 
-void mos6502::Op_PHP()
+MICRO_STEP void mos6502::Op_PHP()
 {
     switch (ticks)
     {
     case 0: _pins.ADDR = R.PC; break;
-    //case 1: _pins.ADDR = stackBase + R.SP--; S.X = true; _pins.DATA = S; _pins.RW = false; break;
+    //case 1: _pins.ADDR = stackBase + R.SP--; S.X(true); _pins.DATA = S; _pins.RW = false; break;
     case 1: _pins.ADDR = stackBase + R.SP--; _pins.DATA = S | static_cast<uint8_t>(FLAGS6502::XF); _pins.RW = false; break;
     case 2: break; // NextOp();
     }
 }
 
-void mos6502::Op_CLC()
+MICRO_STEP void mos6502::Op_CLC()
 {
     switch (ticks)
     {
     case 0: _pins.ADDR = R.PC; break;
-    case 1: S.C = false; break;
+    case 1: S.C(false); break;
     }
 }
 
-void mos6502::Op_PLP()
+MICRO_STEP void mos6502::Op_PLP()
 {
     switch (ticks)
     {
     case 0: _pins.ADDR = R.PC; break;
     case 1: _pins.ADDR = stackBase + R.SP++; break;
     case 2: _pins.ADDR = stackBase + R.SP; break;
-    case 3: S = _pins.DATA; S.B = true; S.X = false; break;
+    case 3: S = _pins.DATA; S.B(true); S.X(false); break;
     }
 }
 
-void mos6502::Op_SEC()
+MICRO_STEP void mos6502::Op_SEC()
 {
     switch (ticks)
     {
     case 0: _pins.ADDR = R.PC; break;
-    case 1: S.C = true; break;
+    case 1: S.C(true); break;
     }
 }
 
-void mos6502::Op_PHA()
+MICRO_STEP void mos6502::Op_PHA()
 {
     switch (ticks)
     {
@@ -489,16 +782,16 @@ void mos6502::Op_PHA()
     }
 }
 
-void mos6502::Op_CLI()
+MICRO_STEP void mos6502::Op_CLI()
 {
     switch (ticks)
     {
     case 0: _pins.ADDR = R.PC; break;
-    case 1: S.I = false; break;
+    case 1: S.I(false); break;
     }
 }
 
-void mos6502::Op_PLA()
+MICRO_STEP void mos6502::Op_PLA()
 {
     switch (ticks)
     {
@@ -509,16 +802,16 @@ void mos6502::Op_PLA()
     }
 }
 
-void mos6502::Op_SEI()
+MICRO_STEP void mos6502::Op_SEI()
 {
     switch (ticks)
     {
     case 0: _pins.ADDR = R.PC; break;
-    case 1: S.I = true; break;
+    case 1: S.I(true); break;
     }
 }
 
-void mos6502::Op_DEY()
+MICRO_STEP void mos6502::Op_DEY()
 {
     switch (ticks)
     {
@@ -527,7 +820,7 @@ void mos6502::Op_DEY()
     }
 }
 
-void mos6502::Op_TYA()
+MICRO_STEP void mos6502::Op_TYA()
 {
     switch (ticks)
     {
@@ -536,7 +829,7 @@ void mos6502::Op_TYA()
     }
 }
 
-void mos6502::Op_TAY()
+MICRO_STEP void mos6502::Op_TAY()
 {
     switch (ticks)
     {
@@ -545,16 +838,16 @@ void mos6502::Op_TAY()
     }
 }
 
-void mos6502::Op_CLV()
+MICRO_STEP void mos6502::Op_CLV()
 {
     switch (ticks)
     {
     case 0: _pins.ADDR = R.PC; break;
-    case 1: S.V = false; break;
+    case 1: S.V(false); break;
     }
 }
 
-void mos6502::Op_INY()
+MICRO_STEP void mos6502::Op_INY()
 {
     switch (ticks)
     {
@@ -563,16 +856,16 @@ void mos6502::Op_INY()
     }
 }
 
-void mos6502::Op_CLD()
+MICRO_STEP void mos6502::Op_CLD()
 {
     switch (ticks)
     {
     case 0: _pins.ADDR = R.PC; break;
-    case 1: S.D = false; break;
+    case 1: S.D(false); break;
     }
 }
 
-void mos6502::Op_INX()
+MICRO_STEP void mos6502::Op_INX()
 {
     switch (ticks)
     {
@@ -581,16 +874,16 @@ void mos6502::Op_INX()
     }
 }
 
-void mos6502::Op_SED()
+MICRO_STEP void mos6502::Op_SED()
 {
     switch (ticks)
     {
     case 0: _pins.ADDR = R.PC; break;
-    case 1: S.D = true; break;
+    case 1: S.D(true); break;
     }
 }
 
-void mos6502::Op_TXA()
+MICRO_STEP void mos6502::Op_TXA()
 {
     switch (ticks)
     {
@@ -599,7 +892,7 @@ void mos6502::Op_TXA()
     }
 }
 
-void mos6502::Op_TXS()
+MICRO_STEP void mos6502::Op_TXS()
 {
     switch (ticks)
     {
@@ -608,7 +901,7 @@ void mos6502::Op_TXS()
     }
 }
 
-void mos6502::Op_TAX()
+MICRO_STEP void mos6502::Op_TAX()
 {
     switch (ticks)
     {
@@ -617,7 +910,7 @@ void mos6502::Op_TAX()
     }
 }
 
-void mos6502::Op_TSX()
+MICRO_STEP void mos6502::Op_TSX()
 {
     switch (ticks)
     {
@@ -626,7 +919,7 @@ void mos6502::Op_TSX()
     }
 }
 
-void mos6502::Op_DEX()
+MICRO_STEP void mos6502::Op_DEX()
 {
     switch (ticks)
     {
@@ -635,7 +928,7 @@ void mos6502::Op_DEX()
     }
 }
 
-void mos6502::Op_NOP()
+MICRO_STEP void mos6502::Op_NOP()
 {
     switch (ticks)
     {
@@ -643,7 +936,7 @@ void mos6502::Op_NOP()
     }
 }
 
-void mos6502::Op_JSR()
+MICRO_STEP void mos6502::Op_JSR()
 {
     switch (ticks)
     {
@@ -656,7 +949,7 @@ void mos6502::Op_JSR()
     }
 }
 
-void mos6502::Op_JMP()
+MICRO_STEP void mos6502::Op_JMP()
 {
     switch (ticks_func)
     {
@@ -664,19 +957,19 @@ void mos6502::Op_JMP()
     }
 }
 
-void mos6502::Op_RTI()
+MICRO_STEP void mos6502::Op_RTI()
 {
     switch (ticks) {
     case 0: _pins.ADDR = R.PC; break;
     case 1: _pins.ADDR = stackBase + R.SP++; break;
     case 2: _pins.ADDR = stackBase + R.SP++; break;
-    case 3: _pins.ADDR = stackBase + R.SP++; S = _pins.DATA; S.B = true; S.X = false; break;
+    case 3: _pins.ADDR = stackBase + R.SP++; S = _pins.DATA; S.B(true); S.X(false); break;
     case 4: _pins.ADDR = stackBase + R.SP; AR = _pins.DATA; break;
     case 5: R.PC = (_pins.DATA << 8) + AR; break;
     }
 }
 
-void mos6502::Op_RTS()
+MICRO_STEP void mos6502::Op_RTS()
 {
     switch (ticks)
     {
@@ -711,154 +1004,56 @@ void mos6502::Do_Branch(bool skip)
     }
 }
 
-void mos6502::Op_BPL()
+MICRO_STEP void mos6502::Op_BPL()
 {
-    Do_Branch(S.N);
+    Do_Branch(S.N());
 }
 
-void mos6502::Op_BMI()
+MICRO_STEP void mos6502::Op_BMI()
 {
-    Do_Branch(!S.N);
+    Do_Branch(!S.N());
 }
 
-void mos6502::Op_BVC()
+MICRO_STEP void mos6502::Op_BVC()
 {
-    Do_Branch(S.V);
+    Do_Branch(S.V());
 }
 
-void mos6502::Op_BVS()
+MICRO_STEP void mos6502::Op_BVS()
 {
-    Do_Branch(!S.V);
+    Do_Branch(!S.V());
 }
 
-void mos6502::Op_BCC()
+MICRO_STEP void mos6502::Op_BCC()
 {
-    Do_Branch(S.C);
+    Do_Branch(S.C());
 }
 
-void mos6502::Op_BCS()
+MICRO_STEP void mos6502::Op_BCS()
 {
-    Do_Branch(!S.C);
+    Do_Branch(!S.C());
 }
 
-void mos6502::Op_BNE()
+MICRO_STEP void mos6502::Op_BNE()
 {
-    Do_Branch(S.Z);
+    Do_Branch(S.Z());
 }
 
-void mos6502::Op_BEQ()
+MICRO_STEP void mos6502::Op_BEQ()
 {
-    Do_Branch(!S.Z);
+    Do_Branch(!S.Z());
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-inline void mos6502::UpdateNZ(uint8_t v)
-{
-    S.Z = (!v);
-    S.N = (v & 0x80);
-}
-
-inline void mos6502::AND_A_Flags(uint8_t v)
-{
-    uint8_t test = R.A & v;
-    S.Z = (!test);
-    S.N = (v & 0x80);
-    S.V = (v & 0x40);
-}
-
-inline uint8_t mos6502::ASL_Flags(uint8_t v)
-{
-    uint8_t t;
-    S.C = (v & 0x80);
-    t = (v << 1) & 0xFF;
-    UpdateNZ(t);
-    return t;
-}
-
-inline uint8_t mos6502::LSR_Flags(uint8_t v)
-{
-    uint8_t t = (v >> 1);
-    S.C = (v & 0x01);
-    UpdateNZ(t);
-    return t;
-}
-
-inline uint8_t mos6502::ROL_Flags(uint8_t v)
-{
-    bool carry = S.C;
-    S.C = (v & 0x80);
-    v <<= 1;
-    if (carry) v |= 1;
-    UpdateNZ(v);
-    return v;
-}
-
-inline uint8_t mos6502::ROR_Flags(uint8_t v)
-{
-    bool carry = S.C;
-    S.C = (v & 0x01);
-    v >>= 1;
-    if (carry) v |= 0x80;
-    UpdateNZ(v);
-    return v;
-}
-
-inline void mos6502::ADC_Flags(uint8_t v)
-{
-    uint16_t sum = R.A + v + (S.C ? 1 : 0);  // can feed bool as int directly, but...
-    S.Z = !(sum & 0xFF);
-
-    if (S.D) {
-        if (((R.A & 0xF) + (v & 0xF) + (S.C ? 1 : 0)) > 9) sum += 6;
-        S.N = (sum & 0x80);
-        S.V = (!((R.A ^ v) & 0x80) && ((R.A ^ sum) & 0x80));
-        if (sum > 0x99)
-        {
-            sum += 96;
-        }
-        S.C = (sum> 0x99);
-    }
-    else 
-    {
-        S.N = (sum & 0x80);
-        S.V = (!((R.A ^ v) & 0x80) && ((R.A ^ sum) & 0x80));
-        S.C = (sum > 0xFF);
-    }
-    R.A = sum & 0xFF;
-}
-
-inline void mos6502::SBC_Flags(uint8_t v)
-{
-    uint16_t dif = R.A - v - (S.C ? 0 : 1);
-    S.N = (dif & 0x80);
-    S.Z = !(dif & 0xFF);
-    S.V = ((R.A ^ dif) & 0x80) && ((R.A ^ v) & 0x80);
-
-    if (S.D)
-    {
-        if (((R.A & 0x0F) - (S.C ? 0 : 1)) < (v & 0x0F)) dif -= 6;
-        if (dif > 0x99)
-        {
-            dif -= 0x60;
-        }
-    }
-    S.C = (dif < 0x100);
-    R.A = (dif & 0xFF);
-}
-
-inline void mos6502::CMP_Flags(uint8_t r, uint8_t v)
-{
-    uint16_t t = r - v;
-    S.C = (r >= v);
-    S.Z = (!t);
-    S.N = (t & 0x80);
-}
-
 mos6502::mos6502()
 {
+    ticks_total = 0;
+#ifdef MOS6502_STATS
+    stats = nullptr;
+#endif
     _pins = reset();
     _pins.ADDR = 0;
     _pins.DATA = 0;
@@ -871,11 +1066,6 @@ mos6502::mos6502()
     _pins.SYNC = true;
 }
 
-mos6502::~mos6502()
-{
-    // I'm the destroyer of the worlds!!!
-}
-
 Pins mos6502::reset()
 {
     R.A = 0;
@@ -883,36 +1073,39 @@ Pins mos6502::reset()
     R.Y = 0;
     R.PC = 0; 
     R.SP = 0xFD;
-    S.N = false;
-    S.V = false;
-    S.X = true;
-    S.B = false;
-    S.D = false;
-    S.I = false;
-    S.Z = false;
-    S.C = false;
+    S.N(false);
+    S.V(false);
+    S.X(true);
+    S.B(false);
+    S.D(false);
+    S.I(false);
+    S.Z(false);
+    S.C(false);
     NMI_signal = false;
     IRQ_signal = false;
     ticks = 0;
     ticks_func = 0;
     addressing_done = false;
+#ifdef MOS6502_STATS
+    stat_kind = StatNone;
+#endif
     return _pins;
 }
 
-Pins mos6502::tick(Pins pins)
+MICRO_INLINE bool mos6502::TickStart(const Pins& pins)
 {
     // edge detect NMI
     if (!_pins.NMI && pins.NMI)
         NMI_signal = true;
     // level detect IRQ
-    if (pins.IRQ && !S.I)
+    if (pins.IRQ && !S.I())
         IRQ_signal = true;
 
     _pins = pins;
 
     // if RDY is high & RW is "read" - skip op execution
     if (_pins.RDY && _pins.RW)
-        return _pins;
+        return false;
 
     if (_pins.SYNC || _pins.IRQ || _pins.NMI || _pins.RES)
     {
@@ -920,12 +1113,13 @@ Pins mos6502::tick(Pins pins)
         if (_pins.RES)
         {
             Op_RES();
-            return _pins;
+            return false;
         }
 
         // fetch a new instruction byte from DATA pins while SYNC is set
         if (_pins.SYNC)
         {
+            StatFetch();
             Opcode = _pins.DATA;
             _pins.SYNC = false;
 
@@ -933,7 +1127,7 @@ Pins mos6502::tick(Pins pins)
             if (NMI_signal || IRQ_signal)
             {
                 Opcode = 0;
-                S.B = false;
+                S.B(false);
                 _pins.RES = false;
             }
             else
@@ -945,6 +1139,13 @@ Pins mos6502::tick(Pins pins)
             addressing_done = false;
         }
     } // if some pins
+    return true;
+}
+
+Pins mos6502::tick(Pins pins)
+{
+    if (!TickStart(pins))
+        return _pins;
 
     // set RW pin by default as read mode on the bus
     _pins.RW = true;
@@ -968,4 +1169,179 @@ Pins mos6502::tick(Pins pins)
     return _pins;
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Microcode core
+//
+// Does exactly what tick() does, but the addressing mode, the operation and the cycles count of the
+// opcode together with the tick number are template arguments. Knowing them at compile time, the
+// compiler resolves the op_table calls, the switch(ticks) inside Addr_xxx/Op_xxx and the
+// addressing_done checks, so every (opcode, tick) pair becomes a short straight piece of code.
+// The only branches left are the ones depending on data (page crossing, branch taken).
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template<uint8_t OP, uint8_t T>
+MICRO_INLINE void mos6502::Micro()
+{
+    constexpr OpFunc addr = op_table[OP].addr;
+    constexpr OpFunc func = op_table[OP].func;
+    constexpr uint8_t first = AddrDoneFirst(addr);
+    constexpr uint8_t last = AddrDoneLast(addr);
+
+    ticks = T;
+    if (T < first)
+    {
+        // still addressing
+        (this->*addr)();
+    }
+    else if (T <= last)
+    {
+        // addressing may finish on this tick, func overlaps with it as in tick()
+        (this->*addr)();
+        if (addressing_done)
+        {
+            ticks_func = 0;
+            (this->*func)();
+            ticks_func = 1;
+        }
+    }
+    else
+    {
+        // addressing is done, the func tick number is known as well
+        ticks_func = T - last;
+        (this->*func)();
+        ticks_func++;
+    }
+    if (ticks + 1 >= op_table[OP].cycles)
+        NextOp();
+    else
+        ticks++;
+}
+
+#define MICRO_OP(op) \
+    case ((op) << 3) | 0: Micro<(op), 0>(); break; \
+    case ((op) << 3) | 1: Micro<(op), 1>(); break; \
+    case ((op) << 3) | 2: Micro<(op), 2>(); break; \
+    case ((op) << 3) | 3: Micro<(op), 3>(); break; \
+    case ((op) << 3) | 4: Micro<(op), 4>(); break; \
+    case ((op) << 3) | 5: Micro<(op), 5>(); break; \
+    case ((op) << 3) | 6: Micro<(op), 6>(); break;
+
+#define MICRO_ROW(h) \
+    MICRO_OP(h + 0x0) MICRO_OP(h + 0x1) MICRO_OP(h + 0x2) MICRO_OP(h + 0x3) \
+    MICRO_OP(h + 0x4) MICRO_OP(h + 0x5) MICRO_OP(h + 0x6) MICRO_OP(h + 0x7) \
+    MICRO_OP(h + 0x8) MICRO_OP(h + 0x9) MICRO_OP(h + 0xA) MICRO_OP(h + 0xB) \
+    MICRO_OP(h + 0xC) MICRO_OP(h + 0xD) MICRO_OP(h + 0xE) MICRO_OP(h + 0xF)
+
+Pins mos6502::tick_mc(Pins pins)
+{
+    if (!TickStart(pins))
+        return _pins;
+
+    _pins.RW = true;
+    // no instruction takes more than 7 ticks, so 3 bits are enough for the tick number
+    switch ((Opcode << 3) | ticks)
+    {
+        MICRO_ROW(0x00) MICRO_ROW(0x10) MICRO_ROW(0x20) MICRO_ROW(0x30)
+        MICRO_ROW(0x40) MICRO_ROW(0x50) MICRO_ROW(0x60) MICRO_ROW(0x70)
+        MICRO_ROW(0x80) MICRO_ROW(0x90) MICRO_ROW(0xA0) MICRO_ROW(0xB0)
+        MICRO_ROW(0xC0) MICRO_ROW(0xD0) MICRO_ROW(0xE0) MICRO_ROW(0xF0)
+    }
+
+    ticks_total++;
+    return _pins;
+}
+
+#undef MICRO_OP
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Microcode core, whole instructions (step_mc)
+//
+// The same Micro<OP, T>() steps, but after the switch on the opcode the ticks of the instruction follow one
+// another as straight code with their bus cycles in between, so there is one jump through the table per
+// instruction instead of one per cycle. A penalty tick skipped (no page crossing) drops out of the line, RDY
+// or reset leave the rest of the instruction to tick_mc().
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MICRO_INLINE bool mos6502::CycleStart(Bus& bus)
+{
+    // the read goes into a copy, CycleEnd() puts all the pins back anyway
+    Pins pins = bus.pins;
+    if (pins.RW)
+        pins.DATA = bus.Read(pins.ADDR);
+    return TickStart(pins);
+}
+
+MICRO_INLINE void mos6502::CycleEnd(Bus& bus)
+{
+    bus.pins.IRQ = _pins.IRQ;
+    bus.pins.NMI = _pins.NMI;
+    bus.pins.RDY = _pins.RDY;
+    bus.pins.RES = _pins.RES;
+    bus.pins.RW = _pins.RW;
+    bus.pins.SYNC = _pins.SYNC;
+    bus.pins.PORT = _pins.PORT;
+    bus.pins.DATA = _pins.DATA;
+    bus.pins.ADDR = _pins.ADDR;
+    bus.TickHandler();
+    if (!bus.pins.RW)
+        bus.Write(bus.pins.ADDR, bus.pins.DATA);
+}
+
+template<uint8_t OP, uint8_t T>
+MICRO_INLINE bool mos6502::MicroCycle(Bus& bus, unsigned& n)
+{
+    if (T >= op_table[OP].cycles)
+        return false;
+    // no page crossing: the penalty tick was skipped, the one after it goes on
+    if (ticks != T)
+        return true;
+    _pins.RW = true;
+    Micro<OP, T>();
+    ticks_total++;
+    CycleEnd(bus);
+    n++;
+    if (_pins.SYNC)
+        return false;
+    if (!CycleStart(bus))
+    {
+        // RDY or reset, the rest is up to tick_mc()
+        CycleEnd(bus);
+        n++;
+        return false;
+    }
+    return true;
+}
+
+template<uint8_t OP>
+MICRO_INLINE unsigned mos6502::MicroOp(Bus& bus)
+{
+    unsigned n = 0;
+    MicroCycle<OP, 0>(bus, n) && MicroCycle<OP, 1>(bus, n) && MicroCycle<OP, 2>(bus, n) && MicroCycle<OP, 3>(bus, n) &&
+        MicroCycle<OP, 4>(bus, n) && MicroCycle<OP, 5>(bus, n) && MicroCycle<OP, 6>(bus, n);
+    return n;
+}
+
+#define MICRO_OP(op) case (op): return MicroOp<(op)>(bus);
+
+unsigned mos6502::step_mc(Bus& bus)
+{
+    // the opcode fetch, or an interrupt taking its place
+    if (!CycleStart(bus))
+    {
+        CycleEnd(bus);
+        return 1;
+    }
+    switch (Opcode)
+    {
+        MICRO_ROW(0x00) MICRO_ROW(0x10) MICRO_ROW(0x20) MICRO_ROW(0x30)
+        MICRO_ROW(0x40) MICRO_ROW(0x50) MICRO_ROW(0x60) MICRO_ROW(0x70)
+        MICRO_ROW(0x80) MICRO_ROW(0x90) MICRO_ROW(0xA0) MICRO_ROW(0xB0)
+        MICRO_ROW(0xC0) MICRO_ROW(0xD0) MICRO_ROW(0xE0) MICRO_ROW(0xF0)
+    }
+    return 0;
+}
 
+#undef MICRO_ROW
+#undef MICRO_OP
+#undef MICRO_INLINE
+#undef MICRO_STEP
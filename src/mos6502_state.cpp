@@ -0,0 +1,54 @@
+#include "mos6502.h"
+#include "State.h"
+
+// CPU part of the machine state (Bus::SaveState), the order here is the file format
+
+void mos6502::saveState(StateWriter& w) const
+{
+    w.u8(R.A);
+    w.u8(R.X);
+    w.u8(R.Y);
+    w.u8(R.SP);
+    w.u16(R.PC);
+    w.u8(S);
+    w.u8(Opcode);
+    w.u8(ticks);
+    w.u8(ticks_func);
+    w.u8(AD);
+    w.u8(addressing_done);
+    w.u16(AR);
+    w.pins(_pins);
+    w.u8(NMI_signal);
+    w.u8(IRQ_signal);
+    w.u64(ticks_total);
+}
+
+bool mos6502::loadState(StateReader& r)
+{
+    mos6502 c = *this;
+    c.R.A = r.u8();
+    c.R.X = r.u8();
+    c.R.Y = r.u8();
+    c.R.SP = r.u8();
+    c.R.PC = r.u16();
+    c.S = r.u8();
+    c.Opcode = r.u8();
+    c.ticks = r.u8();
+    c.ticks_func = r.u8();
+    c.AD = r.u8();
+    c.addressing_done = r.u8() != 0;
+    c.AR = r.u16();
+    c._pins = r.pins();
+    c.NMI_signal = r.u8() != 0;
+    c.IRQ_signal = r.u8() != 0;
+    c.ticks_total = r.u64();
+
+    // tick_mc() switches on (Opcode << 3) | ticks, mid instruction the tick has to be one of the opcode's;
+    // on the opcode fetch (SYNC) or in reset (Op_RES counts up to 8) nothing switches on it
+    uint8_t cycles = op_table[c.Opcode].cycles;
+    bool between = c._pins.SYNC || c._pins.RES;
+    if (!r.ok || c.ticks > (between ? 8 : cycles - 1) || c.ticks_func > (between ? 7 : cycles - 1))
+        return false;
+    *this = c;
+    return true;
+}
@@ -0,0 +1,413 @@
+#include "mos6502.h"
+#include "Bus.h"
+#include "BlockCache.h"
+
+//
+// Instruction level mode
+//
+// Runs a whole instruction per call. Memory is accessed directly through the bus and no pins
+// activity is produced, so dummy reads and the first (unmodified) write of read-modify-write
+// instructions are skipped. Registers, flags, memory and ticks_total end up the same as after
+// ticking the instruction through tick()/tick_mc(), page crossing penalties included,
+// so the modes can be switched on any instruction boundary.
+//
+// Instructions are decoded first (opcode + operand bytes, see DecodedOp) and then run by Exec(),
+// which is shared with the block cache mode (step_block).
+//
+
+unsigned mos6502::step(Bus& bus)
+{
+    uint64_t ticks_start = ticks_total;
+
+    // if RDY is high & RW is "read" - skip op execution
+    if (bus.pins.RDY && bus.pins.RW)
+        return 0;
+
+    // coming from the cycle cores in the middle of an instruction or in the reset state:
+    // just finish it tick by tick to get to the instruction boundary
+    if (!bus.pins.SYNC || bus.pins.RES)
+    {
+        do
+        {
+            bus.CPU_Step();
+        } while ((!bus.pins.SYNC || bus.pins.RES) && !(bus.pins.RDY && bus.pins.RW));
+        return (unsigned)(ticks_total - ticks_start);
+    }
+
+    // the same interrupts latching tick() does on the opcode fetch
+    if (!_pins.NMI && bus.pins.NMI)
+        NMI_signal = true;
+    if (bus.pins.IRQ && !S.I())
+        IRQ_signal = true;
+    _pins = bus.pins;
+
+    unsigned cycles;
+    StatFlush();
+
+    if (NMI_signal || IRQ_signal)
+    {
+        // process the interrupt by simulating the BRK instruction (PC stays, B is cleared in the pushed flags)
+        bool nmi = NMI_signal;
+        Opcode = 0;
+        cycles = op_table[Opcode].cycles;
+        S.B(false);
+        Interrupt(bus, nmi ? nmiVectorL : irqVectorL);
+        StatInterrupt(nmi, cycles);
+    }
+    else
+    {
+        // the opcode is fetched from the address bus, as tick() does, operands follow PC
+        uint8_t opcode = bus.Read(bus.pins.ADDR);
+        uint8_t len = op_length[opcode];
+        uint8_t lo = len > 1 ? bus.Read(R.PC + 1) : 0;
+        uint8_t hi = len > 2 ? bus.Read(R.PC + 2) : 0;
+        cycles = Exec(bus, Decode(opcode, lo, hi));
+        StatExec(opcode, cycles);
+    }
+
+    StepDone(bus);
+    ticks_total += cycles;
+    return (unsigned)(ticks_total - ticks_start);
+}
+
+unsigned mos6502::step_block(Bus& bus, BlockCache& cache)
+{
+    // only plain instruction boundaries run from the cache, the rest (RDY, reset, pending
+    // interrupts) is left for step(). IRQ/NMI lines and the I flag can't change inside a block,
+    // so interrupts are taken on the same instruction the cycle cores take them.
+    if (!BlockReady(bus.pins))
+    {
+        cache.instructions++;
+        return step(bus);
+    }
+
+    const BlockCache::Block* block = cache.Get(R.PC);
+    if (!block)
+    {
+        cache.instructions++;
+        return step(bus);
+    }
+
+    _pins = bus.pins;
+    StatFlush();
+
+    // stop early if the block gets invalidated by its own writes (self-modifying code, bank switch)
+    uint32_t generation = cache.Generation();
+    unsigned cycles = 0;
+    unsigned i = 0;
+    do
+    {
+        unsigned c = Exec(bus, block->ops[i]);
+        StatExec(block->ops[i].opcode, c);
+        cycles += c;
+        i++;
+    } while (i < block->count && cache.Generation() == generation);
+    cache.instructions += i;
+
+    StepDone(bus);
+    ticks_total += cycles;
+    return cycles;
+}
+
+bool mos6502::EndsBlock(uint8_t opcode)
+{
+    switch (opcode)
+    {
+    case 0x00: case 0x20: case 0x40: case 0x4C: case 0x60: case 0x6C:   // BRK JSR RTI JMP RTS JMP()
+    case 0x10: case 0x30: case 0x50: case 0x70:                         // branches
+    case 0x90: case 0xB0: case 0xD0: case 0xF0:
+    case 0x28: case 0x58: case 0x78:                                    // PLP CLI SEI
+        return true;
+    default:
+        return false;
+    }
+}
+
+uint8_t mos6502::MinCycles(uint8_t opcode)
+{
+    // the same as Exec() without the page crossing tick and with branches not taken, BAD ends on the first tick
+    if (Bad(opcode))
+        return 1;
+    if (Branch(opcode))
+        return 2;
+    return op_table[opcode].cycles - (PageCrossing(opcode) ? 1 : 0);
+}
+
+bool mos6502::PageCrossing(uint8_t opcode)
+{
+    OpFunc a = op_table[opcode].addr;
+    return a == &mos6502::Addr_abs_X || a == &mos6502::Addr_abs_Y || a == &mos6502::Addr_ind_Y;
+}
+
+mos6502::Mode mos6502::AddrMode(uint8_t opcode)
+{
+    OpFunc a = op_table[opcode].addr;
+    return a == &mos6502::Addr_imm ? Mode::IMM :
+        a == &mos6502::Addr_zpg ? Mode::ZP0 :
+        a == &mos6502::Addr_zpg_X ? Mode::ZPX :
+        a == &mos6502::Addr_zpg_Y ? Mode::ZPY :
+        a == &mos6502::Addr_ind_X ? Mode::IZX :
+        a == &mos6502::Addr_ind_Y ? Mode::IZY :
+        a == &mos6502::Addr_abs || a == &mos6502::Addr_jsr ? Mode::ABS :
+        a == &mos6502::Addr_abs_X ? Mode::ABX :
+        a == &mos6502::Addr_abs_Y ? Mode::ABY :
+        a == &mos6502::Addr_ind ? Mode::IND :
+        a == &mos6502::Addr_rel ? Mode::REL : Mode::IMP;
+}
+
+// leave the CPU on the instruction boundary, as NextOp() does
+void mos6502::StepDone(Bus& bus)
+{
+    _pins.ADDR = R.PC;
+    _pins.RW = true;
+    _pins.SYNC = true;
+    bus.pins.ADDR = _pins.ADDR;
+    bus.pins.RW = true;
+    bus.pins.SYNC = true;
+}
+
+void mos6502::Interrupt(Bus& bus, uint16_t vector)
+{
+    bus.Write(stackBase + R.SP--, R.PC >> 8);
+    bus.Write(stackBase + R.SP--, R.PC & 0xFF);
+    bus.Write(stackBase + R.SP--, S | static_cast<uint8_t>(FLAGS6502::XF));
+    S.I(true);
+    S.B(true);
+    NMI_signal = false;
+    IRQ_signal = false;
+    R.PC = bus.Read(vector) | (bus.Read(vector + 1) << 8);
+}
+
+// run a decoded instruction, PC points to its opcode, returns the number of ticks taken
+unsigned mos6502::Exec(Bus& bus, const DecodedOp& op)
+{
+    unsigned cycles = op.cycles;
+    Opcode = op.opcode;
+    R.PC += op.len;
+
+    auto rd = [&bus](uint16_t a) { return bus.Read(a); };
+    auto wr = [&bus](uint16_t a, uint8_t v) { bus.Write(a, v); };
+    auto push = [&](uint8_t v) { wr(stackBase + R.SP--, v); };
+    auto pull = [&]() { return rd(stackBase + ++R.SP); };
+
+    // addressing modes, return the effective address (imm returns the value)
+    auto imm = [&]() -> uint8_t { return (uint8_t)op.operand; };
+    auto zpg = [&]() -> uint16_t { return op.operand & 0xFF; };
+    auto zpx = [&]() -> uint16_t { return (op.operand + R.X) & 0xFF; };
+    auto zpy = [&]() -> uint16_t { return (op.operand + R.Y) & 0xFF; };
+    auto abs = [&]() -> uint16_t { return op.operand; };
+    auto indexed = [&](uint16_t base, uint8_t i) -> uint16_t {
+        // the cycle cores skip a tick if there is no page crossing
+        if ((base >> 8) >= ((base + i) >> 8))
+            cycles--;
+        return base + i;
+    };
+    auto abx = [&]() { return indexed(abs(), R.X); };
+    auto aby = [&]() { return indexed(abs(), R.Y); };
+    auto izx = [&]() -> uint16_t {
+        uint8_t p = (uint8_t)op.operand + R.X;
+        return rd(p) | (rd((uint8_t)(p + 1)) << 8);
+    };
+    auto izy = [&]() -> uint16_t {
+        uint8_t p = (uint8_t)op.operand;
+        return indexed(rd(p) | (rd((uint8_t)(p + 1)) << 8), R.Y);
+    };
+    auto ind = [&]() -> uint16_t {
+        // high byte of the pointer is not incremented (the original 6502 bug, as in Addr_ind)
+        uint16_t p = op.operand;
+        return rd(p) | (rd((p & 0xFF00) + ((p + 1) & 0xFF)) << 8);
+    };
+
+    // operations
+    auto ld = [&](uint8_t& r, uint8_t v) { r = v; UpdateNZ(r); };
+    auto ora = [&](uint8_t v) { R.A |= v; UpdateNZ(R.A); };
+    auto and_ = [&](uint8_t v) { R.A &= v; UpdateNZ(R.A); };
+    auto eor = [&](uint8_t v) { R.A ^= v; UpdateNZ(R.A); };
+    auto rmw = [&](uint16_t a, uint8_t (mos6502::*f)(uint8_t)) { wr(a, (this->*f)(rd(a))); };
+    auto incdec = [&](uint16_t a, int d) { uint8_t v = rd(a) + d; UpdateNZ(v); wr(a, v); };
+    auto branch = [&](bool skip) {
+        // 2 ticks if not taken, 3 if taken, 4 if taken to another page (see Do_Branch)
+        cycles = 2;
+        if (!skip)
+        {
+            uint16_t target = R.PC + (int8_t)op.operand;
+            cycles = ((R.PC & 0xFF00) == (target & 0xFF00)) ? 3 : 4;
+            R.PC = target;
+        }
+    };
+    auto brk = [&]() { R.PC++; Interrupt(bus, irqVectorL); };
+    auto jsr = [&]() {
+        // return address is pushed before the high byte of the target is read (it may be overwritten by the push)
+        uint16_t ret = R.PC - 1;
+        push(ret >> 8);
+        push(ret & 0xFF);
+        R.PC = (op.operand & 0xFF) | (rd(ret) << 8);
+    };
+    auto rts = [&]() { uint16_t lo = pull(); R.PC = (lo | (pull() << 8)) + 1; };
+    auto rti = [&]() {
+        S = pull(); S.B(true); S.X(false);
+        uint16_t lo = pull();
+        R.PC = lo | (pull() << 8);
+        // tick() keeps latching IRQ on the two ticks after the flags are restored
+        if (bus.pins.IRQ && !S.I())
+            IRQ_signal = true;
+    };
+
+    switch (op.opcode)
+    {
+    case 0x00: brk(); break;
+    case 0x01: ora(rd(izx())); break;
+    case 0x05: ora(rd(zpg())); break;
+    case 0x06: rmw(zpg(), &mos6502::ASL_Flags); break;
+    case 0x08: push(S | static_cast<uint8_t>(FLAGS6502::XF)); break;
+    case 0x09: ora(imm()); break;
+    case 0x0A: R.A = ASL_Flags(R.A); break;
+    case 0x0D: ora(rd(abs())); break;
+    case 0x0E: rmw(abs(), &mos6502::ASL_Flags); break;
+    case 0x10: branch(S.N()); break;
+    case 0x11: ora(rd(izy())); break;
+    case 0x15: ora(rd(zpx())); break;
+    case 0x16: rmw(zpx(), &mos6502::ASL_Flags); break;
+    case 0x18: S.C(false); break;
+    case 0x19: ora(rd(aby())); break;
+    case 0x1D: ora(rd(abx())); break;
+    case 0x1E: rmw(abx(), &mos6502::ASL_Flags); break;
+    case 0x20: jsr(); break;
+    case 0x21: and_(rd(izx())); break;
+    case 0x24: AND_A_Flags(rd(zpg())); break;
+    case 0x25: and_(rd(zpg())); break;
+    case 0x26: rmw(zpg(), &mos6502::ROL_Flags); break;
+    case 0x28: S = pull(); S.B(true); S.X(false); break;
+    case 0x29: and_(imm()); break;
+    case 0x2A: R.A = ROL_Flags(R.A); break;
+    case 0x2C: AND_A_Flags(rd(abs())); break;
+    case 0x2D: and_(rd(abs())); break;
+    case 0x2E: rmw(abs(), &mos6502::ROL_Flags); break;
+    case 0x30: branch(!S.N()); break;
+    case 0x31: and_(rd(izy())); break;
+    case 0x35: and_(rd(zpx())); break;
+    case 0x36: rmw(zpx(), &mos6502::ROL_Flags); break;
+    case 0x38: S.C(true); break;
+    case 0x39: and_(rd(aby())); break;
+    case 0x3D: and_(rd(abx())); break;
+    case 0x3E: rmw(abx(), &mos6502::ROL_Flags); break;
+    case 0x40: rti(); break;
+    case 0x41: eor(rd(izx())); break;
+    case 0x45: eor(rd(zpg())); break;
+    case 0x46: rmw(zpg(), &mos6502::LSR_Flags); break;
+    case 0x48: push(R.A); break;
+    case 0x49: eor(imm()); break;
+    case 0x4A: R.A = LSR_Flags(R.A); break;
+    case 0x4C: R.PC = abs(); break;
+    case 0x4D: eor(rd(abs())); break;
+    case 0x4E: rmw(abs(), &mos6502::LSR_Flags); break;
+    case 0x50: branch(S.V()); break;
+    case 0x51: eor(rd(izy())); break;
+    case 0x55: eor(rd(zpx())); break;
+    case 0x56: rmw(zpx(), &mos6502::LSR_Flags); break;
+    case 0x58: S.I(false); break;
+    case 0x59: eor(rd(aby())); break;
+    case 0x5D: eor(rd(abx())); break;
+    case 0x5E: rmw(abx(), &mos6502::LSR_Flags); break;
+    case 0x60: rts(); break;
+    case 0x61: ADC_Flags(rd(izx())); break;
+    case 0x65: ADC_Flags(rd(zpg())); break;
+    case 0x66: rmw(zpg(), &mos6502::ROR_Flags); break;
+    case 0x68: R.A = pull(); UpdateNZ(R.A); break;
+    case 0x69: ADC_Flags(imm()); break;
+    case 0x6A: R.A = ROR_Flags(R.A); break;
+    case 0x6C: R.PC = ind(); break;
+    case 0x6D: ADC_Flags(rd(abs())); break;
+    case 0x6E: rmw(abs(), &mos6502::ROR_Flags); break;
+    case 0x70: branch(!S.V()); break;
+    case 0x71: ADC_Flags(rd(izy())); break;
+    case 0x75: ADC_Flags(rd(zpx())); break;
+    case 0x76: rmw(zpx(), &mos6502::ROR_Flags); break;
+    case 0x78: S.I(true); break;
+    case 0x79: ADC_Flags(rd(aby())); break;
+    case 0x7D: ADC_Flags(rd(abx())); break;
+    case 0x7E: rmw(abx(), &mos6502::ROR_Flags); break;
+    case 0x81: wr(izx(), R.A); break;
+    case 0x84: wr(zpg(), R.Y); break;
+    case 0x85: wr(zpg(), R.A); break;
+    case 0x86: wr(zpg(), R.X); break;
+    case 0x88: R.Y--; UpdateNZ(R.Y); break;
+    case 0x8A: R.A = R.X; UpdateNZ(R.A); break;
+    case 0x8C: wr(abs(), R.Y); break;
+    case 0x8D: wr(abs(), R.A); break;
+    case 0x8E: wr(abs(), R.X); break;
+    case 0x90: branch(S.C()); break;
+    case 0x91: wr(izy(), R.A); break;
+    case 0x94: wr(zpx(), R.Y); break;
+    case 0x95: wr(zpx(), R.A); break;
+    case 0x96: wr(zpy(), R.X); break;
+    case 0x98: R.A = R.Y; UpdateNZ(R.A); break;
+    case 0x99: wr(aby(), R.A); break;
+    case 0x9A: R.SP = R.X; break;
+    case 0x9D: wr(abx(), R.A); break;
+    case 0xA0: ld(R.Y, imm()); break;
+    case 0xA1: ld(R.A, rd(izx())); break;
+    case 0xA2: ld(R.X, imm()); break;
+    case 0xA4: ld(R.Y, rd(zpg())); break;
+    case 0xA5: ld(R.A, rd(zpg())); break;
+    case 0xA6: ld(R.X, rd(zpg())); break;
+    case 0xA8: R.Y = R.A; UpdateNZ(R.Y); break;
+    case 0xA9: ld(R.A, imm()); break;
+    case 0xAA: R.X = R.A; UpdateNZ(R.X); break;
+    case 0xAC: ld(R.Y, rd(abs())); break;
+    case 0xAD: ld(R.A, rd(abs())); break;
+    case 0xAE: ld(R.X, rd(abs())); break;
+    case 0xB0: branch(!S.C()); break;
+    case 0xB1: ld(R.A, rd(izy())); break;
+    case 0xB4: ld(R.Y, rd(zpx())); break;
+    case 0xB5: ld(R.A, rd(zpx())); break;
+    case 0xB6: ld(R.X, rd(zpy())); break;
+    case 0xB8: S.V(false); break;
+    case 0xB9: ld(R.A, rd(aby())); break;
+    case 0xBA: R.X = R.SP; UpdateNZ(R.X); break;
+    case 0xBC: ld(R.Y, rd(abx())); break;
+    case 0xBD: ld(R.A, rd(abx())); break;
+    case 0xBE: ld(R.X, rd(aby())); break;
+    case 0xC0: CMP_Flags(R.Y, imm()); break;
+    case 0xC1: CMP_Flags(R.A, rd(izx())); break;
+    case 0xC4: CMP_Flags(R.Y, rd(zpg())); break;
+    case 0xC5: CMP_Flags(R.A, rd(zpg())); break;
+    case 0xC6: incdec(zpg(), -1); break;
+    case 0xC8: R.Y++; UpdateNZ(R.Y); break;
+    case 0xC9: CMP_Flags(R.A, imm()); break;
+    case 0xCA: R.X--; UpdateNZ(R.X); break;
+    case 0xCC: CMP_Flags(R.Y, rd(abs())); break;
+    case 0xCD: CMP_Flags(R.A, rd(abs())); break;
+    case 0xCE: incdec(abs(), -1); break;
+    case 0xD0: branch(S.Z()); break;
+    case 0xD1: CMP_Flags(R.A, rd(izy())); break;
+    case 0xD5: CMP_Flags(R.A, rd(zpx())); break;
+    case 0xD6: incdec(zpx(), -1); break;
+    case 0xD8: S.D(false); break;
+    case 0xD9: CMP_Flags(R.A, rd(aby())); break;
+    case 0xDD: CMP_Flags(R.A, rd(abx())); break;
+    case 0xDE: incdec(abx(), -1); break;
+    case 0xE0: CMP_Flags(R.X, imm()); break;
+    case 0xE1: SBC_Flags(rd(izx())); break;
+    case 0xE4: CMP_Flags(R.X, rd(zpg())); break;
+    case 0xE5: SBC_Flags(rd(zpg())); break;
+    case 0xE6: incdec(zpg(), 1); break;
+    case 0xE8: R.X++; UpdateNZ(R.X); break;
+    case 0xE9: SBC_Flags(imm()); break;
+    case 0xEA: break; // NOP
+    case 0xEC: CMP_Flags(R.X, rd(abs())); break;
+    case 0xED: SBC_Flags(rd(abs())); break;
+    case 0xEE: incdec(abs(), 1); break;
+    case 0xF0: branch(!S.Z()); break;
+    case 0xF1: SBC_Flags(rd(izy())); break;
+    case 0xF5: SBC_Flags(rd(zpx())); break;
+    case 0xF6: incdec(zpx(), 1); break;
+    case 0xF8: S.D(true); break;
+    case 0xF9: SBC_Flags(rd(aby())); break;
+    case 0xFD: SBC_Flags(rd(abx())); break;
+    case 0xFE: incdec(abx(), 1); break;
+    default: cycles = 1; break; // BAD - NextOp() on the first tick
+    }
+
+    return cycles;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <random>
+#include "Bus.h"
+
+// state comparisons for the differential tests, and the bus they run on
+
+// scrambles what goes through it, so a missed slow path shows
+class ScrambleDevice : public Device
+{
+public:
+	void Read(uint16_t addr, uint8_t& data) override { data ^= (uint8_t)addr; }
+	void Write(uint16_t addr, uint8_t& data) override { data += (uint8_t)addr; }
+};
+
+// the device on $3000-$3FFF, $6000-$7FFF read-only
+class ScrambleBus final : public BusT<ScrambleBus>
+{
+public:
+	ScrambleDevice device;
+
+	ScrambleBus()
+	{
+		MapDevice(0x30, 16, &device);
+		SetReadOnly(0x60, 32);
+	}
+	void TickHandler() override {}
+};
+
+inline bool SamePins(const Pins& a, const Pins& b)
+{
+	return a.IRQ == b.IRQ && a.NMI == b.NMI && a.RDY == b.RDY && a.RES == b.RES && a.RW == b.RW && a.SYNC == b.SYNC
+		&& a.DATA == b.DATA && a.ADDR == b.ADDR;
+}
+
+// registers, flags and cycle count
+inline bool SameCpu(Bus& a, Bus& b)
+{
+	Registers6502 ra = a.CPU.readRegisters(), rb = b.CPU.readRegisters();
+	return ra.PC == rb.PC && ra.A == rb.A && ra.X == rb.X && ra.Y == rb.Y && ra.SP == rb.SP
+		&& a.CPU.readFlags() == b.CPU.readFlags() && a.CPU.readTicksTotal() == b.CPU.readTicksTotal();
+}
+
+inline bool SameMemory(Bus& a, Bus& b)
+{
+	for (uint32_t i = 0; i < 0x10000; i++)
+		if (a[(uint16_t)i] != b[(uint16_t)i])
+			return false;
+	return true;
+}
+
+// the same random bytes into both
+inline void FillRandom(std::mt19937& rng, Bus& a, Bus& b)
+{
+	for (uint32_t i = 0; i < 0x10000; i++)
+	{
+		uint8_t v = (uint8_t)rng();
+		a[(uint16_t)i] = v;
+		b[(uint16_t)i] = v;
+	}
+}
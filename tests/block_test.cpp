@@ -0,0 +1,112 @@
+// Block core (Core::Block, BlockCache.h) against the cycle core:
+//   random    block by block on random memory with a device and read-only pages, IRQ and NMI; half the runs on
+//             memory that is mostly simple instructions, for longer blocks and more self-modifying writes
+//   smc       a loop incrementing the operand of its own LDA, the block must see every new value
+#include <cstdio>
+#include <memory>
+#include "Compare.h"
+#include "BlockCache.h"
+
+static void Start(ScrambleBus& a, ScrambleBus& b)
+{
+	b.FlushCode();
+	a.pins = a.CPU.reset();
+	b.pins = b.CPU.reset();
+	a.pins.RES = b.pins.RES = true;
+	while (a.pins.RES)
+		a.CPU_Step();
+	while (b.pins.RES)
+		b.CPU_Step();
+}
+
+static bool Random(std::mt19937& rng)
+{
+	static const uint8_t simple[] = { 0xEA, 0xE8, 0xC8, 0xA9, 0x85, 0x95, 0x8D, 0x18, 0x69, 0xCA };
+
+	std::unique_ptr<ScrambleBus> a(new ScrambleBus()), b(new ScrambleBus());
+	a->core = Core::Cycle;
+	b->core = Core::Block;
+	BlockCache& cache = b->GetBlockCache();
+	for (int run = 0; run < 40; run++)
+	{
+		FillRandom(rng, *a, *b);
+		if (run % 2)
+		{
+			for (uint32_t i = 0; i < 0x10000; i++)
+			{
+				if (rng() % 3)
+				{
+					uint8_t v = simple[rng() % sizeof(simple)];
+					(*a)[(uint16_t)i] = v;
+					(*b)[(uint16_t)i] = v;
+				}
+			}
+		}
+		Start(*a, *b);
+		for (int i = 0; i < 30000; i++)
+		{
+			if (rng() % 300 == 0)
+				a->pins.IRQ = b->pins.IRQ = true;
+			if (rng() % 1500 == 0)
+				a->pins.NMI = b->pins.NMI = true;
+			b->CPU.step_block(*b, cache);
+			while (a->CPU.readTicksTotal() < b->CPU.readTicksTotal())
+				a->CPU_Step_Op();
+			if (!SameCpu(*a, *b) || a->pins.ADDR != b->pins.ADDR)
+			{
+				printf("random: run %d block %d: differs at cycle %llu, PC %04X/%04X\n", run, i,
+					(unsigned long long)a->CPU.readTicksTotal(), a->CPU.readPC(), b->CPU.readPC());
+				return false;
+			}
+			a->pins.IRQ = b->pins.IRQ = a->pins.NMI = b->pins.NMI = false;
+		}
+		if (!SameMemory(*a, *b))
+		{
+			printf("random: run %d: memory differs\n", run);
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool SelfModifying()
+{
+	static const uint8_t code[] =
+	{
+		0xA9, 0x00,         // 0200 LDA #$00
+		0xEE, 0x01, 0x02,   // 0202 INC $0201
+		0x4C, 0x00, 0x02,   // 0205 JMP $0200
+	};
+
+	std::unique_ptr<ScrambleBus> a(new ScrambleBus()), b(new ScrambleBus());
+	for (ScrambleBus* bus : { a.get(), b.get() })
+	{
+		for (uint16_t i = 0; i < sizeof(code); i++)
+			(*bus)[0x0200 + i] = code[i];
+		(*bus)[0xFFFC] = 0x00;
+		(*bus)[0xFFFD] = 0x02;
+	}
+	a->core = Core::Cycle;
+	b->core = Core::Block;
+	Start(*a, *b);
+	for (int i = 0; i < 1000; i++)
+	{
+		b->Run(11);
+		a->Run(b->CPU.readTicksTotal() - a->CPU.readTicksTotal());
+		if (!SameCpu(*a, *b) || (*a)[0x0201] != (*b)[0x0201])
+		{
+			printf("smc: step %d: A %02X/%02X\n", i, a->CPU.readRegisters().A, b->CPU.readRegisters().A);
+			return false;
+		}
+	}
+	return true;
+}
+
+int main()
+{
+	std::mt19937 rng(7);
+	bool ok = Random(rng);
+	ok = SelfModifying() && ok;
+	printf(ok ? "block_test OK\n" : "block_test FAILED\n");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+// Breakpoints (Breakpoints.h) hit the same way on every core: the same program runs on each one with the
+// same breakpoints, and the hits (which one, where, the CPU state at the stop) must come in the same order.
+// Execute breakpoints agree across all the cores; the cycle cores also see dummy reads and the double write of
+// read-modify-write instructions, so watches are compared within the cycle cores and within the instruction
+// level ones. Also the condition compiler on good and bad input.
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "Bus.h"
+
+class TestBus final : public BusT<TestBus>
+{
+public:
+	void TickHandler() override {}
+};
+
+struct Stop
+{
+	BreakHit hit;
+	Registers6502 regs;
+	uint8_t flags;
+	uint64_t ticks;
+
+	bool operator==(const Stop& o) const
+	{
+		return hit.id == o.hit.id && hit.kind == o.hit.kind && hit.addr == o.hit.addr && hit.data == o.hit.data
+			&& hit.pc == o.hit.pc && regs.PC == o.regs.PC && regs.A == o.regs.A && regs.X == o.regs.X
+			&& regs.Y == o.regs.Y && regs.SP == o.regs.SP && flags == o.flags && ticks == o.ticks;
+	}
+};
+
+// the stops of a run up to the cycle limit
+static std::vector<Stop> Run(const std::vector<uint8_t>& memory, Core core, bool watches)
+{
+	std::unique_ptr<TestBus> bus(new TestBus());
+	TestBus& b = *bus;
+	for (uint32_t i = 0; i < 0x10000; i++)
+		b[(uint16_t)i] = memory[i];
+	b.FlushCode();
+	b.core = core;
+	b.pins = b.CPU.reset();
+	b.pins.RES = true;
+	while (b.pins.RES)
+		b.CPU_Step();
+
+	Breakpoints breaks(b);
+	std::mt19937 rng(memory[0] | memory[1] << 8);
+	static const char* conditions[] = { "", "A>=$80", "(X & 1) == 0", "[$0010] != 0 || !C", "Y < 4 && SP > $F0" };
+	for (int i = 0; i < 24; i++)
+	{
+		uint16_t first = (uint16_t)rng();
+		breaks.Add(BreakExec, first, first + rng() % 64, conditions[rng() % 5]);
+	}
+	if (watches)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			uint16_t first = (uint16_t)(rng() & 0x07FF);
+			breaks.Add(i % 2 ? BreakRead : BreakWrite, first, first + rng() % 32, i < 2 ? "" : "DATA >= $40");
+		}
+	}
+
+	std::vector<Stop> stops;
+	const uint64_t limit = 2000000;
+	while (stops.size() < 2000 && b.CPU.readTicksTotal() < limit)
+	{
+		b.RunUntil([&](TestBus& self) { return self.CPU.readTicksTotal() >= limit; });
+		Stop s;
+		if (!breaks.Take(s.hit))
+			break;
+		s.regs = b.CPU.readRegisters();
+		s.flags = b.CPU.readFlags();
+		s.ticks = b.CPU.readTicksTotal();
+		stops.push_back(s);
+	}
+	return stops;
+}
+
+static bool Same(const char* what, const std::vector<Stop>& a, const std::vector<Stop>& b)
+{
+	for (size_t i = 0; i < a.size() || i < b.size(); i++)
+	{
+		if (i >= a.size() || i >= b.size() || !(a[i] == b[i]))
+		{
+			printf("%s: stop %zu of %zu/%zu differs\n", what, i, a.size(), b.size());
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool Parity(std::mt19937& rng)
+{
+	static const uint8_t simple[] = { 0xEA, 0xE8, 0xC8, 0xA9, 0x85, 0x95, 0x8D, 0x9D, 0x18, 0x69, 0xCA, 0xE6, 0xAD, 0xB1 };
+
+	bool ok = true;
+	size_t hits = 0;
+	for (int run = 0; run < 6; run++)
+	{
+		std::vector<uint8_t> memory(0x10000);
+		for (uint8_t& m : memory)
+			m = rng() % 3 ? simple[rng() % sizeof(simple)] : (uint8_t)rng();
+
+		std::vector<Stop> cycle = Run(memory, Core::Cycle, false);
+		hits += cycle.size();
+		ok = Same("exec mc", cycle, Run(memory, Core::Microcode, false)) && ok;
+		ok = Same("exec instr", cycle, Run(memory, Core::Instruction, false)) && ok;
+		ok = Same("exec block", cycle, Run(memory, Core::Block, false)) && ok;
+		ok = Same("exec jit", cycle, Run(memory, Core::Jit, false)) && ok;
+
+		ok = Same("watch mc", Run(memory, Core::Cycle, true), Run(memory, Core::Microcode, true)) && ok;
+		std::vector<Stop> instr = Run(memory, Core::Instruction, true);
+		hits += instr.size();
+		ok = Same("watch block", instr, Run(memory, Core::Block, true)) && ok;
+		ok = Same("watch jit", instr, Run(memory, Core::Jit, true)) && ok;
+	}
+	if (hits < 100)
+	{
+		printf("only %zu hits\n", hits);
+		return false;
+	}
+	return ok;
+}
+
+static bool Conditions()
+{
+	static const char* good[] = { "", "A==$20 && X>3", "[$00FF]!=0", "DATA>=$80 || ADDR==$F004", "(PC & $FF00) == $E000 && !C",
+		"%1010 + 0x1F * 12", "- 5", "!!~1" };
+	static const char* bad[] = { "$-5", "$ 5", "0x0x5", "%2", "12a", "A ==", "(1", "[1)", "Q", "1 1" };
+
+	bool ok = true;
+	for (const char* text : good)
+	{
+		Condition c;
+		if (!c.Compile(text))
+		{
+			printf("'%s' doesn't compile: %s\n", text, c.Error().c_str());
+			ok = false;
+		}
+	}
+	for (const char* text : bad)
+	{
+		Condition c;
+		if (c.Compile(text) || c.Error().empty())
+		{
+			printf("'%s' compiles\n", text);
+			ok = false;
+		}
+	}
+	// deep nesting fails instead of overflowing the stack
+	for (char c : { '(', '!', '-' })
+	{
+		Condition deep;
+		if (deep.Compile(std::string(100000, c) + "1"))
+		{
+			printf("100000 '%c' compile\n", c);
+			ok = false;
+		}
+	}
+	Condition nested;
+	if (!nested.Compile(std::string(40, '(') + "1" + std::string(40, ')')))
+	{
+		printf("40 parentheses don't compile: %s\n", nested.Error().c_str());
+		ok = false;
+	}
+	return ok;
+}
+
+int main()
+{
+	std::mt19937 rng(7);
+	bool ok = Conditions();
+	ok = Parity(rng) && ok;
+	printf(ok ? "breakpoints_test OK\n" : "breakpoints_test FAILED\n");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+// Differential test of the CPU cores against the cycle core (the reference), on random memory:
+//   mc      whole RunUntil() batches of random length, RDY, IRQ and NMI driven by the cycle count, pin for pin
+//   instr   instruction by instruction with IRQ and NMI, sometimes a few single cycles in between
+#include <cstdio>
+#include <memory>
+#include "Compare.h"
+
+class TestBus final : public BusT<TestBus>
+{
+public:
+	bool lines = false;     // drive RDY, IRQ and NMI from the cycle count
+	uint64_t cycles = 0;
+
+	void TickHandler() override
+	{
+		cycles++;
+		if (!lines)
+			return;
+		uint32_t h = (uint32_t)(cycles * 2654435761u) >> 7;
+		pins.RDY = h % 97 < 3;
+		if (h % 3001 == 0)
+			pins.IRQ = true;
+		if (h % 7919 == 0)
+			pins.NMI = !pins.NMI;
+		if (pins.SYNC && h % 5 == 0)
+			pins.IRQ = false;
+	}
+};
+
+static void Randomize(std::mt19937& rng, TestBus& a, TestBus& b)
+{
+	FillRandom(rng, a, b);
+	a.cycles = b.cycles = 0;
+	a.pins = a.CPU.reset();
+	b.pins = b.CPU.reset();
+}
+
+static bool Microcode(std::mt19937& rng)
+{
+	std::unique_ptr<TestBus> a(new TestBus()), b(new TestBus());
+	a->lines = b->lines = true;
+	a->core = Core::Cycle;
+	b->core = Core::Microcode;
+	for (int run = 0; run < 20; run++)
+	{
+		Randomize(rng, *a, *b);
+		for (int i = 0; i < 50000; i++)
+		{
+			uint64_t n = b->RunUntil([](TestBus&) { return true; }, 1 + rng() % 12);
+			for (uint64_t c = 0; c < n; c++)
+				a->CPU_Step();
+			if (!SamePins(a->pins, b->pins) || !SameCpu(*a, *b) || a->cycles != b->cycles)
+			{
+				printf("mc: run %d batch %d: differs at cycle %llu, PC %04X/%04X\n", run, i,
+					(unsigned long long)a->cycles, a->CPU.readPC(), b->CPU.readPC());
+				return false;
+			}
+		}
+		if (!SameMemory(*a, *b))
+		{
+			printf("mc: run %d: memory differs\n", run);
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool Instruction(std::mt19937& rng)
+{
+	std::unique_ptr<TestBus> a(new TestBus()), b(new TestBus());
+	a->core = Core::Cycle;
+	b->core = Core::Instruction;
+	for (int run = 0; run < 20; run++)
+	{
+		Randomize(rng, *a, *b);
+		a->pins.RES = b->pins.RES = true;
+		while (a->pins.RES)
+			a->CPU_Step();
+		b->CPU_Step_Op();
+		for (int i = 0; i < 50000; i++)
+		{
+			if (rng() % 500 == 0)
+				a->pins.IRQ = b->pins.IRQ = true;
+			if (rng() % 2000 == 0)
+				a->pins.NMI = b->pins.NMI = true;
+			// switching cores in the middle of an instruction
+			if (rng() % 50 == 0)
+			{
+				for (unsigned k = rng() % 3; k; k--)
+				{
+					a->CPU_Step();
+					b->CPU_Step();
+				}
+			}
+			a->CPU_Step_Op();
+			b->CPU_Step_Op();
+			if (!SameCpu(*a, *b) || a->pins.SYNC != b->pins.SYNC || a->pins.ADDR != b->pins.ADDR)
+			{
+				printf("instr: run %d instruction %d: differs at cycle %llu, PC %04X/%04X\n", run, i,
+					(unsigned long long)a->CPU.readTicksTotal(), a->CPU.readPC(), b->CPU.readPC());
+				return false;
+			}
+			if (a->pins.SYNC)
+				a->pins.IRQ = b->pins.IRQ = a->pins.NMI = b->pins.NMI = false;
+		}
+		if (!SameMemory(*a, *b))
+		{
+			printf("instr: run %d: memory differs\n", run);
+			return false;
+		}
+	}
+	return true;
+}
+
+int main()
+{
+	std::mt19937 rng(7);
+	bool ok = Microcode(rng);
+	ok = Instruction(rng) && ok;
+	printf(ok ? "core_test OK\n" : "core_test FAILED\n");
+	return ok ? 0 : 1;
+}
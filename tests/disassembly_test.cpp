@@ -0,0 +1,127 @@
+// Disassembly (Disassembly.h) kept up to date by Update() against one built from scratch on a copy of the
+// memory, after every batch of random writes through the bus: linear sweep and flow following (one and
+// several threads, with seeds found running), writes to opcodes, operands and data alike. Also an undefined
+// opcode reached by two paths, which both sides would get wrong the same way.
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+#include "Bus.h"
+#include "Disassembly.h"
+
+class TestBus final : public BusT<TestBus>
+{
+public:
+	void TickHandler() override {}
+};
+
+enum class Kind
+{
+	Sweep,
+	Trace,
+	TraceThreads,
+};
+
+static void Make(Disassembly& d, Kind kind, const std::vector<uint16_t>& seeds)
+{
+	if (kind == Kind::Sweep)
+		d.Build(0x0000, 0xFFFF);
+	else
+		d.Trace(seeds, kind == Kind::Trace ? 1 : 4);
+}
+
+static bool Same(const Disassembly& a, const Disassembly& b)
+{
+	for (uint32_t i = 0; i < 0x10000; i++)
+	{
+		uint16_t addr = (uint16_t)i;
+		if (a.IsInstruction(addr) != b.IsInstruction(addr) || a.IsData(addr) != b.IsData(addr)
+			|| (a.IsInstruction(addr) && (a.Opcode(addr) != b.Opcode(addr) || a.Length(addr) != b.Length(addr)
+				|| a.Mode(addr) != b.Mode(addr))))
+		{
+			printf("  $%04X: %s | %s\n", addr, a.Text(addr).c_str(), b.Text(addr).c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool Run(std::mt19937& rng, Kind kind)
+{
+	static const char* names[] = { "sweep", "trace", "trace threads" };
+	// code-like memory: mostly loads, stores, jumps and branches
+	static const uint8_t ops[] = { 0xA9, 0xAD, 0x8D, 0x20, 0x4C, 0x60, 0xD0, 0xF0, 0x10, 0xEA, 0xE8, 0x6C, 0x00 };
+
+	std::unique_ptr<TestBus> bus(new TestBus()), copy(new TestBus());
+	for (uint32_t i = 0; i < 0x10000; i++)
+		(*bus)[(uint16_t)i] = rng() % 2 ? ops[rng() % sizeof(ops)] : (uint8_t)rng();
+	std::vector<uint16_t> seeds = { 0xC000, 0x8000, 0x1234 };
+
+	Disassembly index(*bus);
+	Make(index, kind, seeds);
+	for (int round = 0; round < 40; round++)
+	{
+		// a few writes somewhere, a burst on one page
+		for (unsigned n = rng() % 8; n; n--)
+			bus->Write((uint16_t)rng(), rng() % 2 ? ops[rng() % sizeof(ops)] : (uint8_t)rng());
+		uint16_t page = (uint16_t)(rng() & 0xFF00);
+		for (unsigned n = rng() % 64; n; n--)
+			bus->Write(page | (rng() & 0xFF), ops[rng() % sizeof(ops)]);
+		index.Update();
+		// code found running somewhere the trace didn't get to
+		if (kind != Kind::Sweep && round % 8 == 7)
+		{
+			uint16_t pc = (uint16_t)rng();
+			if (!index.IsInstruction(pc))
+			{
+				index.Seed(pc);
+				seeds.push_back(pc);
+			}
+		}
+
+		for (uint32_t i = 0; i < 0x10000; i++)
+			(*copy)[(uint16_t)i] = (*bus)[(uint16_t)i];
+		Disassembly fresh(*copy);
+		Make(fresh, kind, seeds);
+		if (!Same(index, fresh))
+		{
+			printf("%s: round %d: the updated index differs from a new one\n", names[(int)kind], round);
+			return false;
+		}
+	}
+	return true;
+}
+
+// an undefined opcode two paths get to (both ways of a branch) stays data
+static bool DeadEnd()
+{
+	std::unique_ptr<TestBus> bus(new TestBus());
+	TestBus& b = *bus;
+	b[0xFFFC] = 0x00;
+	b[0xFFFD] = 0xC0;
+	b[0xC000] = 0x90;   // BCC $C002
+	b[0xC001] = 0x00;
+	b[0xC002] = 0x02;
+	for (unsigned threads : { 1u, 4u })
+	{
+		Disassembly index(b);
+		index.Trace({}, threads);
+		if (index.IsInstruction(0xC002) || !index.IsData(0xC002) || !index.IsInstruction(0xC000))
+		{
+			printf("undefined opcode reached twice: %s\n", index.Text(0xC002).c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
+int main()
+{
+	std::mt19937 rng(7);
+	bool ok = DeadEnd();
+	for (Kind kind : { Kind::Sweep, Kind::Trace, Kind::TraceThreads })
+		for (int i = 0; i < 5; i++)
+			ok = Run(rng, kind) && ok;
+	printf(ok ? "disassembly_test OK\n" : "disassembly_test FAILED\n");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,187 @@
+// Input record/replay (InputLog.h) on the block core: a loop reads a key device and stores what it gets, with
+// key bytes, IRQ and NMI pulses and resets recorded between batches. The replay has to land on the state
+// taken after the input of each batch at the same ticks, and a second replay in budgets of a few cycles must not run more
+// than one instruction past any of them and still end on the recorded state.
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <random>
+#include <sstream>
+#include "Bus.h"
+#include "InputLog.h"
+
+class KeyDevice : public Device
+{
+public:
+	std::deque<uint8_t> keys;
+
+	void Read(uint16_t addr, uint8_t& data) override
+	{
+		data = 0;
+		if ((addr & 0xFF) == 0x04 && !keys.empty())
+		{
+			data = keys.front();
+			keys.pop_front();
+		}
+	}
+	void Write(uint16_t, uint8_t&) override {}
+};
+
+class TestBus final : public BusT<TestBus>
+{
+public:
+	KeyDevice device;
+
+	TestBus() { MapDevice(0x30, 1, &device); }
+	void TickHandler() override {}
+};
+
+// hash of the registers, ticks and memory; not the keys waiting, Run() hands over the ones due at its end
+static uint64_t Fingerprint(TestBus& bus)
+{
+	std::vector<uint8_t> v;
+	StateWriter w(v);
+	Registers6502 r = bus.CPU.readRegisters();
+	w.u8(r.A);
+	w.u8(r.X);
+	w.u8(r.Y);
+	w.u8(r.SP);
+	w.u16(r.PC);
+	w.u8(bus.CPU.readFlags());
+	w.u64(bus.CPU.readTicksTotal());
+	for (uint32_t i = 0; i < 0x10000; i++)
+		v.push_back(bus.Peek((uint16_t)i));
+	uint64_t h = 1469598103934665603ull;
+	for (uint8_t c : v)
+		h = (h ^ c) * 1099511628211ull;
+	return h;
+}
+
+static void Load(TestBus& b, uint16_t at, std::initializer_list<uint8_t> bytes)
+{
+	for (uint8_t c : bytes)
+		b[at++] = c;
+}
+
+int main()
+{
+	std::unique_ptr<TestBus> bus(new TestBus());
+	TestBus& a = *bus;
+	// LDA $3004, STA $0400,X, INX, CLI, 24 x ADC #1, JMP $0200; IRQ and NMI count in $10 and $11
+	Load(a, 0x0200, { 0xAD, 0x04, 0x30, 0x9D, 0x00, 0x04, 0xE8, 0x58 });
+	for (uint16_t i = 0; i < 24; i++)
+		Load(a, (uint16_t)(0x0208 + i * 2), { 0x69, 0x01 });
+	Load(a, 0x0238, { 0x4C, 0x00, 0x02 });
+	Load(a, 0x0300, { 0xEE, 0x10, 0x00, 0x40 });
+	Load(a, 0x0310, { 0xEE, 0x11, 0x00, 0x40 });
+	Load(a, 0xFFFA, { 0x10, 0x03, 0x00, 0x02, 0x00, 0x03 });
+	a.core = Core::Block;
+	a.pins = a.CPU.reset();
+	a.pins.RES = true;
+	while (a.pins.RES)
+		a.CPU_Step();
+
+	std::mt19937 rng(7);
+	std::stringstream log;
+	std::vector<std::pair<uint64_t, uint64_t>> marks;     // ticks, fingerprint after the input of each batch
+	bool ok = true;
+	{
+		InputRecorder recorder(log, a);
+		for (int batch = 0; batch < 400; batch++)
+		{
+			if (rng() % 8 == 0)
+			{
+				recorder.Pin(a.CPU.readTicksTotal(), InputPin::IRQ, true);
+				a.pins.IRQ = true;
+				a.CPU_Step_Op();
+				recorder.Pin(a.CPU.readTicksTotal(), InputPin::IRQ, false);
+				a.pins.IRQ = false;
+			}
+			if (rng() % 20 == 0)
+			{
+				recorder.Pin(a.CPU.readTicksTotal(), InputPin::NMI, true);
+				a.pins.NMI = true;
+				a.CPU_Step_Op();
+				recorder.Pin(a.CPU.readTicksTotal(), InputPin::NMI, false);
+				a.pins.NMI = false;
+			}
+			if (rng() % 3 == 0)
+			{
+				uint8_t key = (uint8_t)rng();
+				recorder.Data(a.CPU.readTicksTotal(), 3, key);
+				a.device.keys.push_back(key);
+			}
+			if (rng() % 120 == 0)
+			{
+				recorder.Pin(a.CPU.readTicksTotal(), InputPin::RES, true);
+				a.pins = a.CPU.reset();
+			}
+			marks.push_back({ a.CPU.readTicksTotal(), Fingerprint(a) });
+			a.Run(100 + rng() % 2000);
+		}
+		std::streampos size = log.tellp();
+		if (recorder.Data(a.CPU.readTicksTotal(), 16, 0xFF) || log.tellp() != size)
+		{
+			printf("data channel 16 recorded\n");
+			ok = false;
+		}
+	}
+	const uint64_t end = a.CPU.readTicksTotal(), last = Fingerprint(a);
+	auto key = [](TestBus& b) { return [&b](uint8_t, uint8_t value) { b.device.keys.push_back(value); }; };
+
+	// on the recorded ticks
+	std::unique_ptr<TestBus> copy(new TestBus());
+	TestBus& b = *copy;
+	InputReplayer replayer(log);
+	if (!replayer.Start(b) || replayer.RecordedCore() != Core::Block)
+	{
+		printf("the log doesn't start\n");
+		return 1;
+	}
+	b.core = replayer.RecordedCore();
+	for (size_t i = 0; ok && i < marks.size(); i++)
+	{
+		uint64_t now = b.CPU.readTicksTotal();
+		uint64_t n = replayer.Run(b, marks[i].first - now, key(b));
+		if (b.CPU.readTicksTotal() != marks[i].first || n != marks[i].first - now || Fingerprint(b) != marks[i].second)
+		{
+			printf("batch %zu replays to %llu, recorded at %llu\n", i, (unsigned long long)b.CPU.readTicksTotal(),
+				(unsigned long long)marks[i].first);
+			ok = false;
+		}
+	}
+	replayer.Run(b, end - b.CPU.readTicksTotal(), key(b));
+	if (ok && Fingerprint(b) != last)
+	{
+		printf("the replay doesn't end on the recorded state\n");
+		ok = false;
+	}
+
+	// in small budgets, each one run over by an instruction at most
+	std::unique_ptr<TestBus> small(new TestBus());
+	TestBus& c = *small;
+	log.clear();
+	log.seekg(0);
+	InputReplayer again(log);
+	again.Start(c);
+	c.core = Core::Block;
+	while (ok && c.CPU.readTicksTotal() < end)
+	{
+		uint64_t now = c.CPU.readTicksTotal();
+		uint64_t budget = std::min<uint64_t>(1 + rng() % 60, end - now);
+		uint64_t n = again.Run(c, budget, key(c));
+		if (n != c.CPU.readTicksTotal() - now || n > budget + 7)
+		{
+			printf("a budget of %llu ran %llu cycles at %llu\n", (unsigned long long)budget, (unsigned long long)n,
+				(unsigned long long)now);
+			ok = false;
+		}
+	}
+	if (ok && (c.CPU.readTicksTotal() != end || Fingerprint(c) != last))
+	{
+		printf("the replay in small budgets doesn't end on the recorded state\n");
+		ok = false;
+	}
+	printf(ok ? "input_test OK\n" : "input_test FAILED\n");
+	return ok ? 0 : 1;
+}
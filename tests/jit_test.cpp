@@ -0,0 +1,82 @@
+// Recompiler (Core::Jit, Jit.h) against the cycle core, block by block on random memory with a device and
+// read-only pages, IRQ and NMI; memory that is mostly simple instructions gets the blocks hot enough to be
+// compiled. Once plain, once with verify on, which must not find a mismatch.
+#include <cstdio>
+#include <memory>
+#include "Compare.h"
+#include "Jit.h"
+
+static bool Run(std::mt19937& rng, bool verify)
+{
+	static const uint8_t simple[] = { 0xEA, 0xE8, 0xC8, 0xA9, 0x85, 0x95, 0x8D, 0x18, 0x69, 0xCA };
+
+	std::unique_ptr<ScrambleBus> a(new ScrambleBus()), b(new ScrambleBus());
+	a->core = Core::Cycle;
+	b->core = Core::Jit;
+	Jit& jit = b->GetJit();
+	jit.SetVerify(verify);
+	for (int run = 0; run < 40; run++)
+	{
+		FillRandom(rng, *a, *b);
+		for (uint32_t i = 0; i < 0x10000; i++)
+		{
+			if (rng() % 3)
+			{
+				uint8_t v = simple[rng() % sizeof(simple)];
+				(*a)[(uint16_t)i] = v;
+				(*b)[(uint16_t)i] = v;
+			}
+		}
+		b->FlushCode();
+		a->pins = a->CPU.reset();
+		b->pins = b->CPU.reset();
+		a->pins.RES = b->pins.RES = true;
+		while (a->pins.RES)
+			a->CPU_Step();
+		while (b->pins.RES)
+			b->CPU_Step();
+		for (int i = 0; i < 30000; i++)
+		{
+			if (rng() % 300 == 0)
+				a->pins.IRQ = b->pins.IRQ = true;
+			if (rng() % 1500 == 0)
+				a->pins.NMI = b->pins.NMI = true;
+			jit.Step();
+			while (a->CPU.readTicksTotal() < b->CPU.readTicksTotal())
+				a->CPU_Step_Op();
+			if (!SameCpu(*a, *b) || a->pins.ADDR != b->pins.ADDR)
+			{
+				printf("%s: run %d block %d: differs at cycle %llu, PC %04X/%04X\n", verify ? "verify" : "plain", run, i,
+					(unsigned long long)a->CPU.readTicksTotal(), a->CPU.readPC(), b->CPU.readPC());
+				return false;
+			}
+			a->pins.IRQ = b->pins.IRQ = a->pins.NMI = b->pins.NMI = false;
+		}
+		if (!SameMemory(*a, *b))
+		{
+			printf("%s: run %d: memory differs\n", verify ? "verify" : "plain", run);
+			return false;
+		}
+	}
+	const Jit::Stats& stats = jit.GetStats();
+	if (Jit::Supported() && !stats.compiled)
+	{
+		printf("%s: nothing compiled\n", verify ? "verify" : "plain");
+		return false;
+	}
+	if (stats.mismatches)
+	{
+		printf("verify: %llu mismatches\n", (unsigned long long)stats.mismatches);
+		return false;
+	}
+	return true;
+}
+
+int main()
+{
+	std::mt19937 rng(7);
+	bool ok = Run(rng, false);
+	ok = Run(rng, true) && ok;
+	printf(ok ? "jit_test OK\n" : "jit_test FAILED\n");
+	return ok ? 0 : 1;
+}
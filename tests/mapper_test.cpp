@@ -0,0 +1,166 @@
+// Mapper (Mapper.h): configs that don't fit the 64K are turned down without touching the bus, bank switching
+// through the control register leaves the memory under it alone, a device already on the control page keeps
+// its other registers and gets the page back when the mapper goes, and the fixed bank lands at the top.
+#include <cstdio>
+#include <memory>
+#include "Bus.h"
+#include "Mapper.h"
+
+class LatchDevice : public Device
+{
+public:
+	uint8_t latch = 0;
+	unsigned writes = 0;
+
+	void Read(uint16_t addr, uint8_t& data) override { if ((addr & 0xFF) == 0x10) data = latch; }
+	void Write(uint16_t addr, uint8_t& data) override { if ((addr & 0xFF) == 0x10) latch = data; writes++; }
+};
+
+class TestBus final : public BusT<TestBus>
+{
+public:
+	LatchDevice device;
+
+	TestBus() { MapDevice(0x70, 1, &device); }
+	void TickHandler() override {}
+};
+
+static bool Configs()
+{
+	struct Case
+	{
+		MapperType type;
+		uint8_t window, pages;
+		uint16_t control, ram_banks;
+		bool good;
+	};
+	static const Case cases[] = {
+		{ MapperType::RamWindow, 0x80, 0x20, 0x7000, 4, true },
+		{ MapperType::RamWindow, 0x80, 0x00, 0x7000, 4, false },    // empty window
+		{ MapperType::RamWindow, 0x80, 0x20, 0x7000, 0, false },    // no banks
+		{ MapperType::RamWindow, 0x80, 0x20, 0x8000, 4, false },    // control in the window
+		{ MapperType::RamWindow, 0x80, 0x20, 0x9FFF, 4, false },
+		{ MapperType::RomWindow, 0xC0, 0x40, 0x7000, 4, true },     // up to the last page
+		{ MapperType::RomWindow, 0xC1, 0x40, 0x7000, 4, false },
+		{ MapperType::RomWindowFixedLast, 0xC0, 0x40, 0x7000, 4, false },   // fixed bank past the end
+		{ MapperType::RomWindowFixedLast, 0x80, 0x40, 0xC000, 4, false },   // control in the fixed bank
+		{ MapperType::RomWindowFixedLast, 0x80, 0x40, 0x7000, 4, true },
+	};
+
+	bool ok = true;
+	for (const Case& c : cases)
+	{
+		MapperConfig config;
+		config.type = c.type;
+		config.window = c.window;
+		config.pages = c.pages;
+		config.control = c.control;
+		config.ram_banks = c.ram_banks;
+		std::string error;
+		std::unique_ptr<TestBus> bus(new TestBus());
+		bool set = bus->SetMapper(config, std::vector<uint8_t>(0x10000, 0xEA));
+		if (Mapper::Check(config, error) != c.good || set != c.good || (!c.good && (error.empty() || bus->GetMapper())))
+		{
+			printf("window %02X+%02X control %04X: %s\n", c.window, c.pages, c.control, c.good ? "turned down" : "taken");
+			ok = false;
+		}
+	}
+	// an empty ROM is one bank of $FF
+	MapperConfig rom;
+	rom.type = MapperType::RomWindow;
+	std::unique_ptr<TestBus> bus(new TestBus());
+	if (!bus->SetMapper(rom) || bus->GetMapper()->Banks() != 1 || bus->Read(0x8000) != 0xFF)
+	{
+		printf("empty ROM isn't a bank of $FF\n");
+		ok = false;
+	}
+	return ok;
+}
+
+static bool Control()
+{
+	std::unique_ptr<TestBus> bus(new TestBus());
+	TestBus& b = *bus;
+	b[0x7000] = 0x5A;
+	MapperConfig config;
+	config.type = MapperType::RamWindow;
+	config.window = 0x80;
+	config.pages = 0x20;
+	config.control = 0x7000;
+	if (!b.SetMapper(config))
+	{
+		printf("RAM window turned down\n");
+		return false;
+	}
+
+	bool ok = true;
+	for (unsigned bank = 0; bank < 4; bank++)
+	{
+		b.Write(0x7000, (uint8_t)bank);
+		b.Write(0x8000, (uint8_t)(0x40 + bank));
+	}
+	for (unsigned bank = 0; bank < 4; bank++)
+	{
+		b.Write(0x7000, (uint8_t)bank);
+		if (b.Read(0x8000) != 0x40 + bank || b.GetMapper()->Bank() != bank)
+		{
+			printf("bank %u reads %02X\n", bank, b.Read(0x8000));
+			ok = false;
+		}
+	}
+	if (b[0x7000] != 0x5A)
+	{
+		printf("the control write went to memory\n");
+		ok = false;
+	}
+
+	// the device keeps its register next to the control one, and the page after the mapper
+	b.Write(0x7010, 0x33);
+	if (b.Read(0x7010) != 0x33 || b.device.latch != 0x33)
+	{
+		printf("the device on the control page doesn't get its writes\n");
+		ok = false;
+	}
+	b.SetMapper(MapperConfig());
+	unsigned writes = b.device.writes;
+	b.Write(0x7000, 0x01);
+	if (b.device.writes != writes + 1 || b[0x7000] != 0x01)
+	{
+		printf("the device doesn't get the page back\n");
+		ok = false;
+	}
+	return ok;
+}
+
+static bool FixedLast()
+{
+	std::vector<uint8_t> image(4 * 0x4000);
+	for (size_t i = 0; i < image.size(); i++)
+		image[i] = (uint8_t)(i / 0x4000);
+	MapperConfig config;
+	config.type = MapperType::RomWindowFixedLast;
+	config.window = 0x80;
+	config.pages = 0x40;
+	config.control = 0x7000;
+
+	std::unique_ptr<TestBus> bus(new TestBus());
+	TestBus& b = *bus;
+	bool ok = b.SetMapper(config, image);
+	for (unsigned bank = 0; ok && bank < 4; bank++)
+	{
+		b.Write(0x7000, (uint8_t)bank);
+		ok = b.Read(0x8000) == bank && b.Read(0xBFFF) == bank && b.Read(0xC000) == 3 && b.Read(0xFFFF) == 3;
+	}
+	if (!ok)
+		printf("the fixed bank isn't the last one\n");
+	return ok;
+}
+
+int main()
+{
+	bool ok = Configs();
+	ok = Control() && ok;
+	ok = FixedLast() && ok;
+	printf(ok ? "mapper_test OK\n" : "mapper_test FAILED\n");
+	return ok ? 0 : 1;
+}
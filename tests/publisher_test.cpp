@@ -0,0 +1,132 @@
+// Publisher (Publisher.h) under load: a CPU thread runs batches of random length and publishes after each one,
+// the UI thread takes snapshots as fast as it can and checks each is whole. The program increments a counter
+// on each of 8 pages in turn at a fixed number of cycles per instruction, so the cycle count of a snapshot
+// tells exactly what its PC, registers and counters have to be; a torn snapshot or a page copied from the
+// wrong batch shows. The disassembly listing has to be there with the PC line on the PC.
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <thread>
+#include "Bus.h"
+#include "Disassembly.h"
+#include "Publisher.h"
+
+class TestBus final : public BusT<TestBus>
+{
+public:
+	void TickHandler() override {}
+};
+
+static const uint16_t Loop = 0xC000;
+static const int Counters = 8;
+static const uint64_t LoopCycles = Counters * 6 + 3;    // INC abs, then JMP abs
+
+static uint16_t Counter(int i) { return (uint16_t)(0x1010 + i * 0x0900); }
+
+// what the snapshot has to hold, from the cycles run since the loop started
+static bool Check(const MachineView& v, uint64_t start, uint8_t base, char* why)
+{
+	uint64_t d = v.ticks - start;
+	uint64_t k = d / LoopCycles, r = d % LoopCycles;
+	if (r % 6 != 0 || r > Counters * 6)
+		return sprintf(why, "%llu cycles into the loop", (unsigned long long)r), false;
+	int done = (int)(r / 6);
+	if (v.pc != Loop + done * 3 || v.regs.PC != v.pc)
+		return sprintf(why, "PC %04X after %d INCs", v.pc, done), false;
+	for (int i = 0; i < Counters; i++)
+	{
+		uint8_t expect = (uint8_t)(base + k + (i < done ? 1 : 0));
+		if (v.memory[Counter(i)] != expect)
+			return sprintf(why, "counter %d is %02X, not %02X", i, v.memory[Counter(i)], expect), false;
+	}
+	if (!v.code_lines || v.code_pc >= v.code_lines || v.code[v.code_pc].addr != v.pc || v.code[v.code_pc].data)
+		return sprintf(why, "no listing at the PC"), false;
+	return true;
+}
+
+int main()
+{
+	std::unique_ptr<TestBus> bus(new TestBus());
+	TestBus& b = *bus;
+	uint16_t a = Loop;
+	for (int i = 0; i < Counters; i++)
+	{
+		b[a++] = 0xEE;  // INC abs
+		b[a++] = (uint8_t)Counter(i);
+		b[a++] = (uint8_t)(Counter(i) >> 8);
+	}
+	b[a++] = 0x4C;      // JMP Loop
+	b[a++] = (uint8_t)Loop;
+	b[a++] = (uint8_t)(Loop >> 8);
+	b[0xFFFC] = (uint8_t)Loop;
+	b[0xFFFD] = (uint8_t)(Loop >> 8);
+
+	b.pins = b.CPU.reset();
+	b.pins.RES = true;
+	while (b.pins.RES)
+		b.CPU_Step();
+	b.core = Core::Instruction;
+	b.RunUntil([](TestBus& self) { return self.CPU.readPC() == Loop; });
+	const uint64_t start = b.CPU.readTicksTotal();
+	const uint8_t base = b[Counter(0)];
+
+	Disassembly code(b);
+	code.Trace();
+	Publisher publisher(b, &code);
+	publisher.Publish(true);
+
+	// the CPU thread runs until the UI has checked enough snapshots (both yield, for a single core)
+	const uint64_t wanted = 3000;
+	std::atomic<uint64_t> checked = { 0 };
+	std::atomic<bool> done = { false };
+	std::thread cpu([&]()
+	{
+		std::mt19937 rng(7);
+		for (int i = 0; i < 2000000 && checked < wanted; i++)
+		{
+			b.RunUntil([](TestBus&) { return false; }, 1 + rng() % 400);
+			publisher.Publish(i % 64 == 0);
+			std::this_thread::yield();
+		}
+		done = true;
+	});
+
+	bool ok = true;
+	uint64_t last_serial = 0, last_ticks = 0;
+	char why[100];
+	while (ok)
+	{
+		bool finished = done;
+		const MachineView& v = publisher.Latest();
+		if (v.serial < last_serial || v.ticks < last_ticks)
+		{
+			printf("snapshot %llu after %llu went back\n", (unsigned long long)v.serial, (unsigned long long)last_serial);
+			ok = false;
+		}
+		else if (v.serial != last_serial || !checked)
+		{
+			if (!Check(v, start, base, why))
+			{
+				printf("snapshot %llu at cycle %llu: %s\n", (unsigned long long)v.serial, (unsigned long long)v.ticks, why);
+				ok = false;
+			}
+			checked++;
+		}
+		last_serial = v.serial;
+		last_ticks = v.ticks;
+		if (finished)
+			break;
+		std::this_thread::yield();
+	}
+	if (!ok)
+		checked = wanted;
+	cpu.join();
+	if (ok && checked < wanted)
+	{
+		printf("only %llu snapshots taken\n", (unsigned long long)checked);
+		ok = false;
+	}
+	printf(ok ? "publisher_test OK\n" : "publisher_test FAILED\n");
+	return ok ? 0 : 1;
+}
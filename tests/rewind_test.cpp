@@ -0,0 +1,220 @@
+// Rewind (Rewind.h) round trips on every core, with and without a RAM bank mapper: the state after each
+// instruction is fingerprinted going forward, and StepBack(), JumpBack() and BackCycles() must land on
+// exactly those states again. Also long records, delta states after stepping back and a mapper change.
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <random>
+#include "Compare.h"
+#include "Mapper.h"
+#include "Rewind.h"
+#include "State.h"
+
+// hash of the CPU (all of it, or the registers only), pins, memory and mapper
+static uint64_t Fingerprint(ScrambleBus& bus, bool registers_only)
+{
+	std::vector<uint8_t> v;
+	StateWriter w(v);
+	if (registers_only)
+	{
+		Registers6502 r = bus.CPU.readRegisters();
+		w.u8(r.A);
+		w.u8(r.X);
+		w.u8(r.Y);
+		w.u8(r.SP);
+		w.u16(r.PC);
+		w.u8(bus.CPU.readFlags());
+		w.u64(bus.CPU.readTicksTotal());
+	}
+	else
+	{
+		bus.CPU.saveState(w);
+		w.pins(bus.pins);
+	}
+	for (uint32_t i = 0; i < 0x10000; i++)
+		v.push_back(bus[(uint16_t)i]);
+	if (Mapper* m = bus.GetMapper())
+	{
+		w.u32(m->Bank());
+		for (unsigned i = 0; i < m->RamPages(); i++)
+			w.bytes(m->RamPage(i), 256);
+	}
+	uint64_t h = 1469598103934665603ull;
+	for (uint8_t c : v)
+		h = (h ^ c) * 1099511628211ull;
+	return h;
+}
+
+static bool Run(std::mt19937& rng, Core core, bool banked)
+{
+	static const uint8_t simple[] = { 0xEA, 0xE8, 0xC8, 0xA9, 0x85, 0x95, 0x8D, 0x9D, 0x18, 0x69, 0xCA, 0x91 };
+	static const char* names[] = { "cycle", "mc", "instr", "block", "jit" };
+	const char* name = names[(int)core];
+
+	std::unique_ptr<ScrambleBus> bus(new ScrambleBus());
+	ScrambleBus& b = *bus;
+	MapperConfig mc;
+	mc.type = MapperType::RamWindow;
+	mc.window = 0x80;
+	mc.pages = 0x20;
+	mc.control = 0x7000;
+	b.SetMapper(banked ? mc : MapperConfig());
+	for (uint32_t i = 0; i < 0x10000; i++)
+		b[(uint16_t)i] = rng() % 3 ? simple[rng() % sizeof(simple)] : (uint8_t)rng();
+	b.FlushCode();
+	b.core = core;
+	b.pins = b.CPU.reset();
+	b.pins.RES = true;
+	while (b.pins.RES)
+		b.CPU_Step();
+
+	RewindConfig config;
+	config.keyframe_cycles = 3000;
+	config.max_bytes = 1 << 20;
+	Rewind rewind(b, config);
+
+	// step back instruction by instruction
+	std::vector<uint64_t> marks(1, Fingerprint(b, false));
+	std::map<uint64_t, uint64_t> by_ticks;
+	by_ticks[b.CPU.readTicksTotal()] = marks.back();
+	int n = 0;
+	b.RunUntil([&](ScrambleBus& self) {
+		rewind.Mark();
+		marks.push_back(Fingerprint(self, false));
+		by_ticks[self.CPU.readTicksTotal()] = marks.back();
+		return ++n >= 1500;
+	});
+	size_t k = marks.size() - 1;
+	int steps = 0;
+	while (steps < 2000 && rewind.StepBack())
+	{
+		k--;
+		steps++;
+		if (Fingerprint(b, false) != marks[k])
+		{
+			printf("%s%s: StepBack() %d differs\n", name, banked ? " banked" : "", steps);
+			return false;
+		}
+	}
+	if (!steps)
+	{
+		printf("%s%s: no history\n", name, banked ? " banked" : "");
+		return false;
+	}
+
+	// forward again, back by keyframes (maybe to one from the first run)
+	n = 0;
+	b.RunUntil([&](ScrambleBus& self) {
+		rewind.Mark();
+		by_ticks[self.CPU.readTicksTotal()] = Fingerprint(self, false);
+		return ++n >= 1500;
+	});
+	uint64_t end = b.CPU.readTicksTotal();
+	auto it = rewind.JumpBack(2) ? by_ticks.find(b.CPU.readTicksTotal()) : by_ticks.end();
+	if (it == by_ticks.end() || it->second != Fingerprint(b, false) || b.CPU.readTicksTotal() >= end)
+	{
+		printf("%s%s: JumpBack() differs\n", name, banked ? " banked" : "");
+		return false;
+	}
+
+	// back by cycles replays on the cycle core, whose internal state between instructions differs from the
+	// other cores: registers only then
+	bool registers_only = core != Core::Cycle;
+	by_ticks.clear();
+	n = 0;
+	b.RunUntil([&](ScrambleBus& self) {
+		rewind.Mark();
+		by_ticks[self.CPU.readTicksTotal()] = Fingerprint(self, registers_only);
+		return ++n >= 2000;
+	});
+	uint64_t now = b.CPU.readTicksTotal();
+	auto target = by_ticks.lower_bound(now - 1500);
+	if (!rewind.BackCycles(now - target->first) || b.CPU.readTicksTotal() != target->first
+		|| Fingerprint(b, registers_only) != target->second)
+	{
+		printf("%s%s: BackCycles() differs\n", name, banked ? " banked" : "");
+		return false;
+	}
+	if (rewind.Bytes() > config.max_bytes + 200000)
+	{
+		printf("%s%s: %zu bytes of history\n", name, banked ? " banked" : "", rewind.Bytes());
+		return false;
+	}
+	return true;
+}
+
+// more than 65535 writes between two marks, a delta state taken after stepping back over writes saved before,
+// and a new mapper dropping the history
+static bool Edges()
+{
+	std::unique_ptr<ScrambleBus> bus(new ScrambleBus());
+	ScrambleBus& b = *bus;
+	static const uint8_t loop[] = { 0xEE, 0x00, 0x03, 0xE8, 0x9D, 0x00, 0x04, 0x4C, 0x00, 0x02 };  // INC $0300, INX, STA $0400,X, JMP $0200
+	for (unsigned i = 0; i < sizeof(loop); i++)
+		b[(uint16_t)(0x0200 + i)] = loop[i];
+	b.core = Core::Instruction;
+	b.pins = b.CPU.forceJumpTo(0x0200);
+
+	RewindConfig config;
+	config.keyframe_cycles = 1ull << 40;
+	config.max_bytes = 64 << 20;
+	Rewind rewind(b, config);
+	bool ok = true;
+
+	uint64_t before = Fingerprint(b, false);
+	int n = 0;
+	b.RunUntil([&](ScrambleBus&) { return ++n >= 4 * 40000; });
+	rewind.Mark();
+	if (!rewind.StepBack() || Fingerprint(b, false) != before)
+	{
+		printf("80000 writes in one record don't go back\n");
+		ok = false;
+	}
+
+	// state saved after some writes, then back over them: the delta has to bring the pages back
+	std::vector<uint64_t> marks;
+	n = 0;
+	b.RunUntil([&](ScrambleBus& self) {
+		rewind.Mark();
+		marks.push_back(Fingerprint(self, false));
+		return ++n >= 400;
+	});
+	std::vector<uint8_t> full, delta;
+	b.SaveState(full);
+	for (int i = 0; i < 200; i++)
+		rewind.StepBack();
+	b.SaveState(delta, StateKind::Delta);
+	std::unique_ptr<ScrambleBus> copy(new ScrambleBus());
+	if (!copy->LoadState(full.data(), full.size()) || !copy->LoadState(delta.data(), delta.size())
+		|| Fingerprint(*copy, false) != Fingerprint(b, false))
+	{
+		printf("delta after StepBack() misses the pages put back\n");
+		ok = false;
+	}
+
+	MapperConfig mc;
+	mc.type = MapperType::RamWindow;
+	mc.window = 0x80;
+	mc.pages = 0x20;
+	mc.control = 0x7000;
+	b.SetMapper(mc);
+	if (rewind.StepBack())
+	{
+		printf("history kept over a new mapper\n");
+		ok = false;
+	}
+	return ok;
+}
+
+int main()
+{
+	std::mt19937 rng(7);
+	bool ok = Edges();
+	for (Core core : { Core::Cycle, Core::Microcode, Core::Instruction, Core::Block, Core::Jit })
+	{
+		ok = Run(rng, core, false) && ok;
+		ok = Run(rng, core, true) && ok;
+	}
+	printf(ok ? "rewind_test OK\n" : "rewind_test FAILED\n");
+	return ok ? 0 : 1;
+}
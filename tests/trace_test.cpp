@@ -0,0 +1,204 @@
+// Bus trace (Trace.h): cycles written through TraceWriter::Record() come back from TraceReader the same, in
+// order and by record number, with held cycles and jumps of ticks_total both ways across small chunks. An
+// index entry whose offset wraps around when added to has to be turned down, the chunks are walked then.
+// CompareTraces() finds a single changed cycle at its record, skipping the chunks before it unread, and tells
+// a trace that is a prefix of the other.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+#include "State.h"
+#include "Trace.h"
+
+static const uint32_t ChunkCycles = 1000;
+
+static std::string TempPath(const char* name)
+{
+	const char* dir = std::getenv("TEST_TMPDIR");
+	return std::string(dir ? dir : "/tmp") + "/" + name;
+}
+
+static bool SameCycle(const TraceCycle& a, const TraceCycle& b)
+{
+	const Pins& p = a.pins;
+	const Pins& q = b.pins;
+	return a.cycle == b.cycle && a.held == b.held && p.ADDR == q.ADDR && p.DATA == q.DATA && p.RW == q.RW
+		&& p.SYNC == q.SYNC && p.IRQ == q.IRQ && p.NMI == q.NMI && p.RDY == q.RDY && p.RES == q.RES;
+}
+
+// cycles as a run loop would record them, held ones and jumps included; held is what the reader gives back:
+// the first cycle of a chunk isn't held, whatever came before it
+static std::vector<TraceCycle> Cycles(std::mt19937& rng, size_t count)
+{
+	std::vector<TraceCycle> out;
+	uint64_t ticks = 1000;
+	uint16_t addr = 0xC000;
+	size_t in_chunk = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		TraceCycle c = {};
+		bool held = i && rng() % 30 == 0;
+		if (i && !held)
+		{
+			ticks++;
+			if (rng() % 2000 == 0)
+				ticks = rng() % 2 ? ticks + rng() % 1000000 : ticks - rng() % (ticks - 1);
+		}
+		bool consecutive = i && ticks == out.back().cycle + 1;
+		if (i && ticks == out.back().cycle && in_chunk < ChunkCycles)
+			c.held = true;
+		else if (!consecutive || in_chunk == ChunkCycles)
+			in_chunk = 0;
+		in_chunk++;
+
+		addr = rng() % 8 ? (uint16_t)(addr + rng() % 5) : (uint16_t)rng();
+		c.cycle = ticks;
+		c.pins.ADDR = addr;
+		c.pins.DATA = (uint8_t)rng();
+		c.pins.RW = rng() % 4 != 0;
+		c.pins.SYNC = rng() % 3 == 0;
+		c.pins.RDY = held;
+		c.pins.IRQ = rng() % 50 == 0;
+		c.pins.NMI = rng() % 100 == 0;
+		out.push_back(c);
+	}
+	return out;
+}
+
+static bool Write(const std::string& path, const std::vector<TraceCycle>& cycles)
+{
+	TraceWriter w;
+	if (!w.Open(path.c_str(), ChunkCycles))
+	{
+		printf("%s\n", w.Error().c_str());
+		return false;
+	}
+	for (const TraceCycle& c : cycles)
+		w.Record(c.cycle, c.pins);
+	if (!w.Close())
+	{
+		printf("%s\n", w.Error().c_str());
+		return false;
+	}
+	return true;
+}
+
+// all of it in order, then records picked at random
+static bool Read(const std::string& path, const std::vector<TraceCycle>& cycles, std::mt19937& rng, const char* what)
+{
+	TraceReader r;
+	if (!r.Open(path.c_str()))
+	{
+		printf("%s: %s\n", what, r.Error().c_str());
+		return false;
+	}
+	if (r.Cycles() != cycles.size())
+	{
+		printf("%s: %llu cycles, %zu written\n", what, (unsigned long long)r.Cycles(), cycles.size());
+		return false;
+	}
+	TraceCycle c;
+	size_t n = 0;
+	while (r.Next(c))
+	{
+		if (n >= cycles.size() || !SameCycle(c, cycles[n]))
+		{
+			printf("%s: record %zu differs (cycle %llu)\n", what, n, (unsigned long long)c.cycle);
+			return false;
+		}
+		n++;
+	}
+	if (n != cycles.size())
+	{
+		printf("%s: %zu records read back\n", what, n);
+		return false;
+	}
+	for (int i = 0; i < 200; i++)
+	{
+		size_t at = rng() % cycles.size();
+		if (!r.SeekRecord(at) || !r.Next(c) || !SameCycle(c, cycles[at]))
+		{
+			printf("%s: record %zu differs after SeekRecord()\n", what, at);
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool Compare(const std::string& path, std::vector<TraceCycle> cycles, size_t changed)
+{
+	std::string other = TempPath("trace_test_other.65tr");
+	cycles[changed].pins.DATA ^= 0x10;
+	bool ok = Write(other, cycles);
+	TraceReader a, b;
+	ok = ok && a.Open(path.c_str()) && b.Open(other.c_str());
+
+	// the chunks before the one holding the changed cycle match by hash
+	uint64_t before = 0, skipped = 0;
+	for (const TraceChunk& c : a.Chunks())
+	{
+		if (before + c.cycles > changed)
+			break;
+		before += c.cycles;
+		skipped++;
+	}
+	TraceMismatch m;
+	if (ok && (CompareTraces(a, b, m) != TraceDiff::Differ || m.record != changed || m.cycle != cycles[changed].cycle
+		|| m.a_ended || m.b_ended || m.chunks_skipped != skipped))
+	{
+		printf("record %zu changed: found at %llu (cycle %llu), %llu chunks skipped\n", changed,
+			(unsigned long long)m.record, (unsigned long long)m.cycle, (unsigned long long)m.chunks_skipped);
+		ok = false;
+	}
+	if (ok && (CompareTraces(a, a, m) != TraceDiff::Same || m.chunks_skipped != a.Chunks().size()))
+	{
+		printf("a trace differs from itself\n");
+		ok = false;
+	}
+
+	// the same cycles cut short after the changed one is a prefix from there on
+	cycles.resize(changed);
+	ok = ok && Write(other, cycles) && b.Open(other.c_str());
+	if (ok && (CompareTraces(a, b, m) != TraceDiff::Differ || !m.b_ended || m.a_ended || m.record != changed))
+	{
+		printf("a trace cut at %zu isn't a prefix\n", changed);
+		ok = false;
+	}
+	std::remove(other.c_str());
+	return ok;
+}
+
+int main()
+{
+	std::mt19937 rng(7);
+	std::vector<TraceCycle> cycles = Cycles(rng, 200000);
+	std::string path = TempPath("trace_test.65tr");
+	bool ok = Write(path, cycles) && Read(path, cycles, rng, "round trip");
+
+	// the first index entry pointing just short of 2^64: offset + header + bytes wraps around to a small number
+	if (ok)
+	{
+		std::ifstream in(path, std::ios::binary);
+		std::vector<uint8_t> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		StateReader footer(file.data() + file.size() - 16, 16);
+		uint64_t index = footer.u64();
+		std::vector<uint8_t> offset;
+		StateWriter w(offset);
+		w.u64(~(uint64_t)0 - 27);
+		std::copy(offset.begin(), offset.end(), file.begin() + (size_t)index + 28);
+		std::string damaged = TempPath("trace_test_index.65tr");
+		std::ofstream(damaged, std::ios::binary).write((const char*)file.data(), file.size());
+		ok = Read(damaged, cycles, rng, "wrapping index");
+		std::remove(damaged.c_str());
+	}
+
+	ok = ok && Compare(path, cycles, 123456);
+
+	std::remove(path.c_str());
+	printf(ok ? "trace_test OK\n" : "trace_test FAILED\n");
+	return ok ? 0 : 1;
+}
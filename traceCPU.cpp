@@ -0,0 +1,262 @@
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "mos6502.h"
+#include "Trace.h"
+
+//
+// Bus trace tool (Trace.h): summary, decoded cycles, first difference of two traces, import of text logs
+//
+
+static void usage()
+{
+	std::cerr <<
+		"usage: traceCPU info <trace>\n"
+		"       traceCPU dump <trace> [--from CYCLE] [--count N]\n"
+		"       traceCPU diff <trace a> <trace b> [--window N]\n"
+		"       traceCPU import <log> <trace> [--first CYCLE]\n"
+		"  --from CYCLE     first cycle to print (default: the start of the trace)\n"
+		"  --count N        cycles to print (default 64)\n"
+		"  --window N       cycles printed before and after the difference (default 8)\n"
+		"  --first CYCLE    cycle number of the first line of the log (default 0)\n"
+		"import reads one cycle per line, hex fields: ADDR DATA R|W [SYNC], SYNC is 1/0 (or s/-),\n"
+		"empty lines and lines starting with # are skipped\n";
+}
+
+static const char* hex(unsigned v, int digits)
+{
+	static char buf[8];
+	std::snprintf(buf, sizeof(buf), "%0*X", digits, v);
+	return buf;
+}
+
+// one cycle, opcode fetches with the mnemonic and the operand bytes read right after them
+static std::string describe(const std::vector<TraceCycle>& w, size_t i)
+{
+	if (i >= w.size())
+		return "";
+	const TraceCycle& c = w[i];
+	char line[96];
+	std::snprintf(line, sizeof(line), "%10llu%c %04X %02X %c%c%c%c%c", (unsigned long long)c.cycle, c.held ? '*' : ' ',
+		c.pins.ADDR, c.pins.DATA, c.pins.RW ? 'R' : 'W', c.pins.SYNC ? 'S' : ' ', c.pins.IRQ ? 'I' : ' ',
+		c.pins.NMI ? 'N' : ' ', c.pins.RES ? 'X' : c.pins.RDY ? 'H' : ' ');
+	std::string s = line;
+	s.erase(s.find_last_not_of(' ') + 1);
+	if (c.pins.SYNC)
+	{
+		s += std::string(" ") + mos6502::Mnemonic(c.pins.DATA);
+		unsigned len = mos6502::Length(c.pins.DATA);
+		for (unsigned k = 1; k < len; k++)
+		{
+			// operand fetches follow the opcode fetch, held cycles may come in between
+			size_t j = i + 1;
+			while (j < w.size() && (w[j].held || w[j].pins.ADDR != (uint16_t)(c.pins.ADDR + k)) && j < i + 4)
+				j++;
+			if (j < w.size() && w[j].pins.ADDR == (uint16_t)(c.pins.ADDR + k))
+				s += std::string(" ") + hex(w[j].pins.DATA, 2);
+			else
+				s += " ??";
+		}
+	}
+	return s;
+}
+
+static bool window(TraceReader& r, uint64_t from, size_t count, std::vector<TraceCycle>& w)
+{
+	w.clear();
+	if (!r.SeekRecord(from))
+		return false;
+	TraceCycle c;
+	while (w.size() < count && r.Next(c))
+		w.push_back(c);
+	return true;
+}
+
+static int info(const char* path)
+{
+	TraceReader r;
+	if (!r.Open(path))
+	{
+		std::cerr << r.Error() << "\n";
+		return 1;
+	}
+	const std::vector<TraceChunk>& chunks = r.Chunks();
+	uint64_t bytes = 0;
+	for (const TraceChunk& c : chunks)
+		bytes += c.bytes;
+	std::printf("{\n");
+	std::printf("  \"chunks\": %zu,\n", chunks.size());
+	std::printf("  \"cycles\": %llu,\n", (unsigned long long)r.Cycles());
+	if (!chunks.empty())
+	{
+		std::printf("  \"first_cycle\": %llu,\n", (unsigned long long)chunks.front().first);
+		std::printf("  \"last_cycle\": %llu,\n", (unsigned long long)(chunks.back().first + chunks.back().ticks - 1));
+	}
+	std::printf("  \"bytes_per_cycle\": %.3f\n", r.Cycles() ? (double)bytes / r.Cycles() : 0.0);
+	std::printf("}\n");
+	return 0;
+}
+
+static int dump(const char* path, bool from_set, uint64_t from, size_t count)
+{
+	TraceReader r;
+	if (!r.Open(path) || (from_set && !r.Seek(from)))
+	{
+		std::cerr << r.Error() << "\n";
+		return 1;
+	}
+	std::vector<TraceCycle> w;
+	TraceCycle c;
+	// a few more for the operands of the last instruction
+	while (w.size() < count + 3 && r.Next(c))
+		w.push_back(c);
+	for (size_t i = 0; i < std::min(count, w.size()); i++)
+		std::printf("%s\n", describe(w, i).c_str());
+	return r.Error().empty() ? 0 : 1;
+}
+
+static int diff(const char* path_a, const char* path_b, size_t around)
+{
+	TraceReader a, b;
+	if (!a.Open(path_a))
+	{
+		std::cerr << a.Error() << "\n";
+		return 1;
+	}
+	if (!b.Open(path_b))
+	{
+		std::cerr << b.Error() << "\n";
+		return 1;
+	}
+
+	auto t0 = std::chrono::steady_clock::now();
+	TraceMismatch m;
+	TraceDiff d = CompareTraces(a, b, m);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	if (d == TraceDiff::Error)
+	{
+		std::cerr << (a.Error().empty() ? b.Error() : a.Error()) << "\n";
+		return 1;
+	}
+	if (d == TraceDiff::Same)
+	{
+		std::printf("same: %llu cycles, %llu chunks matched by hash, %.3f s\n", (unsigned long long)m.record,
+			(unsigned long long)m.chunks_skipped, seconds);
+		return 0;
+	}
+
+	std::printf("first difference at record %llu, cycle %llu (%llu chunks matched by hash, %.3f s)\n",
+		(unsigned long long)m.record, (unsigned long long)m.cycle, (unsigned long long)m.chunks_skipped, seconds);
+	if (m.a_ended || m.b_ended)
+		std::printf("%s ends there\n", m.a_ended ? path_a : path_b);
+
+	uint64_t from = m.record > around ? m.record - around : 0;
+	size_t count = (size_t)(m.record - from) + around + 1;
+	std::vector<TraceCycle> wa, wb;
+	window(a, from, count + 3, wa);
+	window(b, from, count + 3, wb);
+	for (size_t i = 0; i < count && (i < wa.size() || i < wb.size()); i++)
+	{
+		std::string la = describe(wa, i), lb = describe(wb, i);
+		bool differ = i >= wa.size() || i >= wb.size() || la != lb;
+		std::printf("%c %-44s | %s\n", from + i == m.record ? '>' : differ ? '!' : ' ', la.c_str(), lb.c_str());
+	}
+	return 2;
+}
+
+static int import(const char* log, const char* path, uint64_t first)
+{
+	std::ifstream in(log);
+	if (!in.is_open())
+	{
+		std::cerr << "can't read " << log << "\n";
+		return 1;
+	}
+	TraceWriter w;
+	if (!w.Open(path))
+	{
+		std::cerr << w.Error() << "\n";
+		return 1;
+	}
+
+	std::string line;
+	unsigned number = 0;
+	uint64_t cycle = first;
+	while (std::getline(in, line))
+	{
+		number++;
+		char addr[16], data[16], rw[16], sync[16] = "0";
+		int fields = std::sscanf(line.c_str(), "%15s %15s %15s %15s", addr, data, rw, sync);
+		if (fields <= 0 || addr[0] == '#')
+			continue;
+		char r = rw[0] | 0x20;
+		if (fields < 3 || (r != 'r' && r != 'w' && r != '0' && r != '1'))
+		{
+			std::cerr << log << ": line " << number << ": expected ADDR DATA R|W [SYNC]\n";
+			return 1;
+		}
+		Pins p = {};
+		p.ADDR = (uint16_t)std::strtoul(addr, nullptr, 16);
+		p.DATA = (uint8_t)std::strtoul(data, nullptr, 16);
+		p.RW = r == 'r' || r == '1';
+		p.SYNC = sync[0] == '1' || (sync[0] | 0x20) == 's';
+		w.Record(cycle++, p);
+	}
+	if (!w.Close())
+	{
+		std::cerr << w.Error() << "\n";
+		return 1;
+	}
+	std::printf("%llu cycles\n", (unsigned long long)(cycle - first));
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<const char*> files;
+	bool from_set = false;
+	uint64_t from = 0, first = 0;
+	size_t count = 64, around = 8;
+	for (int i = 2; i < argc; i++)
+	{
+		std::string a = argv[i];
+		bool has_value = i + 1 < argc;
+		if (a == "--from" && has_value)
+		{
+			from = std::strtoull(argv[++i], nullptr, 10);
+			from_set = true;
+		}
+		else if (a == "--count" && has_value)
+			count = (size_t)std::strtoull(argv[++i], nullptr, 10);
+		else if (a == "--window" && has_value)
+			around = (size_t)std::strtoull(argv[++i], nullptr, 10);
+		else if (a == "--first" && has_value)
+			first = std::strtoull(argv[++i], nullptr, 10);
+		else if (a[0] != '-')
+			files.push_back(argv[i]);
+		else
+		{
+			usage();
+			return 1;
+		}
+	}
+
+	std::string cmd = argc > 1 ? argv[1] : "";
+	if (cmd == "info" && files.size() == 1)
+		return info(files[0]);
+	if (cmd == "dump" && files.size() == 1)
+		return dump(files[0], from_set, from, count);
+	if (cmd == "diff" && files.size() == 2)
+		return diff(files[0], files[1], around);
+	if (cmd == "import" && files.size() == 2)
+		return import(files[0], files[1], first);
+	usage();
+	return 1;
+}